@@ -30,8 +30,9 @@ int APIENTRY WinMain(_In_ HINSTANCE hInstance, _In_opt_  HINSTANCE hPrevInstance
 	vulkanExample->setupWindow(hInstance, WndProc);													\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -68,8 +69,9 @@ int main(const int argc, const char *argv[])													    \
 	vulkanExample->initVulkan();																	\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 
 #elif defined(VK_USE_PLATFORM_DIRECTFB_EXT)
@@ -93,8 +95,9 @@ int main(const int argc, const char *argv[])													    \
 	vulkanExample->setupWindow();					 												\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 
 #elif (defined(VK_USE_PLATFORM_WAYLAND_KHR) || defined(VK_USE_PLATFORM_HEADLESS_EXT))
@@ -111,8 +114,9 @@ int main(const int argc, const char *argv[])													    \
 	vulkanExample->setupWindow();					 												\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
@@ -136,8 +140,9 @@ int main(const int argc, const char *argv[])													    \
 	vulkanExample->setupWindow();					 												\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 
 #elif (defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT))
@@ -149,6 +154,7 @@ int main(const int argc, const char *argv[])													    \
 VulkanExample *vulkanExample;																		\
 int main(const int argc, const char *argv[])														\
 {																									\
+	int exitCode = 0;																				\
 	@autoreleasepool																				\
 	{																								\
 		for (size_t i = 0; i < argc; i++) { VulkanExample::args.push_back(argv[i]); };				\
@@ -157,9 +163,10 @@ int main(const int argc, const char *argv[])														\
 		vulkanExample->setupWindow(nullptr);														\
 		vulkanExample->prepare();																	\
 		vulkanExample->renderLoop();																\
+		exitCode = vulkanExample->exitCode;															\
 		delete(vulkanExample);																		\
 	}																								\
-	return 0;																						\
+	return exitCode;																				\
 }
 #else
 #define VULKAN_EXAMPLE_MAIN()
@@ -179,7 +186,8 @@ int main(const int argc, const char *argv[])														\
 	vulkanExample->setupWindow();																	\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 #endif
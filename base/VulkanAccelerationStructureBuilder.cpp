@@ -0,0 +1,414 @@
+/*
+* Vulkan acceleration structure builder
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanAccelerationStructureBuilder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace vks
+{
+	void AccelerationStructureBuilder::init(vks::VulkanDevice* device)
+	{
+		this->device = device;
+		VkDevice logicalDevice = device->logicalDevice;
+		vkGetBufferDeviceAddressKHR = reinterpret_cast<PFN_vkGetBufferDeviceAddressKHR>(vkGetDeviceProcAddr(logicalDevice, "vkGetBufferDeviceAddressKHR"));
+		vkCreateAccelerationStructureKHR = reinterpret_cast<PFN_vkCreateAccelerationStructureKHR>(vkGetDeviceProcAddr(logicalDevice, "vkCreateAccelerationStructureKHR"));
+		vkDestroyAccelerationStructureKHR = reinterpret_cast<PFN_vkDestroyAccelerationStructureKHR>(vkGetDeviceProcAddr(logicalDevice, "vkDestroyAccelerationStructureKHR"));
+		vkGetAccelerationStructureBuildSizesKHR = reinterpret_cast<PFN_vkGetAccelerationStructureBuildSizesKHR>(vkGetDeviceProcAddr(logicalDevice, "vkGetAccelerationStructureBuildSizesKHR"));
+		vkGetAccelerationStructureDeviceAddressKHR = reinterpret_cast<PFN_vkGetAccelerationStructureDeviceAddressKHR>(vkGetDeviceProcAddr(logicalDevice, "vkGetAccelerationStructureDeviceAddressKHR"));
+		vkCmdBuildAccelerationStructuresKHR = reinterpret_cast<PFN_vkCmdBuildAccelerationStructuresKHR>(vkGetDeviceProcAddr(logicalDevice, "vkCmdBuildAccelerationStructuresKHR"));
+		vkCmdWriteAccelerationStructuresPropertiesKHR = reinterpret_cast<PFN_vkCmdWriteAccelerationStructuresPropertiesKHR>(vkGetDeviceProcAddr(logicalDevice, "vkCmdWriteAccelerationStructuresPropertiesKHR"));
+		vkCmdCopyAccelerationStructureKHR = reinterpret_cast<PFN_vkCmdCopyAccelerationStructureKHR>(vkGetDeviceProcAddr(logicalDevice, "vkCmdCopyAccelerationStructureKHR"));
+
+		// Scratch addresses of the builds need to be aligned to this
+		VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties{};
+		accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+		VkPhysicalDeviceProperties2 deviceProperties2{};
+		deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		deviceProperties2.pNext = &accelerationStructureProperties;
+		vkGetPhysicalDeviceProperties2(device->physicalDevice, &deviceProperties2);
+		scratchAlignment = std::max<VkDeviceSize>(accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+	}
+
+	void AccelerationStructureBuilder::addBottomLevel(AccelerationStructure* target, const std::vector<VkAccelerationStructureGeometryKHR>& geometries, const std::vector<VkAccelerationStructureBuildRangeInfoKHR>& buildRanges, VkBuildAccelerationStructureFlagsKHR flags)
+	{
+		assert(geometries.size() == buildRanges.size());
+		BuildRequest request{};
+		request.target = target;
+		request.geometries = geometries;
+		request.buildRanges = buildRanges;
+		request.flags = flags;
+		requests.push_back(request);
+	}
+
+	uint64_t AccelerationStructureBuilder::getBufferDeviceAddress(VkBuffer buffer)
+	{
+		VkBufferDeviceAddressInfoKHR bufferDeviceAddressInfo{};
+		bufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+		bufferDeviceAddressInfo.buffer = buffer;
+		return vkGetBufferDeviceAddressKHR(device->logicalDevice, &bufferDeviceAddressInfo);
+	}
+
+	VkDeviceSize AccelerationStructureBuilder::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory)
+	{
+		VkBufferCreateInfo bufferCreateInfo{};
+		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferCreateInfo.size = size;
+		bufferCreateInfo.usage = usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &buffer));
+		VkMemoryRequirements memoryRequirements{};
+		vkGetBufferMemoryRequirements(device->logicalDevice, buffer, &memoryRequirements);
+		VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
+		memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+		memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+		VkMemoryAllocateInfo memoryAllocateInfo{};
+		memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memoryAllocateInfo.pNext = &memoryAllocateFlagsInfo;
+		memoryAllocateInfo.allocationSize = memoryRequirements.size;
+		memoryAllocateInfo.memoryTypeIndex = device->getMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memoryAllocateInfo, nullptr, &memory));
+		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, buffer, memory, 0));
+		return memoryRequirements.size;
+	}
+
+	void AccelerationStructureBuilder::createAccelerationStructureHandle(AccelerationStructure& accelerationStructure, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkAccelerationStructureTypeKHR type)
+	{
+		VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo{};
+		accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+		accelerationStructureCreateInfo.buffer = buffer;
+		accelerationStructureCreateInfo.offset = offset;
+		accelerationStructureCreateInfo.size = size;
+		accelerationStructureCreateInfo.type = type;
+		VK_CHECK_RESULT(vkCreateAccelerationStructureKHR(device->logicalDevice, &accelerationStructureCreateInfo, nullptr, &accelerationStructure.handle));
+
+		VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo{};
+		accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+		accelerationDeviceAddressInfo.accelerationStructure = accelerationStructure.handle;
+		accelerationStructure.deviceAddress = vkGetAccelerationStructureDeviceAddressKHR(device->logicalDevice, &accelerationDeviceAddressInfo);
+	}
+
+	VkDeviceSize AccelerationStructureBuilder::createAccelerationStructure(AccelerationStructure& accelerationStructure, VkDeviceSize size, VkAccelerationStructureTypeKHR type)
+	{
+		const VkDeviceSize memorySize = createBuffer(size, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, accelerationStructure.buffer, accelerationStructure.memory);
+		createAccelerationStructureHandle(accelerationStructure, accelerationStructure.buffer, 0, size, type);
+		return memorySize;
+	}
+
+	uint64_t AccelerationStructureBuilder::createScratchBuffer(VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& memory)
+	{
+		// The buffer's memory alignment may be lower than the required scratch alignment, so the start address is aligned manually
+		createBuffer(size + scratchAlignment, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, buffer, memory);
+		return vks::tools::alignedVkSize(getBufferDeviceAddress(buffer), scratchAlignment);
+	}
+
+	void AccelerationStructureBuilder::destroyAccelerationStructure(AccelerationStructure& accelerationStructure)
+	{
+		if (accelerationStructure.handle != VK_NULL_HANDLE) {
+			vkDestroyAccelerationStructureKHR(device->logicalDevice, accelerationStructure.handle, nullptr);
+		}
+		if (accelerationStructure.buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(device->logicalDevice, accelerationStructure.buffer, nullptr);
+		}
+		if (accelerationStructure.memory != VK_NULL_HANDLE) {
+			vkFreeMemory(device->logicalDevice, accelerationStructure.memory, nullptr);
+		}
+		accelerationStructure = {};
+	}
+
+	void AccelerationStructureBuilder::destroy()
+	{
+		for (auto& storage : sharedStorage) {
+			vkDestroyBuffer(device->logicalDevice, storage.buffer, nullptr);
+			vkFreeMemory(device->logicalDevice, storage.memory, nullptr);
+		}
+		sharedStorage.clear();
+	}
+
+	void AccelerationStructureBuilder::build(VkQueue queue, bool compact)
+	{
+		statistics = {};
+		if (requests.empty()) {
+			return;
+		}
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		const uint32_t count = static_cast<uint32_t>(requests.size());
+		statistics.count = count;
+
+		// Get the sizes and create the acceleration structures with their full build size
+		VkDeviceSize maxScratchSize = 0;
+		VkDeviceSize totalScratchSize = 0;
+		for (auto& request : requests) {
+			if (compact) {
+				request.flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+			}
+			VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
+			buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+			buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+			buildGeometryInfo.flags = request.flags;
+			buildGeometryInfo.geometryCount = static_cast<uint32_t>(request.geometries.size());
+			buildGeometryInfo.pGeometries = request.geometries.data();
+			std::vector<uint32_t> maxPrimitiveCounts(request.buildRanges.size());
+			for (size_t i = 0; i < request.buildRanges.size(); i++) {
+				maxPrimitiveCounts[i] = request.buildRanges[i].primitiveCount;
+			}
+			request.sizeInfo = {};
+			request.sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+			vkGetAccelerationStructureBuildSizesKHR(device->logicalDevice, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildGeometryInfo, maxPrimitiveCounts.data(), &request.sizeInfo);
+			statistics.memoryBeforeCompaction += createAccelerationStructure(*request.target, request.sizeInfo.accelerationStructureSize);
+			const VkDeviceSize scratchSize = vks::tools::alignedVkSize(request.sizeInfo.buildScratchSize, scratchAlignment);
+			maxScratchSize = std::max(maxScratchSize, scratchSize);
+			totalScratchSize += scratchSize;
+			statistics.unbatchedScratchSize += request.sizeInfo.buildScratchSize;
+		}
+
+		// Suballocate the scratch buffer, builds that don't fit into it anymore start a new batch that reuses the scratch memory
+		const VkDeviceSize scratchSize = std::max(std::min(totalScratchSize, scratchBudget), maxScratchSize);
+		std::vector<uint32_t> batchStarts;
+		VkDeviceSize scratchOffset = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			const VkDeviceSize size = vks::tools::alignedVkSize(requests[i].sizeInfo.buildScratchSize, scratchAlignment);
+			if (batchStarts.empty() || (scratchOffset + size > scratchSize)) {
+				batchStarts.push_back(i);
+				scratchOffset = 0;
+			}
+			requests[i].scratchOffset = scratchOffset;
+			scratchOffset += size;
+		}
+		batchStarts.push_back(count);
+		statistics.batchCount = static_cast<uint32_t>(batchStarts.size()) - 1;
+		statistics.scratchSize = scratchSize;
+
+		VkBuffer scratchBuffer;
+		VkDeviceMemory scratchMemory;
+		const uint64_t scratchAddress = createScratchBuffer(scratchSize, scratchBuffer, scratchMemory);
+
+		VkQueryPool queryPool{ VK_NULL_HANDLE };
+		if (compact) {
+			VkQueryPoolCreateInfo queryPoolCreateInfo{};
+			queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCreateInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+			queryPoolCreateInfo.queryCount = count;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolCreateInfo, nullptr, &queryPool));
+		}
+
+		// Builds within a batch write to separate parts of the scratch buffer and can overlap, batches are separated by a barrier
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+		memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		if (compact) {
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0, count);
+		}
+		for (size_t batch = 0; batch + 1 < batchStarts.size(); batch++) {
+			std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos;
+			std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> buildRangeInfos;
+			for (uint32_t i = batchStarts[batch]; i < batchStarts[batch + 1]; i++) {
+				VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
+				buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+				buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+				buildGeometryInfo.flags = requests[i].flags;
+				buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+				buildGeometryInfo.dstAccelerationStructure = requests[i].target->handle;
+				buildGeometryInfo.geometryCount = static_cast<uint32_t>(requests[i].geometries.size());
+				buildGeometryInfo.pGeometries = requests[i].geometries.data();
+				buildGeometryInfo.scratchData.deviceAddress = scratchAddress + requests[i].scratchOffset;
+				buildGeometryInfos.push_back(buildGeometryInfo);
+				buildRangeInfos.push_back(requests[i].buildRanges.data());
+			}
+			vkCmdBuildAccelerationStructuresKHR(commandBuffer, static_cast<uint32_t>(buildGeometryInfos.size()), buildGeometryInfos.data(), buildRangeInfos.data());
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+		std::vector<VkAccelerationStructureKHR> handles(count);
+		for (uint32_t i = 0; i < count; i++) {
+			handles[i] = requests[i].target->handle;
+		}
+		if (compact) {
+			vkCmdWriteAccelerationStructuresPropertiesKHR(commandBuffer, count, handles.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queryPool, 0);
+		}
+		device->flushCommandBuffer(commandBuffer, queue);
+
+		vkDestroyBuffer(device->logicalDevice, scratchBuffer, nullptr);
+		vkFreeMemory(device->logicalDevice, scratchMemory, nullptr);
+
+		statistics.memoryAfterCompaction = statistics.memoryBeforeCompaction;
+		if (compact) {
+			std::vector<VkDeviceSize> compactedSizes(count);
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device->logicalDevice, queryPool, 0, count, count * sizeof(VkDeviceSize), compactedSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+
+			// Copy into storage that only has the compacted size and release the original acceleration structures
+			// All compacted acceleration structures are placed in a single buffer instead of allocating memory for each of them
+			std::vector<VkDeviceSize> offsets(count);
+			VkDeviceSize storageSize = 0;
+			for (uint32_t i = 0; i < count; i++) {
+				offsets[i] = storageSize;
+				storageSize += vks::tools::alignedVkSize(compactedSizes[i], accelerationStructureOffsetAlignment);
+			}
+			SharedStorage storage{};
+			statistics.memoryAfterCompaction = createBuffer(storageSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, storage.buffer, storage.memory);
+			sharedStorage.push_back(storage);
+			std::vector<AccelerationStructure> compacted(count);
+			commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			for (uint32_t i = 0; i < count; i++) {
+				createAccelerationStructureHandle(compacted[i], storage.buffer, offsets[i], compactedSizes[i], VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR);
+				VkCopyAccelerationStructureInfoKHR copyInfo{};
+				copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+				copyInfo.src = requests[i].target->handle;
+				copyInfo.dst = compacted[i].handle;
+				copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+				vkCmdCopyAccelerationStructureKHR(commandBuffer, &copyInfo);
+			}
+			device->flushCommandBuffer(commandBuffer, queue);
+			for (uint32_t i = 0; i < count; i++) {
+				destroyAccelerationStructure(*requests[i].target);
+				*requests[i].target = compacted[i];
+			}
+		}
+
+		requests.clear();
+		statistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	}
+
+	void DynamicTopLevelAccelerationStructure::create(AccelerationStructureBuilder* builder, uint32_t maxInstanceCount, VkBuildAccelerationStructureFlagsKHR flags)
+	{
+		this->builder = builder;
+		this->maxInstanceCount = maxInstanceCount;
+		this->flags = flags | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+
+		VK_CHECK_RESULT(builder->device->createBuffer(
+			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&instanceBuffer,
+			maxInstanceCount * sizeof(VkAccelerationStructureInstanceKHR)));
+		VK_CHECK_RESULT(instanceBuffer.map());
+		instances = static_cast<VkAccelerationStructureInstanceKHR*>(instanceBuffer.mapped);
+
+		// Sized for the maximum instance count, so changing the number of instances only needs a rebuild
+		VkAccelerationStructureGeometryKHR geometry{};
+		geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+		geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+		geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+		geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+		geometry.geometry.instances.arrayOfPointers = VK_FALSE;
+		VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
+		buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+		buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+		buildGeometryInfo.flags = this->flags;
+		buildGeometryInfo.geometryCount = 1;
+		buildGeometryInfo.pGeometries = &geometry;
+		VkAccelerationStructureBuildSizesInfoKHR sizeInfo{};
+		sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+		builder->vkGetAccelerationStructureBuildSizesKHR(builder->device->logicalDevice, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildGeometryInfo, &maxInstanceCount, &sizeInfo);
+
+		builder->createAccelerationStructure(accelerationStructure, sizeInfo.accelerationStructureSize, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR);
+		scratchAddress = builder->createScratchBuffer(std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize), scratchBuffer, scratchMemory);
+
+		builtTransforms.resize(maxInstanceCount);
+		builtInstanceCount = 0;
+		statistics = {};
+	}
+
+	float DynamicTopLevelAccelerationStructure::estimateDegradation(uint32_t instanceCount) const
+	{
+		if (instanceCount == 0) {
+			return 0.0f;
+		}
+		double motion = 0.0;
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			const VkTransformMatrixKHR& current = instances[i].transform;
+			const VkTransformMatrixKHR& built = builtTransforms[i];
+			float dt[3];
+			float maxAxisChange = 0.0f;
+			for (uint32_t r = 0; r < 3; r++) {
+				dt[r] = current.matrix[r][3] - built.matrix[r][3];
+				for (uint32_t c = 0; c < 3; c++) {
+					maxAxisChange = std::max(maxAxisChange, std::abs(current.matrix[r][c] - built.matrix[r][c]));
+				}
+			}
+			motion += std::sqrt(dt[0] * dt[0] + dt[1] * dt[1] + dt[2] * dt[2]) / referenceSize + maxAxisChange;
+		}
+		return static_cast<float>(motion / instanceCount);
+	}
+
+	void DynamicTopLevelAccelerationStructure::record(VkCommandBuffer commandBuffer, uint32_t instanceCount, bool forceRebuild)
+	{
+		assert(instanceCount <= maxInstanceCount);
+		// Refitting requires the same number of instances as the build it updates
+		bool rebuild = forceRebuild || (instanceCount != builtInstanceCount);
+		statistics.degradation = 0.0f;
+		if (!rebuild) {
+			statistics.degradation = estimateDegradation(instanceCount);
+			rebuild = statistics.degradation > rebuildThreshold;
+		}
+
+		VkAccelerationStructureGeometryKHR geometry{};
+		geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+		geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+		geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+		geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+		geometry.geometry.instances.arrayOfPointers = VK_FALSE;
+		geometry.geometry.instances.data.deviceAddress = builder->getBufferDeviceAddress(instanceBuffer.buffer);
+
+		VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
+		buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+		buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+		buildGeometryInfo.flags = flags;
+		buildGeometryInfo.mode = rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+		// Updates are done in place
+		buildGeometryInfo.srcAccelerationStructure = rebuild ? VK_NULL_HANDLE : accelerationStructure.handle;
+		buildGeometryInfo.dstAccelerationStructure = accelerationStructure.handle;
+		buildGeometryInfo.geometryCount = 1;
+		buildGeometryInfo.pGeometries = &geometry;
+		buildGeometryInfo.scratchData.deviceAddress = scratchAddress;
+
+		VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
+		buildRangeInfo.primitiveCount = instanceCount;
+		const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
+		builder->vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildGeometryInfo, &pBuildRangeInfo);
+
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+		memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		statistics.lastWasRebuild = rebuild;
+		if (rebuild) {
+			for (uint32_t i = 0; i < instanceCount; i++) {
+				builtTransforms[i] = instances[i].transform;
+			}
+			builtInstanceCount = instanceCount;
+			statistics.rebuildCount++;
+			statistics.refitsSinceRebuild = 0;
+		}
+		else {
+			statistics.refitCount++;
+			statistics.refitsSinceRebuild++;
+		}
+	}
+
+	void DynamicTopLevelAccelerationStructure::destroy()
+	{
+		if (builder == nullptr) {
+			return;
+		}
+		builder->destroyAccelerationStructure(accelerationStructure);
+		instanceBuffer.destroy();
+		instances = nullptr;
+		if (scratchBuffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(builder->device->logicalDevice, scratchBuffer, nullptr);
+			vkFreeMemory(builder->device->logicalDevice, scratchMemory, nullptr);
+			scratchBuffer = VK_NULL_HANDLE;
+		}
+	}
+}
@@ -0,0 +1,159 @@
+/*
+* Vulkan acceleration structure builder
+*
+* Batches bottom level acceleration structure builds into a single command buffer using a shared scratch buffer
+* and compacts the results, refits top level acceleration structures of animated instances
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+
+namespace vks
+{
+	// Holds information for a ray tracing acceleration structure
+	struct AccelerationStructure {
+		VkAccelerationStructureKHR handle{ VK_NULL_HANDLE };
+		uint64_t deviceAddress = 0;
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+		VkBuffer buffer{ VK_NULL_HANDLE };
+	};
+
+	/**
+	* @brief Builds bottom level acceleration structures in batches and compacts them
+	* @note All queued builds are recorded into one command buffer. Builds share one scratch buffer that is suballocated per build,
+	* if the scratch memory of all builds exceeds the scratch budget, builds are split into batches separated by barriers that reuse the scratch buffer
+	* @note Compaction queries the compacted sizes after building and copies the acceleration structures with a second submission into one buffer shared by all of them.
+	* The shared buffer is owned by the builder, so compacted acceleration structures have no buffer and memory of their own and destroy() has to be called after they have been destroyed
+	*/
+	class AccelerationStructureBuilder
+	{
+	public:
+		struct Statistics {
+			uint32_t count{ 0 };
+			uint32_t batchCount{ 0 };
+			/** @brief Size of the shared scratch buffer */
+			VkDeviceSize scratchSize{ 0 };
+			/** @brief Scratch memory separate buffers for each build would have used */
+			VkDeviceSize unbatchedScratchSize{ 0 };
+			/** @brief Acceleration structure memory before and after compaction */
+			VkDeviceSize memoryBeforeCompaction{ 0 };
+			VkDeviceSize memoryAfterCompaction{ 0 };
+			double milliseconds{ 0.0 };
+		};
+
+		vks::VulkanDevice* device{ nullptr };
+		/** @brief Upper limit for the shared scratch buffer, a single build larger than this still gets its full scratch size */
+		VkDeviceSize scratchBudget{ 64 * 1024 * 1024 };
+		Statistics statistics;
+
+		void init(vks::VulkanDevice* device);
+		/**
+		* @brief Queue the build of a bottom level acceleration structure into target
+		* @note Geometry data needs to stay valid until build() returns, the geometry and range arrays are copied
+		*/
+		void addBottomLevel(AccelerationStructure* target, const std::vector<VkAccelerationStructureGeometryKHR>& geometries, const std::vector<VkAccelerationStructureBuildRangeInfoKHR>& buildRanges, VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+		/** @brief Build all queued acceleration structures and wait for them to finish, compacts them if compact is true */
+		void build(VkQueue queue, bool compact = true);
+		void destroyAccelerationStructure(AccelerationStructure& accelerationStructure);
+		/** @brief Release the buffers shared by compacted acceleration structures */
+		void destroy();
+		/** @brief Create an acceleration structure with its own buffer and memory, returns the size of the memory allocation */
+		VkDeviceSize createAccelerationStructure(AccelerationStructure& accelerationStructure, VkDeviceSize size, VkAccelerationStructureTypeKHR type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR);
+		/** @brief Create a scratch buffer of at least size bytes, returns its device address aligned to the scratch offset alignment */
+		uint64_t createScratchBuffer(VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& memory);
+		uint64_t getBufferDeviceAddress(VkBuffer buffer);
+
+		PFN_vkGetBufferDeviceAddressKHR vkGetBufferDeviceAddressKHR{ nullptr };
+		PFN_vkCreateAccelerationStructureKHR vkCreateAccelerationStructureKHR{ nullptr };
+		PFN_vkDestroyAccelerationStructureKHR vkDestroyAccelerationStructureKHR{ nullptr };
+		PFN_vkGetAccelerationStructureBuildSizesKHR vkGetAccelerationStructureBuildSizesKHR{ nullptr };
+		PFN_vkGetAccelerationStructureDeviceAddressKHR vkGetAccelerationStructureDeviceAddressKHR{ nullptr };
+		PFN_vkCmdBuildAccelerationStructuresKHR vkCmdBuildAccelerationStructuresKHR{ nullptr };
+		PFN_vkCmdWriteAccelerationStructuresPropertiesKHR vkCmdWriteAccelerationStructuresPropertiesKHR{ nullptr };
+		PFN_vkCmdCopyAccelerationStructureKHR vkCmdCopyAccelerationStructureKHR{ nullptr };
+	private:
+		struct BuildRequest {
+			AccelerationStructure* target;
+			std::vector<VkAccelerationStructureGeometryKHR> geometries;
+			std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRanges;
+			VkBuildAccelerationStructureFlagsKHR flags;
+			VkAccelerationStructureBuildSizesInfoKHR sizeInfo;
+			VkDeviceSize scratchOffset;
+		};
+		std::vector<BuildRequest> requests;
+		VkDeviceSize scratchAlignment{ 256 };
+		// Offsets of acceleration structures within their buffer are required to be a multiple of 256 bytes
+		const VkDeviceSize accelerationStructureOffsetAlignment{ 256 };
+		// Buffers holding the compacted acceleration structures of a build
+		struct SharedStorage {
+			VkBuffer buffer;
+			VkDeviceMemory memory;
+		};
+		std::vector<SharedStorage> sharedStorage;
+
+		/** @brief Create a device local buffer with device address support and bind its own memory to it, returns the size of the memory allocation */
+		VkDeviceSize createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory);
+		void createAccelerationStructureHandle(AccelerationStructure& accelerationStructure, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkAccelerationStructureTypeKHR type);
+	};
+
+	/**
+	* @brief Top level acceleration structure for animated instances
+	* @note Instances are written directly to a persistently mapped buffer. Updates refit the acceleration structure (VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR)
+	* and only rebuild it if the instance count changed or the instances moved too far since the last full build, as refitting keeps the tree topology and its quality degrades with motion
+	*/
+	class DynamicTopLevelAccelerationStructure
+	{
+	public:
+		struct Statistics {
+			uint32_t rebuildCount{ 0 };
+			uint32_t refitCount{ 0 };
+			uint32_t refitsSinceRebuild{ 0 };
+			/** @brief Estimated degradation at the last update, relative to the rebuild threshold */
+			float degradation{ 0.0f };
+			/** @brief True if the last update was a full build */
+			bool lastWasRebuild{ false };
+		};
+
+		AccelerationStructure accelerationStructure;
+		/** @brief Persistently mapped instance data, the first instanceCount instances passed to record are used */
+		VkAccelerationStructureInstanceKHR* instances{ nullptr };
+		uint32_t maxInstanceCount{ 0 };
+		/**
+		* @brief Rebuild once the average instance motion since the last full build exceeds this
+		* @note Motion is the change of an instance's translation in units of referenceSize plus the largest change of its rotation and scale
+		*/
+		float rebuildThreshold{ 0.5f };
+		/** @brief Typical size of an instance, used to estimate the motion of instances */
+		float referenceSize{ 1.0f };
+		Statistics statistics;
+
+		void create(AccelerationStructureBuilder* builder, uint32_t maxInstanceCount, VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+		/**
+		* @brief Record the commands for refitting or rebuilding the acceleration structure from the first instanceCount instances
+		* @note Includes a barrier that makes the result visible to ray tracing shaders, the instance buffer must not be written while the commands are executed
+		*/
+		void record(VkCommandBuffer commandBuffer, uint32_t instanceCount, bool forceRebuild = false);
+		void destroy();
+	private:
+		AccelerationStructureBuilder* builder{ nullptr };
+		vks::Buffer instanceBuffer;
+		VkBuffer scratchBuffer{ VK_NULL_HANDLE };
+		VkDeviceMemory scratchMemory{ VK_NULL_HANDLE };
+		uint64_t scratchAddress{ 0 };
+		VkBuildAccelerationStructureFlagsKHR flags{ 0 };
+		// Instance transforms at the time of the last full build
+		std::vector<VkTransformMatrixKHR> builtTransforms;
+		uint32_t builtInstanceCount{ 0 };
+
+		float estimateDegradation(uint32_t instanceCount) const;
+	};
+}
@@ -0,0 +1,235 @@
+/*
+* Vulkan descriptor allocator
+*
+* Growable descriptor pool allocator with per-frame transient pools and a descriptor set cache
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanDescriptorAllocator.h"
+
+namespace vks
+{
+	/**
+	* Initialize the allocator and create the first pool of the chain
+	*
+	* @param device Logical device the pools are created on
+	* @param initialSets Number of sets the first pool can hold, following pools grow geometrically
+	* @param poolRatios Number of descriptors per type to reserve for each set
+	* @param flags (Optional) Create flags for all pools (e.g. VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
+	*/
+	void DescriptorAllocator::init(VkDevice device, uint32_t initialSets, const std::vector<PoolSizeRatio>& poolRatios, VkDescriptorPoolCreateFlags flags)
+	{
+		assert(initialSets > 0);
+		this->device = device;
+		ratios = poolRatios;
+		poolFlags = flags;
+		setsPerPool = initialSets;
+		readyPools.push_back(createPool(initialSets));
+	}
+
+	VkDescriptorPool DescriptorAllocator::createPool(uint32_t setCount)
+	{
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (auto& ratio : ratios) {
+			poolSizes.push_back(vks::initializers::descriptorPoolSize(ratio.type, std::max(1u, static_cast<uint32_t>(ratio.ratio * setCount))));
+		}
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, setCount);
+		descriptorPoolCI.flags = poolFlags;
+		VkDescriptorPool pool;
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &pool));
+		return pool;
+	}
+
+	/**
+	* Get a pool with free space, creating a new one if all existing pools are full
+	*/
+	VkDescriptorPool DescriptorAllocator::getPool()
+	{
+		if (!readyPools.empty()) {
+			VkDescriptorPool pool = readyPools.back();
+			readyPools.pop_back();
+			return pool;
+		}
+		// Grow the pool size for each new pool in the chain, so that the number of pools stays low for large scenes
+		setsPerPool = std::min(setsPerPool * 2, maxSetsPerPool);
+		return createPool(setsPerPool);
+	}
+
+	/**
+	* Allocate a single descriptor set, adding a new pool to the chain if the current one is exhausted
+	*
+	* @param layout Layout of the descriptor set to allocate
+	* @param pNext (Optional) Extension structure chain for the allocation (e.g. variable descriptor counts)
+	*
+	* @return Handle of the newly allocated descriptor set
+	*/
+	VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const void* pNext)
+	{
+		assert(device != VK_NULL_HANDLE);
+		VkDescriptorPool pool = getPool();
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(pool, &layout, 1);
+		allocInfo.pNext = pNext;
+		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+		VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+		// Retire exhausted pools and retry with fresh ones until the allocation succeeds, only other errors are fatal
+		bool emptyPool = false;
+		while ((result == VK_ERROR_OUT_OF_POOL_MEMORY) || (result == VK_ERROR_FRAGMENTED_POOL)) {
+			// A set that doesn't even fit into an empty pool of the maximum size can't be allocated from this allocator
+			if (emptyPool && (setsPerPool == maxSetsPerPool)) {
+				break;
+			}
+			fullPools.push_back(pool);
+			emptyPool = readyPools.empty();
+			pool = getPool();
+			allocInfo.descriptorPool = pool;
+			result = vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+		}
+		VK_CHECK_RESULT(result);
+		readyPools.push_back(pool);
+		return descriptorSet;
+	}
+
+	/**
+	* Allocate and update a descriptor set, or return a previously allocated set that was written with the same contents
+	*
+	* @param layout Layout of the descriptor set to allocate
+	* @param writes Descriptor writes to apply to the set (dstSet is ignored and filled in by the allocator)
+	*
+	* @return Handle of a descriptor set containing the given writes
+	*/
+	VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes)
+	{
+		// Build a key from the layout and the contents of all writes
+		std::vector<uint64_t> key;
+		key.push_back((uint64_t)layout);
+		for (auto& write : writes) {
+			key.push_back(((uint64_t)write.dstBinding << 32) | write.dstArrayElement);
+			key.push_back(((uint64_t)write.descriptorType << 32) | write.descriptorCount);
+			for (uint32_t i = 0; i < write.descriptorCount; i++) {
+				if (write.pBufferInfo) {
+					key.push_back((uint64_t)write.pBufferInfo[i].buffer);
+					key.push_back(write.pBufferInfo[i].offset);
+					key.push_back(write.pBufferInfo[i].range);
+				}
+				if (write.pImageInfo) {
+					key.push_back((uint64_t)write.pImageInfo[i].sampler);
+					key.push_back((uint64_t)write.pImageInfo[i].imageView);
+					key.push_back(write.pImageInfo[i].imageLayout);
+				}
+				if (write.pTexelBufferView) {
+					key.push_back((uint64_t)write.pTexelBufferView[i]);
+				}
+			}
+		}
+		size_t hash = 0;
+		for (auto& value : key) {
+			vks::tools::hashCombine(hash, value);
+		}
+
+		auto range = setCache.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second.key == key) {
+				cacheHitCount++;
+				return it->second.descriptorSet;
+			}
+		}
+
+		VkDescriptorSet descriptorSet = allocate(layout);
+		std::vector<VkWriteDescriptorSet> setWrites = writes;
+		for (auto& write : setWrites) {
+			write.dstSet = descriptorSet;
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+		setCache.insert({ hash, { key, descriptorSet } });
+		return descriptorSet;
+	}
+
+	/**
+	* Reset all pools of the chain, which implicitly frees all sets allocated from them
+	*
+	* @note Pools are kept for reuse, so a reset allocator does not need to grow again
+	*/
+	void DescriptorAllocator::reset()
+	{
+		for (auto pool : readyPools) {
+			VK_CHECK_RESULT(vkResetDescriptorPool(device, pool, 0));
+		}
+		for (auto pool : fullPools) {
+			VK_CHECK_RESULT(vkResetDescriptorPool(device, pool, 0));
+			readyPools.push_back(pool);
+		}
+		fullPools.clear();
+		setCache.clear();
+		cacheHitCount = 0;
+	}
+
+	/**
+	* Destroy all pools of the chain
+	*/
+	void DescriptorAllocator::destroy()
+	{
+		for (auto pool : readyPools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+		for (auto pool : fullPools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+		readyPools.clear();
+		fullPools.clear();
+		setCache.clear();
+	}
+
+	/**
+	* Create one transient allocator for each frame in flight
+	*
+	* @param device Logical device the pools are created on
+	* @param frameCount Number of frames in flight
+	* @param initialSets Number of sets the first pool of each frame can hold
+	* @param poolRatios Number of descriptors per type to reserve for each set
+	*/
+	void FrameDescriptorAllocator::init(VkDevice device, uint32_t frameCount, uint32_t initialSets, const std::vector<DescriptorAllocator::PoolSizeRatio>& poolRatios)
+	{
+		this->device = device;
+		this->initialSets = initialSets;
+		ratios = poolRatios;
+		frames.resize(frameCount);
+		for (auto& frame : frames) {
+			frame.init(device, initialSets, poolRatios);
+		}
+		currentFrame = 0;
+	}
+
+	/**
+	* Start a new frame and reset the transient descriptor sets previously allocated for this frame slot
+	*
+	* @note The caller must ensure that the GPU has finished using the sets of this frame slot (e.g. by waiting on the frame's fence)
+	* @note Frame slots beyond the initial frame count (e.g. after the swap chain was recreated with more images) are added on demand, which invalidates references to the other slots' allocators
+	*
+	* @param frameIndex Index of the frame in flight
+	*
+	* @return Allocator to use for all transient allocations of this frame
+	*/
+	DescriptorAllocator& FrameDescriptorAllocator::beginFrame(uint32_t frameIndex)
+	{
+		assert(device != VK_NULL_HANDLE);
+		while (frames.size() <= frameIndex) {
+			frames.emplace_back();
+			frames.back().init(device, initialSets, ratios);
+		}
+		currentFrame = frameIndex;
+		// Resets all pools of the frame's chain with vkResetDescriptorPool, no matter how many sets were allocated from them
+		frames[currentFrame].reset();
+		return frames[currentFrame];
+	}
+
+	void FrameDescriptorAllocator::destroy()
+	{
+		for (auto& frame : frames) {
+			frame.destroy();
+		}
+		frames.clear();
+	}
+}
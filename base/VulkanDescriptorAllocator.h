@@ -0,0 +1,84 @@
+/*
+* Vulkan descriptor allocator
+*
+* Growable descriptor pool allocator with per-frame transient pools and a descriptor set cache
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Allocates descriptor sets from a chain of descriptor pools
+	* @note If the current pool runs out of space, a new (larger) pool is added to the chain and the allocation is retried
+	*/
+	class DescriptorAllocator
+	{
+	public:
+		/** @brief Number of descriptors of a given type to reserve per descriptor set in each pool */
+		struct PoolSizeRatio {
+			VkDescriptorType type;
+			float ratio;
+		};
+
+		VkDevice device{ VK_NULL_HANDLE };
+		/** @brief Maximum number of sets a single pool in the chain may hold (limits geometric growth) */
+		uint32_t maxSetsPerPool{ 4096 };
+
+		void init(VkDevice device, uint32_t initialSets, const std::vector<PoolSizeRatio>& poolRatios, VkDescriptorPoolCreateFlags flags = 0);
+		VkDescriptorSet allocate(VkDescriptorSetLayout layout, const void* pNext = nullptr);
+		VkDescriptorSet allocate(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes);
+		/** @brief Reset all pools in O(1) per pool, e.g. at the start of a frame for transient sets */
+		void reset();
+		void destroy();
+
+		/** @brief Number of pools currently owned by the allocator */
+		uint32_t poolCount() const { return static_cast<uint32_t>(fullPools.size() + readyPools.size()); };
+		/** @brief Number of allocations served from the descriptor set cache since the last reset */
+		uint32_t cacheHits() const { return cacheHitCount; };
+	private:
+		struct CacheEntry {
+			std::vector<uint64_t> key;
+			VkDescriptorSet descriptorSet;
+		};
+		std::vector<PoolSizeRatio> ratios;
+		std::vector<VkDescriptorPool> fullPools;
+		std::vector<VkDescriptorPool> readyPools;
+		std::unordered_multimap<size_t, CacheEntry> setCache;
+		VkDescriptorPoolCreateFlags poolFlags{ 0 };
+		uint32_t setsPerPool{ 0 };
+		uint32_t cacheHitCount{ 0 };
+
+		VkDescriptorPool getPool();
+		VkDescriptorPool createPool(uint32_t setCount);
+	};
+
+	/**
+	* @brief Transient descriptor allocators, one pool chain per frame in flight
+	* @note Sets allocated for a frame stay valid until that frame slot is started again
+	*/
+	class FrameDescriptorAllocator
+	{
+	public:
+		void init(VkDevice device, uint32_t frameCount, uint32_t initialSets, const std::vector<DescriptorAllocator::PoolSizeRatio>& poolRatios);
+		DescriptorAllocator& beginFrame(uint32_t frameIndex);
+		DescriptorAllocator& current() { return frames[currentFrame]; };
+		void destroy();
+	private:
+		VkDevice device{ VK_NULL_HANDLE };
+		uint32_t initialSets{ 0 };
+		std::vector<DescriptorAllocator::PoolSizeRatio> ratios;
+		std::vector<DescriptorAllocator> frames;
+		uint32_t currentFrame{ 0 };
+	};
+}
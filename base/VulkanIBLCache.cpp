@@ -0,0 +1,254 @@
+/*
+* Vulkan image based lighting map cache
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanIBLCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// OpenGL internal formats of the generated maps
+#define GL_RG16F 0x822F
+#define GL_RGBA16F 0x881A
+#define GL_RGBA32F 0x8814
+
+namespace vks
+{
+	namespace
+	{
+		// 64 bit FNV-1a
+		void hashBytes(uint64_t& hash, const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		}
+
+		bool hashFile(uint64_t& hash, const std::string& fileName)
+		{
+			std::ifstream is(fileName, std::ios::binary);
+			if (!is.is_open()) {
+				return false;
+			}
+			std::vector<char> buffer(64 * 1024);
+			while (is) {
+				is.read(buffer.data(), buffer.size());
+				hashBytes(hash, buffer.data(), static_cast<size_t>(is.gcount()));
+			}
+			return true;
+		}
+	}
+
+	IBLCache::IBLCache()
+	{
+		const uint32_t irradianceDim = 64;
+		const uint32_t prefilteredDim = 512;
+		brdfLut = { "brdflut", VK_FORMAT_R16G16_SFLOAT, GL_RG16F, 4, 512, 1, 1 };
+		irradianceCube = { "irradiance", VK_FORMAT_R32G32B32A32_SFLOAT, GL_RGBA32F, 16, irradianceDim, static_cast<uint32_t>(floor(log2(irradianceDim))) + 1, 6 };
+		prefilteredCube = { "prefiltered", VK_FORMAT_R16G16B16A16_SFLOAT, GL_RGBA16F, 8, prefilteredDim, static_cast<uint32_t>(floor(log2(prefilteredDim))) + 1, 6 };
+	}
+
+	// The cache key covers the contents of the environment map, the generation shaders and all parameters of the generated maps
+	bool IBLCache::getCacheKey(uint64_t& hash, const std::string& environmentMapFile, const std::vector<std::string>& shaderFiles)
+	{
+		hash = 14695981039346656037ull;
+		hashBytes(hash, &version, sizeof(version));
+		if (!hashFile(hash, environmentMapFile)) {
+			return false;
+		}
+		for (auto& shaderFile : shaderFiles) {
+			if (!hashFile(hash, shaderFile)) {
+				return false;
+			}
+		}
+		for (Map* map : { &brdfLut, &irradianceCube, &prefilteredCube }) {
+			const uint32_t params[] = { static_cast<uint32_t>(map->format), map->dim, map->numMips, map->numFaces };
+			hashBytes(hash, params, sizeof(params));
+		}
+		hashBytes(hash, &sampling, sizeof(sampling));
+		return true;
+	}
+
+	bool IBLCache::load(VkQueue queue, vks::Texture2D& lutBrdf, vks::TextureCubeMap& irradiance, vks::TextureCubeMap& prefiltered)
+	{
+		for (Map* map : { &brdfLut, &irradianceCube, &prefilteredCube }) {
+			if (!vks::tools::fileExists(map->fileName)) {
+				return false;
+			}
+		}
+		lutBrdf.loadFromFile(brdfLut.fileName, brdfLut.format, device, queue);
+		irradiance.loadFromFile(irradianceCube.fileName, irradianceCube.format, device, queue);
+		prefiltered.loadFromFile(prefilteredCube.fileName, prefilteredCube.format, device, queue);
+		// The 2D texture loader uses a repeating sampler, the look-up-table must not wrap around at the edges
+		vkDestroySampler(device->logicalDevice, lutBrdf.sampler, nullptr);
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_LINEAR;
+		samplerCI.minFilter = VK_FILTER_LINEAR;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.minLod = 0.0f;
+		samplerCI.maxLod = 1.0f;
+		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &lutBrdf.sampler));
+		lutBrdf.descriptor.sampler = lutBrdf.sampler;
+		return true;
+	}
+
+	// Copy all mip levels and faces of a generated map into a host visible buffer, ordered like the images of a KTX file
+	void IBLCache::recordReadback(VkCommandBuffer commandBuffer, VkImage image, Map& map)
+	{
+		std::vector<VkBufferImageCopy> copyRegions;
+		VkDeviceSize offset = 0;
+		for (uint32_t m = 0; m < map.numMips; m++) {
+			const uint32_t mipDim = std::max(map.dim >> m, 1u);
+			for (uint32_t f = 0; f < map.numFaces; f++) {
+				VkBufferImageCopy copyRegion = {};
+				copyRegion.bufferOffset = offset;
+				copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				copyRegion.imageSubresource.mipLevel = m;
+				copyRegion.imageSubresource.baseArrayLayer = f;
+				copyRegion.imageSubresource.layerCount = 1;
+				copyRegion.imageExtent = { mipDim, mipDim, 1 };
+				copyRegions.push_back(copyRegion);
+				offset += mipDim * mipDim * map.texelSize;
+			}
+		}
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &map.readback, offset));
+
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, map.numMips, 0, map.numFaces };
+		// The generation passes write the maps either as color attachments or via transfers
+		VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+		imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.image = image;
+		imageBarrier.subresourceRange = subresourceRange;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, map.readback.buffer, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+
+		imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.buffer = map.readback.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+	}
+
+	void IBLCache::writeFile(Map& map)
+	{
+		ktxTextureCreateInfo createInfo{};
+		createInfo.glInternalformat = map.glInternalFormat;
+		createInfo.baseWidth = map.dim;
+		createInfo.baseHeight = map.dim;
+		createInfo.baseDepth = 1;
+		createInfo.numDimensions = 2;
+		createInfo.numLevels = map.numMips;
+		createInfo.numLayers = 1;
+		createInfo.numFaces = map.numFaces;
+		createInfo.isArray = KTX_FALSE;
+		createInfo.generateMipmaps = KTX_FALSE;
+		ktxTexture* ktxTexture;
+		if (ktxTexture_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &ktxTexture) != KTX_SUCCESS) {
+			std::cerr << "Could not create cache file for " << map.name << std::endl;
+			return;
+		}
+		VK_CHECK_RESULT(map.readback.map());
+		const uint8_t* src = static_cast<const uint8_t*>(map.readback.mapped);
+		for (uint32_t m = 0; m < map.numMips; m++) {
+			const uint32_t mipDim = std::max(map.dim >> m, 1u);
+			const size_t faceSize = mipDim * mipDim * map.texelSize;
+			for (uint32_t f = 0; f < map.numFaces; f++) {
+				ktxTexture_SetImageFromMemory(ktxTexture, m, 0, f, src, faceSize);
+				src += faceSize;
+			}
+		}
+		map.readback.unmap();
+		if (ktxTexture_WriteToNamedFile(ktxTexture, map.fileName.c_str()) != KTX_SUCCESS) {
+			std::cerr << "Could not write " << map.fileName << std::endl;
+		}
+		ktxTexture_Destroy(ktxTexture);
+	}
+
+	void IBLCache::prepare(vks::VulkanDevice* device, VkQueue queue, const std::string& name, const std::string& environmentMapFile, const std::vector<std::string>& shaderFiles,
+		vks::Texture2D& lutBrdf, vks::TextureCubeMap& irradiance, vks::TextureCubeMap& prefiltered, std::function<void(VkCommandBuffer)> recordGeneration)
+	{
+		this->device = device;
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+#if defined(__ANDROID__)
+		// Assets are read from the apk, so there is no place to write the cache to
+		enabled = false;
+#endif
+		uint64_t cacheKey;
+		if (enabled && !getCacheKey(cacheKey, environmentMapFile, shaderFiles)) {
+			std::cerr << "Could not read the sources for the image based lighting cache key, caching is disabled" << std::endl;
+			enabled = false;
+		}
+
+		if (enabled) {
+			std::string cachePath = path;
+			if (cachePath.empty()) {
+				cachePath = environmentMapFile.substr(0, environmentMapFile.find_last_of("/\\") + 1);
+			}
+			else if ((cachePath.back() != '/') && (cachePath.back() != '\\')) {
+				cachePath += "/";
+			}
+			std::stringstream hashString;
+			hashString << std::hex << std::setw(16) << std::setfill('0') << cacheKey;
+			for (Map* map : { &brdfLut, &irradianceCube, &prefilteredCube }) {
+				map->fileName = cachePath + name + "_" + hashString.str() + "_" + map->name + ".ktx";
+			}
+			if (load(queue, lutBrdf, irradiance, prefiltered)) {
+				auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+				std::cout << "Loading image based lighting maps from cache took " << tDiff << " ms" << std::endl;
+				return;
+			}
+		}
+
+		// The passes don't depend on each other, so they are recorded into one command buffer and submitted at once
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		recordGeneration(commandBuffer);
+		if (enabled) {
+			recordReadback(commandBuffer, lutBrdf.image, brdfLut);
+			recordReadback(commandBuffer, irradiance.image, irradianceCube);
+			recordReadback(commandBuffer, prefiltered.image, prefilteredCube);
+		}
+		device->flushCommandBuffer(commandBuffer, queue);
+
+		for (auto& release : cleanup) {
+			release();
+		}
+		cleanup.clear();
+
+		auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		std::cout << "Generating image based lighting maps took " << tDiff << " ms" << std::endl;
+
+		if (enabled) {
+			for (Map* map : { &brdfLut, &irradianceCube, &prefilteredCube }) {
+				writeFile(*map);
+				map->readback.destroy();
+			}
+		}
+	}
+}
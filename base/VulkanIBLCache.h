@@ -0,0 +1,86 @@
+/*
+* Vulkan image based lighting map cache
+*
+* Stores the maps generated from an environment map for image based lighting (BRDF look-up-table, irradiance cube and
+* pre-filtered cube) as KTX files, so they only need to be generated once
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanTexture.h"
+
+namespace vks
+{
+	/**
+	* @brief Loads the image based lighting maps from KTX files or generates them and writes the files
+	* @note File names contain a 64 bit FNV-1a hash of the environment map, the SPIR-V of the generation shaders and all parameters of the maps,
+	* so changing any of them regenerates the maps
+	* @note On a cache miss all generation passes are recorded into a single command buffer with one submission, the results are read back in the same submission
+	*/
+	class IBLCache
+	{
+	public:
+		// Describes one of the maps generated from the environment cube, all values are part of the cache key
+		struct Map {
+			std::string name;
+			VkFormat format;
+			// OpenGL internal format, required for the KTX (version 1) file header
+			uint32_t glInternalFormat;
+			uint32_t texelSize;
+			uint32_t dim;
+			uint32_t numMips;
+			uint32_t numFaces;
+			// Cache file name, depends on the hash of the source environment map and the generation parameters
+			std::string fileName;
+			// Host visible copy of all mip levels and faces used to write the cache file
+			vks::Buffer readback;
+		};
+		Map brdfLut;
+		Map irradianceCube;
+		Map prefilteredCube;
+
+		// Sampling parameters of the convolution passes
+		struct Sampling {
+			float irradianceDeltaPhi = (2.0f * 3.14159265358979323846f) / 180.0f;
+			float irradianceDeltaTheta = (0.5f * 3.14159265358979323846f) / 64.0f;
+			uint32_t prefilterSampleCount = 32;
+		} sampling;
+
+		bool enabled{ true };
+		/** @brief Directory for the cache files, defaults to the directory of the environment map if empty */
+		std::string path;
+		/** @brief Objects used by the generation passes, released once the batched submission has finished */
+		std::vector<std::function<void()>> cleanup;
+
+		IBLCache();
+		/**
+		* @brief Load the maps into the passed textures from the cache, or generate them and write them to the cache
+		* @param name Prefix for the cache file names
+		* @param environmentMapFile Path of the environment map, hashed for the cache key
+		* @param shaderFiles Paths of the SPIR-V files used to generate the maps, hashed for the cache key
+		* @param recordGeneration Records the generation of all maps into the passed command buffer, the images need to be in shader read layout afterwards
+		*/
+		void prepare(vks::VulkanDevice* device, VkQueue queue, const std::string& name, const std::string& environmentMapFile, const std::vector<std::string>& shaderFiles,
+			vks::Texture2D& lutBrdf, vks::TextureCubeMap& irradiance, vks::TextureCubeMap& prefiltered, std::function<void(VkCommandBuffer)> recordGeneration);
+	private:
+		// Bump this when changing the generation in a way that is not covered by the cache key
+		const uint32_t version = 1;
+		vks::VulkanDevice* device{ nullptr };
+
+		bool getCacheKey(uint64_t& hash, const std::string& environmentMapFile, const std::vector<std::string>& shaderFiles);
+		bool load(VkQueue queue, vks::Texture2D& lutBrdf, vks::TextureCubeMap& irradiance, vks::TextureCubeMap& prefiltered);
+		void recordReadback(VkCommandBuffer commandBuffer, VkImage image, Map& map);
+		void writeFile(Map& map);
+	};
+}
@@ -0,0 +1,594 @@
+/*
+* Vulkan pipeline manager
+*
+* Deduplicates descriptor set layouts, pipeline layouts and pipelines by hashing their create infos
+* and compiles pipelines on background threads
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanPipelineManager.h"
+
+namespace vks
+{
+	namespace
+	{
+		void addKey(std::vector<uint64_t>& key, uint64_t value)
+		{
+			key.push_back(value);
+		}
+
+		void addKey(std::vector<uint64_t>& key, float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(float));
+			key.push_back(bits);
+		}
+
+		size_t hashKey(const std::vector<uint64_t>& key)
+		{
+			size_t hash = 0;
+			for (auto& value : key) {
+				vks::tools::hashCombine(hash, value);
+			}
+			return hash;
+		}
+
+		/*
+			Deep copy of a shader stage, so the stage stays valid while it's compiled on a worker thread
+		*/
+		struct ShaderStageState {
+			VkPipelineShaderStageCreateInfo createInfo{};
+			std::string name;
+			std::vector<VkSpecializationMapEntry> mapEntries;
+			std::vector<uint8_t> data;
+			VkSpecializationInfo specializationInfo{};
+			bool hasSpecialization{ false };
+
+			explicit ShaderStageState(const VkPipelineShaderStageCreateInfo& stage)
+			{
+				createInfo = stage;
+				name = stage.pName;
+				if (stage.pSpecializationInfo) {
+					hasSpecialization = true;
+					specializationInfo = *stage.pSpecializationInfo;
+					mapEntries.assign(specializationInfo.pMapEntries, specializationInfo.pMapEntries + specializationInfo.mapEntryCount);
+					const uint8_t* src = static_cast<const uint8_t*>(specializationInfo.pData);
+					data.assign(src, src + specializationInfo.dataSize);
+				}
+			}
+
+			// Pointers are only fixed up once the stage has its final location in memory
+			void finalize()
+			{
+				createInfo.pName = name.c_str();
+				if (hasSpecialization) {
+					specializationInfo.pMapEntries = mapEntries.data();
+					specializationInfo.pData = data.data();
+					createInfo.pSpecializationInfo = &specializationInfo;
+				}
+			}
+
+			void addToKey(std::vector<uint64_t>& key) const
+			{
+				addKey(key, (uint64_t)createInfo.flags);
+				addKey(key, (uint64_t)createInfo.stage);
+				addKey(key, (uint64_t)createInfo.module);
+				addKey(key, std::hash<std::string>{}(name));
+				addKey(key, (uint64_t)mapEntries.size());
+				for (auto& entry : mapEntries) {
+					addKey(key, ((uint64_t)entry.constantID << 32) | entry.offset);
+					addKey(key, (uint64_t)entry.size);
+				}
+				addKey(key, (uint64_t)data.size());
+				for (auto& byte : data) {
+					addKey(key, (uint64_t)byte);
+				}
+			}
+		};
+
+		/*
+			Deep copy of all state referenced by a graphics pipeline create info
+		*/
+		class GraphicsPipelineState
+		{
+		public:
+			VkGraphicsPipelineCreateInfo createInfo{};
+			// Set to false if the create info contains structures that can't be copied, these pipelines aren't cached
+			bool supported{ true };
+
+			explicit GraphicsPipelineState(const VkGraphicsPipelineCreateInfo& ci)
+			{
+				createInfo = ci;
+				for (const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(ci.pNext); next != nullptr; next = next->pNext) {
+					if (next->sType == VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR) {
+						hasRenderingInfo = true;
+						renderingInfo = *reinterpret_cast<const VkPipelineRenderingCreateInfoKHR*>(next);
+						colorFormats.assign(renderingInfo.pColorAttachmentFormats, renderingInfo.pColorAttachmentFormats + renderingInfo.colorAttachmentCount);
+					} else {
+						supported = false;
+					}
+				}
+				for (uint32_t i = 0; i < ci.stageCount; i++) {
+					if (ci.pStages[i].pNext != nullptr) {
+						supported = false;
+					}
+					stages.emplace_back(ci.pStages[i]);
+				}
+				if (ci.pVertexInputState) {
+					vertexInputState = *ci.pVertexInputState;
+					vertexBindings.assign(vertexInputState.pVertexBindingDescriptions, vertexInputState.pVertexBindingDescriptions + vertexInputState.vertexBindingDescriptionCount);
+					vertexAttributes.assign(vertexInputState.pVertexAttributeDescriptions, vertexInputState.pVertexAttributeDescriptions + vertexInputState.vertexAttributeDescriptionCount);
+				}
+				if (ci.pInputAssemblyState) {
+					inputAssemblyState = *ci.pInputAssemblyState;
+				}
+				if (ci.pTessellationState) {
+					tessellationState = *ci.pTessellationState;
+				}
+				if (ci.pViewportState) {
+					viewportState = *ci.pViewportState;
+					if (viewportState.pViewports) {
+						viewports.assign(viewportState.pViewports, viewportState.pViewports + viewportState.viewportCount);
+					}
+					if (viewportState.pScissors) {
+						scissors.assign(viewportState.pScissors, viewportState.pScissors + viewportState.scissorCount);
+					}
+				}
+				if (ci.pRasterizationState) {
+					rasterizationState = *ci.pRasterizationState;
+				}
+				if (ci.pMultisampleState) {
+					multisampleState = *ci.pMultisampleState;
+					if (multisampleState.pSampleMask) {
+						sampleMask.assign(multisampleState.pSampleMask, multisampleState.pSampleMask + (multisampleState.rasterizationSamples + 31) / 32);
+					}
+				}
+				if (ci.pDepthStencilState) {
+					depthStencilState = *ci.pDepthStencilState;
+				}
+				if (ci.pColorBlendState) {
+					colorBlendState = *ci.pColorBlendState;
+					blendAttachments.assign(colorBlendState.pAttachments, colorBlendState.pAttachments + colorBlendState.attachmentCount);
+				}
+				if (ci.pDynamicState) {
+					dynamicState = *ci.pDynamicState;
+					dynamicStates.assign(dynamicState.pDynamicStates, dynamicState.pDynamicStates + dynamicState.dynamicStateCount);
+				}
+				const void* nestedStates[] = { ci.pVertexInputState, ci.pInputAssemblyState, ci.pTessellationState, ci.pViewportState, ci.pRasterizationState, ci.pMultisampleState, ci.pDepthStencilState, ci.pColorBlendState, ci.pDynamicState };
+				for (auto state : nestedStates) {
+					if (state && static_cast<const VkBaseInStructure*>(state)->pNext != nullptr) {
+						supported = false;
+					}
+				}
+				finalize();
+			}
+
+			std::vector<uint64_t> key() const
+			{
+				std::vector<uint64_t> key;
+				addKey(key, (uint64_t)createInfo.flags);
+				addKey(key, (uint64_t)createInfo.layout);
+				addKey(key, (uint64_t)createInfo.renderPass);
+				addKey(key, (uint64_t)createInfo.subpass);
+				addKey(key, (uint64_t)createInfo.basePipelineHandle);
+				addKey(key, (uint64_t)stages.size());
+				for (auto& stage : stages) {
+					stage.addToKey(key);
+				}
+				// One bit per optional state and a count in front of every list, so different create infos can't produce the same sequence of words
+				const void* optionalStates[] = { createInfo.pVertexInputState, createInfo.pInputAssemblyState, createInfo.pTessellationState, createInfo.pViewportState, createInfo.pRasterizationState, createInfo.pMultisampleState, createInfo.pDepthStencilState, createInfo.pColorBlendState, createInfo.pDynamicState };
+				uint64_t presentStates = hasRenderingInfo ? 1 : 0;
+				for (auto state : optionalStates) {
+					presentStates = (presentStates << 1) | (state ? 1 : 0);
+				}
+				addKey(key, presentStates);
+				if (createInfo.pVertexInputState) {
+					addKey(key, ((uint64_t)vertexBindings.size() << 32) | vertexAttributes.size());
+					for (auto& binding : vertexBindings) {
+						addKey(key, ((uint64_t)binding.binding << 32) | binding.stride);
+						addKey(key, (uint64_t)binding.inputRate);
+					}
+					for (auto& attribute : vertexAttributes) {
+						addKey(key, ((uint64_t)attribute.location << 32) | attribute.binding);
+						addKey(key, ((uint64_t)attribute.format << 32) | attribute.offset);
+					}
+				}
+				if (createInfo.pInputAssemblyState) {
+					addKey(key, ((uint64_t)inputAssemblyState.topology << 32) | inputAssemblyState.primitiveRestartEnable);
+				}
+				if (createInfo.pTessellationState) {
+					addKey(key, (uint64_t)tessellationState.patchControlPoints);
+				}
+				if (createInfo.pViewportState) {
+					addKey(key, ((uint64_t)viewportState.viewportCount << 32) | viewportState.scissorCount);
+					addKey(key, ((uint64_t)viewports.size() << 32) | scissors.size());
+					for (auto& viewport : viewports) {
+						addKey(key, viewport.x);
+						addKey(key, viewport.y);
+						addKey(key, viewport.width);
+						addKey(key, viewport.height);
+						addKey(key, viewport.minDepth);
+						addKey(key, viewport.maxDepth);
+					}
+					for (auto& scissor : scissors) {
+						addKey(key, ((uint64_t)(uint32_t)scissor.offset.x << 32) | (uint32_t)scissor.offset.y);
+						addKey(key, ((uint64_t)scissor.extent.width << 32) | scissor.extent.height);
+					}
+				}
+				if (createInfo.pRasterizationState) {
+					const VkPipelineRasterizationStateCreateInfo& rs = rasterizationState;
+					addKey(key, ((uint64_t)rs.depthClampEnable << 32) | rs.rasterizerDiscardEnable);
+					addKey(key, ((uint64_t)rs.polygonMode << 32) | rs.cullMode);
+					addKey(key, ((uint64_t)rs.frontFace << 32) | rs.depthBiasEnable);
+					addKey(key, rs.depthBiasConstantFactor);
+					addKey(key, rs.depthBiasClamp);
+					addKey(key, rs.depthBiasSlopeFactor);
+					addKey(key, rs.lineWidth);
+				}
+				if (createInfo.pMultisampleState) {
+					const VkPipelineMultisampleStateCreateInfo& ms = multisampleState;
+					addKey(key, ((uint64_t)ms.rasterizationSamples << 32) | ms.sampleShadingEnable);
+					addKey(key, ms.minSampleShading);
+					addKey(key, ((uint64_t)ms.alphaToCoverageEnable << 32) | ms.alphaToOneEnable);
+					addKey(key, (uint64_t)sampleMask.size());
+					for (auto& mask : sampleMask) {
+						addKey(key, (uint64_t)mask);
+					}
+				}
+				if (createInfo.pDepthStencilState) {
+					const VkPipelineDepthStencilStateCreateInfo& ds = depthStencilState;
+					addKey(key, ((uint64_t)ds.depthTestEnable << 32) | ds.depthWriteEnable);
+					addKey(key, ((uint64_t)ds.depthCompareOp << 32) | ds.depthBoundsTestEnable);
+					addKey(key, (uint64_t)ds.stencilTestEnable);
+					for (auto& op : { ds.front, ds.back }) {
+						addKey(key, ((uint64_t)op.failOp << 32) | op.passOp);
+						addKey(key, ((uint64_t)op.depthFailOp << 32) | op.compareOp);
+						addKey(key, ((uint64_t)op.compareMask << 32) | op.writeMask);
+						addKey(key, (uint64_t)op.reference);
+					}
+					addKey(key, ds.minDepthBounds);
+					addKey(key, ds.maxDepthBounds);
+				}
+				if (createInfo.pColorBlendState) {
+					addKey(key, ((uint64_t)colorBlendState.logicOpEnable << 32) | colorBlendState.logicOp);
+					addKey(key, (uint64_t)blendAttachments.size());
+					for (auto& attachment : blendAttachments) {
+						addKey(key, ((uint64_t)attachment.blendEnable << 32) | attachment.colorWriteMask);
+						addKey(key, ((uint64_t)attachment.srcColorBlendFactor << 32) | attachment.dstColorBlendFactor);
+						addKey(key, ((uint64_t)attachment.srcAlphaBlendFactor << 32) | attachment.dstAlphaBlendFactor);
+						addKey(key, ((uint64_t)attachment.colorBlendOp << 32) | attachment.alphaBlendOp);
+					}
+					for (auto& constant : colorBlendState.blendConstants) {
+						addKey(key, constant);
+					}
+				}
+				if (createInfo.pDynamicState) {
+					addKey(key, (uint64_t)dynamicStates.size());
+					for (auto& state : dynamicStates) {
+						addKey(key, (uint64_t)state);
+					}
+				}
+				if (hasRenderingInfo) {
+					addKey(key, ((uint64_t)renderingInfo.viewMask << 32) | renderingInfo.colorAttachmentCount);
+					addKey(key, (uint64_t)colorFormats.size());
+					for (auto& format : colorFormats) {
+						addKey(key, (uint64_t)format);
+					}
+					addKey(key, ((uint64_t)renderingInfo.depthAttachmentFormat << 32) | renderingInfo.stencilAttachmentFormat);
+				}
+				return key;
+			}
+		private:
+			std::vector<ShaderStageState> stages;
+			std::vector<VkPipelineShaderStageCreateInfo> stageInfos;
+			VkPipelineVertexInputStateCreateInfo vertexInputState{};
+			std::vector<VkVertexInputBindingDescription> vertexBindings;
+			std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+			VkPipelineInputAssemblyStateCreateInfo inputAssemblyState{};
+			VkPipelineTessellationStateCreateInfo tessellationState{};
+			VkPipelineViewportStateCreateInfo viewportState{};
+			std::vector<VkViewport> viewports;
+			std::vector<VkRect2D> scissors;
+			VkPipelineRasterizationStateCreateInfo rasterizationState{};
+			VkPipelineMultisampleStateCreateInfo multisampleState{};
+			std::vector<VkSampleMask> sampleMask;
+			VkPipelineDepthStencilStateCreateInfo depthStencilState{};
+			VkPipelineColorBlendStateCreateInfo colorBlendState{};
+			std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+			VkPipelineDynamicStateCreateInfo dynamicState{};
+			std::vector<VkDynamicState> dynamicStates;
+			VkPipelineRenderingCreateInfoKHR renderingInfo{};
+			std::vector<VkFormat> colorFormats;
+			bool hasRenderingInfo{ false };
+
+			// Point the copied create info to the copied state
+			void finalize()
+			{
+				for (auto& stage : stages) {
+					stage.finalize();
+					stageInfos.push_back(stage.createInfo);
+				}
+				createInfo.pStages = stageInfos.data();
+				vertexInputState.pVertexBindingDescriptions = vertexBindings.data();
+				vertexInputState.pVertexAttributeDescriptions = vertexAttributes.data();
+				viewportState.pViewports = viewports.empty() ? nullptr : viewports.data();
+				viewportState.pScissors = scissors.empty() ? nullptr : scissors.data();
+				multisampleState.pSampleMask = sampleMask.empty() ? nullptr : sampleMask.data();
+				colorBlendState.pAttachments = blendAttachments.data();
+				dynamicState.pDynamicStates = dynamicStates.data();
+				createInfo.pVertexInputState = createInfo.pVertexInputState ? &vertexInputState : nullptr;
+				createInfo.pInputAssemblyState = createInfo.pInputAssemblyState ? &inputAssemblyState : nullptr;
+				createInfo.pTessellationState = createInfo.pTessellationState ? &tessellationState : nullptr;
+				createInfo.pViewportState = createInfo.pViewportState ? &viewportState : nullptr;
+				createInfo.pRasterizationState = createInfo.pRasterizationState ? &rasterizationState : nullptr;
+				createInfo.pMultisampleState = createInfo.pMultisampleState ? &multisampleState : nullptr;
+				createInfo.pDepthStencilState = createInfo.pDepthStencilState ? &depthStencilState : nullptr;
+				createInfo.pColorBlendState = createInfo.pColorBlendState ? &colorBlendState : nullptr;
+				createInfo.pDynamicState = createInfo.pDynamicState ? &dynamicState : nullptr;
+				if (hasRenderingInfo) {
+					renderingInfo.pNext = nullptr;
+					renderingInfo.pColorAttachmentFormats = colorFormats.data();
+					createInfo.pNext = &renderingInfo;
+				}
+			}
+		};
+	}
+
+	bool PipelineRequest::ready() const
+	{
+		return future.valid() && (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+	}
+
+	VkPipeline PipelineRequest::get() const
+	{
+		return ready() ? future.get() : fallback;
+	}
+
+	/**
+	* Initialize the pipeline manager
+	*
+	* @note The worker threads used for background compilation are started on the first pipeline request, so applications that don't use the manager don't pay for them
+	*
+	* @param device Logical device the objects are created on
+	* @param pipelineCache Pipeline cache passed to all pipeline creations (shared across threads)
+	* @param threadCount (Optional) Number of compile threads, defaults to the number of hardware threads minus one
+	*/
+	void PipelineManager::init(VkDevice device, VkPipelineCache pipelineCache, uint32_t threadCount)
+	{
+		this->device = device;
+		this->pipelineCache = pipelineCache;
+		if (threadCount == 0) {
+			threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		}
+		this->threadCount = threadCount;
+	}
+
+	/**
+	* Get a descriptor set layout matching the create info, the layout is only created if no identical layout exists
+	*/
+	VkDescriptorSetLayout PipelineManager::getDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& createInfo)
+	{
+		std::vector<uint64_t> key;
+		addKey(key, (uint64_t)createInfo.flags);
+		addKey(key, (uint64_t)createInfo.bindingCount);
+		for (uint32_t i = 0; i < createInfo.bindingCount; i++) {
+			const VkDescriptorSetLayoutBinding& binding = createInfo.pBindings[i];
+			addKey(key, ((uint64_t)binding.binding << 32) | binding.descriptorType);
+			addKey(key, ((uint64_t)binding.descriptorCount << 32) | binding.stageFlags);
+			addKey(key, (uint64_t)(binding.pImmutableSamplers != nullptr));
+			if (binding.pImmutableSamplers) {
+				for (uint32_t j = 0; j < binding.descriptorCount; j++) {
+					addKey(key, (uint64_t)binding.pImmutableSamplers[j]);
+				}
+			}
+		}
+		// Binding flags (e.g. for descriptor indexing) are part of the key, other extension structures are not supported
+		for (const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(createInfo.pNext); next != nullptr; next = next->pNext) {
+			assert(next->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT);
+			const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT* bindingFlags = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT*>(next);
+			addKey(key, (uint64_t)bindingFlags->bindingCount);
+			for (uint32_t i = 0; i < bindingFlags->bindingCount; i++) {
+				addKey(key, (uint64_t)bindingFlags->pBindingFlags[i]);
+			}
+		}
+		const size_t hash = hashKey(key);
+
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto range = descriptorSetLayouts.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second.key == key) {
+				cacheHitCount++;
+				return it->second.handle;
+			}
+		}
+		VkDescriptorSetLayout descriptorSetLayout;
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &descriptorSetLayout));
+		descriptorSetLayouts.insert({ hash, { key, descriptorSetLayout } });
+		return descriptorSetLayout;
+	}
+
+	/**
+	* Get a pipeline layout matching the create info, the layout is only created if no identical layout exists
+	*/
+	VkPipelineLayout PipelineManager::getPipelineLayout(const VkPipelineLayoutCreateInfo& createInfo)
+	{
+		assert(createInfo.pNext == nullptr);
+		std::vector<uint64_t> key;
+		addKey(key, (uint64_t)createInfo.flags);
+		addKey(key, (uint64_t)createInfo.setLayoutCount);
+		for (uint32_t i = 0; i < createInfo.setLayoutCount; i++) {
+			addKey(key, (uint64_t)createInfo.pSetLayouts[i]);
+		}
+		addKey(key, (uint64_t)createInfo.pushConstantRangeCount);
+		for (uint32_t i = 0; i < createInfo.pushConstantRangeCount; i++) {
+			const VkPushConstantRange& range = createInfo.pPushConstantRanges[i];
+			addKey(key, (uint64_t)range.stageFlags);
+			addKey(key, ((uint64_t)range.offset << 32) | range.size);
+		}
+		const size_t hash = hashKey(key);
+
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto range = pipelineLayouts.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second.key == key) {
+				cacheHitCount++;
+				return it->second.handle;
+			}
+		}
+		VkPipelineLayout pipelineLayout;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &createInfo, nullptr, &pipelineLayout));
+		pipelineLayouts.insert({ hash, { key, pipelineLayout } });
+		return pipelineLayout;
+	}
+
+	PipelineRequest PipelineManager::request(std::vector<uint64_t>&& key, std::function<VkPipeline()> compile, VkPipeline fallback)
+	{
+		const size_t hash = hashKey(key);
+		PipelineRequest pipelineRequest{};
+		pipelineRequest.fallback = fallback;
+
+		std::shared_ptr<std::packaged_task<VkPipeline()>> task;
+		uint32_t threadIndex = 0;
+		{
+			std::lock_guard<std::mutex> lock(cacheMutex);
+			auto range = pipelines.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it) {
+				if (it->second.key == key) {
+					cacheHitCount++;
+					pipelineRequest.future = it->second.future;
+					return pipelineRequest;
+				}
+			}
+			// Register the (pending) pipeline before compilation, so concurrent requests for the same state wait on the same future
+			task = std::make_shared<std::packaged_task<VkPipeline()>>(compile);
+			pipelineRequest.future = task->get_future().share();
+			pipelines.insert({ hash, { std::move(key), pipelineRequest.future } });
+			threadIndex = nextThread++;
+			if (threadPool.threads.empty()) {
+				threadPool.setThreadCount(threadCount);
+			}
+		}
+
+		// Distribute compilation jobs across the worker threads
+		threadPool.threads[threadIndex % threadPool.threads.size()]->addJob([task] { (*task)(); });
+		return pipelineRequest;
+	}
+
+	/**
+	* Get a graphics pipeline matching the create info, if it doesn't exist yet it's compiled on a worker thread and the call blocks until it's ready
+	*/
+	VkPipeline PipelineManager::getGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo)
+	{
+		return requestGraphicsPipeline(createInfo).future.get();
+	}
+
+	/**
+	* Request a graphics pipeline to be compiled on a worker thread
+	*
+	* @note All objects referenced by the create info (shader modules, layouts, render passes) must stay valid until the pipeline has been compiled
+	*
+	* @param createInfo Create info of the pipeline, all state pointed to is copied
+	* @param fallback (Optional) Pipeline returned by the request until the new pipeline is ready
+	*
+	* @return Request that returns the compiled pipeline once it's ready
+	*/
+	PipelineRequest PipelineManager::requestGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline fallback)
+	{
+		std::shared_ptr<GraphicsPipelineState> state = std::make_shared<GraphicsPipelineState>(createInfo);
+		if (!state->supported) {
+			// Create infos with extension structures that can't be deep copied are compiled immediately and not deduplicated
+			VkPipeline pipeline;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &createInfo, nullptr, &pipeline));
+			std::lock_guard<std::mutex> lock(cacheMutex);
+			uncachedPipelines.push_back(pipeline);
+			std::promise<VkPipeline> promise;
+			promise.set_value(pipeline);
+			return { promise.get_future().share(), fallback };
+		}
+		return request(state->key(), [this, state]() {
+			VkPipeline pipeline;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &state->createInfo, nullptr, &pipeline));
+			return pipeline;
+		}, fallback);
+	}
+
+	/**
+	* Get a compute pipeline matching the create info, if it doesn't exist yet it's compiled on a worker thread and the call blocks until it's ready
+	*/
+	VkPipeline PipelineManager::getComputePipeline(const VkComputePipelineCreateInfo& createInfo)
+	{
+		return requestComputePipeline(createInfo).future.get();
+	}
+
+	/**
+	* Request a compute pipeline to be compiled on a worker thread
+	*
+	* @param createInfo Create info of the pipeline, all state pointed to is copied
+	* @param fallback (Optional) Pipeline returned by the request until the new pipeline is ready
+	*
+	* @return Request that returns the compiled pipeline once it's ready
+	*/
+	PipelineRequest PipelineManager::requestComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline fallback)
+	{
+		assert((createInfo.pNext == nullptr) && (createInfo.stage.pNext == nullptr));
+		std::shared_ptr<ShaderStageState> stage = std::make_shared<ShaderStageState>(createInfo.stage);
+		stage->finalize();
+		std::vector<uint64_t> key;
+		addKey(key, (uint64_t)createInfo.flags);
+		addKey(key, (uint64_t)createInfo.layout);
+		addKey(key, (uint64_t)createInfo.basePipelineHandle);
+		stage->addToKey(key);
+		VkComputePipelineCreateInfo computeCI = createInfo;
+		return request(std::move(key), [this, computeCI, stage]() mutable {
+			computeCI.stage = stage->createInfo;
+			VkPipeline pipeline;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computeCI, nullptr, &pipeline));
+			return pipeline;
+		}, fallback);
+	}
+
+	void PipelineManager::wait()
+	{
+		threadPool.wait();
+	}
+
+	uint32_t PipelineManager::pendingCount()
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		uint32_t count = 0;
+		for (auto& pipeline : pipelines) {
+			if (pipeline.second.future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				count++;
+			}
+		}
+		return count;
+	}
+
+	/**
+	* Wait for pending compilations and destroy all objects owned by the manager
+	*/
+	void PipelineManager::destroy()
+	{
+		wait();
+		for (auto& pipeline : pipelines) {
+			vkDestroyPipeline(device, pipeline.second.future.get(), nullptr);
+		}
+		for (auto& pipeline : uncachedPipelines) {
+			vkDestroyPipeline(device, pipeline, nullptr);
+		}
+		for (auto& pipelineLayout : pipelineLayouts) {
+			vkDestroyPipelineLayout(device, pipelineLayout.second.handle, nullptr);
+		}
+		for (auto& descriptorSetLayout : descriptorSetLayouts) {
+			vkDestroyDescriptorSetLayout(device, descriptorSetLayout.second.handle, nullptr);
+		}
+		pipelines.clear();
+		uncachedPipelines.clear();
+		pipelineLayouts.clear();
+		descriptorSetLayouts.clear();
+		threadPool.setThreadCount(0);
+	}
+}
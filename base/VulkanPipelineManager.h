@@ -0,0 +1,86 @@
+/*
+* Vulkan pipeline manager
+*
+* Deduplicates descriptor set layouts, pipeline layouts and pipelines by hashing their create infos
+* and compiles pipelines on background threads
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <future>
+#include <memory>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "threadpool.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Handle to a pipeline that may still be compiling on a worker thread
+	* @note Until compilation has finished, get() returns the fallback pipeline passed at request time
+	*/
+	struct PipelineRequest
+	{
+		std::shared_future<VkPipeline> future;
+		VkPipeline fallback{ VK_NULL_HANDLE };
+		bool ready() const;
+		VkPipeline get() const;
+	};
+
+	class PipelineManager
+	{
+	public:
+		VkDevice device{ VK_NULL_HANDLE };
+		VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+
+		void init(VkDevice device, VkPipelineCache pipelineCache, uint32_t threadCount = 0);
+		void destroy();
+
+		VkDescriptorSetLayout getDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& createInfo);
+		VkPipelineLayout getPipelineLayout(const VkPipelineLayoutCreateInfo& createInfo);
+
+		VkPipeline getGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo);
+		VkPipeline getComputePipeline(const VkComputePipelineCreateInfo& createInfo);
+		PipelineRequest requestGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline fallback = VK_NULL_HANDLE);
+		PipelineRequest requestComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline fallback = VK_NULL_HANDLE);
+
+		/** @brief Wait until all pending pipeline compilations have finished */
+		void wait();
+
+		/** @brief Number of pipelines that have been requested but not yet compiled */
+		uint32_t pendingCount();
+		/** @brief Number of requests that were served from already existing objects */
+		uint32_t cacheHits() const { return cacheHitCount; };
+	private:
+		struct PipelineEntry {
+			std::vector<uint64_t> key;
+			std::shared_future<VkPipeline> future;
+		};
+		template <typename T>
+		struct ObjectEntry {
+			std::vector<uint64_t> key;
+			T handle;
+		};
+		std::unordered_multimap<size_t, ObjectEntry<VkDescriptorSetLayout>> descriptorSetLayouts;
+		std::unordered_multimap<size_t, ObjectEntry<VkPipelineLayout>> pipelineLayouts;
+		std::unordered_multimap<size_t, PipelineEntry> pipelines;
+		std::vector<VkPipeline> uncachedPipelines;
+		std::mutex cacheMutex;
+		vks::ThreadPool threadPool;
+		uint32_t nextThread{ 0 };
+		uint32_t cacheHitCount{ 0 };
+
+		// Worker threads are only started once the first pipeline is requested
+		uint32_t threadCount{ 0 };
+
+		PipelineRequest request(std::vector<uint64_t>&& key, std::function<VkPipeline()> compile, VkPipeline fallback);
+	};
+}
@@ -0,0 +1,245 @@
+/*
+* Vulkan radix sort
+*
+* Sorts 32 bit keys with a 32 bit payload per key (e.g. an index) on the GPU using compute shaders
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanRadixSort.h"
+#include "VulkanInitializers.hpp"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+
+namespace vks
+{
+	namespace
+	{
+		void computeBarrier(VkCommandBuffer commandBuffer)
+		{
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+	}
+
+	void RadixSort::prepare(vks::VulkanDevice* device, vks::ShaderCache& shaderCache, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t maxCount)
+	{
+		this->device = device;
+		this->maxCount = maxCount;
+		VkDevice logicalDevice = device->logicalDevice;
+
+		const VkDeviceSize bufferSize = (VkDeviceSize)std::max(maxCount, 1u) * sizeof(uint32_t);
+		const uint32_t maxBlocks = (std::max(maxCount, 1u) + blockSize - 1) / blockSize;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &tempKeys, bufferSize));
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &tempValues, bufferSize));
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &histograms, (VkDeviceSize)radixSize * (maxBlocks + 1) * sizeof(uint32_t)));
+
+		// Binding 0 : Keys in, 1 : Values in, 2 : Keys out, 3 : Values out, 4 : Histograms
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+		for (uint32_t i = 0; i < 5; i++) {
+			setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, i));
+		}
+		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10)
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+		std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, descriptorSetLayout };
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, setLayouts.data(), 2);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, descriptorSets.data()));
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+		computePipelineCreateInfo.stage = shaderCache.loadShader(shadersPath + "base/radixsort_count.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.count));
+		computePipelineCreateInfo.stage = shaderCache.loadShader(shadersPath + "base/radixsort_scan.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.scan));
+		computePipelineCreateInfo.stage = shaderCache.loadShader(shadersPath + "base/radixsort_scatter.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.scatter));
+	}
+
+	void RadixSort::setBuffers(VkBuffer keys, VkBuffer values)
+	{
+		this->keys = keys;
+		this->values = values;
+		std::array<VkDescriptorBufferInfo, 2> sourceKeys = { { { keys, 0, VK_WHOLE_SIZE }, { tempKeys.buffer, 0, VK_WHOLE_SIZE } } };
+		std::array<VkDescriptorBufferInfo, 2> sourceValues = { { { values, 0, VK_WHOLE_SIZE }, { tempValues.buffer, 0, VK_WHOLE_SIZE } } };
+		VkDescriptorBufferInfo histogramInfo = { histograms.buffer, 0, VK_WHOLE_SIZE };
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+		for (uint32_t i = 0; i < 2; i++) {
+			const uint32_t dst = 1 - i;
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &sourceKeys[i]));
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &sourceValues[i]));
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &sourceKeys[dst]));
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &sourceValues[dst]));
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &histogramInfo));
+		}
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void RadixSort::record(VkCommandBuffer commandBuffer, uint32_t count, uint32_t keyBits)
+	{
+		assert(count <= maxCount);
+		if (count < 2) {
+			return;
+		}
+		// An even number of passes puts the result back into the caller's buffers
+		keyBits = std::min((keyBits + 7) & ~7u, 32u);
+		PushConstants pushConstants{ count, 0, (count + blockSize - 1) / blockSize };
+		const uint32_t passCount = keyBits / radixBits;
+		for (uint32_t pass = 0; pass < passCount; pass++) {
+			pushConstants.shift = pass * radixBits;
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[pass % 2], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.count);
+			vkCmdDispatch(commandBuffer, pushConstants.blockCount, 1, 1);
+			computeBarrier(commandBuffer);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.scan);
+			vkCmdDispatch(commandBuffer, radixSize, 1, 1);
+			computeBarrier(commandBuffer);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.scatter);
+			vkCmdDispatch(commandBuffer, pushConstants.blockCount, 1, 1);
+			if (pass < passCount - 1) {
+				computeBarrier(commandBuffer);
+			}
+		}
+	}
+
+	RadixSort::BenchmarkResult RadixSort::benchmark(VkQueue queue, uint32_t queueFamilyIndex, uint32_t count, uint32_t keyBits, uint32_t iterations)
+	{
+		assert(count <= maxCount);
+		BenchmarkResult result{};
+		VkDevice logicalDevice = device->logicalDevice;
+		const VkDeviceSize bufferSize = (VkDeviceSize)count * sizeof(uint32_t);
+
+		// Random keys with the payload set to the original index, so stability and payloads can be checked
+		std::vector<uint32_t> hostKeys(count), hostValues(count);
+		std::mt19937 rndEngine(count);
+		const uint32_t keyMask = (keyBits >= 32) ? 0xFFFFFFFFu : ((1u << keyBits) - 1);
+		for (uint32_t i = 0; i < count; i++) {
+			hostKeys[i] = rndEngine() & keyMask;
+			hostValues[i] = i;
+		}
+
+		vks::Buffer stagingKeys, stagingValues, benchmarkKeys, benchmarkValues;
+		const VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		const VkBufferUsageFlags deviceUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemory, &stagingKeys, bufferSize, hostKeys.data()));
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemory, &stagingValues, bufferSize, hostValues.data()));
+		VK_CHECK_RESULT(device->createBuffer(deviceUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &benchmarkKeys, bufferSize));
+		VK_CHECK_RESULT(device->createBuffer(deviceUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &benchmarkValues, bufferSize));
+
+		VkBuffer previousKeys = keys;
+		VkBuffer previousValues = values;
+		setBuffers(benchmarkKeys.buffer, benchmarkValues.buffer);
+
+		// Commands are recorded from a pool of the queue's family, which also decides if timestamps are supported
+		VkCommandPool commandPool = device->createCommandPool(queueFamilyIndex);
+		VkQueryPool queryPool{ VK_NULL_HANDLE };
+		const bool timestamps = device->queueFamilyProperties[queueFamilyIndex].timestampValidBits > 0;
+		if (timestamps) {
+			VkQueryPoolCreateInfo queryPoolInfo{};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+		}
+
+		// The first iteration is a warm up and not included in the timings
+		double totalTime = 0.0;
+		iterations = std::max(iterations, 1u);
+		for (uint32_t i = 0; i <= iterations; i++) {
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, commandPool, true);
+			VkBufferCopy copyRegion{ 0, 0, bufferSize };
+			vkCmdCopyBuffer(commandBuffer, stagingKeys.buffer, benchmarkKeys.buffer, 1, &copyRegion);
+			vkCmdCopyBuffer(commandBuffer, stagingValues.buffer, benchmarkValues.buffer, 1, &copyRegion);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			if (timestamps) {
+				vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			}
+			record(commandBuffer, count, keyBits);
+			if (timestamps) {
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+			}
+			if (i == iterations) {
+				// Read back the result of the last iteration
+				memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				vkCmdCopyBuffer(commandBuffer, benchmarkKeys.buffer, stagingKeys.buffer, 1, &copyRegion);
+				vkCmdCopyBuffer(commandBuffer, benchmarkValues.buffer, stagingValues.buffer, 1, &copyRegion);
+			}
+			device->flushCommandBuffer(commandBuffer, queue, commandPool, true);
+			uint64_t queryResults[2];
+			if ((i > 0) && timestamps && (vkGetQueryPoolResults(logicalDevice, queryPool, 0, 2, sizeof(queryResults), queryResults, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS)) {
+				totalTime += (double)(queryResults[1] - queryResults[0]) * device->properties.limits.timestampPeriod / 1000000.0;
+			}
+		}
+		result.milliseconds = (float)(totalTime / iterations);
+		result.megaKeysPerSecond = (result.milliseconds > 0.0f) ? (float)count / (result.milliseconds * 1000.0f) : 0.0f;
+
+		// Keys need to be in order, equal keys in the original order and each payload has to belong to its key
+		VK_CHECK_RESULT(stagingKeys.map());
+		VK_CHECK_RESULT(stagingValues.map());
+		const uint32_t* sortedKeys = static_cast<const uint32_t*>(stagingKeys.mapped);
+		const uint32_t* sortedValues = static_cast<const uint32_t*>(stagingValues.mapped);
+		result.valid = true;
+		for (uint32_t i = 0; i < count && result.valid; i++) {
+			if ((sortedValues[i] >= count) || (hostKeys[sortedValues[i]] != sortedKeys[i])) {
+				result.valid = false;
+			}
+			if ((i > 0) && ((sortedKeys[i - 1] > sortedKeys[i]) || ((sortedKeys[i - 1] == sortedKeys[i]) && (sortedValues[i - 1] > sortedValues[i])))) {
+				result.valid = false;
+			}
+		}
+
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(logicalDevice, queryPool, nullptr);
+		}
+		vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+		stagingKeys.destroy();
+		stagingValues.destroy();
+		benchmarkKeys.destroy();
+		benchmarkValues.destroy();
+		if ((previousKeys != VK_NULL_HANDLE) && (previousValues != VK_NULL_HANDLE)) {
+			setBuffers(previousKeys, previousValues);
+		}
+		return result;
+	}
+
+	void RadixSort::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroyPipeline(logicalDevice, pipelines.count, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelines.scan, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelines.scatter, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+		tempKeys.destroy();
+		tempValues.destroy();
+		histograms.destroy();
+		device = nullptr;
+	}
+}
@@ -0,0 +1,90 @@
+/*
+* Vulkan radix sort
+*
+* Sorts 32 bit keys with a 32 bit payload per key (e.g. an index) on the GPU using compute shaders
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <string>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanShaderCache.h"
+
+namespace vks
+{
+	/**
+	* @brief Stable least significant digit radix sort with 4 bit digits
+	* @note Each pass counts the digits per block of keys, scans the counts and scatters the keys (reduce then scan),
+	* so it doesn't rely on forward progress guarantees between work groups
+	* @note Keys and values are sorted in place, the temporary buffers used for ping-ponging are owned by the sorter
+	*/
+	class RadixSort
+	{
+	public:
+		static const uint32_t workGroupSize = 256;
+		static const uint32_t itemsPerThread = 16;
+		static const uint32_t blockSize = workGroupSize * itemsPerThread;
+		static const uint32_t radixBits = 4;
+		static const uint32_t radixSize = 1 << radixBits;
+
+		struct BenchmarkResult {
+			/** @brief Average GPU time of a single sort */
+			float milliseconds{ 0.0f };
+			/** @brief Throughput in million keys per second */
+			float megaKeysPerSecond{ 0.0f };
+			/** @brief True if the result was sorted, stable and kept the payloads with their keys */
+			bool valid{ false };
+		};
+
+		vks::VulkanDevice* device{ nullptr };
+		uint32_t maxCount{ 0 };
+
+		/** @brief Create pipelines and temporary buffers for sorting up to maxCount keys */
+		void prepare(vks::VulkanDevice* device, vks::ShaderCache& shaderCache, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t maxCount);
+		/** @brief Set the key and value buffers to sort (need storage buffer usage and room for maxCount elements) */
+		void setBuffers(VkBuffer keys, VkBuffer values);
+		/**
+		* @brief Record the commands for sorting the first count keys and values
+		* @note Only the lowest keyBits bits of the keys are sorted, rounded up to a multiple of 8 so the result ends up in the buffers passed to setBuffers
+		* @note Writes to the buffers need to be visible to compute shaders before, and a barrier is required before reading the results
+		*/
+		void record(VkCommandBuffer commandBuffer, uint32_t count, uint32_t keyBits = 32);
+		/**
+		* @brief Measure the throughput for sorting random keys and validate the results on the host
+		* @note Uses its own buffers, the buffers passed to setBuffers are restored afterwards
+		* @note queueFamilyIndex has to be the family of queue, timings are only taken if that family supports timestamps
+		*/
+		BenchmarkResult benchmark(VkQueue queue, uint32_t queueFamilyIndex, uint32_t count, uint32_t keyBits, uint32_t iterations);
+		void destroy();
+	private:
+		struct PushConstants {
+			uint32_t count;
+			uint32_t shift;
+			uint32_t blockCount;
+		};
+		vks::Buffer tempKeys;
+		vks::Buffer tempValues;
+		// Digit counts per block followed by the total count per digit
+		vks::Buffer histograms;
+		VkBuffer keys{ VK_NULL_HANDLE };
+		VkBuffer values{ VK_NULL_HANDLE };
+		VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+		// Passes alternate between sorting from the caller's buffers into the temporary buffers and back
+		std::array<VkDescriptorSet, 2> descriptorSets{};
+		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+		struct {
+			VkPipeline count{ VK_NULL_HANDLE };
+			VkPipeline scan{ VK_NULL_HANDLE };
+			VkPipeline scatter{ VK_NULL_HANDLE };
+		} pipelines;
+	};
+}
@@ -12,6 +12,7 @@
 #include "vulkanexamplebase.h"
 #include "VulkanTools.h"
 #include "VulkanDevice.h"
+#include "VulkanAccelerationStructureBuilder.h"
 
 class VulkanRaytracingSample : public VulkanExampleBase
 {
@@ -50,12 +51,7 @@ public:
 	};
 
 	// Holds information for a ray tracing acceleration structure
-	struct AccelerationStructure {
-		VkAccelerationStructureKHR handle;
-		uint64_t deviceAddress = 0;
-		VkDeviceMemory memory;
-		VkBuffer buffer;
-	};
+	using AccelerationStructure = vks::AccelerationStructure;
 
 	// Holds information for a storage image that the ray tracing shaders output to
 	struct StorageImage {
@@ -0,0 +1,122 @@
+/*
+* Vulkan shader cache
+*
+* Deduplicates shader modules by file path and SPIR-V content and loads SPIR-V from memory mapped files
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanShaderCache.h"
+
+namespace vks
+{
+	namespace
+	{
+		// 64-bit FNV-1a hash of the SPIR-V code
+		uint64_t hashCode(const uint32_t* code, size_t codeSize)
+		{
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(code);
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < codeSize; i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+	}
+
+	/**
+	* Initialize the shader cache
+	*
+	* @param device Logical device the shader modules are created on
+	*/
+	void ShaderCache::init(VkDevice device)
+	{
+		this->device = device;
+	}
+
+	/**
+	* Destroy all shader modules owned by the cache
+	*
+	* @note Pipelines created from these modules stay valid, but no new pipelines may be created with them
+	*/
+	void ShaderCache::destroy()
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		for (auto& module : modules) {
+			vkDestroyShaderModule(device, module.second.module, nullptr);
+		}
+		modules.clear();
+		shaders.clear();
+		cacheHitCount = 0;
+	}
+
+	/**
+	* Get a module for the SPIR-V code, reusing an existing module if identical code has been loaded before
+	*
+	* @note Must be called with the cache mutex locked
+	*/
+	VkShaderModule ShaderCache::createModule(const uint32_t* code, size_t codeSize)
+	{
+		uint64_t hash = hashCode(code, codeSize);
+		auto range = modules.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			const std::vector<uint32_t>& cachedCode = it->second.code;
+			if ((cachedCode.size() * sizeof(uint32_t) == codeSize) && (memcmp(cachedCode.data(), code, codeSize) == 0)) {
+				return it->second.module;
+			}
+		}
+		VkShaderModuleCreateInfo moduleCreateInfo{};
+		moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleCreateInfo.codeSize = codeSize;
+		moduleCreateInfo.pCode = code;
+		VkShaderModule module;
+		VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, nullptr, &module));
+		modules.insert({ hash, { std::vector<uint32_t>(code, code + codeSize / sizeof(uint32_t)), module } });
+		return module;
+	}
+
+	/**
+	* Load a SPIR-V shader, reusing the module if the same file or identical code has been loaded before
+	*
+	* @param fileName Path of the SPIR-V file
+	* @param stage Pipeline stage the shader is used for
+	*
+	* @return Shader stage create info referencing a module owned by the cache
+	*/
+	VkPipelineShaderStageCreateInfo ShaderCache::loadShader(const std::string& fileName, VkShaderStageFlagBits stage)
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		VkPipelineShaderStageCreateInfo shaderStage{};
+		shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStage.stage = stage;
+		shaderStage.pName = "main";
+
+		VkShaderModule& module = shaders[fileName];
+		if (module != VK_NULL_HANDLE) {
+			cacheHitCount++;
+			shaderStage.module = module;
+			return shaderStage;
+		}
+
+		// The SPIR-V is read straight from the mapped file (or uncompressed asset) without an intermediate copy
+#if defined(__ANDROID__)
+		AAsset* asset = AAssetManager_open(assetManager, fileName.c_str(), AASSET_MODE_BUFFER);
+		if (!asset) {
+			vks::tools::exitFatal("Could not open shader file \"" + fileName + "\"", -1);
+		}
+		module = createModule(reinterpret_cast<const uint32_t*>(AAsset_getBuffer(asset)), AAsset_getLength(asset));
+		AAsset_close(asset);
+#else
+		vks::tools::MappedFile file(fileName);
+		if (!file.isOpen()) {
+			vks::tools::exitFatal("Could not open shader file \"" + fileName + "\"", -1);
+		}
+		module = createModule(reinterpret_cast<const uint32_t*>(file.data()), file.size());
+#endif
+		shaderStage.module = module;
+		return shaderStage;
+	}
+}
@@ -0,0 +1,59 @@
+/*
+* Vulkan shader cache
+*
+* Deduplicates shader modules by file path and SPIR-V content and loads SPIR-V from memory mapped files
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Loads SPIR-V shaders and hands out one shader module per distinct shader
+	* @note Modules are owned by the cache and stay valid until destroy() is called
+	*/
+	class ShaderCache
+	{
+	public:
+		VkDevice device{ VK_NULL_HANDLE };
+#if defined(__ANDROID__)
+		AAssetManager* assetManager{ nullptr };
+#endif
+
+		void init(VkDevice device);
+		void destroy();
+
+		VkPipelineShaderStageCreateInfo loadShader(const std::string& fileName, VkShaderStageFlagBits stage);
+
+		/** @brief Number of shader modules currently owned by the cache */
+		uint32_t moduleCount() const { return static_cast<uint32_t>(modules.size()); };
+		/** @brief Number of loads that were served from already existing modules */
+		uint32_t cacheHits() const { return cacheHitCount; };
+	private:
+		struct ModuleEntry {
+			// Copy of the SPIR-V, so a hash collision can't hand out the module of a different shader
+			std::vector<uint32_t> code;
+			VkShaderModule module;
+		};
+		// Keyed by file path
+		std::unordered_map<std::string, VkShaderModule> shaders;
+		// Keyed by a hash of the SPIR-V code, so that identical shaders stored in different files share a module
+		std::unordered_multimap<uint64_t, ModuleEntry> modules;
+		std::mutex cacheMutex;
+		uint32_t cacheHitCount{ 0 };
+
+		VkShaderModule createModule(const uint32_t* code, size_t codeSize);
+	};
+}
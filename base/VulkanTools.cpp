@@ -8,6 +8,13 @@
 
 #include "VulkanTools.h"
 
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #if !(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT))
 // iOS & macOS: getAssetPath() and getShaderBasePath() implemented externally for access to Obj-C++ path utilities
 const std::string getAssetPath()
@@ -363,55 +370,42 @@ namespace vks
 		// So they need to be loaded via the asset manager
 		VkShaderModule loadShader(AAssetManager* assetManager, const char *fileName, VkDevice device)
 		{
-			// Load shader from compressed asset
-			AAsset* asset = AAssetManager_open(assetManager, fileName, AASSET_MODE_STREAMING);
+			// Uncompressed assets can be accessed in place without copying them
+			AAsset* asset = AAssetManager_open(assetManager, fileName, AASSET_MODE_BUFFER);
 			assert(asset);
 			size_t size = AAsset_getLength(asset);
 			assert(size > 0);
 
-			char *shaderCode = new char[size];
-			AAsset_read(asset, shaderCode, size);
-			AAsset_close(asset);
-
 			VkShaderModule shaderModule;
-			VkShaderModuleCreateInfo moduleCreateInfo;
+			VkShaderModuleCreateInfo moduleCreateInfo{};
 			moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-			moduleCreateInfo.pNext = NULL;
 			moduleCreateInfo.codeSize = size;
-			moduleCreateInfo.pCode = (uint32_t*)shaderCode;
-			moduleCreateInfo.flags = 0;
+			moduleCreateInfo.pCode = (const uint32_t*)AAsset_getBuffer(asset);
 
 			VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, NULL, &shaderModule));
 
-			delete[] shaderCode;
+			AAsset_close(asset);
 
 			return shaderModule;
 		}
 #else
 		VkShaderModule loadShader(const char *fileName, VkDevice device)
 		{
-			std::ifstream is(fileName, std::ios::binary | std::ios::in | std::ios::ate);
+			// The SPIR-V is passed to the driver straight from the mapped file, without an intermediate copy
+			MappedFile file(fileName);
 
-			if (is.is_open())
+			if (file.isOpen())
 			{
-				size_t size = is.tellg();
-				is.seekg(0, std::ios::beg);
-				char* shaderCode = new char[size];
-				is.read(shaderCode, size);
-				is.close();
-
-				assert(size > 0);
+				assert(file.size() > 0);
 
 				VkShaderModule shaderModule;
 				VkShaderModuleCreateInfo moduleCreateInfo{};
 				moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-				moduleCreateInfo.codeSize = size;
-				moduleCreateInfo.pCode = (uint32_t*)shaderCode;
+				moduleCreateInfo.codeSize = file.size();
+				moduleCreateInfo.pCode = (const uint32_t*)file.data();
 
 				VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, NULL, &shaderModule));
 
-				delete[] shaderCode;
-
 				return shaderModule;
 			}
 			else
@@ -428,6 +422,84 @@ namespace vks
 			return !f.fail();
 		}
 
+#if !defined(__ANDROID__)
+		/**
+		* Map a file into memory for reading
+		*
+		* @param filename Path of the file to map
+		*
+		* @return True if the file could be opened and mapped
+		*/
+		bool MappedFile::open(const std::string& filename)
+		{
+			close();
+#if defined(_WIN32)
+			fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (fileHandle == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(fileHandle, &fileSize) || (fileSize.QuadPart == 0)) {
+				close();
+				return false;
+			}
+			mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mappingHandle == NULL) {
+				close();
+				return false;
+			}
+			mappedData = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+			if (mappedData == nullptr) {
+				close();
+				return false;
+			}
+			mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+			int fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat fileStat;
+			if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0)) {
+				::close(fd);
+				return false;
+			}
+			void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			// The mapping stays valid after the descriptor has been closed
+			::close(fd);
+			if (data == MAP_FAILED) {
+				return false;
+			}
+			mappedData = data;
+			mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+			return true;
+		}
+
+		void MappedFile::close()
+		{
+#if defined(_WIN32)
+			if (mappedData) {
+				UnmapViewOfFile(mappedData);
+			}
+			if (mappingHandle != NULL) {
+				CloseHandle(mappingHandle);
+				mappingHandle = NULL;
+			}
+			if (fileHandle != INVALID_HANDLE_VALUE) {
+				CloseHandle(fileHandle);
+				fileHandle = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (mappedData) {
+				munmap(mappedData, mappedSize);
+			}
+#endif
+			mappedData = nullptr;
+			mappedSize = 0;
+		}
+#endif
+
 		uint32_t alignedSize(uint32_t value, uint32_t alignment)
         {
 	        return (value + alignment - 1) & ~(alignment - 1);
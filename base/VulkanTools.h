@@ -23,6 +23,7 @@
 #include <stdexcept>
 #include <fstream>
 #include <algorithm>
+#include <functional>
 #if defined(_WIN32)
 #include <windows.h>
 #include <fcntl.h>
@@ -132,7 +133,43 @@ namespace vks
 		/** @brief Checks if a file exists */
 		bool fileExists(const std::string &filename);
 
+#if !defined(__ANDROID__)
+		/**
+		* @brief Read-only memory mapping of a whole file
+		* @note The mapping is released when the object is closed or destroyed
+		*/
+		class MappedFile
+		{
+		public:
+			MappedFile() = default;
+			explicit MappedFile(const std::string& filename) { open(filename); };
+			~MappedFile() { close(); };
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			bool open(const std::string& filename);
+			void close();
+			bool isOpen() const { return mappedData != nullptr; };
+			const void* data() const { return mappedData; };
+			size_t size() const { return mappedSize; };
+		private:
+			void* mappedData{ nullptr };
+			size_t mappedSize{ 0 };
+#if defined(_WIN32)
+			HANDLE fileHandle{ INVALID_HANDLE_VALUE };
+			HANDLE mappingHandle{ NULL };
+#endif
+		};
+#endif
+
 		uint32_t alignedSize(uint32_t value, uint32_t alignment);
 		VkDeviceSize alignedVkSize(VkDeviceSize value, VkDeviceSize alignment);
+
+		/** @brief Combines the hash of a value into an existing seed (boost::hash_combine) */
+		template <typename T>
+		inline void hashCombine(size_t& seed, const T& value)
+		{
+			seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		}
 	}
 }
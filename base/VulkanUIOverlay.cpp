@@ -291,13 +291,16 @@ namespace vks
 #endif
 
 		// Vertex bindings an attributes based on ImGui vertex definition
+		// The clip rectangle of each draw is sourced per instance from the geometry ring, as scissors would have to be recorded into the command buffers
 		std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
 			vks::initializers::vertexInputBindingDescription(0, sizeof(ImDrawVert), VK_VERTEX_INPUT_RATE_VERTEX),
+			vks::initializers::vertexInputBindingDescription(1, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_INSTANCE),
 		};
 		std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
 			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(ImDrawVert, pos)),	// Location 0: Position
 			vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(ImDrawVert, uv)),	// Location 1: UV
 			vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R8G8B8A8_UNORM, offsetof(ImDrawVert, col)),	// Location 0: Color
+			vks::initializers::vertexInputAttributeDescription(1, 3, VK_FORMAT_R32G32B32A32_SFLOAT, 0),						// Location 3: Clip rectangle
 		};
 		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
 		vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
@@ -310,7 +313,53 @@ namespace vks
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
 	}
 
-	/** Update vertex and index buffer containing the imGui elements when required */
+	/** (Re)create the geometry ring buffer with one slot per frame in flight for the current capacities */
+	void UIOverlay::createGeometryBuffer()
+	{
+		if (geometryBuffer.buffer != VK_NULL_HANDLE) {
+			// The buffer may still be referenced by command buffers in flight
+			vkQueueWaitIdle(queue);
+			geometryBuffer.destroy();
+		}
+		// Index, indirect and clip data are placed behind the vertices of each slot, slots are aligned for non-coherent flushes
+		const VkDeviceSize atomSize = std::max(device->properties.limits.nonCoherentAtomSize, (VkDeviceSize)16);
+		indexDataOffset = vks::tools::alignedVkSize(vertexCapacity * sizeof(ImDrawVert), 16);
+		drawDataOffset = vks::tools::alignedVkSize(indexDataOffset + indexCapacity * sizeof(ImDrawIdx), 16);
+		clipDataOffset = vks::tools::alignedVkSize(drawDataOffset + drawCapacity * sizeof(VkDrawIndexedIndirectCommand), 16);
+		slotSize = vks::tools::alignedVkSize(clipDataOffset + drawCapacity * sizeof(glm::vec4), atomSize);
+		VK_CHECK_RESULT(device->createBuffer(
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			&geometryBuffer,
+			slotSize * frameSlots.size()));
+		VK_CHECK_RESULT(geometryBuffer.map());
+		// Force all slots to be rewritten
+		for (auto& slot : frameSlots) {
+			slot.generation = 0;
+		}
+	}
+
+	/** Set the number of frames that may be in flight, i.e. the number of slots in the geometry ring */
+	void UIOverlay::setFrameCount(uint32_t count)
+	{
+		assert(count > 0);
+		if (count == frameSlots.size()) {
+			return;
+		}
+		frameSlots.resize(count);
+		if (geometryBuffer.buffer != VK_NULL_HANDLE) {
+			createGeometryBuffer();
+		}
+	}
+
+	/**
+	* Check the current ImGui draw data against the geometry ring
+	*
+	* The ring only grows (geometrically) if the draw data no longer fits. Draw parameters and clip rectangles are
+	* written to the ring by upload(), so changes to the UI layout don't require re-recording command buffers.
+	*
+	* @return True if command buffers containing the UI need to be recorded again
+	*/
 	bool UIOverlay::update()
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
@@ -318,62 +367,108 @@ namespace vks
 
 		if (!imDrawData) { return false; };
 
-		// Note: Alignment is done inside buffer creation
-		VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
-		VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
-
-		// Update buffers only if vertex or index count has been changed compared to current buffer size
-		if ((vertexBufferSize == 0) || (indexBufferSize == 0)) {
+		if ((imDrawData->TotalVtxCount == 0) || (imDrawData->TotalIdxCount == 0)) {
 			return false;
 		}
 
-		// Vertex buffer
-		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount)) {
-			vertexBuffer.unmap();
-			vertexBuffer.destroy();
-			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vertexBuffer, vertexBufferSize));
-			vertexCount = imDrawData->TotalVtxCount;
-			vertexBuffer.unmap();
-			vertexBuffer.map();
-			updateCmdBuffers = true;
+		if (frameSlots.empty()) {
+			frameSlots.resize(1);
+		}
+
+		uint32_t drawCount = 0;
+		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++) {
+			drawCount += static_cast<uint32_t>(imDrawData->CmdLists[i]->CmdBuffer.Size);
 		}
 
-		// Index buffer
-		if ((indexBuffer.buffer == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount)) {
-			indexBuffer.unmap();
-			indexBuffer.destroy();
-			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &indexBuffer, indexBufferSize));
-			indexCount = imDrawData->TotalIdxCount;
-			indexBuffer.map();
+		// Grow the ring if the current draw data does not fit
+		const uint32_t vertexCount = static_cast<uint32_t>(imDrawData->TotalVtxCount);
+		const uint32_t indexCount = static_cast<uint32_t>(imDrawData->TotalIdxCount);
+		if ((geometryBuffer.buffer == VK_NULL_HANDLE) || (vertexCount > vertexCapacity) || (indexCount > indexCapacity) || (drawCount > drawCapacity)) {
+			vertexCapacity = std::max(vertexCount, std::max(vertexCapacity * 2, 4096u));
+			indexCapacity = std::max(indexCount, std::max(indexCapacity * 2, 8192u));
+			drawCapacity = std::max(drawCount, std::max(drawCapacity * 2, 16u));
+			createGeometryBuffer();
 			updateCmdBuffers = true;
 		}
 
-		// Upload data
-		ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mapped;
-		ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer.mapped;
+		generation++;
+
+		return updateCmdBuffers;
+	}
 
-		for (int n = 0; n < imDrawData->CmdListsCount; n++) {
-			const ImDrawList* cmd_list = imDrawData->CmdLists[n];
+	/**
+	* Write the current ImGui draw data into the ring slot of the given frame, if that slot is outdated
+	*
+	* @note The caller must ensure that the GPU is no longer reading the slot (e.g. after acquiring the frame's swap chain image)
+	*
+	* @param frameIndex Index of the frame in flight the data is written for
+	*/
+	void UIOverlay::upload(uint32_t frameIndex)
+	{
+		ImDrawData* imDrawData = ImGui::GetDrawData();
+		if ((!imDrawData) || (geometryBuffer.buffer == VK_NULL_HANDLE) || (frameIndex >= frameSlots.size())) {
+			return;
+		}
+		FrameSlot& slot = frameSlots[frameIndex];
+		if (slot.generation == generation) {
+			return;
+		}
+		if (((uint32_t)imDrawData->TotalVtxCount > vertexCapacity) || ((uint32_t)imDrawData->TotalIdxCount > indexCapacity)) {
+			return;
+		}
+		uint32_t drawCount = 0;
+		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++) {
+			drawCount += static_cast<uint32_t>(imDrawData->CmdLists[i]->CmdBuffer.Size);
+		}
+		if (drawCount > drawCapacity) {
+			return;
+		}
+
+		uint8_t* slotData = (uint8_t*)geometryBuffer.mapped + slotSize * frameIndex;
+		ImDrawVert* vtxDst = (ImDrawVert*)slotData;
+		ImDrawIdx* idxDst = (ImDrawIdx*)(slotData + indexDataOffset);
+		VkDrawIndexedIndirectCommand* drawDst = (VkDrawIndexedIndirectCommand*)(slotData + drawDataOffset);
+		glm::vec4* clipDst = (glm::vec4*)(slotData + clipDataOffset);
+
+		uint32_t drawIndex = 0;
+		int32_t vertexOffset = 0;
+		uint32_t indexOffset = 0;
+		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++) {
+			const ImDrawList* cmd_list = imDrawData->CmdLists[i];
 			memcpy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
 			memcpy(idxDst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
 			vtxDst += cmd_list->VtxBuffer.Size;
 			idxDst += cmd_list->IdxBuffer.Size;
+			for (int32_t j = 0; j < cmd_list->CmdBuffer.Size; j++) {
+				const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[j];
+				drawDst[drawIndex] = { pcmd->ElemCount, 1, indexOffset, vertexOffset, 0 };
+				clipDst[drawIndex] = glm::vec4(pcmd->ClipRect.x, pcmd->ClipRect.y, pcmd->ClipRect.z, pcmd->ClipRect.w);
+				drawIndex++;
+				indexOffset += pcmd->ElemCount;
+			}
+			vertexOffset += cmd_list->VtxBuffer.Size;
+		}
+		// Recorded draws without matching ImGui command are skipped
+		for (; drawIndex < drawCapacity; drawIndex++) {
+			drawDst[drawIndex] = { 0, 0, 0, 0, 0 };
 		}
 
 		// Flush to make writes visible to GPU
-		vertexBuffer.flush();
-		indexBuffer.flush();
-
-		return updateCmdBuffers;
+		geometryBuffer.flush(slotSize, slotSize * frameIndex);
+		slot.generation = generation;
 	}
 
-	void UIOverlay::draw(const VkCommandBuffer commandBuffer)
+	/**
+	* Record the UI draw commands, with vertex, index, draw parameters and clip rectangles sourced from the given ring slot
+	*
+	* @note The number of recorded draws only depends on the ring's capacity, unused draws are zeroed by upload()
+	*
+	* @param commandBuffer Command buffer to record the commands to
+	* @param frameIndex Index of the frame in flight the command buffer is submitted for
+	*/
+	void UIOverlay::draw(const VkCommandBuffer commandBuffer, uint32_t frameIndex)
 	{
-		ImDrawData* imDrawData = ImGui::GetDrawData();
-		int32_t vertexOffset = 0;
-		int32_t indexOffset = 0;
-
-		if ((!imDrawData) || (imDrawData->CmdListsCount == 0)) {
+		if ((geometryBuffer.buffer == VK_NULL_HANDLE) || (drawCapacity == 0) || (frameIndex >= frameSlots.size())) {
 			return;
 		}
 
@@ -386,26 +481,16 @@ namespace vks
 		pushConstBlock.translate = glm::vec2(-1.0f);
 		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 
-		VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		const VkDeviceSize slotOffset = slotSize * frameIndex;
+		VkDeviceSize offsets[1] = { slotOffset };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &geometryBuffer.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, geometryBuffer.buffer, slotOffset + indexDataOffset, VK_INDEX_TYPE_UINT16);
 
-		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++)
-		{
-			const ImDrawList* cmd_list = imDrawData->CmdLists[i];
-			for (int32_t j = 0; j < cmd_list->CmdBuffer.Size; j++)
-			{
-				const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[j];
-				VkRect2D scissorRect;
-				scissorRect.offset.x = std::max((int32_t)(pcmd->ClipRect.x), 0);
-				scissorRect.offset.y = std::max((int32_t)(pcmd->ClipRect.y), 0);
-				scissorRect.extent.width = (uint32_t)(pcmd->ClipRect.z - pcmd->ClipRect.x);
-				scissorRect.extent.height = (uint32_t)(pcmd->ClipRect.w - pcmd->ClipRect.y);
-				vkCmdSetScissor(commandBuffer, 0, 1, &scissorRect);
-				vkCmdDrawIndexed(commandBuffer, pcmd->ElemCount, 1, indexOffset, vertexOffset, 0);
-				indexOffset += pcmd->ElemCount;
-			}
-			vertexOffset += cmd_list->VtxBuffer.Size;
+		// One indirect draw per ImGui command, each one sourcing its clip rectangle as the single instance attribute
+		for (uint32_t i = 0; i < drawCapacity; i++) {
+			VkDeviceSize clipOffset = slotOffset + clipDataOffset + i * sizeof(glm::vec4);
+			vkCmdBindVertexBuffers(commandBuffer, 1, 1, &geometryBuffer.buffer, &clipOffset);
+			vkCmdDrawIndexedIndirect(commandBuffer, geometryBuffer.buffer, slotOffset + drawDataOffset + i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
 		}
 	}
 
@@ -417,8 +502,7 @@ namespace vks
 
 	void UIOverlay::freeResources()
 	{
-		vertexBuffer.destroy();
-		indexBuffer.destroy();
+		geometryBuffer.destroy();
 		vkDestroyImageView(device->logicalDevice, fontView, nullptr);
 		vkDestroyImage(device->logicalDevice, fontImage, nullptr);
 		vkFreeMemory(device->logicalDevice, fontMemory, nullptr);
@@ -39,10 +39,15 @@ namespace vks
 		VkSampleCountFlagBits rasterizationSamples{ VK_SAMPLE_COUNT_1_BIT };
 		uint32_t subpass{ 0 };
 
-		vks::Buffer vertexBuffer;
-		vks::Buffer indexBuffer;
-		int32_t vertexCount{ 0 };
-		int32_t indexCount{ 0 };
+		/**
+		* Persistently mapped ring with one slot per frame in flight, each holding the vertices, indices,
+		* indirect draw commands and clip rectangles of the UI. Command buffers only reference the slots
+		* with a fixed number of draws, so they only need to be recorded again if the ring grows.
+		*/
+		vks::Buffer geometryBuffer;
+		uint32_t vertexCapacity{ 0 };
+		uint32_t indexCapacity{ 0 };
+		uint32_t drawCapacity{ 0 };
 
 		std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
@@ -73,8 +78,10 @@ namespace vks
 		void preparePipeline(const VkPipelineCache pipelineCache, const VkRenderPass renderPass, const VkFormat colorFormat, const VkFormat depthFormat);
 		void prepareResources();
 
+		void setFrameCount(uint32_t count);
 		bool update();
-		void draw(const VkCommandBuffer commandBuffer);
+		void upload(uint32_t frameIndex);
+		void draw(const VkCommandBuffer commandBuffer, uint32_t frameIndex = 0);
 		void resize(uint32_t width, uint32_t height);
 
 		void freeResources();
@@ -90,5 +97,18 @@ namespace vks
 		bool button(const char* caption);
 		bool colorPicker(const char* caption, float* color);
 		void text(const char* formatstr, ...);
+	private:
+		struct FrameSlot {
+			// Generation of the draw data last written to this slot
+			uint64_t generation{ 0 };
+		};
+		std::vector<FrameSlot> frameSlots;
+		uint64_t generation{ 0 };
+		VkDeviceSize slotSize{ 0 };
+		VkDeviceSize indexDataOffset{ 0 };
+		VkDeviceSize drawDataOffset{ 0 };
+		VkDeviceSize clipDataOffset{ 0 };
+
+		void createGeometryBuffer();
 	};
 }
@@ -22,6 +22,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "VulkanDescriptorAllocator.h"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -99,7 +100,7 @@ namespace vkglTF
 		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
 
 		Material(vks::VulkanDevice* device) : device(device) {};
-		void createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
+		void createDescriptorSet(vks::DescriptorAllocator& descriptorAllocator, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
 	};
 
 	/*
@@ -261,7 +262,8 @@ namespace vkglTF
 		void createEmptyTexture(VkQueue transferQueue);
 	public:
 		vks::VulkanDevice* device;
-		VkDescriptorPool descriptorPool;
+		// Descriptor sets are allocated from a growable pool chain, so no up-front counting of samplers and buffers is required
+		vks::DescriptorAllocator descriptorAllocator;
 
 		struct Vertices {
 			int count;
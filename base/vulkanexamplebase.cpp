@@ -199,6 +199,7 @@ void VulkanExampleBase::createPipelineCache()
 	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
 	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
 	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	pipelineManager.init(device, pipelineCache);
 }
 
 void VulkanExampleBase::prepare()
@@ -222,20 +223,13 @@ void VulkanExampleBase::prepare()
 		};
 		ui.prepareResources();
 		ui.preparePipeline(pipelineCache, renderPass, swapChain.colorFormat, depthFormat);
+		ui.setFrameCount(static_cast<uint32_t>(drawCmdBuffers.size()));
 	}
 }
 
 VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileName, VkShaderStageFlagBits stage)
 {
-	VkPipelineShaderStageCreateInfo shaderStage = {};
-	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	shaderStage.stage = stage;
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-	shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device);
-#else
-	shaderStage.module = vks::tools::loadShader(fileName.c_str(), device);
-#endif
-	shaderStage.pName = "main";
+	VkPipelineShaderStageCreateInfo shaderStage = shaderCache.loadShader(fileName, stage);
 	assert(shaderStage.module != VK_NULL_HANDLE);
 	shaderModules.push_back(shaderStage.module);
 	return shaderStage;
@@ -296,7 +290,7 @@ void VulkanExampleBase::renderLoop()
 // SRS - for non-apple plaforms, handle benchmarking here within VulkanExampleBase::renderLoop()
 //     - for macOS, handle benchmarking within NSApp rendering loop via displayLinkOutputCb()
 #if !(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT))
-	if (benchmark.active) {
+	if (benchmark.active && !exitRequested) {
 #if defined(VK_USE_PLATFORM_WAYLAND_KHR)
 		while (!configured)
 		{
@@ -330,7 +324,7 @@ void VulkanExampleBase::renderLoop()
 #if defined(_WIN32)
 	MSG msg;
 	bool quitMessageReceived = false;
-	while (!quitMessageReceived) {
+	while (!quitMessageReceived && !exitRequested) {
 		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
 			TranslateMessage(&msg);
 			DispatchMessage(&msg);
@@ -369,7 +363,7 @@ void VulkanExampleBase::renderLoop()
 
 		// App destruction requested
 		// Exit loop, example will be destroyed in application main
-		if (destroy)
+		if (destroy || exitRequested)
 		{
 			ANativeActivity_finish(androidApp->activity);
 			break;
@@ -443,7 +437,7 @@ void VulkanExampleBase::renderLoop()
 		}
 	}
 #elif defined(_DIRECT2DISPLAY)
-	while (!quit)
+	while (!quit && !exitRequested)
 	{
 		auto tStart = std::chrono::high_resolution_clock::now();
 		if (viewUpdated)
@@ -479,7 +473,7 @@ void VulkanExampleBase::renderLoop()
 		updateOverlay();
 	}
 #elif defined(VK_USE_PLATFORM_DIRECTFB_EXT)
-	while (!quit)
+	while (!quit && !exitRequested)
 	{
 		auto tStart = std::chrono::high_resolution_clock::now();
 		if (viewUpdated)
@@ -520,7 +514,7 @@ void VulkanExampleBase::renderLoop()
 		updateOverlay();
 	}
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	while (!quit)
+	while (!quit && !exitRequested)
 	{
 		auto tStart = std::chrono::high_resolution_clock::now();
 		if (viewUpdated)
@@ -578,7 +572,7 @@ void VulkanExampleBase::renderLoop()
 	}
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
 	xcb_flush(connection);
-	while (!quit)
+	while (!quit && !exitRequested)
 	{
 		auto tStart = std::chrono::high_resolution_clock::now();
 		if (viewUpdated)
@@ -627,7 +621,7 @@ void VulkanExampleBase::renderLoop()
 		updateOverlay();
 	}
 #elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
-	while (!quit)
+	while (!quit && !exitRequested)
 	{
 		auto tStart = std::chrono::high_resolution_clock::now();
 		if (viewUpdated)
@@ -662,7 +656,7 @@ void VulkanExampleBase::renderLoop()
 #elif (defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT)) && defined(VK_EXAMPLE_XCODE_GENERATED)
 	[NSApp run];
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
-	while (!quit) {
+	while (!quit && !exitRequested) {
 		handleEvent();
 
 		if (prepared) {
@@ -724,6 +718,7 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::PopStyleVar();
 	ImGui::Render();
 
+	// UI geometry, draw parameters and clip rectangles are written to the ring in prepareFrame, so command buffers only need to be rebuilt if the ring had to grow or the example's UI settings changed
 	if (ui.update() || ui.updated) {
 		buildCommandBuffers();
 		ui.updated = false;
@@ -744,7 +739,16 @@ void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		ui.draw(commandBuffer);
+		// Command buffers are recorded per swap chain image, so each one sources the UI geometry from the ring slot of its image
+		// Command buffers not from that list are expected to be recorded for the current frame
+		uint32_t frameIndex = currentBuffer;
+		for (uint32_t i = 0; i < drawCmdBuffers.size(); i++) {
+			if (drawCmdBuffers[i] == commandBuffer) {
+				frameIndex = i;
+				break;
+			}
+		}
+		ui.draw(commandBuffer, frameIndex);
 	}
 }
 
@@ -763,6 +767,10 @@ void VulkanExampleBase::prepareFrame()
 	else {
 		VK_CHECK_RESULT(result);
 	}
+	// Write the latest UI geometry to the ring slot of the acquired image, which is no longer in use by the GPU
+	if (settings.overlay) {
+		ui.upload(currentBuffer);
+	}
 }
 
 void VulkanExampleBase::submitFrame()
@@ -913,10 +921,9 @@ VulkanExampleBase::~VulkanExampleBase()
 		vkDestroyFramebuffer(device, frameBuffers[i], nullptr);
 	}
 
-	for (auto& shaderModule : shaderModules)
-	{
-		vkDestroyShaderModule(device, shaderModule, nullptr);
-	}
+	// Waits for pipelines still being compiled in the background, as these may reference the shader modules
+	pipelineManager.destroy();
+	shaderCache.destroy();
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.memory, nullptr);
@@ -1074,6 +1081,11 @@ bool VulkanExampleBase::initVulkan()
 	}
 	device = vulkanDevice->logicalDevice;
 
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	shaderCache.assetManager = androidApp->activity->assetManager;
+#endif
+	shaderCache.init(device);
+
 	// Get a graphics queue from the device
 	vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.graphics, 0, &queue);
 
@@ -1935,6 +1947,10 @@ void* VulkanExampleBase::setupWindow(void* view)
 void VulkanExampleBase::displayLinkOutputCb()
 {
 #if defined(VK_EXAMPLE_XCODE_GENERATED)
+	if (exitRequested) {
+		quit = true;
+		return;
+	}
 	if (benchmark.active) {
 		benchmark.run([=] { render(); }, vulkanDevice->properties);
 		if (benchmark.filename != "") {
@@ -3206,6 +3222,10 @@ void VulkanExampleBase::windowResize()
 	// references to the recreated frame buffer
 	destroyCommandBuffers();
 	createCommandBuffers();
+	if (settings.overlay) {
+		// The number of swap chain images may have changed
+		ui.setFrameCount(static_cast<uint32_t>(drawCmdBuffers.size()));
+	}
 	buildCommandBuffers();
 
 	// SRS - Recreate fences in case number of swapchain images has changed on resize
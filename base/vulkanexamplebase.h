@@ -68,6 +68,8 @@
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
 #include "VulkanTexture.h"
+#include "VulkanPipelineManager.h"
+#include "VulkanShaderCache.h"
 
 #include "VulkanInitializers.hpp"
 #include "camera.hpp"
@@ -139,10 +141,14 @@ protected:
 	uint32_t currentBuffer = 0;
 	// Descriptor set pool
 	VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
-	// List of shader modules created (stored for cleanup)
+	// List of shader modules returned by loadShader in load order (owned by the shader cache)
 	std::vector<VkShaderModule> shaderModules;
+	/** @brief Shares shader modules between loads of the same file or identical SPIR-V */
+	vks::ShaderCache shaderCache;
 	// Pipeline cache object
 	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+	/** @brief Deduplicates layouts and pipelines and compiles pipelines on background threads (uses the pipeline cache above) */
+	vks::PipelineManager pipelineManager;
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
 	VulkanSwapChain swapChain;
 	// Synchronization semaphores
@@ -157,6 +163,10 @@ protected:
 public:
 	bool prepared = false;
 	bool resized = false;
+	/** @brief Set by an example to leave the render loop, e.g. once a command line triggered one-time task has finished. The example is then shut down and destroyed regularly */
+	bool exitRequested = false;
+	/** @brief Process exit code returned from main once the example has been destroyed, e.g. to report a failed command line triggered test */
+	int exitCode = 0;
 	bool viewUpdated = false;
 	uint32_t width = 1280;
 	uint32_t height = 720;
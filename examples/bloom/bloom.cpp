@@ -1,11 +1,16 @@
 /*
 * Vulkan Example - Implements a separable two-pass fullscreen blur (also known as bloom)
 *
-* Copyright (C) 2016 - 2023 Sascha Willems - www.saschawillems.de
+* Alternatively the bloom can be generated with compute shaders that progressively downsample the glow pass into a mip chain
+* and then accumulate it back up with tent filtered upsamples (dual filtering), which results in a wide radius at a cost that
+* doesn't depend on the radius
+*
+* Copyright (C) 2016 - 2024 Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <iomanip>
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
 
@@ -14,11 +19,23 @@
 #define FB_DIM 256
 #define FB_COLOR_FORMAT VK_FORMAT_R8G8B8A8_UNORM
 
+// Bloom mip chain properties
+#define BLOOM_MAX_MIPS 8
+#define BLOOM_CHAIN_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+// Has to match the tile size of the downsample and upsample compute shaders
+#define BLOOM_TILE_SIZE 8
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	bool bloom = true;
 
+	enum BloomMode { Gaussian = 0, MipChain = 1 };
+	int32_t bloomMode = MipChain;
+	// Index into offscreenDims, selects the resolution of the offscreen glow pass
+	int32_t offscreenDimIndex = 0;
+	const std::vector<uint32_t> offscreenDims = { FB_DIM, FB_DIM * 2, FB_DIM * 4 };
+
 	vks::TextureCubeMap cubemap;
 
 	struct {
@@ -55,11 +72,17 @@ public:
 		VkPipeline glowPass;
 		VkPipeline phongPass;
 		VkPipeline skyBox;
+		VkPipeline composite;
+		VkPipeline downsample;
+		VkPipeline upsample;
+		// Horizontal blur into an offscreen framebuffer, only used by the benchmark
+		VkPipeline blurHorzOffscreen{ VK_NULL_HANDLE };
 	} pipelines;
 
 	struct {
 		VkPipelineLayout blur;
 		VkPipelineLayout scene;
+		VkPipelineLayout bloomChain;
 	} pipelineLayouts;
 
 	struct {
@@ -67,11 +90,16 @@ public:
 		VkDescriptorSet blurHorz;
 		VkDescriptorSet scene;
 		VkDescriptorSet skyBox;
+		VkDescriptorSet composite;
+		// Per level of the mip chain
+		std::array<VkDescriptorSet, BLOOM_MAX_MIPS> downsample;
+		std::array<VkDescriptorSet, BLOOM_MAX_MIPS> upsample;
 	} descriptorSets;
 
 	struct {
 		VkDescriptorSetLayout blur;
 		VkDescriptorSetLayout scene;
+		VkDescriptorSetLayout bloomChain;
 	} descriptorSetLayouts;
 
 	// Framebuffer for offscreen rendering
@@ -92,6 +120,17 @@ public:
 		std::array<FrameBuffer, 2> framebuffers;
 	} offscreenPass;
 
+	// Mip chain used by the compute bloom, the first level is half the size of the offscreen pass
+	// All levels stay in the general layout as they are both written as storage images and sampled
+	struct BloomChain {
+		VkImage image;
+		VkDeviceMemory mem;
+		uint32_t levels;
+		std::array<VkImageView, BLOOM_MAX_MIPS> views;
+		std::array<VkExtent2D, BLOOM_MAX_MIPS> extents;
+		std::array<VkDescriptorImageInfo, BLOOM_MAX_MIPS> descriptors;
+	} bloomChain;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Bloom (offscreen rendering)";
@@ -100,6 +139,8 @@ public:
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -10.25f));
 		camera.setRotation(glm::vec3(7.5f, -343.0f, 0.0f));
 		camera.setPerspective(45.0f, (float)width / (float)height, 0.1f, 256.0f);
+		commandLineParser.add("bloombenchmark", { "-bb", "--bloombenchmark" }, 0, "Compare the GPU times of the gaussian blur and the mip chain bloom at several resolutions and exit");
+		commandLineParser.parse(args);
 	}
 
 	~VulkanExample()
@@ -109,32 +150,26 @@ public:
 
 		vkDestroySampler(device, offscreenPass.sampler, nullptr);
 
-		// Frame buffer
-		for (auto& framebuffer : offscreenPass.framebuffers)
-		{
-			// Attachments
-			vkDestroyImageView(device, framebuffer.color.view, nullptr);
-			vkDestroyImage(device, framebuffer.color.image, nullptr);
-			vkFreeMemory(device, framebuffer.color.mem, nullptr);
-			vkDestroyImageView(device, framebuffer.depth.view, nullptr);
-			vkDestroyImage(device, framebuffer.depth.image, nullptr);
-			vkFreeMemory(device, framebuffer.depth.mem, nullptr);
-
-			vkDestroyFramebuffer(device, framebuffer.framebuffer, nullptr);
-		}
+		destroyOffscreenFramebuffers();
 		vkDestroyRenderPass(device, offscreenPass.renderPass, nullptr);
 
 		vkDestroyPipeline(device, pipelines.blurHorz, nullptr);
 		vkDestroyPipeline(device, pipelines.blurVert, nullptr);
+		vkDestroyPipeline(device, pipelines.blurHorzOffscreen, nullptr);
 		vkDestroyPipeline(device, pipelines.phongPass, nullptr);
 		vkDestroyPipeline(device, pipelines.glowPass, nullptr);
 		vkDestroyPipeline(device, pipelines.skyBox, nullptr);
+		vkDestroyPipeline(device, pipelines.composite, nullptr);
+		vkDestroyPipeline(device, pipelines.downsample, nullptr);
+		vkDestroyPipeline(device, pipelines.upsample, nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayouts.blur , nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayouts.scene, nullptr);
+		vkDestroyPipelineLayout(device, pipelineLayouts.bloomChain, nullptr);
 
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.blur, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.scene, nullptr);
+		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.bloomChain, nullptr);
 
 		// Uniform buffers
 		uniformBuffers.scene.destroy();
@@ -146,14 +181,14 @@ public:
 
 	// Setup the offscreen framebuffer for rendering the mirrored scene
 	// The color attachment of this framebuffer will then be sampled from
-	void prepareOffscreenFramebuffer(FrameBuffer *frameBuf, VkFormat colorFormat, VkFormat depthFormat)
+	void prepareOffscreenFramebuffer(FrameBuffer *frameBuf, VkFormat colorFormat, VkFormat depthFormat, uint32_t dim)
 	{
 		// Color attachment
 		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
 		image.imageType = VK_IMAGE_TYPE_2D;
 		image.format = colorFormat;
-		image.extent.width = FB_DIM;
-		image.extent.height = FB_DIM;
+		image.extent.width = dim;
+		image.extent.height = dim;
 		image.extent.depth = 1;
 		image.mipLevels = 1;
 		image.arrayLayers = 1;
@@ -222,8 +257,8 @@ public:
 		fbufCreateInfo.renderPass = offscreenPass.renderPass;
 		fbufCreateInfo.attachmentCount = 2;
 		fbufCreateInfo.pAttachments = attachments;
-		fbufCreateInfo.width = FB_DIM;
-		fbufCreateInfo.height = FB_DIM;
+		fbufCreateInfo.width = dim;
+		fbufCreateInfo.height = dim;
 		fbufCreateInfo.layers = 1;
 
 		VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuf->framebuffer));
@@ -234,12 +269,107 @@ public:
 		frameBuf->descriptor.sampler = offscreenPass.sampler;
 	}
 
-	// Prepare the offscreen framebuffers used for the vertical- and horizontal blur
-	void prepareOffscreen()
+	// Create the offscreen framebuffers used for the glow pass and the vertical blur with a size of dim x dim
+	void prepareOffscreenFramebuffers(uint32_t dim)
 	{
-		offscreenPass.width = FB_DIM;
-		offscreenPass.height = FB_DIM;
+		offscreenPass.width = dim;
+		offscreenPass.height = dim;
 
+		VkFormat fbDepthFormat;
+		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &fbDepthFormat);
+		assert(validDepthFormat);
+
+		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[0], FB_COLOR_FORMAT, fbDepthFormat, dim);
+		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[1], FB_COLOR_FORMAT, fbDepthFormat, dim);
+	}
+
+	void destroyOffscreenFramebuffers()
+	{
+		for (auto& framebuffer : offscreenPass.framebuffers)
+		{
+			// Attachments
+			vkDestroyImageView(device, framebuffer.color.view, nullptr);
+			vkDestroyImage(device, framebuffer.color.image, nullptr);
+			vkFreeMemory(device, framebuffer.color.mem, nullptr);
+			vkDestroyImageView(device, framebuffer.depth.view, nullptr);
+			vkDestroyImage(device, framebuffer.depth.image, nullptr);
+			vkFreeMemory(device, framebuffer.depth.mem, nullptr);
+
+			vkDestroyFramebuffer(device, framebuffer.framebuffer, nullptr);
+		}
+	}
+
+	// Create the mip chain for the compute bloom based on the current size of the offscreen pass
+	void prepareBloomChain()
+	{
+		// Stop at a level of at least 4x4 texels, the levels below that don't add anything visible
+		uint32_t dimLog2 = 0;
+		while ((1u << (dimLog2 + 1)) <= (uint32_t)offscreenPass.width) {
+			dimLog2++;
+		}
+		bloomChain.levels = std::max(std::min((uint32_t)BLOOM_MAX_MIPS, dimLog2 - 2), 1u);
+
+		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
+		image.imageType = VK_IMAGE_TYPE_2D;
+		image.format = BLOOM_CHAIN_FORMAT;
+		image.extent.width = std::max(offscreenPass.width / 2, 1);
+		image.extent.height = std::max(offscreenPass.height / 2, 1);
+		image.extent.depth = 1;
+		image.mipLevels = bloomChain.levels;
+		image.arrayLayers = 1;
+		image.samples = VK_SAMPLE_COUNT_1_BIT;
+		image.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &bloomChain.image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, bloomChain.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &bloomChain.mem));
+		VK_CHECK_RESULT(vkBindImageMemory(device, bloomChain.image, bloomChain.mem, 0));
+
+		// Each level gets its own view, so it can be bound as a storage image and sampled without selecting the level in the shaders
+		for (uint32_t i = 0; i < bloomChain.levels; i++) {
+			VkImageViewCreateInfo view = vks::initializers::imageViewCreateInfo();
+			view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			view.format = BLOOM_CHAIN_FORMAT;
+			view.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+			view.image = bloomChain.image;
+			VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &bloomChain.views[i]));
+			bloomChain.extents[i] = { std::max(image.extent.width >> i, 1u), std::max(image.extent.height >> i, 1u) };
+			bloomChain.descriptors[i] = { offscreenPass.sampler, bloomChain.views[i], VK_IMAGE_LAYOUT_GENERAL };
+		}
+
+		VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vks::tools::setImageLayout(layoutCmd, bloomChain.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, bloomChain.levels, 0, 1 });
+		vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
+	}
+
+	void destroyBloomChain()
+	{
+		for (uint32_t i = 0; i < bloomChain.levels; i++) {
+			vkDestroyImageView(device, bloomChain.views[i], nullptr);
+		}
+		vkDestroyImage(device, bloomChain.image, nullptr);
+		vkFreeMemory(device, bloomChain.mem, nullptr);
+	}
+
+	// Change the resolution of the offscreen pass and the bloom mip chain
+	void resizeOffscreen(uint32_t dim)
+	{
+		vkDeviceWaitIdle(device);
+		destroyBloomChain();
+		destroyOffscreenFramebuffers();
+		prepareOffscreenFramebuffers(dim);
+		prepareBloomChain();
+		updateDescriptorSets();
+	}
+
+	// Prepare the offscreen render pass and framebuffers used for the vertical- and horizontal blur
+	void prepareOffscreen()
+	{
 		// Find a suitable depth format
 		VkFormat fbDepthFormat;
 		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &fbDepthFormat);
@@ -323,8 +453,67 @@ public:
 		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &offscreenPass.sampler));
 
 		// Create two frame buffers
-		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[0], FB_COLOR_FORMAT, fbDepthFormat);
-		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[1], FB_COLOR_FORMAT, fbDepthFormat);
+		prepareOffscreenFramebuffers(offscreenDims[offscreenDimIndex]);
+		prepareBloomChain();
+	}
+
+	// Vertical blur of the glow pass into the second offscreen framebuffer
+	void drawVerticalBlur(VkCommandBuffer commandBuffer)
+	{
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = offscreenPass.renderPass;
+		renderPassBeginInfo.framebuffer = offscreenPass.framebuffers[1].framebuffer;
+		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
+		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurVert, 0, NULL);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurVert);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	// Generate the bloom from the glow pass using the compute shader mip chain
+	void dispatchBloomChain(VkCommandBuffer commandBuffer)
+	{
+		// The glow pass has to be finished before the compute shaders read it, this also makes sure that sampling the mip chain
+		// in the previous frame's composition is done before it's written again
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		// Every pass reads the result of the previous one
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		// Downsample the glow pass into the first level and each level into the next one
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.downsample);
+		for (uint32_t i = 0; i < bloomChain.levels; i++) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.bloomChain, 0, 1, &descriptorSets.downsample[i], 0, nullptr);
+			vkCmdDispatch(commandBuffer, (bloomChain.extents[i].width + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE, (bloomChain.extents[i].height + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE, 1);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		// Accumulate the levels back up, starting at the smallest one
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.upsample);
+		for (int32_t i = (int32_t)bloomChain.levels - 2; i >= 0; i--) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.bloomChain, 0, 1, &descriptorSets.upsample[i], 0, nullptr);
+			vkCmdDispatch(commandBuffer, (bloomChain.extents[i].width + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE, (bloomChain.extents[i].height + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE, 1);
+			if (i > 0) {
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
+		}
+
+		// The first level is sampled in the composition
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 	}
 
 	void buildCommandBuffers()
@@ -375,22 +564,21 @@ public:
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
 
-				/*
-					Second render pass: Vertical blur
-
-					Render contents of the first pass into a second framebuffer and apply a vertical blur
-					This is the first blur pass, the horizontal blur is applied when rendering on top of the scene
-				*/
-
-				renderPassBeginInfo.framebuffer = offscreenPass.framebuffers[1].framebuffer;
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurVert, 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurVert);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+				if (bloomMode == Gaussian) {
+					/*
+						Second render pass: Vertical blur
+
+						Render contents of the first pass into a second framebuffer and apply a vertical blur
+						This is the first blur pass, the horizontal blur is applied when rendering on top of the scene
+					*/
+					drawVerticalBlur(drawCmdBuffers[i]);
+				} else {
+					/*
+						Compute passes: Downsample the first pass into the bloom mip chain and accumulate it back up
+						The first level of the chain is applied when rendering on top of the scene
+					*/
+					dispatchBloomChain(drawCmdBuffers[i]);
+				}
 			}
 
 			/*
@@ -435,8 +623,13 @@ public:
 
 				if (bloom)
 				{
-					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurHorz, 0, NULL);
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurHorz);
+					if (bloomMode == Gaussian) {
+						vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurHorz, 0, NULL);
+						vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurHorz);
+					} else {
+						vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.composite, 0, NULL);
+						vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composite);
+					}
 					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 				}
 
@@ -463,10 +656,11 @@ public:
 	{
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 9 + BLOOM_MAX_MIPS * 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 7 + BLOOM_MAX_MIPS * 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, BLOOM_MAX_MIPS * 2)
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 5);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 6 + BLOOM_MAX_MIPS * 2);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 		// Layouts
@@ -491,38 +685,91 @@ public:
 		descriptorSetLayoutCreateInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, nullptr, &descriptorSetLayouts.scene));
 
+		// Bloom mip chain
+		setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),	// Binding 0 : Source level
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),			// Binding 1 : Target level
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),			// Binding 2 : Blur parameters
+		};
+		descriptorSetLayoutCreateInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, nullptr, &descriptorSetLayouts.bloomChain));
+
 		// Sets
 		VkDescriptorSetAllocateInfo descriptorSetAllocInfo;
+
+		descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.blur, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.blurVert));
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.blurHorz));
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.composite));
+
+		descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.scene, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.scene));
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.skyBox));
+
+		// Sets for all possible levels are allocated, so they only need to be updated if the resolution changes
+		descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.bloomChain, 1);
+		for (uint32_t i = 0; i < BLOOM_MAX_MIPS; i++) {
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.downsample[i]));
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.upsample[i]));
+		}
+
+		updateDescriptorSets();
+	}
+
+	// (Re)write the descriptors referencing the offscreen framebuffers and the bloom mip chain
+	void updateDescriptorSets()
+	{
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 
 		// Full screen blur
 		// Vertical
-		descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.blur, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.blurVert));
 		writeDescriptorSets = {
 			vks::initializers::writeDescriptorSet(descriptorSets.blurVert, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.blurParams.descriptor),				// Binding 0: Fragment shader uniform buffer
 			vks::initializers::writeDescriptorSet(descriptorSets.blurVert, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &offscreenPass.framebuffers[0].descriptor),	// Binding 1: Fragment shader texture sampler
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 		// Horizontal
-		descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.blur, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.blurHorz));
 		writeDescriptorSets = {
 			vks::initializers::writeDescriptorSet(descriptorSets.blurHorz, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.blurParams.descriptor),				// Binding 0: Fragment shader uniform buffer
 			vks::initializers::writeDescriptorSet(descriptorSets.blurHorz, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &offscreenPass.framebuffers[1].descriptor),	// Binding 1: Fragment shader texture sampler
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
+		// Composition of the bloom mip chain
+		writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.composite, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.blurParams.descriptor),				// Binding 0: Fragment shader uniform buffer
+			vks::initializers::writeDescriptorSet(descriptorSets.composite, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &bloomChain.descriptors[0]),					// Binding 1: Fragment shader texture sampler
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// Bloom mip chain
+		for (uint32_t i = 0; i < bloomChain.levels; i++) {
+			// Downsample from the previous level (or the glow pass for the first level) into this level
+			VkDescriptorImageInfo* downsampleSource = (i == 0) ? &offscreenPass.framebuffers[0].descriptor : &bloomChain.descriptors[i - 1];
+			writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(descriptorSets.downsample[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, downsampleSource),
+				vks::initializers::writeDescriptorSet(descriptorSets.downsample[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &bloomChain.descriptors[i]),
+				vks::initializers::writeDescriptorSet(descriptorSets.downsample[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffers.blurParams.descriptor),
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			// Upsample from the next level into this level
+			if (i + 1 < bloomChain.levels) {
+				writeDescriptorSets = {
+					vks::initializers::writeDescriptorSet(descriptorSets.upsample[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &bloomChain.descriptors[i + 1]),
+					vks::initializers::writeDescriptorSet(descriptorSets.upsample[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &bloomChain.descriptors[i]),
+					vks::initializers::writeDescriptorSet(descriptorSets.upsample[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffers.blurParams.descriptor),
+				};
+				vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			}
+		}
+
 		// Scene rendering
-		descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.scene, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.scene));
 		writeDescriptorSets = {
 			vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.scene.descriptor)							// Binding 0: Vertex shader uniform buffer
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
 		// Skybox
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.skyBox));
 		writeDescriptorSets = {
 			vks::initializers::writeDescriptorSet(descriptorSets.skyBox, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.skyBox.descriptor),						// Binding 0: Vertex shader uniform buffer
 			vks::initializers::writeDescriptorSet(descriptorSets.skyBox, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	1, &cubemap.descriptor),							// Binding 1: Fragment shader texture sampler
@@ -539,6 +786,9 @@ public:
 		pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.scene, 1);
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.scene));
 
+		pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.bloomChain, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.bloomChain));
+
 		// Pipelines
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 		VkPipelineRasterizationStateCreateInfo rasterizationStateCI = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
@@ -591,6 +841,15 @@ public:
 		blurdirection = 1;
 		pipelineCI.renderPass = renderPass;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.blurHorz));
+		if (commandLineParser.isSet("bloombenchmark")) {
+			pipelineCI.renderPass = offscreenPass.renderPass;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.blurHorzOffscreen));
+		}
+
+		// Composition of the bloom mip chain, uses the same fullscreen triangle and additive blending as the blur
+		shaderStages[1] = loadShader(getShadersPath() + "bloom/composite.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		pipelineCI.renderPass = renderPass;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.composite));
 
 		// Phong pass (3D model)
 		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal});
@@ -616,6 +875,13 @@ public:
 		rasterizationStateCI.cullMode = VK_CULL_MODE_FRONT_BIT;
 		pipelineCI.renderPass = renderPass;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.skyBox));
+
+		// Bloom mip chain compute pipelines
+		VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayouts.bloomChain, 0);
+		computePipelineCI.stage = loadShader(getShadersPath() + "bloom/downsample.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &pipelines.downsample));
+		computePipelineCI.stage = loadShader(getShadersPath() + "bloom/upsample.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &pipelines.upsample));
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -688,6 +954,90 @@ public:
 		VulkanExampleBase::submitFrame();
 	}
 
+	/*
+		Compares the GPU time of the two bloom implementations at different offscreen resolutions
+		The glow pass is shared by both and not included, the gaussian blur is measured with both of its passes rendering into offscreen framebuffers
+	*/
+	void runBloomBenchmark()
+	{
+		const std::vector<uint32_t> dims = { 256, 512, 1024, 2048 };
+		const uint32_t iterations = 100;
+
+		if (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits == 0) {
+			std::cout << "Timestamp queries are not supported by the graphics queue of " << deviceProperties.deviceName << std::endl;
+			return;
+		}
+		VkQueryPool queryPool;
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 3;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		std::cout << "Bloom benchmark on " << deviceProperties.deviceName << " (" << iterations << " iterations)" << std::endl;
+		for (uint32_t dim : dims) {
+			resizeOffscreen(dim);
+			VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
+			VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
+
+			// The first run is a warm up and not included in the timings
+			uint64_t timestamps[3] = {};
+			for (uint32_t run = 0; run < 2; run++) {
+				VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				vkCmdResetQueryPool(commandBuffer, queryPool, 0, 3);
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+				// Glow pass as the input for both
+				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+				renderPassBeginInfo.renderPass = offscreenPass.renderPass;
+				renderPassBeginInfo.framebuffer = offscreenPass.framebuffers[0].framebuffer;
+				renderPassBeginInfo.renderArea.extent = { dim, dim };
+				renderPassBeginInfo.clearValueCount = 2;
+				renderPassBeginInfo.pClearValues = clearValues;
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.glowPass);
+				models.ufoGlow.draw(commandBuffer);
+				vkCmdEndRenderPass(commandBuffer);
+
+				// Mip chain, the first timestamp is written once the glow pass is done
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+				for (uint32_t i = 0; i < iterations; i++) {
+					dispatchBloomChain(commandBuffer);
+				}
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+
+				// Gaussian blur, the horizontal pass overwrites the glow pass, which doesn't change the amount of work
+				renderPassBeginInfo.framebuffer = offscreenPass.framebuffers[0].framebuffer;
+				for (uint32_t i = 0; i < iterations; i++) {
+					drawVerticalBlur(commandBuffer);
+					vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurHorz, 0, NULL);
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurHorzOffscreen);
+					vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+					vkCmdEndRenderPass(commandBuffer);
+				}
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2);
+
+				vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+				VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 3, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			}
+			const float timestampPeriod = deviceProperties.limits.timestampPeriod;
+			const float mipChainTime = (float)(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0f / (float)iterations;
+			const float gaussianTime = (float)(timestamps[2] - timestamps[1]) * timestampPeriod / 1000000.0f / (float)iterations;
+			std::cout << std::setw(4) << dim << " x " << std::setw(4) << dim << ": "
+				<< "gaussian blur " << std::fixed << std::setprecision(3) << gaussianTime << " ms, "
+				<< "mip chain (" << bloomChain.levels << " levels) " << mipChainTime << " ms" << std::endl;
+		}
+
+		vkDestroyQueryPool(device, queryPool, nullptr);
+	}
+
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
@@ -696,6 +1046,15 @@ public:
 		prepareOffscreen();
 		setupDescriptors();
 		preparePipelines();
+		if (commandLineParser.isSet("bloombenchmark")) {
+#if defined(_WIN32)
+			setupConsole(title);
+#endif
+			runBloomBenchmark();
+			// Skip the render loop, the example is then destroyed regularly
+			exitRequested = true;
+			return;
+		}
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -717,6 +1076,18 @@ public:
 			if (overlay->checkBox("Bloom", &bloom)) {
 				buildCommandBuffers();
 			}
+			if (overlay->comboBox("Mode", &bloomMode, { "Gaussian blur", "Mip chain" })) {
+				buildCommandBuffers();
+			}
+			std::vector<std::string> resolutions;
+			for (uint32_t dim : offscreenDims) {
+				resolutions.push_back(std::to_string(dim) + " x " + std::to_string(dim));
+			}
+			if (overlay->comboBox("Resolution", &offscreenDimIndex, resolutions)) {
+				resizeOffscreen(offscreenDims[offscreenDimIndex]);
+				buildCommandBuffers();
+			}
+			// For the mip chain the scale weights the contribution of the lower levels, which widens the bloom
 			if (overlay->inputFloat("Scale", &ubos.blurParams.blurScale, 0.1f, 2)) {
 				updateUniformBuffersBlur();
 			}
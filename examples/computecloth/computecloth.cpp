@@ -1,9 +1,13 @@
 /*
 * Vulkan Example - Compute shader cloth simulation
 *
-* A compute shader updates a shader storage buffer that contains particles held together by springs and also does basic
+* A compute shader updates a shader storage buffer that contains particles held together by distance constraints and also does basic
 * collision detection against a sphere. This storage buffer is then used as the vertex input for the graphics part of the sample
 *
+* The constraints are solved with XPBD using a number of substeps per frame with a single iteration each. They are split into graph colored
+* batches that are solved in parallel in shared memory on tiles of the grid.
+* The grid size can be set at runtime with --gridsize, run with --clothreference to check the stability of the solver on the CPU only.
+*
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -11,14 +15,19 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "threadpool.hpp"
+#include "computecloth.h"
 
 
 class VulkanExample : public VulkanExampleBase
 {
 public:
-	uint32_t readSet{ 0 };
 	uint32_t indexCount{ 0 };
+	// Number of substeps the simulation of a frame is split into, the constraint solver does one iteration per substep
+	int32_t substeps{ 8 };
 	bool simulateWind{ false };
+	// Set by --clothreference to run the CPU reference check instead of rendering
+	bool runReference{ false };
 	// This will be set to true, if the device has a dedicated queue from a compute only queue family
 	// With such a queue graphics and compute workloads can run in parallel, but this also requires additional barriers (often called "async compute")
 	// These barriers will release and acquire the resources used in graphics and compute between the different queue families
@@ -29,10 +38,13 @@ public:
 
 	// The cloth is made from a grid of particles
 	struct Particle {
+		// w = inverse mass
 		glm::vec4 pos;
 		glm::vec4 vel;
 		glm::vec4 uv;
 		glm::vec4 normal;
+		// Position at the start of the current substep
+		glm::vec4 prevPos;
 	};
 
 	// Cloth definition parameters
@@ -43,12 +55,8 @@ public:
 
 	// We put the resource "types" into structs to make this sample easier to understand
 
-	// We use two buffers for our cloth simulation: One with the input cloth data and one for outputting updated values
-	// The compute pipeline will update the output buffer, and the graphics pipeline will it as a vertex buffer
-	struct StorageBuffers {
-		vks::Buffer input;
-		vks::Buffer output;
-	} storageBuffers;
+	// The particles are stored in a single buffer that the compute pipeline updates in place, and the graphics pipeline uses as a vertex buffer
+	vks::Buffer storageBuffer;
 
 	// Resources for the graphics part of the example
 	struct Graphics {
@@ -77,23 +85,35 @@ public:
 		} semaphores;
 		VkQueue queue{ VK_NULL_HANDLE };
 		VkCommandPool commandPool{ VK_NULL_HANDLE };
-		std::array<VkCommandBuffer, 2> commandBuffers{};
+		VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
 		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
-		std::array<VkDescriptorSet, 2> descriptorSets{ VK_NULL_HANDLE };
+		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
-		VkPipeline pipeline{ VK_NULL_HANDLE };
+		// The passes of the solver are built from the same shader using a specialization constant
+		struct Pipelines {
+			VkPipeline predict{ VK_NULL_HANDLE };
+			VkPipeline solve{ VK_NULL_HANDLE };
+			VkPipeline normals{ VK_NULL_HANDLE };
+		} pipelines;
+		struct PushConstants {
+			int32_t tileOffset;
+			uint32_t finalize;
+			uint32_t predict;
+		};
 		struct UniformData {
+			// Duration of a single substep
 			float deltaT{ 0.0f };
-			// These arguments define the spring setup for the cloth piece
-			// Changing these changes how the cloth reacts
+			// These arguments define the constraint setup for the cloth piece
+			// Changing these changes how the cloth reacts, compliance is the inverse of the stiffness (zero = inextensible)
 			float particleMass{ 0.1f };
-			float springStiffness{ 2000.0f };
+			float stretchCompliance{ 0.0f };
+			float shearCompliance{ 0.0001f };
 			float damping{ 0.25f };
 			float restDistH{ 0 };
 			float restDistV{ 0 };
 			float restDistD{ 0 };
-			float sphereRadius{ 1.0f };
-			glm::vec4 spherePos{ 0.0f, 0.0f, 0.0f, 0.0f };
+			// xyz = center, w = radius
+			glm::vec4 sphere{ 0.0f, 0.0f, 0.0f, 1.0f };
 			glm::vec4 gravity{ 0.0f, 9.8f, 0.0f, 0.0f };
 			glm::ivec2 particleCount{ 0 };
 		} uniformData;
@@ -107,6 +127,16 @@ public:
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 512.0f);
 		camera.setRotation(glm::vec3(-30.0f, -45.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -5.0f));
+
+		commandLineParser.add("gridsize", { "-gs", "--gridsize" }, 1, "Number of particles along each side of the cloth");
+		commandLineParser.add("substeps", { "-ss", "--substeps" }, 1, "Number of simulation substeps per frame (default scales with the grid size)");
+		commandLineParser.add("clothreference", { "-cr", "--clothreference" }, 0, "Check the stability of the solver with the CPU reference and exit (default grid size 512)");
+		commandLineParser.parse(args);
+		runReference = commandLineParser.isSet("clothreference");
+		const uint32_t gridSize = std::max(commandLineParser.getValueAsInt("gridsize", runReference ? 512 : 60), 2);
+		cloth.gridsize = glm::uvec2(gridSize);
+		// A single solver iteration per substep propagates corrections slowly across large grids, so the default number of substeps grows with the grid size
+		substeps = commandLineParser.getValueAsInt("substeps", std::max(8u, gridSize / 8));
 	}
 
 	~VulkanExample()
@@ -125,14 +155,35 @@ public:
 			compute.uniformBuffer.destroy();
 			vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
-			vkDestroyPipeline(device, compute.pipeline, nullptr);
+			vkDestroyPipeline(device, compute.pipelines.predict, nullptr);
+			vkDestroyPipeline(device, compute.pipelines.solve, nullptr);
+			vkDestroyPipeline(device, compute.pipelines.normals, nullptr);
 			vkDestroySemaphore(device, compute.semaphores.ready, nullptr);
 			vkDestroySemaphore(device, compute.semaphores.complete, nullptr);
 			vkDestroyCommandPool(device, compute.commandPool, nullptr);
 
-			// SSBOs
-			storageBuffers.input.destroy();
-			storageBuffers.output.destroy();
+			// SSBO
+			storageBuffer.destroy();
+		}
+	}
+
+	// Runs the CPU reference of the solver with the current settings and reports whether it stays stable
+	void runClothReference()
+	{
+		cloth::SolverParams params{};
+		params.inverseMass = 1.0f / compute.uniformData.particleMass;
+		params.stretchCompliance = compute.uniformData.stretchCompliance;
+		params.shearCompliance = compute.uniformData.shearCompliance;
+		params.damping = compute.uniformData.damping;
+		memcpy(params.sphere, &compute.uniformData.sphere, sizeof(params.sphere));
+		memcpy(params.gravity, &compute.uniformData.gravity, sizeof(params.gravity));
+		vks::ThreadPool threadPool;
+		threadPool.setThreadCount(std::max(std::thread::hardware_concurrency(), 1u));
+		// Four seconds at 60 fps, long enough for the cloth to drop onto the sphere and settle
+		const bool stable = cloth::runStabilityTest(params, cloth.gridsize.x, cloth.size.x, substeps, 240, 1.0f / 60.0f, threadPool);
+		if (!stable) {
+			std::cout << "Cloth reference failed the stability test" << std::endl;
+			exitCode = 1;
 		}
 	}
 
@@ -161,17 +212,13 @@ public:
 			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
 			bufferBarrier.size = VK_WHOLE_SIZE;
 
-			std::vector<VkBufferMemoryBarrier> bufferBarriers;
-			bufferBarrier.buffer = storageBuffers.input.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			bufferBarrier.buffer = storageBuffers.output.buffer;
-			bufferBarriers.push_back(bufferBarrier);
+			bufferBarrier.buffer = storageBuffer.buffer;
 			vkCmdPipelineBarrier(commandBuffer,
 				srcStageMask,
 				dstStageMask,
 				VK_FLAGS_NONE,
 				0, nullptr,
-				static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+				1, &bufferBarrier,
 				0, nullptr);
 		}
 	}
@@ -180,22 +227,18 @@ public:
 	{
 		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
 		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		bufferBarrier.size = VK_WHOLE_SIZE;
-		std::vector<VkBufferMemoryBarrier> bufferBarriers;
-		bufferBarrier.buffer = storageBuffers.input.buffer;
-		bufferBarriers.push_back(bufferBarrier);
-		bufferBarrier.buffer = storageBuffers.output.buffer;
-		bufferBarriers.push_back(bufferBarrier);
+		bufferBarrier.buffer = storageBuffer.buffer;
 		vkCmdPipelineBarrier(
 			commandBuffer,
 			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_FLAGS_NONE,
 			0, nullptr,
-			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			1, &bufferBarrier,
 			0, nullptr);
 	}
 
@@ -208,18 +251,14 @@ public:
 			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
 			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;
 			bufferBarrier.size = VK_WHOLE_SIZE;
-			std::vector<VkBufferMemoryBarrier> bufferBarriers;
-			bufferBarrier.buffer = storageBuffers.input.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			bufferBarrier.buffer = storageBuffers.output.buffer;
-			bufferBarriers.push_back(bufferBarrier);
+			bufferBarrier.buffer = storageBuffer.buffer;
 			vkCmdPipelineBarrier(
 				commandBuffer,
 				srcStageMask,
 				dstStageMask,
 				VK_FLAGS_NONE,
 				0, nullptr,
-				static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+				1, &bufferBarrier,
 				0, nullptr);
 		}
 	}
@@ -272,7 +311,7 @@ public:
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.cloth);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], graphics.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &storageBuffers.output.buffer, offsets);
+			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &storageBuffer.buffer, offsets);
 			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
 
 			drawUI(drawCmdBuffers[i]);
@@ -292,46 +331,54 @@ public:
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 
-		for (uint32_t i = 0; i < 2; i++) {
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffers[i], &cmdBufInfo));
-
-			// Acquire the storage buffers from the graphics queue
-			addGraphicsToComputeBarriers(compute.commandBuffers[i], 0, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-
-			vkCmdBindPipeline(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
-
-			uint32_t calculateNormals = 0;
-			vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
-
-			// Dispatch the compute job
-			const uint32_t iterations = 64;
-			for (uint32_t j = 0; j < iterations; j++) {
-				readSet = 1 - readSet;
-				vkCmdBindDescriptorSets(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[readSet], 0, 0);
-
-				if (j == iterations - 1) {
-					calculateNormals = 1;
-					vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
-				}
-
-				vkCmdDispatch(compute.commandBuffers[i], cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
-
-				// Don't add a barrier on the last iteration of the loop, since we'll have an explicit release to the graphics queue
-				if (j != iterations - 1) {
-					addComputeToComputeBarriers(compute.commandBuffers[i]);
-				}
+		VkCommandBuffer commandBuffer = compute.commandBuffer;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+
+		// Acquire the storage buffer from the graphics queue
+		addGraphicsToComputeBarriers(commandBuffer, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
+
+		// Work group counts are rounded up, the shaders discard invocations outside of the grid
+		const uint32_t tileSize = CLOTH_TILE_SIZE;
+		const uint32_t groupsX = (cloth.gridsize.x + tileSize - 1) / tileSize;
+		const uint32_t groupsY = (cloth.gridsize.y + tileSize - 1) / tileSize;
+		// The second tiling is offset by half a tile and needs an additional row and column of tiles to cover the grid
+		const uint32_t offsetGroupsX = (cloth.gridsize.x + tileSize / 2 + tileSize - 1) / tileSize;
+		const uint32_t offsetGroupsY = (cloth.gridsize.y + tileSize / 2 + tileSize - 1) / tileSize;
+
+		Compute::PushConstants pushConstants{ 0, 0, 0 };
+		vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Compute::PushConstants), &pushConstants);
+
+		// Start the first substep
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelines.predict);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+		addComputeToComputeBarriers(commandBuffer);
+
+		// Each substep solves all constraints once in two passes, the second one also resolves collisions, updates velocities and starts the next substep
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelines.solve);
+		for (int32_t i = 0; i < substeps; i++) {
+			pushConstants = { 0, 0, 0 };
+			vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Compute::PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+			addComputeToComputeBarriers(commandBuffer);
+
+			pushConstants = { CLOTH_TILE_SIZE / 2, 1, (i < substeps - 1) ? 1u : 0u };
+			vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Compute::PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, offsetGroupsX, offsetGroupsY, 1);
+			addComputeToComputeBarriers(commandBuffer);
+		}
 
-			}
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelines.normals);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
 
-			// release the storage buffers back to the graphics queue
-			addComputeToGraphicsBarriers(compute.commandBuffers[i], VK_ACCESS_SHADER_WRITE_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
-			vkEndCommandBuffer(compute.commandBuffers[i]);
-		}
+		// release the storage buffer back to the graphics queue
+		addComputeToGraphicsBarriers(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		vkEndCommandBuffer(commandBuffer);
 	}
 
-	// Setup and fill the shader storage buffers containing the particles
-	// These buffers are used as shader storage buffers in the compute shader (to update them) and as vertex input in the vertex shader (to display them)
+	// Setup and fill the shader storage buffer containing the particles
+	// This buffer is used as a shader storage buffer in the compute shader (to update it) and as vertex input in the vertex shader (to display it)
 	void prepareStorageBuffers()
 	{
 		std::vector<Particle> particleBuffer(cloth.gridsize.x * cloth.gridsize.y);
@@ -342,12 +389,16 @@ public:
 		float dv = 1.0f / (cloth.gridsize.y - 1);
 
 		// Set up a flat cloth that falls onto sphere
-		glm::mat4 transM = glm::translate(glm::mat4(1.0f), glm::vec3(-cloth.size.x / 2.0f, -2.0f, -cloth.size.y / 2.0f));
-		for (uint32_t i = 0; i < cloth.gridsize.y; i++) {
-			for (uint32_t j = 0; j < cloth.gridsize.x; j++) {
-				particleBuffer[i + j * cloth.gridsize.y].pos = transM * glm::vec4(dx * j, 0.0f, dy * i, 1.0f);
-				particleBuffer[i + j * cloth.gridsize.y].vel = glm::vec4(0.0f);
-				particleBuffer[i + j * cloth.gridsize.y].uv = glm::vec4(1.0f - du * i, dv * j, 0.0f, 0.0f);
+		// Particles are stored row by row, grid rows run along the x axis (same layout as the CPU reference)
+		glm::mat4 transM = glm::translate(glm::mat4(1.0f), glm::vec3(-cloth.size.y / 2.0f, -2.0f, -cloth.size.x / 2.0f));
+		for (uint32_t y = 0; y < cloth.gridsize.y; y++) {
+			for (uint32_t x = 0; x < cloth.gridsize.x; x++) {
+				Particle& particle = particleBuffer[y * cloth.gridsize.x + x];
+				particle.pos = transM * glm::vec4(dy * y, 0.0f, dx * x, 1.0f);
+				particle.pos.w = 1.0f / compute.uniformData.particleMass;
+				particle.vel = glm::vec4(0.0f);
+				particle.uv = glm::vec4(1.0f - du * x, dv * y, 0.0f, 0.0f);
+				particle.prevPos = particle.pos;
 			}
 		}
 
@@ -365,24 +416,18 @@ public:
 			storageBufferSize,
 			particleBuffer.data());
 
-		// SSBOs will be used both as storage buffers (compute) and vertex buffers (graphics)
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&storageBuffers.input,
-			storageBufferSize);
-
+		// The SSBO will be used both as a storage buffer (compute) and a vertex buffer (graphics)
 		vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&storageBuffers.output,
+			&storageBuffer,
 			storageBufferSize);
 
 		// Copy from staging buffer
 		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 		VkBufferCopy copyRegion = {};
 		copyRegion.size = storageBufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, storageBuffers.output.buffer, 1, &copyRegion);
+		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, storageBuffer.buffer, 1, &copyRegion);
 		// Add an initial release barrier to the graphics queue,
 		// so that when the compute command buffer executes for the first time
 		// it doesn't complain about a lack of a corresponding "release" to its "acquire"
@@ -436,11 +481,11 @@ public:
 
 		// Descriptor pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 		// Descriptor layout
@@ -549,8 +594,7 @@ public:
 		// Create compute pipeline
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
@@ -559,33 +603,32 @@ public:
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&compute.descriptorSetLayout, 1);
 
 		// Push constants used to pass some parameters
-		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(uint32_t), 0);
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(Compute::PushConstants), 0);
 		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
 		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
 
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
-
-		// Create two descriptor sets with input and output buffers switched
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[0]));
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[1]));
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSet));
 
 		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffers.input.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &storageBuffers.output.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor),
-
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffers.output.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &storageBuffers.input.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor)
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &compute.uniformBuffer.descriptor)
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
 
-		// Create pipeline
+		// Create the pipelines for the solver passes, the pass is selected with a specialization constant
+		int32_t pass = 0;
+		VkSpecializationMapEntry specializationMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(int32_t));
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(int32_t), &pass);
 		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
 		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computecloth/cloth.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
-		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipeline));
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+		std::array<VkPipeline*, 3> pipelines = { &compute.pipelines.predict, &compute.pipelines.solve, &compute.pipelines.normals };
+		for (pass = 0; pass < static_cast<int32_t>(pipelines.size()); pass++) {
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, pipelines[pass]));
+		}
 
 		// Separate command pool as queue family for compute may be different than graphics
 		VkCommandPoolCreateInfo cmdPoolInfo = {};
@@ -595,8 +638,8 @@ public:
 		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
 
 		// Create a command buffer for compute operations
-		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 2);
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffers[0]));
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffer));
 
 		// Semaphores for graphics / compute synchronization
 		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
@@ -611,7 +654,7 @@ public:
 	{
 		if (!paused) {
 			// SRS - Clamp frameTimer to max 20ms refresh period (e.g. if blocked on resize), otherwise image breakup can occur
-			compute.uniformData.deltaT = fmin(frameTimer, 0.02f) * 0.0025f;
+			compute.uniformData.deltaT = fmin(frameTimer, 0.02f) / static_cast<float>(substeps);
 
 			if (simulateWind) {
 				std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
@@ -656,7 +699,7 @@ public:
 		computeSubmitInfo.signalSemaphoreCount = 1;
 		computeSubmitInfo.pSignalSemaphores = &compute.semaphores.complete;
 		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffers[readSet];
+		computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
 
 		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
 
@@ -699,6 +742,15 @@ public:
 		prepareStorageBuffers();
 		prepareGraphics();
 		prepareCompute();
+		if (runReference) {
+#if defined(_WIN32)
+			setupConsole("Cloth reference");
+#endif
+			runClothReference();
+			// Skip the render loop, the example is then destroyed regularly
+			exitRequested = true;
+			return;
+		}
 		prepared = true;
 	}
 
@@ -715,6 +767,14 @@ public:
 	{
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Simulate wind", &simulateWind);
+			if (overlay->sliderInt("Substeps", &substeps, 1, 64)) {
+				// The compute command buffer may still be in flight
+				vkQueueWaitIdle(compute.queue);
+				buildComputeCommandBuffer();
+			}
+		}
+		if (overlay->header("Statistics")) {
+			overlay->text("Grid: %d x %d particles", cloth.gridsize.x, cloth.gridsize.y);
 		}
 	}
 };
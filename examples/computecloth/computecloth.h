@@ -0,0 +1,271 @@
+/*
+* Vulkan Example - Compute shader cloth simulation
+*
+* CPU reference of the cloth solver used by the compute shader
+*
+* Uses the same scheme as the compute shader: XPBD distance constraints with one iteration per substep, solved in
+* graph colored batches on the same tiling. It runs headless (--clothreference) to check the stability of the
+* solver at large grid sizes without a GPU.
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include "threadpool.hpp"
+
+// Edge length of the tiles the constraints are solved in, must match the compute shader
+#define CLOTH_TILE_SIZE 16
+
+namespace cloth
+{
+	struct Vec3 {
+		float x, y, z;
+		Vec3 operator+(const Vec3& b) const { return { x + b.x, y + b.y, z + b.z }; }
+		Vec3 operator-(const Vec3& b) const { return { x - b.x, y - b.y, z - b.z }; }
+		Vec3 operator*(float s) const { return { x * s, y * s, z * s }; }
+		float dot(const Vec3& b) const { return x * b.x + y * b.y + z * b.z; }
+	};
+
+	// Mirrors the uniform block of the compute shader
+	struct SolverParams {
+		float deltaT;
+		float inverseMass;
+		float stretchCompliance;
+		float shearCompliance;
+		float damping;
+		float restDistH;
+		float restDistV;
+		float restDistD;
+		float sphere[4];
+		float gravity[3];
+		uint32_t width;
+		uint32_t height;
+	};
+
+	/*
+		Distance constraints of the grid, split into eight batches with no shared particles inside a batch:
+		horizontal, vertical and the two diagonals, each with even and odd x (or y for vertical) start
+	*/
+	enum ConstraintType { Horizontal = 0, Vertical = 1, Diagonal = 2, AntiDiagonal = 3 };
+
+	inline void constraintEndpoints(uint32_t type, int32_t x, int32_t y, int32_t& ax, int32_t& ay, int32_t& bx, int32_t& by)
+	{
+		switch (type) {
+		case Horizontal: ax = x; ay = y; bx = x + 1; by = y; break;
+		case Vertical: ax = x; ay = y; bx = x; by = y + 1; break;
+		case Diagonal: ax = x; ay = y; bx = x + 1; by = y + 1; break;
+		default: ax = x + 1; ay = y; bx = x; by = y + 1; break;
+		}
+	}
+
+	// Constraints crossing the edges of the first tiling are solved in the second one, which is offset by half a tile
+	inline bool crossesTile(int32_t ax, int32_t ay, int32_t bx, int32_t by)
+	{
+		return (ax / CLOTH_TILE_SIZE != bx / CLOTH_TILE_SIZE) || (ay / CLOTH_TILE_SIZE != by / CLOTH_TILE_SIZE);
+	}
+
+	class ReferenceSolver
+	{
+	public:
+		std::vector<Vec3> position, previous, velocity;
+		std::vector<float> inverseMass;
+		uint32_t width{ 0 }, height{ 0 };
+
+		// Flat cloth, laid out the same way as in the example
+		void init(uint32_t width, uint32_t height, float sizeX, float sizeY, float invMass)
+		{
+			this->width = width;
+			this->height = height;
+			const size_t count = (size_t)width * height;
+			position.resize(count);
+			previous.resize(count);
+			velocity.assign(count, { 0.0f, 0.0f, 0.0f });
+			inverseMass.assign(count, invMass);
+			const float dx = sizeX / (width - 1);
+			const float dy = sizeY / (height - 1);
+			for (uint32_t y = 0; y < height; y++) {
+				for (uint32_t x = 0; x < width; x++) {
+					position[y * width + x] = { dy * y - sizeY / 2.0f, -2.0f, dx * x - sizeX / 2.0f };
+				}
+			}
+		}
+
+		// Advance by one frame, split into the given number of substeps
+		void step(const SolverParams& params, uint32_t substeps, vks::ThreadPool& threadPool)
+		{
+			for (uint32_t s = 0; s < substeps; s++) {
+				parallelRows(threadPool, height, [&](uint32_t y) { predict(params, y); });
+				for (uint32_t tiling = 0; tiling < 2; tiling++) {
+					for (uint32_t batch = 0; batch < 8; batch++) {
+						parallelRows(threadPool, height, [&](uint32_t y) { solveRow(params, tiling, batch, y); });
+					}
+				}
+				parallelRows(threadPool, height, [&](uint32_t y) { finalize(params, y); });
+			}
+		}
+
+		// Largest and mean relative deviation of the structural edges from their rest length
+		void strain(const SolverParams& params, float& maxStrain, float& meanStrain) const
+		{
+			maxStrain = 0.0f;
+			double sum = 0.0;
+			for (uint32_t y = 0; y < height; y++) {
+				for (uint32_t x = 0; x < width; x++) {
+					const Vec3& p = position[y * width + x];
+					if (x + 1 < width) {
+						const Vec3 d = position[y * width + x + 1] - p;
+						const float s = std::fabs(std::sqrt(d.dot(d)) / params.restDistH - 1.0f);
+						maxStrain = std::max(maxStrain, s);
+						sum += s;
+					}
+					if (y + 1 < height) {
+						const Vec3 d = position[(y + 1) * width + x] - p;
+						const float s = std::fabs(std::sqrt(d.dot(d)) / params.restDistV - 1.0f);
+						maxStrain = std::max(maxStrain, s);
+						sum += s;
+					}
+				}
+			}
+			meanStrain = (float)(sum / (2.0 * width * (height - 1)));
+		}
+
+		bool finite() const
+		{
+			for (const Vec3& p : position) {
+				if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+	private:
+		template <typename F>
+		void parallelRows(vks::ThreadPool& threadPool, uint32_t rows, F func)
+		{
+			std::atomic<uint32_t> nextRow{ 0 };
+			for (auto& thread : threadPool.threads) {
+				thread->addJob([&] {
+					uint32_t row;
+					while ((row = nextRow++) < rows) {
+						func(row);
+					}
+				});
+			}
+			threadPool.wait();
+		}
+
+		void predict(const SolverParams& params, uint32_t y)
+		{
+			const Vec3 gravity = { params.gravity[0], params.gravity[1], params.gravity[2] };
+			const float damping = std::max(1.0f - params.damping * params.deltaT, 0.0f);
+			for (uint32_t i = y * width; i < (y + 1) * width; i++) {
+				if (inverseMass[i] > 0.0f) {
+					velocity[i] = velocity[i] + gravity * params.deltaT;
+				}
+				velocity[i] = velocity[i] * damping;
+				previous[i] = position[i];
+				position[i] = position[i] + velocity[i] * params.deltaT;
+			}
+		}
+
+		void solveRow(const SolverParams& params, uint32_t tiling, uint32_t batch, uint32_t y)
+		{
+			const uint32_t type = batch / 2;
+			const uint32_t parity = batch % 2;
+			const float restDistances[4] = { params.restDistH, params.restDistV, params.restDistD, params.restDistD };
+			const float alpha = ((type < Diagonal) ? params.stretchCompliance : params.shearCompliance) / (params.deltaT * params.deltaT);
+			if ((type == Vertical) && ((y & 1) != parity)) {
+				return;
+			}
+			for (uint32_t x = 0; x < width; x++) {
+				if ((type != Vertical) && ((x & 1) != parity)) {
+					continue;
+				}
+				int32_t ax, ay, bx, by;
+				constraintEndpoints(type, x, y, ax, ay, bx, by);
+				if ((std::max(ax, bx) >= (int32_t)width) || (std::max(ay, by) >= (int32_t)height)) {
+					continue;
+				}
+				// Every constraint is solved exactly once per substep, in the first tiling if it lies inside a tile, in the second one otherwise
+				if (crossesTile(ax, ay, bx, by) != (tiling == 1)) {
+					continue;
+				}
+				const uint32_t a = ay * width + ax;
+				const uint32_t b = by * width + bx;
+				const float wSum = inverseMass[a] + inverseMass[b];
+				const Vec3 d = position[b] - position[a];
+				const float length = std::sqrt(d.dot(d));
+				if ((wSum == 0.0f) || (length < 1e-6f)) {
+					continue;
+				}
+				const float deltaLambda = -(length - restDistances[type]) / (wSum + alpha);
+				const Vec3 n = d * (1.0f / length);
+				position[a] = position[a] - n * (inverseMass[a] * deltaLambda);
+				position[b] = position[b] + n * (inverseMass[b] * deltaLambda);
+			}
+		}
+
+		void finalize(const SolverParams& params, uint32_t y)
+		{
+			const Vec3 center = { params.sphere[0], params.sphere[1], params.sphere[2] };
+			const float radius = params.sphere[3] + 0.01f;
+			for (uint32_t i = y * width; i < (y + 1) * width; i++) {
+				const Vec3 d = position[i] - center;
+				const float distance2 = d.dot(d);
+				if (distance2 < radius * radius) {
+					position[i] = center + d * (radius / std::sqrt(distance2));
+				}
+				velocity[i] = (position[i] - previous[i]) * (1.0f / params.deltaT);
+			}
+		}
+	};
+
+	/*
+		Simulate the cloth falling onto the sphere for a number of frames and check that the solver stays stable
+		Returns true if the positions stay finite and the edges stay close to their rest length
+		As with any Gauss-Seidel type solver, the number of substeps needs to grow with the grid size to keep the cloth from stretching
+	*/
+	inline bool runStabilityTest(SolverParams params, uint32_t gridSize, float clothSize, uint32_t substeps, uint32_t frames, float frameTime, vks::ThreadPool& threadPool)
+	{
+		ReferenceSolver solver;
+		solver.init(gridSize, gridSize, clothSize, clothSize, params.inverseMass);
+		params.width = params.height = gridSize;
+		params.restDistH = clothSize / (gridSize - 1);
+		params.restDistV = clothSize / (gridSize - 1);
+		params.restDistD = std::sqrt(params.restDistH * params.restDistH + params.restDistV * params.restDistV);
+		params.deltaT = frameTime / substeps;
+
+		std::cout << "Cloth reference: " << gridSize << " x " << gridSize << " particles, " << substeps << " substeps, " << frames << " frames" << std::endl;
+		float maxStrain = 0.0f, meanStrain = 0.0f;
+		auto tStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; frame++) {
+			solver.step(params, substeps, threadPool);
+			if (!solver.finite()) {
+				std::cout << "Unstable: non finite positions at frame " << frame << std::endl;
+				return false;
+			}
+			float frameMax, frameMean;
+			solver.strain(params, frameMax, frameMean);
+			maxStrain = std::max(maxStrain, frameMax);
+			meanStrain = std::max(meanStrain, frameMean);
+		}
+		const double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		// The cloth may stretch locally where it hangs off the top of the sphere, but must not blow up
+		const float strainLimit = 0.5f;
+		std::cout << "Max. strain: " << maxStrain * 100.0f << "%, max. mean strain: " << meanStrain * 100.0f << "%" << std::endl;
+		std::cout << "CPU time: " << time / frames << "ms per frame" << std::endl;
+		std::cout << ((maxStrain < strainLimit) ? "Stable" : "Unstable: strain limit exceeded") << std::endl;
+		return maxStrain < strainLimit;
+	}
+}
@@ -6,12 +6,18 @@
 * For that a shader storage buffer is used which is then used as a vertex buffer for drawing the particle system with a graphics pipeline
 * To optimize performance, the compute shaders use shared memory
 *
+* For large particle counts the forces can be calculated with the Barnes-Hut algorithm instead of brute force (O(n log n) instead of O(n^2))
+* The tree is rebuilt on the GPU every frame: particles are sorted by Morton code, and a binary radix tree over the sorted codes is built and summarized bottom up
+* Particle count can be set with --particles, results can be validated against a multi threaded SIMD CPU reference at runtime
+*
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include "vulkanexamplebase.h"
+#include "threadpool.hpp"
+#include "computenbody.h"
 
 #if defined(__ANDROID__)
 // Lower particle count on Android for performance reasons
@@ -20,6 +26,9 @@
 #define PARTICLES_PER_ATTRACTOR 4 * 1024
 #endif
 
+// Brute force gets too slow above this, so larger particle counts default to Barnes-Hut
+#define BARNES_HUT_THRESHOLD 64 * 1024
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -34,11 +43,53 @@ public:
 		glm::vec4 vel;								// xyz = velocity, w = gradient texture position
 	};
 	uint32_t numParticles{ 0 };
+	// Particle count requested via command line, 0 = default
+	uint32_t requestedParticles{ 0 };
 
 	// We use a shader storage buffer object to store the particlces
 	// This is updated by the compute pipeline and displayed as a vertex buffer by the graphics pipeline
 	vks::Buffer storageBuffer;
 
+	enum ForceMode { BruteForce = 0, BarnesHut = 1 };
+	int32_t forceMode{ BruteForce };
+
+	// Buffers for the Barnes-Hut tree, rebuilt every frame
+	struct BarnesHutBuffers {
+		vks::Buffer accelerations;			// Per particle acceleration of the last step, used for validation
+		vks::Buffer bounds;					// Bounding box of all particles
+		vks::Buffer sortKeys;				// Morton codes, padded to a power of two for the bitonic sort
+		vks::Buffer sortValues;				// Particle indices sorted along with the Morton codes
+		vks::Buffer nodes;					// Internal nodes of the binary radix tree
+		vks::Buffer leafParents;			// Parent node of each leaf (particle)
+		vks::Buffer nodeFlags;				// Visit counters for the bottom up summarization
+		uint32_t sortCount{ 0 };
+	} barnesHut;
+
+	// Internal tree node, matches the layout used in the shaders
+	struct Node {
+		glm::vec4 centerOfMass;
+		glm::vec4 boundsMin;
+		glm::vec4 boundsMax;
+		glm::ivec4 links;
+	};
+
+	// Validation of the GPU results against the CPU reference
+	struct Validation {
+		bool requested{ false };
+		// Set for the frame in which the GPU results are copied to the host
+		bool capture{ false };
+		vks::Buffer particles;
+		vks::Buffer accelerations;
+		// Number of particles checked against the reference, the reference is O(n) per particle
+		uint32_t sampleCount{ 1024 };
+		bool valid{ false };
+		float meanError{ 0.0f };
+		float maxError{ 0.0f };
+		float cpuTime{ 0.0f };
+		float cpuStepEstimate{ 0.0f };
+	} validation;
+	vks::ThreadPool threadPool;
+
 	// Resources for the graphics part of the example
 	struct Graphics {
 		uint32_t queueFamilyIndex;					// Used to check if compute and graphics queue families differ and require additional barriers
@@ -67,6 +118,16 @@ public:
 		VkPipelineLayout pipelineLayout;			// Layout of the compute pipeline
 		VkPipeline pipelineCalculate;				// Compute pipeline for N-Body velocity calculation (1st pass)
 		VkPipeline pipelineIntegrate;				// Compute pipeline for euler integration (2nd pass)
+		struct BarnesHutPipelines {					// Compute pipelines for building and traversing the Barnes-Hut tree
+			VkPipeline bounds;
+			VkPipeline morton;
+			VkPipeline sort;
+			VkPipeline tree;
+			VkPipeline summarize;
+			VkPipeline traverse;
+		} pipelinesBarnesHut;
+		VkQueryPool queryPool{ VK_NULL_HANDLE };	// Timestamps for measuring the compute passes
+		float timing{ 0.0f };
 		struct UniformData {						// Compute shader uniform block object
 			float deltaT{ 0.0f };					// Frame delta time
 			int32_t particleCount{ 0 };
@@ -74,6 +135,9 @@ public:
 			float gravity{ 0.002f };
 			float power{ 0.75f };
 			float soften{ 0.05f };
+			// Barnes-Hut opening angle, nodes with size / distance below this are approximated by their center of mass
+			float theta{ 0.5f };
+			uint32_t sortCount{ 0 };
 		} uniformData;
 		vks::Buffer uniformBuffer;					// Uniform buffer object containing particle system parameters
 	} compute;
@@ -86,6 +150,12 @@ public:
 		camera.setRotation(glm::vec3(-26.0f, 75.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -14.0f));
 		camera.movementSpeed = 2.5f;
+		commandLineParser.add("particles", { "-p", "--particles" }, 1, "Set the number of particles");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("particles")) {
+			requestedParticles = (uint32_t)commandLineParser.getValueAsInt("particles", 0);
+		}
+		threadPool.setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
 	}
 
 	~VulkanExample()
@@ -104,10 +174,26 @@ public:
 			vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 			vkDestroyPipeline(device, compute.pipelineCalculate, nullptr);
 			vkDestroyPipeline(device, compute.pipelineIntegrate, nullptr);
+			vkDestroyPipeline(device, compute.pipelinesBarnesHut.bounds, nullptr);
+			vkDestroyPipeline(device, compute.pipelinesBarnesHut.morton, nullptr);
+			vkDestroyPipeline(device, compute.pipelinesBarnesHut.sort, nullptr);
+			vkDestroyPipeline(device, compute.pipelinesBarnesHut.tree, nullptr);
+			vkDestroyPipeline(device, compute.pipelinesBarnesHut.summarize, nullptr);
+			vkDestroyPipeline(device, compute.pipelinesBarnesHut.traverse, nullptr);
+			if (compute.queryPool != VK_NULL_HANDLE) {
+				vkDestroyQueryPool(device, compute.queryPool, nullptr);
+			}
 			vkDestroySemaphore(device, compute.semaphore, nullptr);
 			vkDestroyCommandPool(device, compute.commandPool, nullptr);
 
 			storageBuffer.destroy();
+			barnesHut.accelerations.destroy();
+			barnesHut.bounds.destroy();
+			barnesHut.sortKeys.destroy();
+			barnesHut.sortValues.destroy();
+			barnesHut.nodes.destroy();
+			barnesHut.leafParents.destroy();
+			barnesHut.nodeFlags.destroy();
 
 			textures.particle.destroy();
 			textures.gradient.destroy();
@@ -221,12 +307,80 @@ public:
 
 	}
 
+	// Make compute shader writes visible to the following dispatch
+	void computeBarrier(VkCommandBuffer commandBuffer)
+	{
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	uint32_t workGroupCount(uint32_t invocations)
+	{
+		return (invocations + 255) / 256;
+	}
+
+	// Build the Barnes-Hut tree from the current particle positions
+	void recordTreeBuild(VkCommandBuffer commandBuffer)
+	{
+		// Reset the bounding box (min = max. value, max = min. value in the order preserving encoding used by the shaders) and the node visit counters
+		vkCmdFillBuffer(commandBuffer, barnesHut.bounds.buffer, 0, sizeof(glm::uvec4), 0xFFFFFFFF);
+		vkCmdFillBuffer(commandBuffer, barnesHut.bounds.buffer, sizeof(glm::uvec4), sizeof(glm::uvec4), 0);
+		vkCmdFillBuffer(commandBuffer, barnesHut.nodeFlags.buffer, 0, VK_WHOLE_SIZE, 0);
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		// Bounding box
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelinesBarnesHut.bounds);
+		vkCmdDispatch(commandBuffer, workGroupCount(numParticles), 1, 1);
+		computeBarrier(commandBuffer);
+
+		// Morton codes
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelinesBarnesHut.morton);
+		vkCmdDispatch(commandBuffer, barnesHut.sortCount / 256, 1, 1);
+		computeBarrier(commandBuffer);
+
+		// Bitonic sort by Morton code
+		// Compare distances below the work group size are done in shared memory, so only the larger distances need a dispatch of their own
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelinesBarnesHut.sort);
+		auto sortStep = [&](uint32_t k, uint32_t j) {
+			uint32_t pushConsts[2] = { k, j };
+			vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConsts), pushConsts);
+			vkCmdDispatch(commandBuffer, barnesHut.sortCount / 256, 1, 1);
+			computeBarrier(commandBuffer);
+		};
+		sortStep(256, 128);
+		for (uint32_t k = 512; k <= barnesHut.sortCount; k <<= 1) {
+			for (uint32_t j = k >> 1; j >= 256; j >>= 1) {
+				sortStep(k, j);
+			}
+			sortStep(k, 128);
+		}
+
+		// Radix tree
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelinesBarnesHut.tree);
+		vkCmdDispatch(commandBuffer, workGroupCount(numParticles - 1), 1, 1);
+		computeBarrier(commandBuffer);
+
+		// Node masses, centers of mass and bounds
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelinesBarnesHut.summarize);
+		vkCmdDispatch(commandBuffer, workGroupCount(numParticles), 1, 1);
+		computeBarrier(commandBuffer);
+	}
+
 	void buildComputeCommandBuffer()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufInfo));
 
+		if (compute.queryPool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(compute.commandBuffer, compute.queryPool, 0, 2);
+		}
+
 		// Acquire barrier
 		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
 		{
@@ -253,11 +407,20 @@ public:
 				0, nullptr);
 		}
 
+		if (compute.queryPool != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(compute.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, compute.queryPool, 0);
+		}
+
 		// First pass: Calculate particle movement
 		// -------------------------------------------------------------------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
 		vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
+		if (forceMode == BarnesHut) {
+			recordTreeBuild(compute.commandBuffer);
+			vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelinesBarnesHut.traverse);
+		} else {
+			vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
+		}
+		vkCmdDispatch(compute.commandBuffer, workGroupCount(numParticles), 1, 1);
 
 		// Add memory barrier to ensure that the computer shader has finished writing to the buffer
 		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
@@ -278,10 +441,30 @@ public:
 			1, &bufferBarrier,
 			0, nullptr);
 
+		// Copy the positions used for this step and the resulting accelerations to the host for validation
+		if (validation.capture) {
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			VkBufferCopy copyRegion = { 0, 0, storageBuffer.size };
+			vkCmdCopyBuffer(compute.commandBuffer, storageBuffer.buffer, validation.particles.buffer, 1, &copyRegion);
+			copyRegion.size = barnesHut.accelerations.size;
+			vkCmdCopyBuffer(compute.commandBuffer, barnesHut.accelerations.buffer, validation.accelerations.buffer, 1, &copyRegion);
+			// The integration pass must not overwrite the positions before they have been copied
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
 		// Second pass: Integrate particles
 		// -------------------------------------------------------------------------------------------------------
 		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
+		vkCmdDispatch(compute.commandBuffer, workGroupCount(numParticles), 1, 1);
+
+		if (compute.queryPool != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(compute.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, compute.queryPool, 1);
+		}
 
 		// Release barrier
 		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
@@ -326,6 +509,15 @@ public:
 		};
 
 		numParticles = static_cast<uint32_t>(attractors.size()) * PARTICLES_PER_ATTRACTOR;
+		if (requestedParticles > 0) {
+			// The largest buffer is the tree with one node per particle, which must fit into a single storage buffer descriptor
+			const uint32_t maxParticles = vulkanDevice->properties.limits.maxStorageBufferRange / sizeof(Node);
+			numParticles = std::min(std::max(requestedParticles, (uint32_t)attractors.size() * 2), maxParticles);
+			if (numParticles != requestedParticles) {
+				std::cout << "Particle count clamped to " << numParticles << std::endl;
+			}
+		}
+		forceMode = (numParticles > BARNES_HUT_THRESHOLD) ? BarnesHut : BruteForce;
 
 		// Initial particle positions
 		std::vector<Particle> particleBuffer(numParticles);
@@ -333,11 +525,15 @@ public:
 		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
 		std::normal_distribution<float> rndDist(0.0f, 1.0f);
 
-		for (uint32_t i = 0; i < static_cast<uint32_t>(attractors.size()); i++)
+		// Particles are distributed evenly among the attractors
+		const uint32_t attractorCount = static_cast<uint32_t>(attractors.size());
+		uint32_t offset = 0;
+		for (uint32_t i = 0; i < attractorCount; i++)
 		{
-			for (uint32_t j = 0; j < PARTICLES_PER_ATTRACTOR; j++)
+			const uint32_t particlesPerAttractor = numParticles / attractorCount + ((i < numParticles % attractorCount) ? 1 : 0);
+			for (uint32_t j = 0; j < particlesPerAttractor; j++)
 			{
-				Particle& particle = particleBuffer[i * PARTICLES_PER_ATTRACTOR + j];
+				Particle& particle = particleBuffer[offset + j];
 
 				// First particle in group as heavy center of gravity
 				if (j == 0)
@@ -364,6 +560,7 @@ public:
 				// Color gradient offset
 				particle.vel.w = (float)i * 1.0f / static_cast<uint32_t>(attractors.size());
 			}
+			offset += particlesPerAttractor;
 		}
 
 		compute.uniformData.particleCount = numParticles;
@@ -376,8 +573,8 @@ public:
 		vks::Buffer stagingBuffer;
 
 		vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, storageBufferSize, particleBuffer.data());
-		// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
-		vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storageBuffer, storageBufferSize);
+		// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline, and copied to the host for validation
+		vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storageBuffer, storageBufferSize);
 
 		// Copy from staging buffer to storage buffer
 		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -412,6 +609,23 @@ public:
 		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
 
 		stagingBuffer.destroy();
+
+		// Barnes-Hut tree buffers, only accessed on the device
+		// The bitonic sort needs a power of two number of elements, at least one work group
+		barnesHut.sortCount = 256;
+		while (barnesHut.sortCount < numParticles) {
+			barnesHut.sortCount <<= 1;
+		}
+		compute.uniformData.sortCount = barnesHut.sortCount;
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		const VkDeviceSize internalNodeCount = std::max(numParticles - 1, 1u);
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &barnesHut.accelerations, numParticles * sizeof(glm::vec4)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &barnesHut.bounds, 2 * sizeof(glm::uvec4)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &barnesHut.sortKeys, barnesHut.sortCount * sizeof(uint32_t)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &barnesHut.sortValues, barnesHut.sortCount * sizeof(uint32_t)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &barnesHut.nodes, internalNodeCount * sizeof(Node)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &barnesHut.leafParents, numParticles * sizeof(int32_t)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &barnesHut.nodeFlags, internalNodeCount * sizeof(uint32_t)));
 	}
 
 	void prepareGraphics()
@@ -423,7 +637,7 @@ public:
 		// Descriptor pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
@@ -546,6 +760,15 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
 			// Binding 1 : Uniform buffer
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2 : Particle accelerations
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// Bindings 3..8 : Barnes-Hut bounds, sort keys and values, tree nodes, leaf parents and node visit counters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 8),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
@@ -558,12 +781,25 @@ public:
 			// Binding 0 : Particle position storage buffer
 			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffer.descriptor),
 			// Binding 1 : Uniform buffer
-			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1,&compute.uniformBuffer.descriptor)
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1,&compute.uniformBuffer.descriptor),
+			// Binding 2 : Particle accelerations
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &barnesHut.accelerations.descriptor),
+			// Bindings 3..8 : Barnes-Hut tree
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &barnesHut.bounds.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &barnesHut.sortKeys.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &barnesHut.sortValues.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &barnesHut.nodes.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &barnesHut.leafParents.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8, &barnesHut.nodeFlags.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
 
 		// Create pipelines
+		// The bitonic sort passes its stage via push constants
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&compute.descriptorSetLayout, 1);
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 2 * sizeof(uint32_t), 0);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
 
 		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
@@ -583,6 +819,29 @@ public:
 		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_integrate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineIntegrate));
 
+		// Barnes-Hut tree build and traversal
+		const std::vector<std::pair<std::string, VkPipeline*>> barnesHutPipelines = {
+			{ "bounds", &compute.pipelinesBarnesHut.bounds },
+			{ "morton", &compute.pipelinesBarnesHut.morton },
+			{ "sort", &compute.pipelinesBarnesHut.sort },
+			{ "tree", &compute.pipelinesBarnesHut.tree },
+			{ "summarize", &compute.pipelinesBarnesHut.summarize },
+			{ "traverse", &compute.pipelinesBarnesHut.traverse },
+		};
+		for (auto& pipeline : barnesHutPipelines) {
+			computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/barneshut_" + pipeline.first + ".comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, pipeline.second));
+		}
+
+		// Timestamps are only available if the compute queue supports them
+		if (vulkanDevice->queueFamilyProperties[compute.queueFamilyIndex].timestampValidBits > 0) {
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &compute.queryPool));
+		}
+
 		// Separate command pool as queue family for compute may be different than graphics
 		VkCommandPoolCreateInfo cmdPoolInfo = {};
 		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -607,6 +866,43 @@ public:
 		memcpy(compute.uniformBuffer.mapped, &compute.uniformData, sizeof(Compute::UniformData));
 	}
 
+	// Compare the accelerations calculated on the GPU in the captured frame against the CPU reference
+	void validateResults()
+	{
+		nbody::Bodies bodies;
+		bodies.set(reinterpret_cast<const float*>(validation.particles.mapped), numParticles, sizeof(Particle) / sizeof(float));
+		const glm::vec4* gpuAccelerations = reinterpret_cast<const glm::vec4*>(validation.accelerations.mapped);
+
+		// The reference is exact (all pairs), so only a subset of the particles spread over all attractors is checked
+		const uint32_t sampleCount = std::min(validation.sampleCount, numParticles);
+		std::vector<uint32_t> indices(sampleCount);
+		for (uint32_t i = 0; i < sampleCount; i++) {
+			indices[i] = (uint32_t)(((uint64_t)i * numParticles) / sampleCount);
+		}
+		const nbody::ForceParams params = { compute.uniformData.gravity, compute.uniformData.power, compute.uniformData.soften };
+		std::vector<float> cpuAccelerations;
+		auto tStart = std::chrono::high_resolution_clock::now();
+		nbody::accelerations(bodies, params, indices, cpuAccelerations, threadPool);
+		validation.cpuTime = (float)std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		validation.cpuStepEstimate = validation.cpuTime * (float)numParticles / (float)sampleCount;
+
+		// Error relative to the magnitude of the reference acceleration
+		double errorSum = 0.0;
+		validation.maxError = 0.0f;
+		for (uint32_t i = 0; i < sampleCount; i++) {
+			const glm::vec3 reference(cpuAccelerations[i * 3], cpuAccelerations[i * 3 + 1], cpuAccelerations[i * 3 + 2]);
+			const glm::vec3 difference = glm::vec3(gpuAccelerations[indices[i]]) - reference;
+			const float error = glm::length(difference) / std::max(glm::length(reference), 1e-6f);
+			errorSum += error;
+			validation.maxError = std::max(validation.maxError, error);
+		}
+		validation.meanError = (float)(errorSum / sampleCount);
+		validation.valid = true;
+
+		std::cout << (forceMode == BarnesHut ? "Barnes-Hut" : "Brute force") << " validation (" << sampleCount << " of " << numParticles << " particles): mean error " << validation.meanError * 100.0f << "%, max. error " << validation.maxError * 100.0f << "%" << std::endl;
+		std::cout << "CPU reference (" << nbody::simdPath() << ", " << threadPool.threads.size() << " threads): " << validation.cpuTime << "ms for " << sampleCount << " particles, " << validation.cpuStepEstimate << "ms estimated for a full step" << std::endl;
+	}
+
 	void updateGraphicsUniformBuffers()
 	{
 		graphics.uniformData.projection = camera.matrices.perspective;
@@ -668,9 +964,65 @@ public:
 	{
 		if (!prepared)
 			return;
+		// Capture the GPU results of this frame for validation
+		if (validation.requested) {
+			validation.requested = false;
+			validation.capture = true;
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &validation.particles, storageBuffer.size));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &validation.accelerations, barnesHut.accelerations.size));
+			VK_CHECK_RESULT(validation.particles.map());
+			VK_CHECK_RESULT(validation.accelerations.map());
+			VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+			buildComputeCommandBuffer();
+		}
 		updateComputeUniformBuffers();
 		updateGraphicsUniformBuffers();
 		draw();
+		if (validation.capture) {
+			VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+			validation.capture = false;
+			validateResults();
+			validation.particles.destroy();
+			validation.accelerations.destroy();
+			buildComputeCommandBuffer();
+		}
+		// Results of the frame's compute passes are available, as the base waits for the graphics queue, which in turn waits for compute
+		if (compute.queryPool != VK_NULL_HANDLE) {
+			uint64_t timestamps[2];
+			if (vkGetQueryPoolResults(device, compute.queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+				compute.timing = (float)(timestamps[1] - timestamps[0]) * vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+			}
+		}
+	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Settings")) {
+			overlay->text("Particles: %d", numParticles);
+			if (overlay->comboBox("Force calculation", &forceMode, { "Brute force", "Barnes-Hut" })) {
+				VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+				buildComputeCommandBuffer();
+				validation.valid = false;
+			}
+			if (forceMode == BarnesHut) {
+				overlay->sliderFloat("Theta", &compute.uniformData.theta, 0.1f, 1.5f);
+			}
+			if (compute.queryPool != VK_NULL_HANDLE) {
+				overlay->text("Compute: %.2f ms", compute.timing);
+			}
+		}
+		if (overlay->header("Validation")) {
+			if (overlay->button("Validate against CPU")) {
+				validation.requested = true;
+			}
+			if (validation.valid) {
+				overlay->text("Mean error: %.3f %%", validation.meanError * 100.0f);
+				overlay->text("Max. error: %.3f %%", validation.maxError * 100.0f);
+				overlay->text("CPU (%s, %d threads): %.1f ms", nbody::simdPath(), (int32_t)threadPool.threads.size(), validation.cpuTime);
+				overlay->text("for %d particles", std::min(validation.sampleCount, numParticles));
+				overlay->text("CPU full step (est.): %.1f ms", validation.cpuStepEstimate);
+			}
+		}
 	}
 };
 
@@ -0,0 +1,140 @@
+/*
+* Vulkan Example - Compute shader N-body simulation
+*
+* CPU reference for the N-body force calculation
+*
+* Computes exact (all pairs) accelerations for a subset of the bodies, distributed over the threads of a thread pool.
+* Four bodies are processed at once with SSE if available, with a scalar fallback on other platforms.
+* Used to validate the brute force and Barnes-Hut GPU paths and as a CPU performance baseline.
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "threadpool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define NBODY_USE_SSE2
+#endif
+
+namespace nbody
+{
+	// Same parameters as used by the compute shaders
+	struct ForceParams {
+		float gravity;
+		float power;
+		float soften;
+	};
+
+	// Bodies stored as structure of arrays, padded to a multiple of four with massless bodies
+	struct Bodies {
+		std::vector<float> x, y, z, mass;
+		uint32_t count{ 0 };
+
+		// Copy positions and masses from an array of vec4 (xyz = position, w = mass), with stride given in floats
+		void set(const float* data, uint32_t count, uint32_t stride)
+		{
+			this->count = count;
+			const size_t padded = (count + 3) & ~3;
+			x.assign(padded, 0.0f);
+			y.assign(padded, 0.0f);
+			z.assign(padded, 0.0f);
+			mass.assign(padded, 0.0f);
+			for (uint32_t i = 0; i < count; i++) {
+				const float* p = data + (size_t)i * stride;
+				x[i] = p[0];
+				y[i] = p[1];
+				z[i] = p[2];
+				mass[i] = p[3];
+			}
+		}
+	};
+
+	inline const char* simdPath()
+	{
+#if defined(NBODY_USE_SSE2)
+		return "SSE2";
+#else
+		return "scalar";
+#endif
+	}
+
+	// Acceleration of a single body at the given position by all bodies
+	inline void acceleration(const Bodies& bodies, const ForceParams& params, float px, float py, float pz, float* result)
+	{
+		float ax = 0.0f, ay = 0.0f, az = 0.0f;
+		size_t j = 0;
+#if defined(NBODY_USE_SSE2)
+		// The SIMD path only covers the power used by the example (x^0.75 = sqrt(x * sqrt(x))), other powers are done by the scalar loop
+		if (params.power == 0.75f) {
+			const __m128 vpx = _mm_set1_ps(px), vpy = _mm_set1_ps(py), vpz = _mm_set1_ps(pz);
+			const __m128 vsoften = _mm_set1_ps(params.soften);
+			__m128 vax = _mm_setzero_ps(), vay = _mm_setzero_ps(), vaz = _mm_setzero_ps();
+			for (; j < bodies.x.size(); j += 4) {
+				const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&bodies.x[j]), vpx);
+				const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&bodies.y[j]), vpy);
+				const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&bodies.z[j]), vpz);
+				const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)), vsoften);
+				const __m128 denom = _mm_sqrt_ps(_mm_mul_ps(d2, _mm_sqrt_ps(d2)));
+				const __m128 s = _mm_div_ps(_mm_loadu_ps(&bodies.mass[j]), denom);
+				vax = _mm_add_ps(vax, _mm_mul_ps(dx, s));
+				vay = _mm_add_ps(vay, _mm_mul_ps(dy, s));
+				vaz = _mm_add_ps(vaz, _mm_mul_ps(dz, s));
+			}
+			float lanes[3][4];
+			_mm_storeu_ps(lanes[0], vax);
+			_mm_storeu_ps(lanes[1], vay);
+			_mm_storeu_ps(lanes[2], vaz);
+			ax = (lanes[0][0] + lanes[0][1]) + (lanes[0][2] + lanes[0][3]);
+			ay = (lanes[1][0] + lanes[1][1]) + (lanes[1][2] + lanes[1][3]);
+			az = (lanes[2][0] + lanes[2][1]) + (lanes[2][2] + lanes[2][3]);
+		}
+#endif
+		for (; j < bodies.x.size(); j++) {
+			const float dx = bodies.x[j] - px;
+			const float dy = bodies.y[j] - py;
+			const float dz = bodies.z[j] - pz;
+			const float s = bodies.mass[j] / std::pow(dx * dx + dy * dy + dz * dz + params.soften, params.power);
+			ax += dx * s;
+			ay += dy * s;
+			az += dz * s;
+		}
+		result[0] = ax * params.gravity;
+		result[1] = ay * params.gravity;
+		result[2] = az * params.gravity;
+	}
+
+	/*
+		Calculate the accelerations of the bodies with the given indices on all threads of the pool
+		Results are written as three floats per index
+	*/
+	inline void accelerations(const Bodies& bodies, const ForceParams& params, const std::vector<uint32_t>& indices, std::vector<float>& result, vks::ThreadPool& threadPool)
+	{
+		result.resize(indices.size() * 3);
+		// Bodies are handed out in small batches to balance the load between threads
+		const uint32_t batchSize = 16;
+		std::atomic<uint32_t> nextBatch{ 0 };
+		for (auto& thread : threadPool.threads) {
+			thread->addJob([&] {
+				uint32_t first;
+				while ((first = (nextBatch++) * batchSize) < indices.size()) {
+					const uint32_t last = std::min(first + batchSize, (uint32_t)indices.size());
+					for (uint32_t i = first; i < last; i++) {
+						const uint32_t b = indices[i];
+						acceleration(bodies, params, bodies.x[b], bodies.y[b], bodies.z[b], &result[i * 3]);
+					}
+				}
+			});
+		}
+		threadPool.wait();
+	}
+}
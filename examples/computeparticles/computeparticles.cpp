@@ -3,12 +3,18 @@
 *
 * Updated compute shader by Lukas Bergdoll (https://github.com/Voultapher)
 *
+* Particles can be rendered with additive blending (order independent) or alpha blended, which requires them to be
+* drawn back to front. For the latter the particles are sorted by view depth on the GPU each frame using the radix sort
+* from the base framework, and the sorted indices are used as the index buffer for drawing
+*
 * Copyright (C) 2016-2024 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <iomanip>
 #include "vulkanexamplebase.h"
+#include "VulkanRadixSort.h"
 
 #if defined(__ANDROID__)
 // Lower particle count on Android for performance reasons
@@ -24,6 +30,9 @@ public:
 	float animStart = 20.0f;
 	bool attachToCursor = false;
 
+	enum BlendMode { Additive = 0, AlphaBlended = 1 };
+	int32_t blendMode = Additive;
+
 	struct {
 		vks::Texture2D particle;
 		vks::Texture2D gradient;
@@ -33,21 +42,42 @@ public:
 	struct Particle {
 		glm::vec2 pos;								// Particle position
 		glm::vec2 vel;								// Particle velocity
-		glm::vec4 gradientPos;						// Texture coordinates for the gradient ramp map
+		glm::vec4 gradientPos;						// x = Texture coordinates for the gradient ramp map, y = z position of the particle
 	};
 
 	// We use a shader storage buffer object to store the particlces
 	// This is updated by the compute pipeline and displayed as a vertex buffer by the graphics pipeline
 	vks::Buffer storageBuffer;
 
+	// Depth sorting of the particles for alpha blending
+	// The keys are the quantized view depths, the values are the particle indices and are used as the index buffer for drawing
+	struct {
+		vks::RadixSort radixSort;
+		vks::Buffer keys;
+		vks::Buffer values;
+		VkDescriptorSetLayout descriptorSetLayout;	// Depth key shader binding layout
+		VkDescriptorSet descriptorSet;				// Depth key shader bindings
+		VkPipelineLayout pipelineLayout;
+		VkPipeline pipeline;						// Compute pipeline writing the depth keys and particle indices
+	} sorting;
+
 	// Resources for the graphics part of the example
 	struct Graphics {
 		uint32_t queueFamilyIndex;					// Used to check if compute and graphics queue families differ and require additional barriers
 		VkDescriptorSetLayout descriptorSetLayout;	// Particle system rendering shader binding layout
 		VkDescriptorSet descriptorSet;				// Particle system rendering shader bindings
 		VkPipelineLayout pipelineLayout;			// Layout of the graphics pipeline
-		VkPipeline pipeline;						// Particle rendering pipeline
+		struct {
+			VkPipeline additive;
+			VkPipeline alphaBlended;
+		} pipelines;								// Particle rendering pipelines
 		VkSemaphore semaphore;                      // Execution dependency between compute & graphic submission
+		vks::Buffer uniformBuffer;					// Uniform buffer object containing the camera matrices
+		struct UniformData {
+			glm::mat4 projection;
+			glm::mat4 view;
+			glm::vec2 screenDim;
+		} uniformData;
 	} graphics;
 
 	// Resources for the compute part of the example
@@ -67,22 +97,32 @@ public:
 			float destX;							//		x position of the attractor
 			float destY;							//		y position of the attractor
 			int32_t particleCount = PARTICLE_COUNT;
+			glm::mat4 view;							//		View matrix used to calculate the depth sort keys
+			float depthNear;						//		View depth range of the particles, mapped to the 16 bit sort keys
+			float depthFar;
 		} uniformData;
 	} compute;
 
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Compute shader particle system";
+		camera.type = Camera::CameraType::lookat;
+		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 64.0f);
+		camera.setTranslation(glm::vec3(0.0f, 0.0f, -2.0f));
+		commandLineParser.add("sortbenchmark", { "-sb", "--sortbenchmark" }, 0, "Measure the throughput of the GPU radix sort and exit");
+		commandLineParser.parse(args);
 	}
 
 	~VulkanExample()
 	{
 		if (device) {
 			// Graphics
-			vkDestroyPipeline(device, graphics.pipeline, nullptr);
+			vkDestroyPipeline(device, graphics.pipelines.additive, nullptr);
+			vkDestroyPipeline(device, graphics.pipelines.alphaBlended, nullptr);
 			vkDestroyPipelineLayout(device, graphics.pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, graphics.descriptorSetLayout, nullptr);
 			vkDestroySemaphore(device, graphics.semaphore, nullptr);
+			graphics.uniformBuffer.destroy();
 
 			// Compute
 			compute.uniformBuffer.destroy();
@@ -92,6 +132,14 @@ public:
 			vkDestroySemaphore(device, compute.semaphore, nullptr);
 			vkDestroyCommandPool(device, compute.commandPool, nullptr);
 
+			// Sorting
+			sorting.radixSort.destroy();
+			vkDestroyPipeline(device, sorting.pipeline, nullptr);
+			vkDestroyPipelineLayout(device, sorting.pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, sorting.descriptorSetLayout, nullptr);
+			sorting.keys.destroy();
+			sorting.values.destroy();
+
 			storageBuffer.destroy();
 			textures.particle.destroy();
 			textures.gradient.destroy();
@@ -104,6 +152,23 @@ public:
 		textures.gradient.loadFromFile(getAssetPath() + "textures/particle_gradient_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	}
 
+	// Transfer the ownership of the buffers shared between the compute and graphics queue (particles and sorted indices)
+	void queueOwnershipBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
+	{
+		std::array<VkBufferMemoryBarrier, 2> bufferBarriers{};
+		std::array<const vks::Buffer*, 2> buffers = { &storageBuffer, &sorting.values };
+		for (size_t i = 0; i < bufferBarriers.size(); i++) {
+			bufferBarriers[i] = vks::initializers::bufferMemoryBarrier();
+			bufferBarriers[i].srcAccessMask = srcAccessMask;
+			bufferBarriers[i].dstAccessMask = dstAccessMask;
+			bufferBarriers[i].srcQueueFamilyIndex = srcQueueFamilyIndex;
+			bufferBarriers[i].dstQueueFamilyIndex = dstQueueFamilyIndex;
+			bufferBarriers[i].buffer = buffers[i]->buffer;
+			bufferBarriers[i].size = buffers[i]->size;
+		}
+		vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
+	}
+
 	void buildCommandBuffers()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
@@ -131,27 +196,7 @@ public:
 			// Acquire barrier
 			if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
 			{
-				VkBufferMemoryBarrier buffer_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					0,
-					VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-					compute.queueFamilyIndex,
-					graphics.queueFamilyIndex,
-					storageBuffer.buffer,
-					0,
-					storageBuffer.size
-				};
-
-				vkCmdPipelineBarrier(
-					drawCmdBuffers[i],
-					VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-					VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-					0,
-					0, nullptr,
-					1, &buffer_barrier,
-					0, nullptr);
+				queueOwnershipBarrier(drawCmdBuffers[i], 0, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, compute.queueFamilyIndex, graphics.queueFamilyIndex, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 			}
 
 			// Draw the particle system using the update vertex buffer
@@ -163,12 +208,18 @@ public:
 			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, (blendMode == AlphaBlended) ? graphics.pipelines.alphaBlended : graphics.pipelines.additive);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
 
 			VkDeviceSize offsets[1] = { 0 };
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &storageBuffer.buffer, offsets);
-			vkCmdDraw(drawCmdBuffers[i], PARTICLE_COUNT, 1, 0, 0);
+			if (blendMode == AlphaBlended) {
+				// The particle indices sorted back to front by the compute queue
+				vkCmdBindIndexBuffer(drawCmdBuffers[i], sorting.values.buffer, 0, VK_INDEX_TYPE_UINT32);
+				vkCmdDrawIndexed(drawCmdBuffers[i], PARTICLE_COUNT, 1, 0, 0, 0);
+			} else {
+				vkCmdDraw(drawCmdBuffers[i], PARTICLE_COUNT, 1, 0, 0);
+			}
 
 			drawUI(drawCmdBuffers[i]);
 
@@ -177,27 +228,7 @@ public:
 			// Release barrier
 			if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
 			{
-				VkBufferMemoryBarrier buffer_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-					0,
-					graphics.queueFamilyIndex,
-					compute.queueFamilyIndex,
-					storageBuffer.buffer,
-					0,
-					storageBuffer.size
-				};
-
-				vkCmdPipelineBarrier(
-					drawCmdBuffers[i],
-					VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-					VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-					0,
-					0, nullptr,
-					1, &buffer_barrier,
-					0, nullptr);
+				queueOwnershipBarrier(drawCmdBuffers[i], VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, 0, graphics.queueFamilyIndex, compute.queueFamilyIndex, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 			}
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -216,27 +247,7 @@ public:
 		// Add memory barrier to ensure that the (graphics) vertex shader has fetched attributes before compute starts to write to the buffer
 		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
 		{
-			VkBufferMemoryBarrier buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				0,
-				VK_ACCESS_SHADER_WRITE_BIT,
-				graphics.queueFamilyIndex,
-				compute.queueFamilyIndex,
-				storageBuffer.buffer,
-				0,
-				storageBuffer.size
-			};
-
-			vkCmdPipelineBarrier(
-				compute.commandBuffer,
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				0,
-				0, nullptr,
-				1, &buffer_barrier,
-				0, nullptr);
+			queueOwnershipBarrier(compute.commandBuffer, 0, VK_ACCESS_SHADER_WRITE_BIT, graphics.queueFamilyIndex, compute.queueFamilyIndex, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 		}
 
 		// Dispatch the compute job
@@ -244,31 +255,29 @@ public:
 		vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
 		vkCmdDispatch(compute.commandBuffer, PARTICLE_COUNT / 256, 1, 1);
 
+		// Sort the particles back to front for alpha blending
+		if (blendMode == AlphaBlended)
+		{
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+			// Calculate the depth keys from the updated positions
+			vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sorting.pipeline);
+			vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sorting.pipelineLayout, 0, 1, &sorting.descriptorSet, 0, 0);
+			vkCmdDispatch(compute.commandBuffer, PARTICLE_COUNT / 256, 1, 1);
+
+			// The keys only use 16 bits, which halves the number of sort passes
+			vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			sorting.radixSort.record(compute.commandBuffer, PARTICLE_COUNT, 16);
+		}
+
 		// Add barrier to ensure that compute shader has finished writing to the buffer
 		// Without this the (rendering) vertex shader may display incomplete results (partial data from last frame)
 		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
 		{
-			VkBufferMemoryBarrier buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				VK_ACCESS_SHADER_WRITE_BIT,
-				0,
-				compute.queueFamilyIndex,
-				graphics.queueFamilyIndex,
-				storageBuffer.buffer,
-				0,
-				storageBuffer.size
-			};
-
-			vkCmdPipelineBarrier(
-				compute.commandBuffer,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				0,
-				0, nullptr,
-				1, &buffer_barrier,
-				0, nullptr);
+			queueOwnershipBarrier(compute.commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, 0, compute.queueFamilyIndex, graphics.queueFamilyIndex, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 		}
 
 		vkEndCommandBuffer(compute.commandBuffer);
@@ -279,6 +288,7 @@ public:
 	{
 		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
 		std::uniform_real_distribution<float> rndDist(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> rndDepth(-0.25f, 0.25f);
 
 		// Initial particle positions
 		std::vector<Particle> particleBuffer(PARTICLE_COUNT);
@@ -286,6 +296,8 @@ public:
 			particle.pos = glm::vec2(rndDist(rndEngine), rndDist(rndEngine));
 			particle.vel = glm::vec2(0.0f);
 			particle.gradientPos.x = particle.pos.x / 2.0f;
+			// The simulation is 2D, the particles keep their position in a thin slab along z
+			particle.gradientPos.y = rndDepth(rndEngine);
 		}
 
 		VkDeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
@@ -309,50 +321,43 @@ public:
 			&storageBuffer,
 			storageBufferSize);
 
+		// Sort keys and values, the values are the sorted particle indices that are used as the index buffer for drawing
+		// Both start out with identity indices, so the draw order is valid before the first sort
+		std::vector<uint32_t> indices(PARTICLE_COUNT);
+		std::iota(indices.begin(), indices.end(), 0);
+		VkDeviceSize sortBufferSize = indices.size() * sizeof(uint32_t);
+		vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &sorting.keys, sortBufferSize);
+		vulkanDevice->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &sorting.values, sortBufferSize);
+		vks::Buffer indexStagingBuffer;
+		vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indexStagingBuffer, sortBufferSize, indices.data());
+
 		// Copy from staging buffer to storage buffer
 		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 		VkBufferCopy copyRegion = {};
 		copyRegion.size = storageBufferSize;
 		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, storageBuffer.buffer, 1, &copyRegion);
+		copyRegion.size = sortBufferSize;
+		vkCmdCopyBuffer(copyCmd, indexStagingBuffer.buffer, sorting.values.buffer, 1, &copyRegion);
 		// Execute a transfer barrier to the compute queue, if necessary
 		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
 		{
-			VkBufferMemoryBarrier buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-				0,
-				graphics.queueFamilyIndex,
-				compute.queueFamilyIndex,
-				storageBuffer.buffer,
-				0,
-				storageBuffer.size
-			};
-
-			vkCmdPipelineBarrier(
-				copyCmd,
-				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				0,
-				0, nullptr,
-				1, &buffer_barrier,
-				0, nullptr);
+			queueOwnershipBarrier(copyCmd, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, 0, graphics.queueFamilyIndex, compute.queueFamilyIndex, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 		}
 		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
 
 		stagingBuffer.destroy();
+		indexStagingBuffer.destroy();
 	}
 
 	// The descriptor pool will be shared between graphics and compute
 	void setupDescriptorPool()
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
 
@@ -366,7 +371,9 @@ public:
 			// Binding 0 : Particle color map
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
 			// Binding 1 : Particle gradient ramp
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+			// Binding 2 : Camera matrices
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 2)
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &graphics.descriptorSetLayout));
@@ -388,6 +395,12 @@ public:
 			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 			1,
 			&textures.gradient.descriptor));
+		// Binding 2 : Camera matrices
+		writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(
+			graphics.descriptorSet,
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			2,
+			&graphics.uniformBuffer.descriptor));
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 
@@ -449,7 +462,15 @@ public:
 		blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
 		blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_DST_ALPHA;
 
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &graphics.pipeline));
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &graphics.pipelines.additive));
+
+		// Alpha blending, only correct if the particles are drawn back to front
+		blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &graphics.pipelines.alphaBlended));
 
 		// Semaphore for compute & graphics sync
 		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
@@ -521,6 +542,8 @@ public:
 		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
 
+		prepareSorting();
+
 		// Create a command buffer for compute operations
 		compute.commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, compute.commandPool);
 
@@ -532,6 +555,66 @@ public:
 		buildComputeCommandBuffer();
 	}
 
+	// Pipeline for writing the sort keys and the radix sort used to sort the particles by depth
+	void prepareSorting()
+	{
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			// Binding 0 : Particle storage buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1 : Uniform buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2 : Sort keys
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// Binding 3 : Sort values (particle indices)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &sorting.descriptorSetLayout));
+
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &sorting.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &sorting.descriptorSet));
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(sorting.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(sorting.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &compute.uniformBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(sorting.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &sorting.keys.descriptor),
+			vks::initializers::writeDescriptorSet(sorting.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &sorting.values.descriptor)
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&sorting.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &sorting.pipelineLayout));
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(sorting.pipelineLayout, 0);
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computeparticles/particle_depth.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &sorting.pipeline));
+
+		sorting.radixSort.prepare(vulkanDevice, shaderCache, pipelineCache, getShadersPath(), PARTICLE_COUNT);
+		sorting.radixSort.setBuffers(sorting.keys.buffer, sorting.values.buffer);
+	}
+
+	// Measure the throughput of the radix sort for different key counts and key sizes
+	void runSortBenchmark()
+	{
+#if defined(__ANDROID__)
+		const std::vector<uint32_t> counts = { 256 * 1024, 1024 * 1024 };
+#else
+		const std::vector<uint32_t> counts = { 256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 8 * 1024 * 1024 };
+#endif
+		const uint32_t iterations = 10;
+		vks::RadixSort radixSort;
+		radixSort.prepare(vulkanDevice, shaderCache, pipelineCache, getShadersPath(), counts.back());
+		std::cout << "GPU radix sort benchmark on " << deviceProperties.deviceName << " (" << iterations << " iterations)" << std::endl;
+		for (uint32_t keyBits : { 16u, 32u }) {
+			for (uint32_t count : counts) {
+				vks::RadixSort::BenchmarkResult result = radixSort.benchmark(compute.queue, vulkanDevice->queueFamilyIndices.compute, count, keyBits, iterations);
+				std::cout << std::setw(9) << count << " keys, " << std::setw(2) << keyBits << " bit: "
+					<< std::fixed << std::setprecision(3) << result.milliseconds << " ms, "
+					<< std::setprecision(1) << result.megaKeysPerSecond << " Mkeys/s"
+					<< (result.valid ? "" : " (invalid result)") << std::endl;
+			}
+		}
+		radixSort.destroy();
+	}
+
 	// Prepare and initialize uniform buffer containing shader uniforms
 	void prepareUniformBuffers()
 	{
@@ -540,6 +623,10 @@ public:
 		// Map for host access
 		VK_CHECK_RESULT(compute.uniformBuffer.map());
 
+		// Vertex shader uniform buffer block
+		vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &graphics.uniformBuffer, sizeof(Graphics::UniformData));
+		VK_CHECK_RESULT(graphics.uniformBuffer.map());
+
 		updateUniformBuffers();
 	}
 
@@ -555,11 +642,29 @@ public:
 		{
 			float normalizedMx = (mouseState.position.x - static_cast<float>(width / 2)) / static_cast<float>(width / 2);
 			float normalizedMy = (mouseState.position.y - static_cast<float>(height / 2)) / static_cast<float>(height / 2);
-			compute.uniformData.destX = normalizedMx;
-			compute.uniformData.destY = normalizedMy;
+			// Intersect the view ray through the cursor with the z = 0 plane of the simulation
+			glm::mat4 invViewProj = glm::inverse(camera.matrices.perspective * camera.matrices.view);
+			glm::vec4 rayStart = invViewProj * glm::vec4(normalizedMx, normalizedMy, 0.0f, 1.0f);
+			glm::vec4 rayEnd = invViewProj * glm::vec4(normalizedMx, normalizedMy, 1.0f, 1.0f);
+			glm::vec3 origin = glm::vec3(rayStart) / rayStart.w;
+			glm::vec3 direction = glm::vec3(rayEnd) / rayEnd.w - origin;
+			float t = (std::abs(direction.z) > 1e-6f) ? -origin.z / direction.z : 0.0f;
+			compute.uniformData.destX = origin.x + direction.x * t;
+			compute.uniformData.destY = origin.y + direction.y * t;
 		}
 
+		// The particles stay inside [-1, 1] on x and y and the slab on z, so their view depth is within the bounding sphere around the origin
+		const float boundingRadius = glm::length(glm::vec3(1.0f, 1.0f, 0.25f));
+		const float distance = glm::length(camera.position);
+		compute.uniformData.view = camera.matrices.view;
+		compute.uniformData.depthNear = std::max(distance - boundingRadius, 0.0f);
+		compute.uniformData.depthFar = distance + boundingRadius;
 		memcpy(compute.uniformBuffer.mapped, &compute.uniformData, sizeof(Compute::UniformData));
+
+		graphics.uniformData.projection = camera.matrices.perspective;
+		graphics.uniformData.view = camera.matrices.view;
+		graphics.uniformData.screenDim = glm::vec2((float)width, (float)height);
+		memcpy(graphics.uniformBuffer.mapped, &graphics.uniformData, sizeof(Graphics::UniformData));
 	}
 
 	void draw()
@@ -608,6 +713,16 @@ public:
 		setupDescriptorPool();
 		prepareGraphics();
 		prepareCompute();
+		if (commandLineParser.isSet("sortbenchmark")) {
+#if defined(_WIN32)
+			setupConsole(title);
+#endif
+			// Sorts on the compute queue used by the example
+			runSortBenchmark();
+			// Skip the render loop, the example is then destroyed regularly
+			exitRequested = true;
+			return;
+		}
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -639,6 +754,11 @@ public:
 	{
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Attach attractor to cursor", &attachToCursor);
+			if (overlay->comboBox("Blending", &blendMode, { "Additive", "Alpha blended (depth sorted)" })) {
+				// The compute command buffer may still be in flight
+				vkQueueWaitIdle(compute.queue);
+				buildComputeCommandBuffer();
+			}
 		}
 	}
 };
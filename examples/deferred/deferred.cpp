@@ -5,21 +5,45 @@
 * albedo, normals, world positions are rendered to offscreen images which are then put together and lit
 * in a composition pass
 * Use the dropdown in the ui to switch between the final composition pass or the separate components
-* 
-* 
-* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* Lights are stored in a storage buffer and binned into a 3D grid of view space clusters by a compute shader
+* The composition pass only evaluates the lights of the cluster a fragment belongs to
+*
+* The G-Buffer can use a packed layout that reconstructs positions from depth and stores octahedral encoded normals
+*
+* Copyright (C) 2016-2024 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <iomanip>
+#include <random>
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
 
+// Must match the defines in the cluster culling and composition shaders
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define CLUSTER_MAX_LIGHTS 512
+#define MAX_LIGHT_COUNT 16384
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	int32_t debugDisplayTarget = 0;
 
+	enum LightCulling { Clustered = 0, None = 1 };
+	int32_t lightCulling{ Clustered };
+	const std::vector<uint32_t> lightCounts = { 6, 64, 256, 1024, 4096, 10240, 16384 };
+	int32_t lightCountIndex{ 3 };
+
+	// Full stores world positions and normals in 16 bit float RGBA attachments
+	// Packed reconstructs the position from the (sampled) depth attachment and stores octahedral encoded normals in two channels
+	enum GBufferLayout { Full = 0, Packed = 1 };
+	int32_t gbufferLayout{ Full };
+	bool gbufferReport{ false };
+
 	struct {
 		struct {
 			vks::Texture2D colorMap;
@@ -43,16 +67,27 @@ public:
 		glm::vec4 instancePos[3];
 	} uniformDataOffscreen;
 
+	// w component of the position is the range of the light, beyond which it's culled
 	struct Light {
 		glm::vec4 position;
 		glm::vec3 color;
 		float radius;
 	};
+	std::vector<Light> lights;
+	// Initial positions and animation parameters (x = orbit radius, y = speed, z = phase) of the lights
+	std::vector<glm::vec4> lightOrigins;
+	std::vector<glm::vec3> lightAnimations;
 
 	struct UniformDataComposition {
-		Light lights[6];
+		glm::mat4 view;
+		// Used to reconstruct world space positions from depth with the packed G-Buffer layout
+		glm::mat4 invViewProjection;
 		glm::vec4 viewPos;
+		// x = projection[0][0], y = projection[1][1], z = near plane, w = far plane
+		glm::vec4 clusterParams;
 		int debugDisplayTarget = 0;
+		uint32_t lightCount{ 0 };
+		uint32_t clustered{ 1 };
 	} uniformDataComposition;
 
 	struct {
@@ -60,12 +95,52 @@ public:
 		vks::Buffer composition{ VK_NULL_HANDLE };
 	} uniformBuffers;
 
+	struct {
+		vks::Buffer lights;
+		// Number of lights per cluster
+		vks::Buffer clusterLightCounts;
+		// Fixed size list of light indices per cluster
+		vks::Buffer clusterLightIndices;
+	} storageBuffers;
+
 	struct {
 		VkPipeline offscreen{ VK_NULL_HANDLE };
+		VkPipeline offscreenPacked{ VK_NULL_HANDLE };
 		VkPipeline composition{ VK_NULL_HANDLE };
+		VkPipeline compositionPacked{ VK_NULL_HANDLE };
+		VkPipeline clusterCulling{ VK_NULL_HANDLE };
 	} pipelines;
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 
+	// Timestamps before and after light culling and after the composition pass
+	// Only taken if the graphics queue family supports timestamps
+	VkQueryPool queryPool{ VK_NULL_HANDLE };
+	bool timestampsSupported{ false };
+	struct Timings {
+		float culling{ 0.0f };
+		float composition{ 0.0f };
+	} timings;
+
+	// Measures the GPU time of culling and composition for all light counts, one configuration after another over several frames
+	struct LightSweep {
+		bool active{ false };
+		bool exitWhenDone{ false };
+		uint32_t countIndex{ 0 };
+		int32_t culling{ Clustered };
+		uint32_t frame{ 0 };
+		float accumulated{ 0.0f };
+		// Saved settings, restored after the sweep
+		int32_t savedCountIndex{ 0 };
+		int32_t savedCulling{ Clustered };
+		// GPU time in ms for each light count, negative if not measured
+		std::vector<float> clusteredTimes;
+		std::vector<float> noCullingTimes;
+	} lightSweep;
+	const uint32_t sweepWarmupFrames = 5;
+	const uint32_t sweepMeasureFrames = 20;
+	// Shading every light for every fragment gets too slow beyond this
+	const uint32_t sweepMaxUnculledLights = 4096;
+
 	struct {
 		VkDescriptorSet model{ VK_NULL_HANDLE };
 		VkDescriptorSet floor{ VK_NULL_HANDLE };
@@ -80,16 +155,33 @@ public:
 		VkDeviceMemory mem;
 		VkImageView view;
 		VkFormat format;
+		VkDeviceSize size;
 	};
 	struct FrameBuffer {
 		int32_t width, height;
 		VkFramebuffer frameBuffer;
 		// One attachment for every component required for a deferred rendering setup
+		// The packed layout doesn't use the position attachment
 		FrameBufferAttachment position, normal, albedo;
 		FrameBufferAttachment depth;
 		VkRenderPass renderPass;
+		VkRenderPass renderPassPacked;
 	} offScreenFrameBuf{};
 
+	// Describes an attachment of a G-Buffer layout, color attachments come first, depth is last
+	struct GBufferAttachmentInfo {
+		VkFormat format;
+		VkImageUsageFlags usage;
+		// Bytes per texel
+		uint32_t texelSize;
+	};
+
+	struct {
+		VkFormat depth;
+		VkFormat packedDepth;
+		VkFormat packedNormal;
+	} gbufferFormats{};
+
 	// One sampler for the frame buffer color attachments
 	VkSampler colorSampler{ VK_NULL_HANDLE };
 
@@ -109,6 +201,11 @@ public:
 		camera.position = { 2.15f, 0.3f, -8.75f };
 		camera.setRotation(glm::vec3(-0.75f, 12.5f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
+		commandLineParser.add("lightsweep", { "-ls", "--lightsweep" }, 0, "Measure the GPU time of light culling and shading for increasing light counts, print the results and exit");
+		commandLineParser.add("gbufferreport", { "-gr", "--gbufferreport" }, 0, "Print the memory and bandwidth of the full and packed G-Buffer layouts for common resolutions and exit");
+		commandLineParser.parse(args);
+		lightSweep.exitWhenDone = commandLineParser.isSet("lightsweep");
+		gbufferReport = commandLineParser.isSet("gbufferreport");
 	}
 
 	~VulkanExample()
@@ -117,29 +214,13 @@ public:
 			vkDestroySampler(device, colorSampler, nullptr);
 
 			// Frame buffer
-
-			// Color attachments
-			vkDestroyImageView(device, offScreenFrameBuf.position.view, nullptr);
-			vkDestroyImage(device, offScreenFrameBuf.position.image, nullptr);
-			vkFreeMemory(device, offScreenFrameBuf.position.mem, nullptr);
-
-			vkDestroyImageView(device, offScreenFrameBuf.normal.view, nullptr);
-			vkDestroyImage(device, offScreenFrameBuf.normal.image, nullptr);
-			vkFreeMemory(device, offScreenFrameBuf.normal.mem, nullptr);
-
-			vkDestroyImageView(device, offScreenFrameBuf.albedo.view, nullptr);
-			vkDestroyImage(device, offScreenFrameBuf.albedo.image, nullptr);
-			vkFreeMemory(device, offScreenFrameBuf.albedo.mem, nullptr);
-
-			// Depth attachment
-			vkDestroyImageView(device, offScreenFrameBuf.depth.view, nullptr);
-			vkDestroyImage(device, offScreenFrameBuf.depth.image, nullptr);
-			vkFreeMemory(device, offScreenFrameBuf.depth.mem, nullptr);
-
-			vkDestroyFramebuffer(device, offScreenFrameBuf.frameBuffer, nullptr);
+			destroyGBuffer();
 
 			vkDestroyPipeline(device, pipelines.composition, nullptr);
+			vkDestroyPipeline(device, pipelines.compositionPacked, nullptr);
 			vkDestroyPipeline(device, pipelines.offscreen, nullptr);
+			vkDestroyPipeline(device, pipelines.offscreenPacked, nullptr);
+			vkDestroyPipeline(device, pipelines.clusterCulling, nullptr);
 
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
@@ -149,7 +230,14 @@ public:
 			uniformBuffers.offscreen.destroy();
 			uniformBuffers.composition.destroy();
 
+			storageBuffers.lights.destroy();
+			storageBuffers.clusterLightCounts.destroy();
+			storageBuffers.clusterLightIndices.destroy();
+
+			vkDestroyQueryPool(device, queryPool, nullptr);
+
 			vkDestroyRenderPass(device, offScreenFrameBuf.renderPass, nullptr);
+			vkDestroyRenderPass(device, offScreenFrameBuf.renderPassPacked, nullptr);
 
 			textures.model.colorMap.destroy();
 			textures.model.normalMap.destroy();
@@ -169,43 +257,117 @@ public:
 		}
 	};
 
+	// Memory and per frame traffic of a G-Buffer layout at a given resolution
+	struct GBufferFootprint {
+		// Memory that has to be committed for the attachments
+		VkDeviceSize memory{ 0 };
+		// Memory of transient attachments that are backed by lazily allocated memory and may never be committed
+		VkDeviceSize lazyMemory{ 0 };
+		// Bytes stored by the G-Buffer pass plus bytes sampled by the composition pass (depth testing not included)
+		VkDeviceSize bandwidth{ 0 };
+	};
+	std::array<GBufferFootprint, 2> gbufferFootprints;
+
+	uint32_t depthFormatSize(VkFormat format)
+	{
+		switch (format) {
+		case VK_FORMAT_D16_UNORM:
+			return 2;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+			return 3;
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return 5;
+		default:
+			return 4;
+		}
+	}
+
+	void selectGBufferFormats()
+	{
+		// Find a suitable depth format
+		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &gbufferFormats.depth);
+		assert(validDepthFormat);
+
+		// The packed layout samples depth, so it needs a depth only format (D16 support is mandatory)
+		gbufferFormats.packedDepth = VK_FORMAT_D16_UNORM;
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_D32_SFLOAT, &formatProperties);
+		if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) && (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+			gbufferFormats.packedDepth = VK_FORMAT_D32_SFLOAT;
+		}
+
+		// Octahedral normals are stored as 16 bit unorm if that can be rendered to, 16 bit float is always supported
+		gbufferFormats.packedNormal = VK_FORMAT_R16G16_SFLOAT;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R16G16_UNORM, &formatProperties);
+		if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) {
+			gbufferFormats.packedNormal = VK_FORMAT_R16G16_UNORM;
+		}
+	}
+
+	std::vector<GBufferAttachmentInfo> getGBufferAttachmentInfos(int32_t layout)
+	{
+		const VkImageUsageFlags colorUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		if (layout == Packed) {
+			return {
+				// Octahedral encoded normals
+				{ gbufferFormats.packedNormal, colorUsage, 4 },
+				// Albedo (color) with the specular intensity in alpha
+				{ VK_FORMAT_R8G8B8A8_UNORM, colorUsage, 4 },
+				// Depth, sampled to reconstruct the position
+				{ gbufferFormats.packedDepth, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, depthFormatSize(gbufferFormats.packedDepth) },
+			};
+		}
+		return {
+			// (World space) Positions
+			{ VK_FORMAT_R16G16B16A16_SFLOAT, colorUsage, 8 },
+			// (World space) Normals
+			{ VK_FORMAT_R16G16B16A16_SFLOAT, colorUsage, 8 },
+			// Albedo (color)
+			{ VK_FORMAT_R8G8B8A8_UNORM, colorUsage, 4 },
+			// Depth is only used during the G-Buffer pass, so it doesn't need to be stored and can be transient
+			{ gbufferFormats.depth, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, depthFormatSize(gbufferFormats.depth) },
+		};
+	}
+
+	VkImageCreateInfo getGBufferImageCreateInfo(const GBufferAttachmentInfo& info, uint32_t width, uint32_t height)
+	{
+		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
+		image.imageType = VK_IMAGE_TYPE_2D;
+		image.format = info.format;
+		image.extent.width = width;
+		image.extent.height = height;
+		image.extent.depth = 1;
+		image.mipLevels = 1;
+		image.arrayLayers = 1;
+		image.samples = VK_SAMPLE_COUNT_1_BIT;
+		image.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image.usage = info.usage;
+		return image;
+	}
+
 	// Create a frame buffer attachment
 	void createAttachment(
-		VkFormat format,
-		VkImageUsageFlagBits usage,
+		const GBufferAttachmentInfo& info,
 		FrameBufferAttachment *attachment)
 	{
 		VkImageAspectFlags aspectMask = 0;
-		VkImageLayout imageLayout;
 
-		attachment->format = format;
+		attachment->format = info.format;
 
-		if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
+		if (info.usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
 		{
 			aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 		}
-		if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
+		if (info.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
 		{
 			aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			if (format >= VK_FORMAT_D16_UNORM_S8_UINT)
+			if (info.format >= VK_FORMAT_D16_UNORM_S8_UINT)
 				aspectMask |=VK_IMAGE_ASPECT_STENCIL_BIT;
-			imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 		}
 
 		assert(aspectMask > 0);
 
-		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
-		image.imageType = VK_IMAGE_TYPE_2D;
-		image.format = format;
-		image.extent.width = offScreenFrameBuf.width;
-		image.extent.height = offScreenFrameBuf.height;
-		image.extent.depth = 1;
-		image.mipLevels = 1;
-		image.arrayLayers = 1;
-		image.samples = VK_SAMPLE_COUNT_1_BIT;
-		image.tiling = VK_IMAGE_TILING_OPTIMAL;
-		image.usage = usage | VK_IMAGE_USAGE_SAMPLED_BIT;
+		VkImageCreateInfo image = getGBufferImageCreateInfo(info, offScreenFrameBuf.width, offScreenFrameBuf.height);
 
 		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		VkMemoryRequirements memReqs;
@@ -213,13 +375,21 @@ public:
 		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &attachment->image));
 		vkGetImageMemoryRequirements(device, attachment->image, &memReqs);
 		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		attachment->size = memReqs.size;
+		// Transient attachments use lazily allocated memory if the implementation offers it (usually tile based GPUs)
+		VkBool32 lazilyAllocated = VK_FALSE;
+		if (info.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+			memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazilyAllocated);
+		}
+		if (!lazilyAllocated) {
+			memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		}
 		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &attachment->mem));
 		VK_CHECK_RESULT(vkBindImageMemory(device, attachment->image, attachment->mem, 0));
 
 		VkImageViewCreateInfo imageView = vks::initializers::imageViewCreateInfo();
 		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageView.format = format;
+		imageView.format = info.format;
 		imageView.subresourceRange = {};
 		imageView.subresourceRange.aspectMask = aspectMask;
 		imageView.subresourceRange.baseMipLevel = 0;
@@ -230,81 +400,56 @@ public:
 		VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &attachment->view));
 	}
 
-	// Prepare a new framebuffer and attachments for offscreen rendering (G-Buffer)
-	void prepareOffscreenFramebuffer()
+	void destroyAttachment(FrameBufferAttachment* attachment)
 	{
-		// Note: Instead of using fixed sizes, one could also match the window size and recreate the attachments on resize
-		offScreenFrameBuf.width = 2048;
-		offScreenFrameBuf.height = 2048;
-
-		// Color attachments
-
-		// (World space) Positions
-		createAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			&offScreenFrameBuf.position);
-
-		// (World space) Normals
-		createAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			&offScreenFrameBuf.normal);
-
-		// Albedo (color)
-		createAttachment(
-			VK_FORMAT_R8G8B8A8_UNORM,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			&offScreenFrameBuf.albedo);
-
-		// Depth attachment
-
-		// Find a suitable depth format
-		VkFormat attDepthFormat;
-		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &attDepthFormat);
-		assert(validDepthFormat);
+		if (attachment->image == VK_NULL_HANDLE) {
+			return;
+		}
+		vkDestroyImageView(device, attachment->view, nullptr);
+		vkDestroyImage(device, attachment->image, nullptr);
+		vkFreeMemory(device, attachment->mem, nullptr);
+		*attachment = {};
+	}
 
-		createAttachment(
-			attDepthFormat,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-			&offScreenFrameBuf.depth);
+	// Set up a separate renderpass with references to the color and depth attachments of a G-Buffer layout
+	void createGBufferRenderPass(int32_t layout, VkRenderPass* renderPass)
+	{
+		const std::vector<GBufferAttachmentInfo> infos = getGBufferAttachmentInfos(layout);
+		const uint32_t depthIndex = static_cast<uint32_t>(infos.size()) - 1;
+		const bool sampleDepth = (infos[depthIndex].usage & VK_IMAGE_USAGE_SAMPLED_BIT) != 0;
 
-		// Set up separate renderpass with references to the color and depth attachments
-		std::array<VkAttachmentDescription, 4> attachmentDescs = {};
+		std::vector<VkAttachmentDescription> attachmentDescs(infos.size());
 
 		// Init attachment properties
-		for (uint32_t i = 0; i < 4; ++i)
+		for (uint32_t i = 0; i < static_cast<uint32_t>(infos.size()); ++i)
 		{
+			attachmentDescs[i].format = infos[i].format;
 			attachmentDescs[i].samples = VK_SAMPLE_COUNT_1_BIT;
 			attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 			attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 			attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 			attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			if (i == 3)
+			attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			if (i == depthIndex)
 			{
-				attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+				// Depth is only written back to memory if it's sampled in the composition pass
+				attachmentDescs[i].storeOp = sampleDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				attachmentDescs[i].finalLayout = sampleDepth ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 			}
 			else
 			{
-				attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 				attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 			}
 		}
 
-		// Formats
-		attachmentDescs[0].format = offScreenFrameBuf.position.format;
-		attachmentDescs[1].format = offScreenFrameBuf.normal.format;
-		attachmentDescs[2].format = offScreenFrameBuf.albedo.format;
-		attachmentDescs[3].format = offScreenFrameBuf.depth.format;
-
 		std::vector<VkAttachmentReference> colorReferences;
-		colorReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-		colorReferences.push_back({ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-		colorReferences.push_back({ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+		for (uint32_t i = 0; i < depthIndex; ++i)
+		{
+			colorReferences.push_back({ i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+		}
 
 		VkAttachmentReference depthReference = {};
-		depthReference.attachment = 3;
+		depthReference.attachment = depthIndex;
 		depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 		VkSubpassDescription subpass = {};
@@ -319,16 +464,16 @@ public:
 		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 		dependencies[0].dstSubpass = 0;
 		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 		dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 		dependencies[1].srcSubpass = 0;
 		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 		dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
@@ -341,24 +486,118 @@ public:
 		renderPassInfo.dependencyCount = 2;
 		renderPassInfo.pDependencies = dependencies.data();
 
-		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &offScreenFrameBuf.renderPass));
+		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, renderPass));
+	}
 
-		std::array<VkImageView,4> attachments;
-		attachments[0] = offScreenFrameBuf.position.view;
-		attachments[1] = offScreenFrameBuf.normal.view;
-		attachments[2] = offScreenFrameBuf.albedo.view;
-		attachments[3] = offScreenFrameBuf.depth.view;
+	// Create the attachments and the framebuffer for the current G-Buffer layout
+	void prepareGBuffer()
+	{
+		const std::vector<GBufferAttachmentInfo> infos = getGBufferAttachmentInfos(gbufferLayout);
+		std::vector<FrameBufferAttachment*> targets;
+		if (gbufferLayout == Packed) {
+			targets = { &offScreenFrameBuf.normal, &offScreenFrameBuf.albedo, &offScreenFrameBuf.depth };
+		} else {
+			targets = { &offScreenFrameBuf.position, &offScreenFrameBuf.normal, &offScreenFrameBuf.albedo, &offScreenFrameBuf.depth };
+		}
+
+		std::vector<VkImageView> attachments;
+		for (size_t i = 0; i < infos.size(); i++) {
+			createAttachment(infos[i], targets[i]);
+			attachments.push_back(targets[i]->view);
+		}
 
 		VkFramebufferCreateInfo fbufCreateInfo = {};
 		fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		fbufCreateInfo.pNext = NULL;
-		fbufCreateInfo.renderPass = offScreenFrameBuf.renderPass;
+		fbufCreateInfo.renderPass = (gbufferLayout == Packed) ? offScreenFrameBuf.renderPassPacked : offScreenFrameBuf.renderPass;
 		fbufCreateInfo.pAttachments = attachments.data();
 		fbufCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
 		fbufCreateInfo.width = offScreenFrameBuf.width;
 		fbufCreateInfo.height = offScreenFrameBuf.height;
 		fbufCreateInfo.layers = 1;
 		VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offScreenFrameBuf.frameBuffer));
+	}
+
+	void destroyGBuffer()
+	{
+		destroyAttachment(&offScreenFrameBuf.position);
+		destroyAttachment(&offScreenFrameBuf.normal);
+		destroyAttachment(&offScreenFrameBuf.albedo);
+		destroyAttachment(&offScreenFrameBuf.depth);
+		vkDestroyFramebuffer(device, offScreenFrameBuf.frameBuffer, nullptr);
+		offScreenFrameBuf.frameBuffer = VK_NULL_HANDLE;
+	}
+
+	// Uses the memory requirements reported by the implementation, so alignment and padding are included
+	GBufferFootprint getGBufferFootprint(int32_t layout, uint32_t width, uint32_t height)
+	{
+		GBufferFootprint footprint{};
+		const VkDeviceSize pixelCount = (VkDeviceSize)width * height;
+		for (const GBufferAttachmentInfo& info : getGBufferAttachmentInfos(layout)) {
+			VkImageCreateInfo imageCreateInfo = getGBufferImageCreateInfo(info, width, height);
+			VkImage image;
+			VkMemoryRequirements memReqs;
+			VK_CHECK_RESULT(vkCreateImage(device, &imageCreateInfo, nullptr, &image));
+			vkGetImageMemoryRequirements(device, image, &memReqs);
+			vkDestroyImage(device, image, nullptr);
+
+			VkBool32 lazilyAllocated = VK_FALSE;
+			if (info.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+				vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazilyAllocated);
+			}
+			if (lazilyAllocated) {
+				footprint.lazyMemory += memReqs.size;
+			} else {
+				footprint.memory += memReqs.size;
+			}
+			// Transient attachments are neither stored nor sampled
+			if (info.usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+				footprint.bandwidth += pixelCount * info.texelSize * 2;
+			}
+		}
+		return footprint;
+	}
+
+	void printGBufferReport()
+	{
+		const std::vector<std::pair<uint32_t, uint32_t>> resolutions = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+		std::cout << "G-Buffer memory and traffic per frame (attachment stores + composition reads) in MB\n";
+		std::cout << "Packed normal format: " << ((gbufferFormats.packedNormal == VK_FORMAT_R16G16_UNORM) ? "R16G16_UNORM" : "R16G16_SFLOAT");
+		std::cout << ", packed depth format: " << ((gbufferFormats.packedDepth == VK_FORMAT_D32_SFLOAT) ? "D32_SFLOAT" : "D16_UNORM") << "\n";
+		std::cout << std::setw(12) << "resolution" << std::setw(12) << "full mem" << std::setw(12) << "packed mem" << std::setw(10) << "saved" << std::setw(12) << "full bw" << std::setw(12) << "packed bw" << std::setw(10) << "saved" << "\n";
+		std::cout << std::fixed << std::setprecision(1);
+		VkDeviceSize lazyMemory = 0;
+		for (auto& resolution : resolutions) {
+			const GBufferFootprint full = getGBufferFootprint(Full, resolution.first, resolution.second);
+			const GBufferFootprint packed = getGBufferFootprint(Packed, resolution.first, resolution.second);
+			// Memory of the full layout includes the transient depth attachment if it's not lazily allocated
+			std::cout << std::setw(12) << (std::to_string(resolution.first) + "x" + std::to_string(resolution.second));
+			std::cout << std::setw(12) << (float)full.memory / 1048576.0f << std::setw(12) << (float)packed.memory / 1048576.0f;
+			std::cout << std::setw(9) << (1.0f - (float)packed.memory / (float)full.memory) * 100.0f << "%";
+			std::cout << std::setw(12) << (float)full.bandwidth / 1048576.0f << std::setw(12) << (float)packed.bandwidth / 1048576.0f;
+			std::cout << std::setw(9) << (1.0f - (float)packed.bandwidth / (float)full.bandwidth) * 100.0f << "%" << "\n";
+			lazyMemory = std::max(lazyMemory, full.lazyMemory);
+		}
+		std::cout << "Lazily allocated memory for transient attachments: " << (lazyMemory > 0 ? "yes" : "no") << "\n" << std::flush;
+	}
+
+	// Prepare a new framebuffer and attachments for offscreen rendering (G-Buffer)
+	void prepareOffscreenFramebuffer()
+	{
+		// Note: Instead of using fixed sizes, one could also match the window size and recreate the attachments on resize
+		offScreenFrameBuf.width = 2048;
+		offScreenFrameBuf.height = 2048;
+
+		selectGBufferFormats();
+
+		// Render passes for both layouts are created upfront, as they're required to create the pipelines
+		createGBufferRenderPass(Full, &offScreenFrameBuf.renderPass);
+		createGBufferRenderPass(Packed, &offScreenFrameBuf.renderPassPacked);
+
+		prepareGBuffer();
+
+		gbufferFootprints[Full] = getGBufferFootprint(Full, offScreenFrameBuf.width, offScreenFrameBuf.height);
+		gbufferFootprints[Packed] = getGBufferFootprint(Packed, offScreenFrameBuf.width, offScreenFrameBuf.height);
 
 		// Create sampler to sample from the color attachments
 		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
@@ -384,24 +623,27 @@ public:
 		}
 
 		// Create a semaphore used to synchronize offscreen rendering and usage
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
+		if (offscreenSemaphore == VK_NULL_HANDLE) {
+			VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
+		}
 
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 		// Clear values for all attachments written in the fragment shader
+		const uint32_t colorAttachmentCount = (gbufferLayout == Packed) ? 2 : 3;
 		std::array<VkClearValue,4> clearValues;
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[3].depthStencil = { 1.0f, 0 };
+		for (uint32_t i = 0; i < colorAttachmentCount; i++) {
+			clearValues[i].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		}
+		clearValues[colorAttachmentCount].depthStencil = { 1.0f, 0 };
 
 		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		renderPassBeginInfo.renderPass =  offScreenFrameBuf.renderPass;
+		renderPassBeginInfo.renderPass = (gbufferLayout == Packed) ? offScreenFrameBuf.renderPassPacked : offScreenFrameBuf.renderPass;
 		renderPassBeginInfo.framebuffer = offScreenFrameBuf.frameBuffer;
 		renderPassBeginInfo.renderArea.extent.width = offScreenFrameBuf.width;
 		renderPassBeginInfo.renderArea.extent.height = offScreenFrameBuf.height;
-		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassBeginInfo.clearValueCount = colorAttachmentCount + 1;
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(offScreenCmdBuffer, &cmdBufInfo));
@@ -414,7 +656,7 @@ public:
 		VkRect2D scissor = vks::initializers::rect2D(offScreenFrameBuf.width, offScreenFrameBuf.height, 0, 0);
 		vkCmdSetScissor(offScreenCmdBuffer, 0, 1, &scissor);
 
-		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
+		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, (gbufferLayout == Packed) ? pipelines.offscreenPacked : pipelines.offscreen);
 
 		// Floor
 		vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.floor, 0, nullptr);
@@ -464,6 +706,34 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (timestampsSupported) {
+				vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, 3);
+				vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			}
+
+			// Bin the lights into the view space clusters, one work group per cluster
+			if (lightCulling == Clustered) {
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.clusterCulling);
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets.composition, 0, nullptr);
+				vkCmdDispatch(drawCmdBuffers[i], CLUSTER_COUNT_X, CLUSTER_COUNT_Y, CLUSTER_COUNT_Z);
+
+				// Make the light lists visible to the composition pass
+				std::array<VkBufferMemoryBarrier, 2> bufferBarriers{};
+				bufferBarriers[0] = vks::initializers::bufferMemoryBarrier();
+				bufferBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				bufferBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				bufferBarriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bufferBarriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bufferBarriers[0].buffer = storageBuffers.clusterLightCounts.buffer;
+				bufferBarriers[0].size = VK_WHOLE_SIZE;
+				bufferBarriers[1] = bufferBarriers[0];
+				bufferBarriers[1].buffer = storageBuffers.clusterLightIndices.buffer;
+				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
+			}
+			if (timestampsSupported) {
+				vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+			}
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -474,7 +744,7 @@ public:
 
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.composition, 0, nullptr);
 
-   			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition);
+   			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, (gbufferLayout == Packed) ? pipelines.compositionPacked : pipelines.composition);
 			
 			// Final composition
 			// This is done by simply drawing a full screen quad
@@ -486,16 +756,54 @@ public:
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			if (timestampsSupported) {
+				vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2);
+			}
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
 
+	// Image descriptors for the offscreen attachments, these change with the G-Buffer layout
+	void updateGBufferDescriptors()
+	{
+		// The packed layout reconstructs the position from depth
+		VkDescriptorImageInfo texDescriptorPosition =
+			vks::initializers::descriptorImageInfo(
+				colorSampler,
+				(gbufferLayout == Packed) ? offScreenFrameBuf.depth.view : offScreenFrameBuf.position.view,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		VkDescriptorImageInfo texDescriptorNormal =
+			vks::initializers::descriptorImageInfo(
+				colorSampler,
+				offScreenFrameBuf.normal.view,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		VkDescriptorImageInfo texDescriptorAlbedo =
+			vks::initializers::descriptorImageInfo(
+				colorSampler,
+				offScreenFrameBuf.albedo.view,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			// Binding 1 : Position (or depth) texture target
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptorPosition),
+			// Binding 2 : Normals texture target
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &texDescriptorNormal),
+			// Binding 3 : Albedo texture target
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &texDescriptorAlbedo),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
 	void setupDescriptors()
 	{
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -510,8 +818,14 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
 			// Binding 3 : Albedo texture target
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
-			// Binding 4 : Fragment shader uniform buffer
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+			// Binding 4 : Fragment and cluster culling shader uniform buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			// Binding 5 : Lights
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 5),
+			// Binding 6 : Light count per cluster
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 6),
+			// Binding 7 : Light indices per cluster
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 7),
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
@@ -520,36 +834,18 @@ public:
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 
-		// Image descriptors for the offscreen color attachments
-		VkDescriptorImageInfo texDescriptorPosition =
-			vks::initializers::descriptorImageInfo(
-				colorSampler,
-				offScreenFrameBuf.position.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorNormal =
-			vks::initializers::descriptorImageInfo(
-				colorSampler,
-				offScreenFrameBuf.normal.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorAlbedo =
-			vks::initializers::descriptorImageInfo(
-				colorSampler,
-				offScreenFrameBuf.albedo.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
 		// Deferred composition
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.composition));
+		updateGBufferDescriptors();
 		writeDescriptorSets = {
-			// Binding 1 : Position texture target
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptorPosition),
-			// Binding 2 : Normals texture target
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &texDescriptorNormal),
-			// Binding 3 : Albedo texture target
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &texDescriptorAlbedo),
 			// Binding 4 : Fragment shader uniform buffer
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.composition.descriptor),
+			// Binding 5 : Lights
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &storageBuffers.lights.descriptor),
+			// Binding 6 : Light count per cluster
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &storageBuffers.clusterLightCounts.descriptor),
+			// Binding 7 : Light indices per cluster
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &storageBuffers.clusterLightIndices.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
@@ -616,7 +912,14 @@ public:
 		// Empty vertex input state, vertices are generated by the vertex shader
 		VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
 		pipelineCI.pVertexInputState = &emptyInputState;
+		// The G-Buffer layout is selected with a specialization constant
+		VkBool32 packedGBuffer = VK_FALSE;
+		VkSpecializationMapEntry specializationMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(VkBool32), &packedGBuffer);
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.composition));
+		packedGBuffer = VK_TRUE;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.compositionPacked));
 
 		// Vertex input state from glTF model for pipeline rendering models
 		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Tangent});
@@ -642,6 +945,95 @@ public:
 		colorBlendState.pAttachments = blendAttachmentStates.data();
 
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreen));
+
+		// Offscreen pipeline for the packed layout, writes normals and albedo only
+		shaderStages[1] = loadShader(getShadersPath() + "deferred/mrt_packed.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		pipelineCI.renderPass = offScreenFrameBuf.renderPassPacked;
+		colorBlendState.attachmentCount = 2;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreenPacked));
+
+		// Cluster light culling pipeline
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "deferred/clusterculling.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.clusterCulling));
+	}
+
+	// The first six lights are the hand placed lights of the scene, the others are randomly scattered across the floor
+	void prepareLights()
+	{
+		lights.resize(MAX_LIGHT_COUNT);
+		lightOrigins.resize(MAX_LIGHT_COUNT);
+		lightAnimations.resize(MAX_LIGHT_COUNT);
+
+		// White
+		lights[0].position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+		lights[0].color = glm::vec3(1.5f);
+		lights[0].radius = 15.0f * 0.25f;
+		// Red
+		lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
+		lights[1].color = glm::vec3(1.0f, 0.0f, 0.0f);
+		lights[1].radius = 15.0f;
+		// Blue
+		lights[2].position = glm::vec4(2.0f, -1.0f, 0.0f, 0.0f);
+		lights[2].color = glm::vec3(0.0f, 0.0f, 2.5f);
+		lights[2].radius = 5.0f;
+		// Yellow
+		lights[3].position = glm::vec4(0.0f, -0.9f, 0.5f, 0.0f);
+		lights[3].color = glm::vec3(1.0f, 1.0f, 0.0f);
+		lights[3].radius = 2.0f;
+		// Green
+		lights[4].position = glm::vec4(0.0f, -0.5f, 0.0f, 0.0f);
+		lights[4].color = glm::vec3(0.0f, 1.0f, 0.2f);
+		lights[4].radius = 5.0f;
+		// Yellow
+		lights[5].position = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
+		lights[5].color = glm::vec3(1.0f, 0.7f, 0.3f);
+		lights[5].radius = 25.0f;
+		// Range at which the contribution of the attenuation falls below 1/100 of the light's intensity
+		for (uint32_t i = 0; i < 6; i++) {
+			lights[i].position.w = std::sqrt(lights[i].radius * 100.0f);
+		}
+
+		std::default_random_engine rndEngine(benchmark.active || lightSweep.exitWhenDone ? 0 : (unsigned)time(nullptr));
+		std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+		for (uint32_t i = 6; i < MAX_LIGHT_COUNT; i++) {
+			lights[i].position = glm::vec4(-20.0f + rndDist(rndEngine) * 40.0f, -0.1f - rndDist(rndEngine) * 1.5f, -20.0f + rndDist(rndEngine) * 40.0f, 1.5f + rndDist(rndEngine) * 1.5f);
+			lights[i].color = glm::vec3(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine));
+			lights[i].radius = 0.25f + rndDist(rndEngine) * 0.25f;
+			lightAnimations[i] = glm::vec3(0.25f + rndDist(rndEngine), 0.5f + rndDist(rndEngine), rndDist(rndEngine) * 360.0f);
+		}
+		for (uint32_t i = 0; i < MAX_LIGHT_COUNT; i++) {
+			lightOrigins[i] = lights[i].position;
+		}
+	}
+
+	void updateLights()
+	{
+		const uint32_t lightCount = lightCounts[lightCountIndex];
+		if (!paused) {
+			lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
+			lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
+
+			lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+			lights[1].position.z = 0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+
+			lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
+			lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
+
+			lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
+			lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
+
+			lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
+			lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
+
+			// The random lights orbit around their initial positions
+			for (uint32_t i = 6; i < lightCount; i++) {
+				const float angle = glm::radians(360.0f * timer * lightAnimations[i].y + lightAnimations[i].z);
+				lights[i].position.x = lightOrigins[i].x + sin(angle) * lightAnimations[i].x;
+				lights[i].position.z = lightOrigins[i].z + cos(angle) * lightAnimations[i].x;
+			}
+		}
+		memcpy(storageBuffers.lights.mapped, lights.data(), lightCount * sizeof(Light));
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -657,6 +1049,17 @@ public:
 		VK_CHECK_RESULT(uniformBuffers.offscreen.map());
 		VK_CHECK_RESULT(uniformBuffers.composition.map());
 
+		// Lights are updated by the host every frame
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &storageBuffers.lights, MAX_LIGHT_COUNT * sizeof(Light)));
+		VK_CHECK_RESULT(storageBuffers.lights.map());
+
+		// Cluster light lists are only accessed by the GPU
+		const VkDeviceSize clusterCount = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storageBuffers.clusterLightCounts, clusterCount * sizeof(uint32_t)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storageBuffers.clusterLightIndices, clusterCount * CLUSTER_MAX_LIGHTS * sizeof(uint32_t)));
+
+		prepareLights();
+
 		// Setup instanced model positions
 		uniformDataOffscreen.instancePos[0] = glm::vec4(0.0f);
 		uniformDataOffscreen.instancePos[1] = glm::vec4(-4.0f, 0.0, -4.0f, 0.0f);
@@ -679,55 +1082,140 @@ public:
 	// Update lights and parameters passed to the composition shaders
 	void updateUniformBufferComposition()
 	{
-		// White
-		uniformDataComposition.lights[0].position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
-		uniformDataComposition.lights[0].color = glm::vec3(1.5f);
-		uniformDataComposition.lights[0].radius = 15.0f * 0.25f;
-		// Red
-		uniformDataComposition.lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
-		uniformDataComposition.lights[1].color = glm::vec3(1.0f, 0.0f, 0.0f);
-		uniformDataComposition.lights[1].radius = 15.0f;
-		// Blue
-		uniformDataComposition.lights[2].position = glm::vec4(2.0f, -1.0f, 0.0f, 0.0f);
-		uniformDataComposition.lights[2].color = glm::vec3(0.0f, 0.0f, 2.5f);
-		uniformDataComposition.lights[2].radius = 5.0f;
-		// Yellow
-		uniformDataComposition.lights[3].position = glm::vec4(0.0f, -0.9f, 0.5f, 0.0f);
-		uniformDataComposition.lights[3].color = glm::vec3(1.0f, 1.0f, 0.0f);
-		uniformDataComposition.lights[3].radius = 2.0f;
-		// Green
-		uniformDataComposition.lights[4].position = glm::vec4(0.0f, -0.5f, 0.0f, 0.0f);
-		uniformDataComposition.lights[4].color = glm::vec3(0.0f, 1.0f, 0.2f);
-		uniformDataComposition.lights[4].radius = 5.0f;
-		// Yellow
-		uniformDataComposition.lights[5].position = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
-		uniformDataComposition.lights[5].color = glm::vec3(1.0f, 0.7f, 0.3f);
-		uniformDataComposition.lights[5].radius = 25.0f;
+		updateLights();
 
-		// Animate the lights
-		if (!paused) {
-			uniformDataComposition.lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
-			uniformDataComposition.lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
+		uniformDataComposition.view = camera.matrices.view;
+		uniformDataComposition.invViewProjection = glm::inverse(camera.matrices.perspective * camera.matrices.view);
+		uniformDataComposition.clusterParams = glm::vec4(camera.matrices.perspective[0][0], camera.matrices.perspective[1][1], camera.getNearClip(), camera.getFarClip());
+		uniformDataComposition.lightCount = lightCounts[lightCountIndex];
+		uniformDataComposition.clustered = (lightCulling == Clustered) ? 1 : 0;
 
-			uniformDataComposition.lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
-			uniformDataComposition.lights[1].position.z = 0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+		// Current view position
+		uniformDataComposition.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
 
-			uniformDataComposition.lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
-			uniformDataComposition.lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
+		uniformDataComposition.debugDisplayTarget = debugDisplayTarget;
 
-			uniformDataComposition.lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
-			uniformDataComposition.lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
+		memcpy(uniformBuffers.composition.mapped, &uniformDataComposition, sizeof(UniformDataComposition));
+	}
 
-			uniformDataComposition.lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
-			uniformDataComposition.lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
+	void prepareTimestamps()
+	{
+		timestampsSupported = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0;
+		if (!timestampsSupported) {
+			return;
 		}
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 3;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+	}
 
-		// Current view position
-		uniformDataComposition.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
+	void getTimings()
+	{
+		if (!timestampsSupported) {
+			return;
+		}
+		uint64_t timestamps[3];
+		if (vkGetQueryPoolResults(device, queryPool, 0, 3, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			const float period = vulkanDevice->properties.limits.timestampPeriod;
+			timings.culling = (float)(timestamps[1] - timestamps[0]) * period / 1000000.0f;
+			timings.composition = (float)(timestamps[2] - timestamps[1]) * period / 1000000.0f;
+		}
+	}
 
-		uniformDataComposition.debugDisplayTarget = debugDisplayTarget;
+	void startLightSweep()
+	{
+		if (!timestampsSupported) {
+			std::cout << "Light sweep skipped, the graphics queue does not support timestamps" << std::endl;
+			exitRequested = lightSweep.exitWhenDone;
+			return;
+		}
+		lightSweep.active = true;
+		lightSweep.savedCountIndex = lightCountIndex;
+		lightSweep.savedCulling = lightCulling;
+		lightSweep.countIndex = 0;
+		lightSweep.culling = Clustered;
+		lightSweep.frame = 0;
+		lightSweep.accumulated = 0.0f;
+		lightSweep.clusteredTimes.assign(lightCounts.size(), -1.0f);
+		lightSweep.noCullingTimes.assign(lightCounts.size(), -1.0f);
+		lightCountIndex = 0;
+		lightCulling = Clustered;
+		buildCommandBuffers();
+	}
 
-		memcpy(uniformBuffers.composition.mapped, &uniformDataComposition, sizeof(UniformDataComposition));
+	// Advances the light sweep after a frame has been rendered, every configuration is rendered for a few frames before measuring
+	void updateLightSweep()
+	{
+		lightSweep.frame++;
+		if (lightSweep.frame <= sweepWarmupFrames) {
+			return;
+		}
+		lightSweep.accumulated += timings.culling + timings.composition;
+		if (lightSweep.frame < sweepWarmupFrames + sweepMeasureFrames) {
+			return;
+		}
+		const float average = lightSweep.accumulated / (float)sweepMeasureFrames;
+		if (lightSweep.culling == Clustered) {
+			lightSweep.clusteredTimes[lightSweep.countIndex] = average;
+		} else {
+			lightSweep.noCullingTimes[lightSweep.countIndex] = average;
+		}
+		lightSweep.frame = 0;
+		lightSweep.accumulated = 0.0f;
+		// Measure culled and unculled for each light count, the latter only up to a limit
+		if ((lightSweep.culling == Clustered) && (lightCounts[lightSweep.countIndex] <= sweepMaxUnculledLights)) {
+			lightSweep.culling = None;
+		} else {
+			lightSweep.culling = Clustered;
+			lightSweep.countIndex++;
+		}
+		if (lightSweep.countIndex >= lightCounts.size()) {
+			lightSweep.active = false;
+			printLightSweep();
+			if (lightSweep.exitWhenDone) {
+				// Leave the render loop, the example is then destroyed regularly
+				exitRequested = true;
+				return;
+			}
+			lightCountIndex = lightSweep.savedCountIndex;
+			lightCulling = lightSweep.savedCulling;
+		} else {
+			lightCountIndex = lightSweep.countIndex;
+			lightCulling = lightSweep.culling;
+		}
+		buildCommandBuffers();
+	}
+
+	void printLightSweep()
+	{
+		std::cout << "Light culling and composition GPU time at " << width << "x" << height << "\n";
+		std::cout << std::setw(8) << "lights" << std::setw(16) << "clustered ms" << std::setw(16) << "us per light" << std::setw(16) << "unculled ms" << std::setw(16) << "us per light" << "\n";
+		std::cout << std::fixed << std::setprecision(3);
+		for (size_t i = 0; i < lightCounts.size(); i++) {
+			std::cout << std::setw(8) << lightCounts[i];
+			for (float time : { lightSweep.clusteredTimes[i], lightSweep.noCullingTimes[i] }) {
+				if (time < 0.0f) {
+					std::cout << std::setw(16) << "-" << std::setw(16) << "-";
+				} else {
+					std::cout << std::setw(16) << time << std::setw(16) << time * 1000.0f / (float)lightCounts[i];
+				}
+			}
+			std::cout << "\n";
+		}
+		std::cout << std::flush;
+	}
+
+	// Switching the layout recreates the G-Buffer attachments, so the memory of the other layout is released
+	void changeGBufferLayout()
+	{
+		vkDeviceWaitIdle(device);
+		destroyGBuffer();
+		prepareGBuffer();
+		updateGBufferDescriptors();
+		buildDeferredCommandBuffer();
+		buildCommandBuffers();
 	}
 
 	void prepare()
@@ -738,9 +1226,25 @@ public:
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
+		prepareTimestamps();
 		buildCommandBuffers();
 		buildDeferredCommandBuffer();
+		if (gbufferReport) {
+#if defined(_WIN32)
+			setupConsole(title);
+#endif
+			printGBufferReport();
+			// Skip the render loop, the example is then destroyed regularly
+			exitRequested = true;
+			return;
+		}
 		prepared = true;
+		if (lightSweep.exitWhenDone) {
+#if defined(_WIN32)
+			setupConsole(title);
+#endif
+			startLightSweep();
+		}
 	}
 
 	void draw()
@@ -782,6 +1286,11 @@ public:
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 
 		VulkanExampleBase::submitFrame();
+
+		getTimings();
+		if (lightSweep.active) {
+			updateLightSweep();
+		}
 	}
 
 	virtual void render()
@@ -796,7 +1305,53 @@ public:
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
-			overlay->comboBox("Display", &debugDisplayTarget, { "Final composition", "Position", "Normals", "Albedo", "Specular" });
+			overlay->comboBox("Display", &debugDisplayTarget, { "Final composition", "Position", "Normals", "Albedo", "Specular", "Lights per cluster" });
+			if (overlay->comboBox("G-Buffer", &gbufferLayout, { "Full", "Packed" })) {
+				changeGBufferLayout();
+			}
+			std::vector<std::string> lightCountNames;
+			for (uint32_t count : lightCounts) {
+				lightCountNames.push_back(std::to_string(count));
+			}
+			if (!lightSweep.active) {
+				if (overlay->comboBox("Lights", &lightCountIndex, lightCountNames)) {
+					buildCommandBuffers();
+				}
+				if (overlay->comboBox("Light culling", &lightCulling, { "Clustered", "None" })) {
+					buildCommandBuffers();
+				}
+				if (timestampsSupported && overlay->button("Measure cost per light")) {
+					startLightSweep();
+				}
+			}
+		}
+		if (overlay->header("Statistics")) {
+			// Compare the current G-Buffer against the other layout at the same resolution
+			const GBufferFootprint& current = gbufferFootprints[gbufferLayout];
+			const GBufferFootprint& other = gbufferFootprints[(gbufferLayout == Packed) ? Full : Packed];
+			overlay->text("G-Buffer %dx%d", offScreenFrameBuf.width, offScreenFrameBuf.height);
+			overlay->text("Memory: %.1f MB (other layout %.1f MB)", (float)current.memory / 1048576.0f, (float)other.memory / 1048576.0f);
+			if (current.lazyMemory > 0) {
+				overlay->text("Lazily allocated: %.1f MB", (float)current.lazyMemory / 1048576.0f);
+			}
+			overlay->text("Traffic: %.1f MB/frame (other layout %.1f MB)", (float)current.bandwidth / 1048576.0f, (float)other.bandwidth / 1048576.0f);
+			if (timestampsSupported) {
+				overlay->text("Light culling: %.3f ms", timings.culling);
+				overlay->text("Composition: %.3f ms", timings.composition);
+				overlay->text("Per light: %.3f us", (timings.culling + timings.composition) * 1000.0f / (float)lightCounts[lightCountIndex]);
+			}
+			if (lightSweep.active) {
+				overlay->text("Measuring %d lights...", lightCounts[lightSweep.countIndex]);
+			} else if (!lightSweep.clusteredTimes.empty()) {
+				// Results of the last sweep as total time in ms (clustered / unculled)
+				for (size_t i = 0; i < lightCounts.size(); i++) {
+					if (lightSweep.noCullingTimes[i] < 0.0f) {
+						overlay->text("%5d: %.3f / - ms", lightCounts[i], lightSweep.clusteredTimes[i]);
+					} else {
+						overlay->text("%5d: %.3f / %.3f ms", lightCounts[i], lightSweep.clusteredTimes[i], lightSweep.noCullingTimes[i]);
+					}
+				}
+			}
 		}
 	}
 };
@@ -1,16 +1,18 @@
 /*
 * Vulkan Example - Font rendering using signed distance fields
 * 
-* This sample compares rendering resolution independent fonts using signed distance fields to traditional bitmap fonts
+* This sample compares rendering resolution independent fonts using multi-channel signed distance fields to traditional bitmap fonts
 *
-* Font generated using https://github.com/libgdx/libgdx/wiki/Hiero
+* The distance field atlas is generated at runtime from a TrueType font and grows as new characters are displayed
+* Bitmap font generated using https://github.com/libgdx/libgdx/wiki/Hiero
 *
-* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+* Copyright (C) 2016-2024 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include "vulkanexamplebase.h"
+#include "distancefieldfonts.h"
 
 // Vertex layout for this example
 struct Vertex {
@@ -48,14 +50,34 @@ class VulkanExample : public VulkanExampleBase
 public:
 	bool splitScreen = true;
 
+	// Sample texts, selecting one adds its missing glyphs to the distance field atlas
+	const std::vector<std::string> texts = { u8"Vulkan", u8"Vulkan Ωμέγα", u8"Вулкан", u8"Vulkan ÄÖÜ ß €" };
+	int32_t textIndex{ 0 };
+
+	msdf::FontAtlas fontAtlas;
+
 	struct Textures {
-		vks::Texture2D fontSDF;
+		vks::Texture2D fontSDF{};
 		vks::Texture2D fontBitmap;
 	} textures;
 
-	vks::Buffer vertexBuffer;
-	vks::Buffer indexBuffer;
-	uint32_t indexCount{ 0 };
+	struct TextMesh {
+		vks::Buffer vertexBuffer;
+		vks::Buffer indexBuffer;
+		uint32_t indexCount{ 0 };
+		void destroy()
+		{
+			vertexBuffer.destroy();
+			indexBuffer.destroy();
+			vertexBuffer = vks::Buffer();
+			indexBuffer = vks::Buffer();
+			indexCount = 0;
+		}
+	};
+	struct TextMeshes {
+		TextMesh sdf;
+		TextMesh bitmap;
+	} textMeshes;
 
 	struct UniformData {
 		// Scene matrices
@@ -99,8 +121,8 @@ public:
 			vkDestroyPipeline(device, pipelines.bitmap, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-			vertexBuffer.destroy();
-			indexBuffer.destroy();
+			textMeshes.sdf.destroy();
+			textMeshes.bitmap.destroy();
 			uniformBuffer.destroy();
 		}
 	}
@@ -164,7 +186,9 @@ public:
 
 	void loadAssets()
 	{
-		textures.fontSDF.loadFromFile(getAssetPath() + "textures/font_sdf_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		if (!fontAtlas.loadFont(getAssetPath() + "Roboto-Medium.ttf")) {
+			vks::tools::exitFatal("Could not load font file \"" + getAssetPath() + "Roboto-Medium.ttf\"", -1);
+		}
 		textures.fontBitmap.loadFromFile(getAssetPath() + "textures/font_bitmap_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	}
 
@@ -201,12 +225,12 @@ public:
 
 			VkDeviceSize offsets[1] = { 0 };
 
-			// Signed distance field font
+			// Multi-channel signed distance field font
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sdf, 0, NULL);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.sdf);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &vertexBuffer.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
+			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &textMeshes.sdf.vertexBuffer.buffer, offsets);
+			vkCmdBindIndexBuffer(drawCmdBuffers[i], textMeshes.sdf.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexed(drawCmdBuffers[i], textMeshes.sdf.indexCount, 1, 0, 0, 0);
 
 			// Linear filtered bitmap font
 			if (splitScreen)
@@ -215,7 +239,11 @@ public:
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.bitmap, 0, NULL);
 				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.bitmap);
-				vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
+				if (textMeshes.bitmap.indexCount > 0) {
+					vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &textMeshes.bitmap.vertexBuffer.buffer, offsets);
+					vkCmdBindIndexBuffer(drawCmdBuffers[i], textMeshes.bitmap.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+					vkCmdDrawIndexed(drawCmdBuffers[i], textMeshes.bitmap.indexCount, 1, 0, 0, 0);
+				}
 			}
 
 			drawUI(drawCmdBuffers[i]);
@@ -226,21 +254,141 @@ public:
 		}
 	}
 
-	// Creates a vertex and index buffer with triangle data containing the chars of the given text
-	void generateText(std:: string text)
+	// Upload the parts of the distance field atlas that changed since the last upload
+	void updateFontTexture()
+	{
+		if ((textures.fontSDF.image == VK_NULL_HANDLE) || fontAtlas.resized) {
+			// The atlas has grown, so the texture needs to be recreated with the new size
+			if (textures.fontSDF.image != VK_NULL_HANDLE) {
+				textures.fontSDF.destroy();
+			}
+			textures.fontSDF.fromBuffer(fontAtlas.pixels.data(), fontAtlas.pixels.size(), VK_FORMAT_R8G8B8A8_UNORM, fontAtlas.width, fontAtlas.height, vulkanDevice, queue);
+			if (descriptorSets.sdf != VK_NULL_HANDLE) {
+				VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSets.sdf, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textures.fontSDF.descriptor);
+				vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+			}
+		} else if (!fontAtlas.updatedRegions.empty()) {
+			// Only copy the rectangles of newly added glyphs
+			VkDeviceSize stagingSize = 0;
+			for (auto& region : fontAtlas.updatedRegions) {
+				stagingSize += static_cast<VkDeviceSize>(region.width) * region.height * 4;
+			}
+			vks::Buffer stagingBuffer;
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, stagingSize));
+			VK_CHECK_RESULT(stagingBuffer.map());
+			std::vector<VkBufferImageCopy> copyRegions;
+			VkDeviceSize offset = 0;
+			for (auto& region : fontAtlas.updatedRegions) {
+				const size_t rowSize = static_cast<size_t>(region.width) * 4;
+				for (uint32_t y = 0; y < region.height; y++) {
+					memcpy(static_cast<uint8_t*>(stagingBuffer.mapped) + offset + y * rowSize, &fontAtlas.pixels[(static_cast<size_t>(region.y + y) * fontAtlas.width + region.x) * 4], rowSize);
+				}
+				VkBufferImageCopy copyRegion{};
+				copyRegion.bufferOffset = offset;
+				copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				copyRegion.imageOffset = { static_cast<int32_t>(region.x), static_cast<int32_t>(region.y), 0 };
+				copyRegion.imageExtent = { region.width, region.height, 1 };
+				copyRegions.push_back(copyRegion);
+				offset += rowSize * region.height;
+			}
+			stagingBuffer.unmap();
+
+			VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vks::tools::setImageLayout(copyCmd, textures.fontSDF.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+			vkCmdCopyBufferToImage(copyCmd, stagingBuffer.buffer, textures.fontSDF.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+			vks::tools::setImageLayout(copyCmd, textures.fontSDF.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+			vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+			stagingBuffer.destroy();
+		}
+		fontAtlas.clearUpdates();
+	}
+
+	void createTextMesh(TextMesh& mesh, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		mesh.destroy();
+		mesh.indexCount = static_cast<uint32_t>(indices.size());
+		if (mesh.indexCount == 0) {
+			return;
+		}
+		// Generate host accessible buffers for the text vertices and indices and upload the data
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &mesh.vertexBuffer, vertices.size() * sizeof(Vertex), (void*)vertices.data()));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &mesh.indexBuffer, indices.size() * sizeof(uint32_t), (void*)indices.data()));
+	}
+
+	void addQuad(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, glm::vec4 rect, glm::vec4 uv)
+	{
+		const uint32_t indexOffset = static_cast<uint32_t>(vertices.size());
+		vertices.push_back({ { rect.z, rect.w, 0.0f }, { uv.z, uv.w } });
+		vertices.push_back({ { rect.x, rect.w, 0.0f }, { uv.x, uv.w } });
+		vertices.push_back({ { rect.x, rect.y, 0.0f }, { uv.x, uv.y } });
+		vertices.push_back({ { rect.z, rect.y, 0.0f }, { uv.z, uv.y } });
+		std::array<uint32_t, 6> letterIndices = { 0,1,2, 2,3,0 };
+		for (auto& index : letterIndices)
+		{
+			indices.push_back(indexOffset + index);
+		}
+	}
+
+	// Creates a vertex and index buffer with triangle data containing the chars of the given text using the distance field atlas
+	// Glyphs that are not yet present are generated and added to the atlas
+	void generateText(const std::string& text)
+	{
+		std::vector<uint32_t> codepoints = msdf::FontAtlas::decodeUTF8(text);
+		if (fontAtlas.addGlyphs(codepoints) > 0) {
+			updateFontTexture();
+		}
+
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		const float w = static_cast<float>(fontAtlas.width);
+		const float h = static_cast<float>(fontAtlas.height);
+		float posx = 0.0f;
+		float top = FLT_MAX;
+		float bottom = -FLT_MAX;
+		for (auto codepoint : codepoints)
+		{
+			const msdf::Glyph* glyph = fontAtlas.getGlyph(codepoint);
+			if (!glyph) {
+				continue;
+			}
+			if (glyph->width > 0) {
+				glm::vec4 rect = glyph->bounds + glm::vec4(posx, 0.0f, posx, 0.0f);
+				glm::vec4 uv = glm::vec4(glyph->x / w, glyph->y / h, (glyph->x + glyph->width) / w, (glyph->y + glyph->height) / h);
+				addQuad(vertices, indices, rect, uv);
+				top = std::min(top, rect.y);
+				bottom = std::max(bottom, rect.w);
+			}
+			posx += glyph->advance;
+		}
+
+		// Center
+		for (auto& v : vertices)
+		{
+			v.pos[0] -= posx / 2.0f;
+			v.pos[1] -= (top + bottom) / 2.0f;
+		}
+
+		createTextMesh(textMeshes.sdf, vertices, indices);
+	}
+
+	// Creates a vertex and index buffer with triangle data containing the chars of the given text using the bitmap font
+	// The bitmap font only contains ASCII characters, all other characters are skipped
+	void generateBitmapText(const std::string& text)
 	{
 		std::vector<Vertex> vertices;
 		std::vector<uint32_t> indices;
-		uint32_t indexOffset = 0;
 
-		float w = static_cast<float>(textures.fontSDF.width);
+		float w = static_cast<float>(textures.fontBitmap.width);
 
 		float posx = 0.0f;
-		float posy = 0.0f;
 
-		for (uint32_t i = 0; i < text.size(); i++)
+		for (auto codepoint : msdf::FontAtlas::decodeUTF8(text))
 		{
-			bmchar *charInfo = &fontChars[(int)text[i]];
+			if (codepoint >= fontChars.size()) {
+				continue;
+			}
+			bmchar *charInfo = &fontChars[codepoint];
 
 			if (charInfo->width == 0)
 				charInfo->width = 36;
@@ -258,24 +406,11 @@ public:
 			float xo = charInfo->xoffset / 36.0f;
 			float yo = charInfo->yoffset / 36.0f;
 
-			posy = yo;
-
-			vertices.push_back({ { posx + dimx + xo,  posy + dimy, 0.0f }, { ue, te } });
-			vertices.push_back({ { posx + xo,         posy + dimy, 0.0f }, { us, te } });
-			vertices.push_back({ { posx + xo,         posy,        0.0f }, { us, ts } });
-			vertices.push_back({ { posx + dimx + xo,  posy,        0.0f }, { ue, ts } });
-
-			std::array<uint32_t, 6> letterIndices = { 0,1,2, 2,3,0 };
-			for (auto& index : letterIndices)
-			{
-				indices.push_back(indexOffset + index);
-			}
-			indexOffset += 4;
+			addQuad(vertices, indices, glm::vec4(posx + xo, yo, posx + dimx + xo, yo + dimy), glm::vec4(us, ts, ue, te));
 
 			float advance = ((float)(charInfo->xadvance) / 36.0f);
 			posx += advance;
 		}
-		indexCount = static_cast<uint32_t>(indices.size());
 
 		// Center
 		for (auto& v : vertices)
@@ -284,9 +419,7 @@ public:
 			v.pos[1] -= 0.5f;
 		}
 
-		// Generate host accessible buffers for the text vertices and indices and upload the data
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vertexBuffer, vertices.size() * sizeof(Vertex), vertices.data()));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indexBuffer, indices.size() * sizeof(uint32_t), indices.data()));
+		createTextMesh(textMeshes.bitmap, vertices, indices);
 	}
 
 	void setupDescriptors()
@@ -420,7 +553,8 @@ public:
 		VulkanExampleBase::prepare();
 		parsebmFont();
 		loadAssets();
-		generateText("Vulkan");
+		generateText(texts[textIndex]);
+		generateBitmapText(texts[textIndex]);
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
@@ -456,6 +590,17 @@ public:
 				camera.setPerspective(splitScreen ? 30.0f : 45.0f, (float)width / (float)(height * ((splitScreen) ? 0.5f : 1.0f)), 1.0f, 256.0f);
 				buildCommandBuffers();
 			}
+			if (overlay->comboBox("Text", &textIndex, texts)) {
+				// The buffers and the atlas texture may still be in use by the previous frame
+				vkDeviceWaitIdle(device);
+				generateText(texts[textIndex]);
+				generateBitmapText(texts[textIndex]);
+				buildCommandBuffers();
+			}
+		}
+		if (overlay->header("Font atlas")) {
+			overlay->text("Size: %d x %d", fontAtlas.width, fontAtlas.height);
+			overlay->text("Glyphs: %d", fontAtlas.glyphCount());
 		}
 	}
 };
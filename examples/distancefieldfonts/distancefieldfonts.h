@@ -0,0 +1,770 @@
+/*
+* Vulkan Example - Font rendering using signed distance fields
+*
+* Runtime multi-channel signed distance field (MSDF) font atlas
+*
+* Glyph outlines are read from a TrueType font, converted to multi-channel distance fields on worker threads
+* and packed into an atlas that grows as new codepoints are requested. This allows rendering any glyph contained
+* in the font (including large sets like CJK) without baking an atlas offline.
+*
+* Based on "Shape Decomposition for Multi-channel Distance Fields" by Viktor Chlumsky
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+// Glyph outlines are read with the stb TrueType parser that also ships with ImGui
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "imstb_truetype.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define MSDF_USE_SSE2
+#endif
+
+namespace msdf
+{
+	/*
+		Four lane float vector, used to evaluate the distance to an edge for four neighbouring texels at once
+		Maps to SSE2 where available, other platforms use a scalar fallback
+	*/
+#if defined(MSDF_USE_SSE2)
+	struct float4 {
+		__m128 v;
+		float4() {}
+		float4(__m128 v) : v(v) {}
+		explicit float4(float s) : v(_mm_set1_ps(s)) {}
+		float4(float x, float y, float z, float w) : v(_mm_setr_ps(x, y, z, w)) {}
+		void store(float* dst) const { _mm_storeu_ps(dst, v); }
+	};
+	struct mask4 {
+		__m128 v;
+		mask4(__m128 v) : v(v) {}
+	};
+	inline float4 operator+(float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+	inline float4 operator-(float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+	inline float4 operator*(float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+	inline float4 operator-(float4 a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+	inline float4 min(float4 a, float4 b) { return _mm_min_ps(a.v, b.v); }
+	inline float4 max(float4 a, float4 b) { return _mm_max_ps(a.v, b.v); }
+	inline float4 sqrt(float4 a) { return _mm_sqrt_ps(a.v); }
+	inline float4 abs(float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+	inline float4 rcp(float4 a) { return _mm_div_ps(_mm_set1_ps(1.0f), a.v); }
+	inline mask4 operator<(float4 a, float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+	inline mask4 operator<=(float4 a, float4 b) { return _mm_cmple_ps(a.v, b.v); }
+	inline mask4 operator>(float4 a, float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+	inline mask4 operator&(mask4 a, mask4 b) { return _mm_and_ps(a.v, b.v); }
+	inline mask4 operator|(mask4 a, mask4 b) { return _mm_or_ps(a.v, b.v); }
+	inline mask4 none() { return _mm_setzero_ps(); }
+	inline float4 select(mask4 m, float4 a, float4 b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+#else
+	struct float4 {
+		float v[4];
+		float4() {}
+		explicit float4(float s) : v{ s, s, s, s } {}
+		float4(float x, float y, float z, float w) : v{ x, y, z, w } {}
+		void store(float* dst) const { memcpy(dst, v, sizeof(v)); }
+	};
+	struct mask4 {
+		bool v[4];
+	};
+	template <typename F>
+	inline float4 map(float4 a, float4 b, F f) { float4 r; for (int i = 0; i < 4; i++) { r.v[i] = f(a.v[i], b.v[i]); } return r; }
+	template <typename F>
+	inline mask4 compare(float4 a, float4 b, F f) { mask4 r; for (int i = 0; i < 4; i++) { r.v[i] = f(a.v[i], b.v[i]); } return r; }
+	inline float4 operator+(float4 a, float4 b) { return map(a, b, [](float x, float y) { return x + y; }); }
+	inline float4 operator-(float4 a, float4 b) { return map(a, b, [](float x, float y) { return x - y; }); }
+	inline float4 operator*(float4 a, float4 b) { return map(a, b, [](float x, float y) { return x * y; }); }
+	inline float4 operator-(float4 a) { return map(a, a, [](float x, float) { return -x; }); }
+	inline float4 min(float4 a, float4 b) { return map(a, b, [](float x, float y) { return y < x ? y : x; }); }
+	inline float4 max(float4 a, float4 b) { return map(a, b, [](float x, float y) { return x < y ? y : x; }); }
+	inline float4 sqrt(float4 a) { return map(a, a, [](float x, float) { return std::sqrt(x); }); }
+	inline float4 abs(float4 a) { return map(a, a, [](float x, float) { return std::fabs(x); }); }
+	inline float4 rcp(float4 a) { return map(a, a, [](float x, float) { return 1.0f / x; }); }
+	inline mask4 operator<(float4 a, float4 b) { return compare(a, b, [](float x, float y) { return x < y; }); }
+	inline mask4 operator<=(float4 a, float4 b) { return compare(a, b, [](float x, float y) { return x <= y; }); }
+	inline mask4 operator>(float4 a, float4 b) { return compare(a, b, [](float x, float y) { return x > y; }); }
+	inline mask4 operator&(mask4 a, mask4 b) { mask4 r; for (int i = 0; i < 4; i++) { r.v[i] = a.v[i] && b.v[i]; } return r; }
+	inline mask4 operator|(mask4 a, mask4 b) { mask4 r; for (int i = 0; i < 4; i++) { r.v[i] = a.v[i] || b.v[i]; } return r; }
+	inline mask4 none() { return mask4{ { false, false, false, false } }; }
+	inline float4 select(mask4 m, float4 a, float4 b) { float4 r; for (int i = 0; i < 4; i++) { r.v[i] = m.v[i] ? a.v[i] : b.v[i]; } return r; }
+#endif
+
+	// Edge colors are bit masks of the channels an edge contributes to
+	enum EdgeColor : uint32_t {
+		BLACK = 0, RED = 1, GREEN = 2, YELLOW = 3, BLUE = 4, MAGENTA = 5, CYAN = 6, WHITE = 7
+	};
+
+	// Linear, quadratic or cubic Bezier edge of a glyph contour
+	struct Edge {
+		// Degree of the curve, 1 = line, 2 = quadratic, 3 = cubic
+		uint32_t degree{ 1 };
+		glm::vec2 p[4];
+		uint32_t color{ WHITE };
+
+		glm::vec2 point(float t) const
+		{
+			const float s = 1.0f - t;
+			switch (degree) {
+			case 2:
+				return s * s * p[0] + 2.0f * s * t * p[1] + t * t * p[2];
+			case 3:
+				return s * s * s * p[0] + 3.0f * s * s * t * p[1] + 3.0f * s * t * t * p[2] + t * t * t * p[3];
+			default:
+				return s * p[0] + t * p[1];
+			}
+		}
+
+		// Tangent direction at the start (t = 0) or end (t = 1) of the edge, skipping coincident control points
+		glm::vec2 direction(bool end) const
+		{
+			for (uint32_t i = 1; i <= degree; i++) {
+				glm::vec2 dir = end ? (p[degree] - p[degree - i]) : (p[i] - p[0]);
+				if (glm::dot(dir, dir) > 0.0f) {
+					return glm::normalize(dir);
+				}
+			}
+			return glm::vec2(0.0f);
+		}
+
+		// Split the edge at t using de Casteljau's algorithm
+		void split(float t, Edge& first, Edge& second) const
+		{
+			glm::vec2 q[4] = { p[0], p[1], p[2], p[3] };
+			first = second = *this;
+			first.p[0] = q[0];
+			second.p[degree] = q[degree];
+			for (uint32_t level = 1; level <= degree; level++) {
+				for (uint32_t i = 0; i <= degree - level; i++) {
+					q[i] = glm::mix(q[i], q[i + 1], t);
+				}
+				first.p[level] = q[0];
+				second.p[degree - level] = q[degree - level];
+			}
+		}
+
+		float controlPolygonLength() const
+		{
+			float length = 0.0f;
+			for (uint32_t i = 0; i < degree; i++) {
+				length += glm::length(p[i + 1] - p[i]);
+			}
+			return length;
+		}
+	};
+
+	struct Contour {
+		std::vector<Edge> edges;
+	};
+
+	struct Shape {
+		std::vector<Contour> contours;
+	};
+
+	// Straight line segment of a flattened edge, carries the color of the edge it was generated from
+	struct Segment {
+		glm::vec2 a, b;
+		uint32_t color;
+		// Segments at the end points of an edge extend into pseudo distances along the edge tangent
+		bool extendStart, extendEnd;
+	};
+
+	/*
+		Edge coloring
+	*/
+
+	inline bool isCorner(const glm::vec2& a, const glm::vec2& b, float crossThreshold)
+	{
+		return (glm::dot(a, b) <= 0.0f) || (std::fabs(a.x * b.y - a.y * b.x) > crossThreshold);
+	}
+
+	/**
+	* Assign channel colors to all edges, so that edges meeting at a sharp corner never share more than one channel
+	*
+	* @param shape Shape to color
+	* @param angleThreshold Maximum angle (in radians) between two edges that is still considered smooth
+	*/
+	inline void colorEdges(Shape& shape, float angleThreshold = 3.0f)
+	{
+		const float crossThreshold = std::sin(angleThreshold);
+		const EdgeColor splineColors[3] = { CYAN, MAGENTA, YELLOW };
+		for (auto& contour : shape.contours) {
+			auto& edges = contour.edges;
+			std::vector<size_t> corners;
+			glm::vec2 prevDirection = edges.back().direction(true);
+			for (size_t i = 0; i < edges.size(); i++) {
+				if (isCorner(prevDirection, edges[i].direction(false), crossThreshold)) {
+					corners.push_back(i);
+				}
+				prevDirection = edges[i].direction(true);
+			}
+
+			if (corners.empty()) {
+				// Smooth contour
+				for (auto& edge : edges) {
+					edge.color = WHITE;
+				}
+				continue;
+			}
+
+			if (corners.size() == 1) {
+				// "Teardrop" with a single corner, the contour is split into three parts with different colors
+				const EdgeColor colors[3] = { MAGENTA, WHITE, YELLOW };
+				std::rotate(edges.begin(), edges.begin() + corners[0], edges.end());
+				if (edges.size() >= 3) {
+					const size_t m = edges.size();
+					for (size_t i = 0; i < m; i++) {
+						const int part = int(3.0f + 2.875f * i / (m - 1) - 1.4375f + 0.5f) - 3;
+						edges[i].color = colors[1 + part];
+					}
+				} else {
+					// Not enough edges, split the existing ones into thirds
+					std::vector<Edge> parts;
+					for (auto& edge : edges) {
+						Edge first, rest, second, third;
+						edge.split(1.0f / 3.0f, first, rest);
+						rest.split(0.5f, second, third);
+						parts.push_back(first);
+						parts.push_back(second);
+						parts.push_back(third);
+					}
+					for (size_t i = 0; i < parts.size(); i++) {
+						parts[i].color = colors[(i * 3) / parts.size()];
+					}
+					edges = parts;
+				}
+				continue;
+			}
+
+			// Multiple corners, switch colors at every corner and make sure the last spline differs from the first
+			const size_t cornerCount = corners.size();
+			const size_t start = corners[0];
+			size_t spline = 0;
+			uint32_t color = 0;
+			for (size_t i = 0; i < edges.size(); i++) {
+				const size_t index = (start + i) % edges.size();
+				if ((spline + 1 < cornerCount) && (corners[spline + 1] == index)) {
+					spline++;
+					color = (color + 1) % 3;
+					if ((spline == cornerCount - 1) && (color == 0)) {
+						color = 1;
+					}
+				}
+				edges[index].color = splineColors[color];
+			}
+		}
+	}
+
+	/**
+	* Approximate all curved edges by line segments
+	*
+	* @param shape Shape to flatten
+	* @param tolerance Approximate length (in texels) of the generated segments
+	*/
+	inline std::vector<Segment> flatten(const Shape& shape, float tolerance = 2.0f)
+	{
+		std::vector<Segment> segments;
+		for (auto& contour : shape.contours) {
+			for (auto& edge : contour.edges) {
+				uint32_t count = 1;
+				if (edge.degree > 1) {
+					count = std::min(std::max(static_cast<uint32_t>(std::ceil(edge.controlPolygonLength() / tolerance)), 2u), 32u);
+				}
+				glm::vec2 a = edge.p[0];
+				for (uint32_t i = 1; i <= count; i++) {
+					const glm::vec2 b = (i == count) ? edge.p[edge.degree] : edge.point(static_cast<float>(i) / count);
+					if (glm::dot(b - a, b - a) > 1e-10f) {
+						segments.push_back({ a, b, edge.color, i == 1, i == count });
+						a = b;
+					}
+				}
+			}
+		}
+		return segments;
+	}
+
+	/**
+	* Generate a multi-channel signed distance field from a set of colored line segments
+	*
+	* Each channel stores the pseudo distance to the closest segment of that channel, so the median of the three channels
+	* reconstructs sharp corners. Four texels of a row are evaluated against a segment at once. The sign is taken from
+	* the non-zero winding rule, so the result does not depend on the orientation of the contours.
+	*
+	* @param segments Colored segments of the glyph in texel space
+	* @param width Width of the field in texels
+	* @param height Height of the field in texels
+	* @param range Distance (in texels) covered by the full [0..1] value range
+	* @param dst Destination RGBA8 texels
+	* @param rowPitch Number of bytes between two rows of the destination
+	*/
+	inline void generate(const std::vector<Segment>& segments, uint32_t width, uint32_t height, float range, uint8_t* dst, size_t rowPitch)
+	{
+		// Per segment constants
+		struct SegmentData {
+			float ax, ay, bx, by;
+			float abx, aby, invLengthSq, invLength, dirx, diry;
+			uint32_t color;
+			bool extendStart, extendEnd;
+		};
+		std::vector<SegmentData> data;
+		data.reserve(segments.size());
+		for (auto& segment : segments) {
+			const glm::vec2 ab = segment.b - segment.a;
+			const float length = glm::length(ab);
+			data.push_back({ segment.a.x, segment.a.y, segment.b.x, segment.b.y, ab.x, ab.y, 1.0f / (length * length), 1.0f / length, ab.x / length, ab.y / length, segment.color, segment.extendStart, segment.extendEnd });
+		}
+
+		struct Channel {
+			float4 distance;
+			float4 orthogonality;
+			float4 pseudoDistance;
+		};
+		const float4 zero(0.0f), one(1.0f), epsilon(1e-3f);
+		for (uint32_t y = 0; y < height; y++) {
+			const float py = static_cast<float>(y) + 0.5f;
+			for (uint32_t x = 0; x < width; x += 4) {
+				const float fx = static_cast<float>(x) + 0.5f;
+				const float4 px(fx, fx + 1.0f, fx + 2.0f, fx + 3.0f);
+				Channel channels[3];
+				for (auto& channel : channels) {
+					channel.distance = float4(FLT_MAX);
+					channel.orthogonality = one;
+					channel.pseudoDistance = float4(-FLT_MAX);
+				}
+				float4 winding = zero;
+
+				for (auto& s : data) {
+					const float4 apx = px - float4(s.ax);
+					const float4 apy = float4(py - s.ay);
+					const float4 abx(s.abx), aby(s.aby);
+					const float4 t = (apx * abx + apy * aby) * float4(s.invLengthSq);
+					const float4 tc = min(max(t, zero), one);
+					// Vector from the closest point on the segment to the texel
+					const float4 qx = apx - abx * tc;
+					const float4 qy = apy - aby * tc;
+					const float4 distance = sqrt(qx * qx + qy * qy);
+					const float4 cross = abx * apy - aby * apx;
+					const float4 signedDistance = select(cross < zero, -distance, distance);
+					// Used to break ties between segments sharing an end point, prefer the one that is more perpendicular to the texel
+					const float4 orthogonality = abs(float4(s.dirx) * qx + float4(s.diry) * qy) * rcp(max(distance, float4(1e-6f)));
+					mask4 extend = none();
+					if (s.extendStart) {
+						extend = extend | (t < zero);
+					}
+					if (s.extendEnd) {
+						extend = extend | (t > one);
+					}
+					const float4 pseudoDistance = select(extend, cross * float4(s.invLength), signedDistance);
+
+					for (uint32_t c = 0; c < 3; c++) {
+						if (s.color & (1 << c)) {
+							Channel& channel = channels[c];
+							const mask4 closer = (distance < channel.distance - epsilon) | ((distance <= channel.distance + epsilon) & (orthogonality < channel.orthogonality));
+							channel.distance = select(closer, distance, channel.distance);
+							channel.orthogonality = select(closer, orthogonality, channel.orthogonality);
+							channel.pseudoDistance = select(closer, pseudoDistance, channel.pseudoDistance);
+						}
+					}
+
+					// Non-zero winding number of a ray cast from the texels into positive x direction
+					if ((s.ay <= py) != (s.by <= py)) {
+						const float ix = s.ax + (py - s.ay) * s.abx / s.aby;
+						winding = winding + select(px < float4(ix), float4(s.by > s.ay ? 1.0f : -1.0f), zero);
+					}
+				}
+
+				float r[4], g[4], b[4], w[4];
+				channels[0].pseudoDistance.store(r);
+				channels[1].pseudoDistance.store(g);
+				channels[2].pseudoDistance.store(b);
+				winding.store(w);
+				for (uint32_t i = 0; (i < 4) && (x + i < width); i++) {
+					const float median = std::max(std::min(r[i], g[i]), std::min(std::max(r[i], g[i]), b[i]));
+					// Texels inside the glyph have positive distances
+					const float sign = ((median > 0.0f) == (w[i] != 0.0f)) ? 1.0f : -1.0f;
+					uint8_t* texel = dst + y * rowPitch + (x + i) * 4;
+					texel[0] = static_cast<uint8_t>(std::min(std::max(sign * r[i] / range + 0.5f, 0.0f), 1.0f) * 255.0f + 0.5f);
+					texel[1] = static_cast<uint8_t>(std::min(std::max(sign * g[i] / range + 0.5f, 0.0f), 1.0f) * 255.0f + 0.5f);
+					texel[2] = static_cast<uint8_t>(std::min(std::max(sign * b[i] / range + 0.5f, 0.0f), 1.0f) * 255.0f + 0.5f);
+					texel[3] = 255;
+				}
+			}
+		}
+	}
+
+	/*
+		Skyline rectangle packer
+		The atlas has a fixed width and an unbounded height, the skyline stores the top edge of all packed rectangles
+	*/
+	class SkylinePacker
+	{
+	public:
+		void init(uint32_t width)
+		{
+			this->width = width;
+			nodes = { { 0, 0, width } };
+			usedHeight = 0;
+		}
+
+		/**
+		* Find a place for a rectangle, preferring the position with the lowest top edge (bottom-left heuristic)
+		*
+		* @return False if the rectangle does not fit within the width or the given maximum height
+		*/
+		bool pack(uint32_t w, uint32_t h, uint32_t maxHeight, uint32_t& x, uint32_t& y)
+		{
+			size_t bestIndex = nodes.size();
+			uint32_t bestY = UINT32_MAX;
+			uint32_t bestWidth = UINT32_MAX;
+			for (size_t i = 0; i < nodes.size(); i++) {
+				uint32_t top;
+				if (fit(i, w, top) && ((top < bestY) || ((top == bestY) && (nodes[i].width < bestWidth)))) {
+					bestIndex = i;
+					bestY = top;
+					bestWidth = nodes[i].width;
+				}
+			}
+			if ((bestIndex == nodes.size()) || (bestY + h > maxHeight)) {
+				return false;
+			}
+			x = nodes[bestIndex].x;
+			y = bestY;
+
+			// Insert the new top edge and cut away the parts of the skyline it covers
+			nodes.insert(nodes.begin() + bestIndex, { x, y + h, w });
+			for (size_t i = bestIndex + 1; i < nodes.size();) {
+				const uint32_t prevEnd = nodes[i - 1].x + nodes[i - 1].width;
+				if (nodes[i].x >= prevEnd) {
+					break;
+				}
+				const uint32_t overlap = prevEnd - nodes[i].x;
+				if (nodes[i].width <= overlap) {
+					nodes.erase(nodes.begin() + i);
+					continue;
+				}
+				nodes[i].x += overlap;
+				nodes[i].width -= overlap;
+				break;
+			}
+			// Merge neighbouring nodes at the same height
+			for (size_t i = 0; i + 1 < nodes.size();) {
+				if (nodes[i].y == nodes[i + 1].y) {
+					nodes[i].width += nodes[i + 1].width;
+					nodes.erase(nodes.begin() + i + 1);
+				} else {
+					i++;
+				}
+			}
+			usedHeight = std::max(usedHeight, y + h);
+			return true;
+		}
+
+		/** @brief Height of the area covered by packed rectangles */
+		uint32_t height() const { return usedHeight; }
+	private:
+		struct Node {
+			uint32_t x, y, width;
+		};
+		std::vector<Node> nodes;
+		uint32_t width{ 0 };
+		uint32_t usedHeight{ 0 };
+
+		// Get the top edge a rectangle of the given width would have if placed at the start of the node
+		bool fit(size_t index, uint32_t w, uint32_t& top) const
+		{
+			if (nodes[index].x + w > width) {
+				return false;
+			}
+			top = 0;
+			uint32_t remaining = w;
+			for (size_t i = index; remaining > 0; i++) {
+				top = std::max(top, nodes[i].y);
+				if (nodes[i].width >= remaining) {
+					break;
+				}
+				remaining -= nodes[i].width;
+			}
+			return true;
+		}
+	};
+
+	// Placement and metrics of a glyph in the atlas
+	struct Glyph {
+		// Rectangle in the atlas in texels, zero sized for glyphs without an outline (e.g. space)
+		uint32_t x{ 0 }, y{ 0 }, width{ 0 }, height{ 0 };
+		// Quad relative to the pen position on the baseline in em units (left, top, right, bottom), y points down
+		glm::vec4 bounds{ 0.0f };
+		// Horizontal pen advance in em units
+		float advance{ 0.0f };
+	};
+
+	/*
+		Multi-channel signed distance field font atlas that is filled on demand
+	*/
+	class FontAtlas
+	{
+	public:
+		// Atlas dimensions in texels, the width is fixed and the height grows in powers of two
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		// RGBA8 atlas texels, growing only appends rows so existing glyphs keep their place
+		std::vector<uint8_t> pixels;
+		// Rectangles that changed since the last call to clearUpdates()
+		struct Region {
+			uint32_t x, y, width, height;
+		};
+		std::vector<Region> updatedRegions;
+		// True if the atlas has grown since the last call to clearUpdates(), requiring a full upload
+		bool resized{ false };
+
+		/**
+		* Load a TrueType font and set up an empty atlas
+		*
+		* @param fileName TrueType font file
+		* @param atlasWidth Fixed width of the atlas in texels
+		* @param glyphSize Size of one em in atlas texels
+		* @param distanceRange Distance (in texels) covered by the full value range of the distance field
+		*/
+		bool loadFont(const std::string& fileName, uint32_t atlasWidth = 1024, float glyphSize = 64.0f, float distanceRange = 16.0f)
+		{
+#if defined(__ANDROID__)
+			AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, fileName.c_str(), AASSET_MODE_STREAMING);
+			if (!asset) {
+				return false;
+			}
+			fontData.resize(AAsset_getLength(asset));
+			AAsset_read(asset, fontData.data(), fontData.size());
+			AAsset_close(asset);
+#else
+			std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+			if (!file.is_open()) {
+				return false;
+			}
+			fontData.resize(static_cast<size_t>(file.tellg()));
+			file.seekg(0, std::ios::beg);
+			file.read(reinterpret_cast<char*>(fontData.data()), fontData.size());
+#endif
+			if (!stbtt_InitFont(&fontInfo, fontData.data(), stbtt_GetFontOffsetForIndex(fontData.data(), 0))) {
+				return false;
+			}
+			this->glyphSize = glyphSize;
+			this->distanceRange = distanceRange;
+			scale = stbtt_ScaleForPixelHeight(&fontInfo, glyphSize);
+			width = atlasWidth;
+			height = 0;
+			pixels.clear();
+			glyphs.clear();
+			packer.init(width);
+			updatedRegions.clear();
+			resized = false;
+			return true;
+		}
+
+		/**
+		* Add glyphs for all codepoints not yet present in the atlas
+		*
+		* Glyphs are packed on the calling thread, the distance fields are generated in parallel on worker threads
+		* Codepoints not contained in the font use the font's missing glyph
+		*
+		* @return Number of glyphs that were added
+		*/
+		uint32_t addGlyphs(const std::vector<uint32_t>& codepoints)
+		{
+			struct Job {
+				int glyphIndex;
+				Glyph* glyph;
+				glm::vec2 offset;
+			};
+			std::vector<Job> jobs;
+			uint32_t added = 0;
+			const uint32_t padding = static_cast<uint32_t>(std::ceil(distanceRange * 0.5f)) + 1;
+			for (auto codepoint : codepoints) {
+				if (glyphs.find(codepoint) != glyphs.end()) {
+					continue;
+				}
+				Glyph& glyph = glyphs[codepoint];
+				added++;
+				const int glyphIndex = stbtt_FindGlyphIndex(&fontInfo, static_cast<int>(codepoint));
+				int advance, leftSideBearing;
+				stbtt_GetGlyphHMetrics(&fontInfo, glyphIndex, &advance, &leftSideBearing);
+				glyph.advance = advance * scale / glyphSize;
+				int x0, y0, x1, y1;
+				if (!stbtt_GetGlyphBox(&fontInfo, glyphIndex, &x0, &y0, &x1, &y1) || (x0 >= x1) || (y0 >= y1)) {
+					continue;
+				}
+				// Glyph rectangle in texels with enough padding for the distance range, font units have y pointing up
+				const int left = static_cast<int>(std::floor(x0 * scale)) - static_cast<int>(padding);
+				const int top = static_cast<int>(std::floor(-y1 * scale)) - static_cast<int>(padding);
+				const int right = static_cast<int>(std::ceil(x1 * scale)) + static_cast<int>(padding);
+				const int bottom = static_cast<int>(std::ceil(-y0 * scale)) + static_cast<int>(padding);
+				const uint32_t w = static_cast<uint32_t>(right - left);
+				const uint32_t h = static_cast<uint32_t>(bottom - top);
+				if (!packer.pack(w, h, maxHeight, glyph.x, glyph.y)) {
+					// Atlas is full, the glyph is kept without an outline
+					continue;
+				}
+				glyph.width = w;
+				glyph.height = h;
+				glyph.bounds = glm::vec4(left, top, right, bottom) / glyphSize;
+				jobs.push_back({ glyphIndex, &glyph, glm::vec2(-left, -top) });
+			}
+
+			if (packer.height() > height) {
+				uint32_t newHeight = std::max(height, 64u);
+				while (newHeight < packer.height()) {
+					newHeight *= 2;
+				}
+				pixels.resize(static_cast<size_t>(width) * newHeight * 4, 0);
+				height = newHeight;
+				resized = true;
+			}
+
+			// Glyphs are written to disjoint rectangles of the atlas, so no synchronization is required
+			std::atomic<size_t> nextJob{ 0 };
+			auto worker = [&]() {
+				for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+					const Job& job = jobs[i];
+					Shape shape = loadShape(job.glyphIndex, job.offset);
+					if (shape.contours.empty()) {
+						continue;
+					}
+					colorEdges(shape);
+					generate(flatten(shape), job.glyph->width, job.glyph->height, distanceRange, &pixels[(static_cast<size_t>(job.glyph->y) * width + job.glyph->x) * 4], static_cast<size_t>(width) * 4);
+				}
+			};
+			const uint32_t threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), static_cast<uint32_t>(jobs.size()));
+			std::vector<std::thread> threads;
+			for (uint32_t i = 1; i < threadCount; i++) {
+				threads.push_back(std::thread(worker));
+			}
+			worker();
+			for (auto& thread : threads) {
+				thread.join();
+			}
+
+			for (auto& job : jobs) {
+				updatedRegions.push_back({ job.glyph->x, job.glyph->y, job.glyph->width, job.glyph->height });
+			}
+			return added;
+		}
+
+		/** @brief Get a glyph previously added to the atlas, nullptr if it has not been added */
+		const Glyph* getGlyph(uint32_t codepoint) const
+		{
+			auto it = glyphs.find(codepoint);
+			return (it != glyphs.end()) ? &it->second : nullptr;
+		}
+
+		/** @brief Number of glyphs in the atlas */
+		uint32_t glyphCount() const { return static_cast<uint32_t>(glyphs.size()); }
+
+		/** @brief Mark all changes as uploaded */
+		void clearUpdates()
+		{
+			updatedRegions.clear();
+			resized = false;
+		}
+
+		/** @brief Decode an UTF-8 string into codepoints, invalid sequences are skipped */
+		static std::vector<uint32_t> decodeUTF8(const std::string& text)
+		{
+			std::vector<uint32_t> codepoints;
+			for (size_t i = 0; i < text.size();) {
+				const uint8_t c = static_cast<uint8_t>(text[i]);
+				uint32_t length = (c < 0x80) ? 1 : ((c >> 5) == 0x6) ? 2 : ((c >> 4) == 0xe) ? 3 : ((c >> 3) == 0x1e) ? 4 : 0;
+				if ((length == 0) || (i + length > text.size())) {
+					i++;
+					continue;
+				}
+				uint32_t codepoint = (length == 1) ? c : (c & (0xff >> (length + 1)));
+				for (uint32_t j = 1; j < length; j++) {
+					codepoint = (codepoint << 6) | (static_cast<uint8_t>(text[i + j]) & 0x3f);
+				}
+				codepoints.push_back(codepoint);
+				i += length;
+			}
+			return codepoints;
+		}
+	private:
+		const uint32_t maxHeight{ 8192 };
+		std::vector<unsigned char> fontData;
+		stbtt_fontinfo fontInfo{};
+		float scale{ 1.0f };
+		float glyphSize{ 64.0f };
+		float distanceRange{ 16.0f };
+		SkylinePacker packer;
+		// Node based container, so glyph pointers stay valid while new glyphs are added
+		std::unordered_map<uint32_t, Glyph> glyphs;
+
+		// Read the outline of a glyph and transform it into atlas texel space (y pointing down)
+		Shape loadShape(int glyphIndex, glm::vec2 offset) const
+		{
+			Shape shape;
+			stbtt_vertex* vertices = nullptr;
+			const int count = stbtt_GetGlyphShape(&fontInfo, glyphIndex, &vertices);
+			auto transform = [&](float x, float y) {
+				return glm::vec2(x * scale, -y * scale) + offset;
+			};
+			glm::vec2 start(0.0f), last(0.0f);
+			for (int i = 0; i < count; i++) {
+				const stbtt_vertex& v = vertices[i];
+				const glm::vec2 p = transform(v.x, v.y);
+				Edge edge;
+				edge.p[0] = last;
+				switch (v.type) {
+				case STBTT_vmove:
+					shape.contours.push_back({});
+					start = p;
+					break;
+				case STBTT_vline:
+					edge.degree = 1;
+					edge.p[1] = p;
+					shape.contours.back().edges.push_back(edge);
+					break;
+				case STBTT_vcurve:
+					edge.degree = 2;
+					edge.p[1] = transform(v.cx, v.cy);
+					edge.p[2] = p;
+					shape.contours.back().edges.push_back(edge);
+					break;
+				case STBTT_vcubic:
+					edge.degree = 3;
+					edge.p[1] = transform(v.cx, v.cy);
+					edge.p[2] = transform(v.cx1, v.cy1);
+					edge.p[3] = p;
+					shape.contours.back().edges.push_back(edge);
+					break;
+				}
+				last = p;
+				// Close contours that do not end at their start point
+				const bool contourEnd = (i + 1 == count) || (vertices[i + 1].type == STBTT_vmove);
+				if (contourEnd && !shape.contours.empty() && (last != start)) {
+					Edge closing;
+					closing.p[0] = last;
+					closing.p[1] = start;
+					shape.contours.back().edges.push_back(closing);
+				}
+			}
+			stbtt_FreeShape(&fontInfo, vertices);
+			shape.contours.erase(std::remove_if(shape.contours.begin(), shape.contours.end(), [](const Contour& contour) { return contour.edges.empty(); }), shape.contours.end());
+			return shape;
+		}
+	};
+}
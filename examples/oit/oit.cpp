@@ -1,6 +1,11 @@
 /*
 * Vulkan Example - Order Independent Transparency rendering using linked lists
 *
+* Also implements two modes with bounded memory that can be switched at runtime:
+* - Weighted blended OIT (McGuire and Bavoil) accumulates depth weighted colors in a single pass with two render targets
+* - A k-buffer keeps the k nearest fragments of each pixel sorted and blends the fragments pushed out of it with weighted blending (tail blending)
+* GPU timings and counters for fragments, covered pixels and overflow help choosing a mode for a scene
+*
 * Copyright by Sascha Willems - www.saschawillems.de
 * Copyright by Daemyung Jang  - dm86.jang@gmail.com
 *
@@ -11,6 +16,8 @@
 #include "VulkanglTFModel.h"
 
 #define NODE_COUNT 20
+// Number of nearest fragments per pixel kept sorted by the k-buffer, must match the shaders
+#define KBUFFER_SIZE 8
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -20,15 +27,24 @@ public:
 		vkglTF::Model cube;
 	} models;
 
+	enum Mode { LinkedList = 0, WeightedBlended = 1, KBuffer = 2 };
+	int32_t mode{ LinkedList };
+
 	struct Node {
 		glm::vec4 color;
 		float depth{ 0.0f };
 		uint32_t next{ 0 };
+		// The node array uses std430 layout, where the struct is aligned to 16 bytes
+		uint32_t padding[2]{};
 	};
 
-	struct {
+	struct GeometrySBO {
 		uint32_t count{ 0 };
 		uint32_t maxNodeCount{ 0 };
+		// Fragments that didn't fit into the linked list buffer (dropped) or the k-buffer (tail blended)
+		uint32_t overflow{ 0 };
+		// Pixels with at least one transparent fragment, counted by the resolve pass
+		uint32_t coveredPixels{ 0 };
 	} geometrySBO;
 
 	struct GeometryPass {
@@ -37,8 +53,26 @@ public:
 		vks::Buffer geometry;
 		vks::Texture headIndex;
 		vks::Buffer linkedList;
+		// Keys (depth and object index) of the nearest fragments of each pixel, one array layer per list entry
+		vks::Texture kBuffer;
+		// Accumulation targets for weighted blending, also used for the tail of the k-buffer
+		struct {
+			VkRenderPass renderPass{ VK_NULL_HANDLE };
+			VkFramebuffer framebuffer{ VK_NULL_HANDLE };
+			vks::Texture accum;
+			vks::Texture revealage;
+		} blended;
 	} geometryPass;
 
+	struct SceneObject {
+		vkglTF::Model* model;
+		glm::mat4 matrix;
+		glm::vec4 color;
+	};
+	// The k-buffer only stores an object index with each fragment and looks up the color from this list
+	std::vector<SceneObject> sceneObjects;
+	vks::Buffer objectColors;
+
 	struct RenderPassUniformData {
 		glm::mat4 projection;
 		glm::mat4 view;
@@ -48,6 +82,7 @@ public:
 	struct ObjectData {
 		glm::mat4 model;
 		glm::vec4 color;
+		uint32_t index;
 	};
 
 	struct {
@@ -60,9 +95,10 @@ public:
 		VkPipelineLayout color{ VK_NULL_HANDLE };
 	} pipelineLayouts;
 
+	// Geometry and resolve (color) pipelines for each mode
 	struct {
-		VkPipeline geometry{ VK_NULL_HANDLE };
-		VkPipeline color{ VK_NULL_HANDLE };
+		std::array<VkPipeline, 3> geometry{};
+		std::array<VkPipeline, 3> color{};
 	} pipelines;
 
 	struct {
@@ -72,6 +108,19 @@ public:
 
 	VkDeviceSize objectUniformBufferSize{ 0 };
 
+	struct {
+		// Timestamps at the start, after the geometry pass and after the resolve pass (only if supported by the graphics queue family)
+		VkQueryPool timestamps{ VK_NULL_HANDLE };
+		// Fragment shader invocations of the geometry pass
+		VkQueryPool pipelineStatistics{ VK_NULL_HANDLE };
+		// The counters of the geometry buffer are copied here at the end of each frame
+		vks::Buffer readback;
+		GeometrySBO counters;
+		uint64_t fragments{ 0 };
+		float geometryTime{ 0.0f };
+		float resolveTime{ 0.0f };
+	} stats;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Order independent transparency rendering";
@@ -79,19 +128,32 @@ public:
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -6.0f));
 		camera.setRotation(glm::vec3(0.0f, 0.0f, 0.0f));
 		camera.setPerspective(60.0f, (float) width / (float) height, 0.1f, 256.0f);
+		commandLineParser.add("oitmode", { "-om", "--oitmode" }, 1, "Transparency mode (0 = linked list, 1 = weighted blended, 2 = k-buffer)");
+		commandLineParser.parse(args);
+		mode = std::min(std::max(commandLineParser.getValueAsInt("oitmode", LinkedList), 0), 2);
 	}
 
 	~VulkanExample()
 	{
 		if (device) {
-			vkDestroyPipeline(device, pipelines.geometry, nullptr);
-			vkDestroyPipeline(device, pipelines.color, nullptr);
+			for (uint32_t i = 0; i < 3; i++) {
+				vkDestroyPipeline(device, pipelines.geometry[i], nullptr);
+				vkDestroyPipeline(device, pipelines.color[i], nullptr);
+			}
 			vkDestroyPipelineLayout(device, pipelineLayouts.geometry, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayouts.color, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.geometry, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.color, nullptr);
 			destroyGeometryPass();
+			vkDestroyRenderPass(device, geometryPass.renderPass, nullptr);
+			vkDestroyRenderPass(device, geometryPass.blended.renderPass, nullptr);
 			renderPassUniformBuffer.destroy();
+			objectColors.destroy();
+			stats.readback.destroy();
+			vkDestroyQueryPool(device, stats.timestamps, nullptr);
+			if (stats.pipelineStatistics != VK_NULL_HANDLE) {
+				vkDestroyQueryPool(device, stats.pipelineStatistics, nullptr);
+			}
 		}
 	}
 
@@ -103,6 +165,10 @@ public:
 		} else {
 			vks::tools::exitFatal("Selected GPU does not support stores and atomic operations in the fragment stage", VK_ERROR_FEATURE_NOT_PRESENT);
 		}
+		// Used to count the fragments of the geometry pass
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
+		}
 	};
 
 	void loadAssets()
@@ -110,6 +176,66 @@ public:
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::FlipY;
 		models.sphere.loadFromFile(getAssetPath() + "models/sphere.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		models.cube.loadFromFile(getAssetPath() + "models/cube.gltf", vulkanDevice, queue, glTFLoadingFlags);
+
+		// A grid of red spheres and two blue cubes
+		for (int32_t x = 0; x < 5; x++) {
+			for (int32_t y = 0; y < 5; y++) {
+				for (int32_t z = 0; z < 5; z++) {
+					glm::mat4 T = glm::translate(glm::mat4(1.0f), glm::vec3(x - 2, y - 2, z - 2));
+					glm::mat4 S = glm::scale(glm::mat4(1.0f), glm::vec3(0.3f));
+					sceneObjects.push_back({ &models.sphere, T * S, glm::vec4(1.0f, 0.0f, 0.0f, 0.5f) });
+				}
+			}
+		}
+		for (uint32_t x = 0; x < 2; x++) {
+			glm::mat4 T = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f * x - 1.5f, 0.0f, 0.0f));
+			glm::mat4 S = glm::scale(glm::mat4(1.0f), glm::vec3(0.2f));
+			sceneObjects.push_back({ &models.cube, T * S, glm::vec4(0.0f, 0.0f, 1.0f, 0.5f) });
+		}
+		// The k-buffer keys have 8 bits for the object index
+		assert(sceneObjects.size() <= 256);
+		std::vector<glm::vec4> colors;
+		for (auto& object : sceneObjects) {
+			colors.push_back(object.color);
+		}
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &objectColors, colors.size() * sizeof(glm::vec4), colors.data()));
+	}
+
+	void prepareStatistics()
+	{
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stats.readback, sizeof(GeometrySBO)));
+		VK_CHECK_RESULT(stats.readback.map());
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		if (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0) {
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 3;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &stats.timestamps));
+		}
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+			queryPoolInfo.queryCount = 1;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &stats.pipelineStatistics));
+		}
+	}
+
+	// Read the counters and timings of the last frame, the base class waits for the queue to become idle after each frame
+	void getStatistics()
+	{
+		memcpy(&stats.counters, stats.readback.mapped, sizeof(GeometrySBO));
+		uint64_t timestamps[3];
+		if ((stats.timestamps != VK_NULL_HANDLE) && vkGetQueryPoolResults(device, stats.timestamps, 0, 3, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			const float timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+			stats.geometryTime = (float)(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0f;
+			stats.resolveTime = (float)(timestamps[2] - timestamps[1]) * timestampPeriod / 1000000.0f;
+		}
+		if (stats.pipelineStatistics != VK_NULL_HANDLE) {
+			vkGetQueryPoolResults(device, stats.pipelineStatistics, 0, 1, sizeof(uint64_t), &stats.fragments, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		} else {
+			// Only the linked list counts all fragments
+			stats.fragments = (mode == LinkedList) ? stats.counters.count : 0;
+		}
 	}
 
 	void prepareUniformBuffers()
@@ -119,7 +245,7 @@ public:
 		VK_CHECK_RESULT(renderPassUniformBuffer.map());
 	}
 
-	void prepareGeometryPass()
+	void prepareGeometryRenderPasses()
 	{
 		VkSubpassDescription subpassDescription = {};
 		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -132,6 +258,84 @@ public:
 
 		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &geometryPass.renderPass));
 
+		// Weighted blending accumulates premultiplied colors into the first attachment and the product of (1 - alpha) (the revealage) into the second
+		std::array<VkAttachmentDescription, 2> attachments{};
+		attachments[0].format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		attachments[1].format = VK_FORMAT_R16_SFLOAT;
+		for (auto& attachment : attachments) {
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+		std::array<VkAttachmentReference, 2> colorReferences = { { { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }, { 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL } } };
+		subpassDescription.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+		subpassDescription.pColorAttachments = colorReferences.data();
+
+		// The resolve pass of the previous frame reads the attachments, the resolve pass of this frame reads the results
+		std::array<VkSubpassDependency, 2> dependencies{};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
+		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &geometryPass.blended.renderPass));
+	}
+
+	// Creates an image with view that is only accessed on the device
+	void createImage(vks::Texture& texture, VkFormat format, VkImageUsageFlags usage, uint32_t layerCount)
+	{
+		texture.device = vulkanDevice;
+		VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = format;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = layerCount;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = usage;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageInfo, nullptr, &texture.image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, texture.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &texture.deviceMemory));
+		VK_CHECK_RESULT(vkBindImageMemory(device, texture.image, texture.deviceMemory, 0));
+
+		VkImageViewCreateInfo imageViewInfo = vks::initializers::imageViewCreateInfo();
+		imageViewInfo.viewType = (layerCount > 1) ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		imageViewInfo.format = format;
+		imageViewInfo.image = texture.image;
+		imageViewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, layerCount };
+		VK_CHECK_RESULT(vkCreateImageView(device, &imageViewInfo, nullptr, &texture.view));
+
+		texture.width = width;
+		texture.height = height;
+		texture.mipLevels = 1;
+		texture.layerCount = layerCount;
+		texture.descriptor.imageView = texture.view;
+	}
+
+	void prepareGeometryPass()
+	{
 		// Geometry frame buffer doesn't need any output attachment.
 		VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
 		fbufCreateInfo.renderPass = geometryPass.renderPass;
@@ -153,13 +357,13 @@ public:
 		VK_CHECK_RESULT(stagingBuffer.map());
 
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&geometryPass.geometry,
 			sizeof(geometrySBO)));
 
 		// Set up GeometrySBO data.
-		geometrySBO.count = 0;
+		geometrySBO = {};
 		geometrySBO.maxNodeCount = NODE_COUNT * width * height;
 		memcpy(stagingBuffer.mapped, &geometrySBO, sizeof(geometrySBO));
 
@@ -235,6 +439,34 @@ public:
 			&geometryPass.linkedList,
 			sizeof(Node) * geometrySBO.maxNodeCount));
 
+		// K-buffer with one layer per entry, cleared to empty (all bits set) each frame
+		createImage(geometryPass.kBuffer, VK_FORMAT_R32_UINT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT, KBUFFER_SIZE);
+		geometryPass.kBuffer.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		geometryPass.kBuffer.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		geometryPass.kBuffer.sampler = VK_NULL_HANDLE;
+
+		// Weighted blending targets, read with texel fetches in the resolve pass
+		createImage(geometryPass.blended.accum, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 1);
+		createImage(geometryPass.blended.revealage, VK_FORMAT_R16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 1);
+		VkSamplerCreateInfo samplerInfo = vks::initializers::samplerCreateInfo();
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = 1.0f;
+		for (vks::Texture* texture : { &geometryPass.blended.accum, &geometryPass.blended.revealage }) {
+			VK_CHECK_RESULT(vkCreateSampler(device, &samplerInfo, nullptr, &texture->sampler));
+			texture->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			texture->descriptor.sampler = texture->sampler;
+			texture->descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+		std::array<VkImageView, 2> blendAttachments = { geometryPass.blended.accum.view, geometryPass.blended.revealage.view };
+		fbufCreateInfo.renderPass = geometryPass.blended.renderPass;
+		fbufCreateInfo.attachmentCount = static_cast<uint32_t>(blendAttachments.size());
+		fbufCreateInfo.pAttachments = blendAttachments.data();
+		VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &geometryPass.blended.framebuffer));
+
 		// Change HeadIndex image's layout from UNDEFINED to GENERAL
 		VkCommandBufferAllocateInfo cmdBufAllocInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
 
@@ -255,6 +487,21 @@ public:
 
 		vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
+		// Same for the k-buffer
+		barrier.image = geometryPass.kBuffer.image;
+		barrier.subresourceRange.layerCount = KBUFFER_SIZE;
+		vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		// The resolve pass samples the weighted blending targets even if they haven't been rendered to yet
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.subresourceRange.layerCount = 1;
+		for (VkImage image : { geometryPass.blended.accum.image, geometryPass.blended.revealage.image }) {
+			barrier.image = image;
+			vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
 		VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuf));
 
 		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
@@ -263,6 +510,7 @@ public:
 
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+		vkFreeCommandBuffers(device, cmdPool, 1, &cmdBuf);
 	}
 
 	void setupDescriptors()
@@ -271,8 +519,9 @@ public:
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2),
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -289,6 +538,10 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
 			// LinkedListSBO
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+			// kBufferImage
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+			// ObjectColorsSBO
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &descriptorSetLayouts.geometry));
@@ -299,6 +552,16 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
 			// LinkedListSBO
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+			// Weighted blending accumulation
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+			// Weighted blending revealage
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+			// kBufferImage
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+			// GeometrySBO (statistics)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),
+			// ObjectColorsSBO
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 6),
 		};
 		descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &descriptorSetLayouts.color));
@@ -323,7 +586,11 @@ public:
 			// Binding 3: headIndexImage
 			vks::initializers::writeDescriptorSet(descriptorSets.geometry, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, &geometryPass.headIndex.descriptor),
 			// Binding 4: LinkedListSBO
-			vks::initializers::writeDescriptorSet(descriptorSets.geometry, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &geometryPass.linkedList.descriptor)
+			vks::initializers::writeDescriptorSet(descriptorSets.geometry, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &geometryPass.linkedList.descriptor),
+			// Binding 4: kBufferImage
+			vks::initializers::writeDescriptorSet(descriptorSets.geometry, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4, &geometryPass.kBuffer.descriptor),
+			// Binding 5: ObjectColorsSBO
+			vks::initializers::writeDescriptorSet(descriptorSets.geometry, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &objectColors.descriptor)
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
@@ -335,7 +602,17 @@ public:
 			// Binding 0: headIndexImage
 			vks::initializers::writeDescriptorSet(descriptorSets.color, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, &geometryPass.headIndex.descriptor),
 			// Binding 1: LinkedListSBO
-			vks::initializers::writeDescriptorSet(descriptorSets.color, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &geometryPass.linkedList.descriptor)
+			vks::initializers::writeDescriptorSet(descriptorSets.color, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &geometryPass.linkedList.descriptor),
+			// Binding 2: Weighted blending accumulation
+			vks::initializers::writeDescriptorSet(descriptorSets.color, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &geometryPass.blended.accum.descriptor),
+			// Binding 3: Weighted blending revealage
+			vks::initializers::writeDescriptorSet(descriptorSets.color, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &geometryPass.blended.revealage.descriptor),
+			// Binding 4: kBufferImage
+			vks::initializers::writeDescriptorSet(descriptorSets.color, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4, &geometryPass.kBuffer.descriptor),
+			// Binding 5: GeometrySBO
+			vks::initializers::writeDescriptorSet(descriptorSets.color, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &geometryPass.geometry.descriptor),
+			// Binding 6: ObjectColorsSBO
+			vks::initializers::writeDescriptorSet(descriptorSets.color, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &objectColors.descriptor)
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
@@ -379,11 +656,39 @@ public:
 		pipelineCI.pStages = shaderStages.data();
 		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position });
 
-		// Create a geometry pipeline
+		// Create the geometry pipelines
 		shaderStages[0] = loadShader(getShadersPath() + "oit/geometry.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "oit/geometry.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.geometry));
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.geometry[LinkedList]));
+
+		// Weighted blending adds up the weighted colors and multiplies the revealage by (1 - alpha)
+		std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachmentStates{};
+		blendAttachmentStates[0].colorWriteMask = 0xf;
+		blendAttachmentStates[0].blendEnable = VK_TRUE;
+		blendAttachmentStates[0].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentStates[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentStates[0].colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachmentStates[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentStates[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentStates[0].alphaBlendOp = VK_BLEND_OP_ADD;
+		blendAttachmentStates[1].colorWriteMask = VK_COLOR_COMPONENT_R_BIT;
+		blendAttachmentStates[1].blendEnable = VK_TRUE;
+		blendAttachmentStates[1].srcColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+		blendAttachmentStates[1].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+		blendAttachmentStates[1].colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachmentStates[1].srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		blendAttachmentStates[1].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentStates[1].alphaBlendOp = VK_BLEND_OP_ADD;
+		colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(static_cast<uint32_t>(blendAttachmentStates.size()), blendAttachmentStates.data());
+		pipelineCI.renderPass = geometryPass.blended.renderPass;
+
+		shaderStages[1] = loadShader(getShadersPath() + "oit/geometry_wboit.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.geometry[WeightedBlended]));
+
+		// The k-buffer blends the fragments that don't fit into it the same way
+		shaderStages[1] = loadShader(getShadersPath() + "oit/geometry_kbuffer.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.geometry[KBuffer]));
 
 		// Create a color pipeline
 		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
@@ -409,7 +714,13 @@ public:
 		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
 		rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.color));
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.color[LinkedList]));
+
+		shaderStages[1] = loadShader(getShadersPath() + "oit/color_wboit.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.color[WeightedBlended]));
+
+		shaderStages[1] = loadShader(getShadersPath() + "oit/color_kbuffer.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.color[KBuffer]));
 	}
 
 	void buildCommandBuffers() override
@@ -442,6 +753,13 @@ public:
 			// Update dynamic scissor state
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
+			if (stats.timestamps != VK_NULL_HANDLE) {
+				vkCmdResetQueryPool(drawCmdBuffers[i], stats.timestamps, 0, 3);
+			}
+			if (stats.pipelineStatistics != VK_NULL_HANDLE) {
+				vkCmdResetQueryPool(drawCmdBuffers[i], stats.pipelineStatistics, 0, 1);
+			}
+
 			VkClearColorValue clearColor;
 			clearColor.uint32[0] = 0xffffffff;
 
@@ -451,10 +769,17 @@ public:
 			subresRange.levelCount = 1;
 			subresRange.layerCount = 1;
 
-			vkCmdClearColorImage(drawCmdBuffers[i], geometryPass.headIndex.image, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &subresRange);
+			if (mode == LinkedList) {
+				vkCmdClearColorImage(drawCmdBuffers[i], geometryPass.headIndex.image, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &subresRange);
+			}
+			if (mode == KBuffer) {
+				subresRange.layerCount = KBUFFER_SIZE;
+				vkCmdClearColorImage(drawCmdBuffers[i], geometryPass.kBuffer.image, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &subresRange);
+			}
 
-			// Clear previous geometry pass data
-			vkCmdFillBuffer(drawCmdBuffers[i], geometryPass.geometry.buffer, 0, sizeof(uint32_t), 0);
+			// Clear previous geometry pass data (node count and statistics, but not the max. node count)
+			vkCmdFillBuffer(drawCmdBuffers[i], geometryPass.geometry.buffer, offsetof(GeometrySBO, count), sizeof(uint32_t), 0);
+			vkCmdFillBuffer(drawCmdBuffers[i], geometryPass.geometry.buffer, offsetof(GeometrySBO, overflow), 2 * sizeof(uint32_t), 0);
 
 			// We need a barrier to make sure all writes are finished before starting to write again
 			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
@@ -462,50 +787,56 @@ public:
 			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 			vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 
+			if (stats.timestamps != VK_NULL_HANDLE) {
+				vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, stats.timestamps, 0);
+			}
+			if (stats.pipelineStatistics != VK_NULL_HANDLE) {
+				vkCmdBeginQuery(drawCmdBuffers[i], stats.pipelineStatistics, 0, 0);
+			}
+
 			// Begin the geometry render pass
-			renderPassBeginInfo.renderPass = geometryPass.renderPass;
-			renderPassBeginInfo.framebuffer = geometryPass.framebuffer;
-			renderPassBeginInfo.clearValueCount = 0;
-			renderPassBeginInfo.pClearValues = nullptr;
+			// Weighted blending and the k-buffer tail accumulate into render targets cleared to zero color and full revealage
+			VkClearValue blendClearValues[2];
+			blendClearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+			blendClearValues[1].color = { { 1.0f, 0.0f, 0.0f, 0.0f } };
+			if (mode == LinkedList) {
+				renderPassBeginInfo.renderPass = geometryPass.renderPass;
+				renderPassBeginInfo.framebuffer = geometryPass.framebuffer;
+				renderPassBeginInfo.clearValueCount = 0;
+				renderPassBeginInfo.pClearValues = nullptr;
+			} else {
+				renderPassBeginInfo.renderPass = geometryPass.blended.renderPass;
+				renderPassBeginInfo.framebuffer = geometryPass.blended.framebuffer;
+				renderPassBeginInfo.clearValueCount = 2;
+				renderPassBeginInfo.pClearValues = blendClearValues;
+			}
 
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.geometry);
-			uint32_t dynamicOffset = 0;
-			models.sphere.bindBuffers(drawCmdBuffers[i]);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.geometry[mode]);
 
 			// Render the scene
-			ObjectData objectData;
-
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.geometry, 0, 1, &descriptorSets.geometry, 0, nullptr);
-			objectData.color = glm::vec4(1.0f, 0.0f, 0.0f, 0.5f);
-			for (int32_t x = 0; x < 5; x++)
-			{
-				for (int32_t y = 0; y < 5; y++)
-				{
-					for (int32_t z = 0; z < 5; z++)
-					{
-						glm::mat4 T = glm::translate(glm::mat4(1.0f), glm::vec3(x - 2, y - 2, z - 2));
-						glm::mat4 S = glm::scale(glm::mat4(1.0f), glm::vec3(0.3f));
-						objectData.model = T * S;
-						vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.geometry, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ObjectData), &objectData);
-						models.sphere.draw(drawCmdBuffers[i]);
-					}
+			vkglTF::Model* boundModel = nullptr;
+			for (uint32_t j = 0; j < static_cast<uint32_t>(sceneObjects.size()); j++) {
+				const SceneObject& object = sceneObjects[j];
+				if (object.model != boundModel) {
+					object.model->bindBuffers(drawCmdBuffers[i]);
+					boundModel = object.model;
 				}
-			}
-
-			models.cube.bindBuffers(drawCmdBuffers[i]);
-			objectData.color = glm::vec4(0.0f, 0.0f, 1.0f, 0.5f);
-			for (uint32_t x = 0; x < 2; x++)
-			{
-				glm::mat4 T = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f * x - 1.5f, 0.0f, 0.0f));
-				glm::mat4 S = glm::scale(glm::mat4(1.0f), glm::vec3(0.2f));
-				objectData.model = T * S;
+				ObjectData objectData{ object.matrix, object.color, j };
 				vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.geometry, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ObjectData), &objectData);
-				models.cube.draw(drawCmdBuffers[i]);
+				object.model->draw(drawCmdBuffers[i]);
 			}
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			if (stats.pipelineStatistics != VK_NULL_HANDLE) {
+				vkCmdEndQuery(drawCmdBuffers[i], stats.pipelineStatistics, 0);
+			}
+			if (stats.timestamps != VK_NULL_HANDLE) {
+				vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, stats.timestamps, 1);
+			}
+
 			// Make a pipeline barrier to guarantee the geometry pass is done
 			vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
 
@@ -522,12 +853,22 @@ public:
 			renderPassBeginInfo.pClearValues = clearValues;
 
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.color);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.color[mode]);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.color, 0, 1, &descriptorSets.color, 0, nullptr);
 			vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+			if (stats.timestamps != VK_NULL_HANDLE) {
+				vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, stats.timestamps, 2);
+			}
 			drawUI(drawCmdBuffers[i]);
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			// Copy the counters to the host
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			VkBufferCopy copyRegion{ 0, 0, sizeof(GeometrySBO) };
+			vkCmdCopyBuffer(drawCmdBuffers[i], geometryPass.geometry.buffer, stats.readback.buffer, 1, &copyRegion);
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
@@ -544,6 +885,8 @@ public:
 		VulkanExampleBase::prepare();
 		loadAssets();
 		prepareUniformBuffers();
+		prepareStatistics();
+		prepareGeometryRenderPasses();
 		prepareGeometryPass();
 		setupDescriptors();
 		preparePipelines();
@@ -567,6 +910,40 @@ public:
 			return;
 		updateUniformBuffers();
 		draw();
+		getStatistics();
+	}
+
+	void OnUpdateUIOverlay(vks::UIOverlay* overlay) override
+	{
+		if (overlay->header("Settings")) {
+			// Changing the mode rebuilds the command buffers
+			overlay->comboBox("Mode", &mode, { "Linked list", "Weighted blended", "K-buffer + tail blending" });
+		}
+		if (overlay->header("Statistics")) {
+			const uint32_t pixelCount = width * height;
+			if (stats.timestamps != VK_NULL_HANDLE) {
+				overlay->text("Geometry pass: %.3f ms", stats.geometryTime);
+				overlay->text("Resolve pass: %.3f ms", stats.resolveTime);
+			}
+			if (stats.fragments > 0) {
+				overlay->text("Fragments: %d", (int32_t)stats.fragments);
+				overlay->text("Avg. fragments per covered pixel: %.2f", stats.counters.coveredPixels > 0 ? (float)stats.fragments / (float)stats.counters.coveredPixels : 0.0f);
+			}
+			overlay->text("Covered pixels: %.1f%%", 100.0f * (float)stats.counters.coveredPixels / (float)pixelCount);
+			switch (mode) {
+			case LinkedList:
+				overlay->text("Dropped fragments: %d", (int32_t)stats.counters.overflow);
+				overlay->text("Memory: %.1f MB", (float)(geometryPass.linkedList.size + pixelCount * sizeof(uint32_t)) / (1024.0f * 1024.0f));
+				break;
+			case WeightedBlended:
+				overlay->text("Memory: %.1f MB", (float)(pixelCount * (8 + 2)) / (1024.0f * 1024.0f));
+				break;
+			case KBuffer:
+				overlay->text("Tail blended fragments: %d", (int32_t)stats.counters.overflow);
+				overlay->text("Memory: %.1f MB", (float)(pixelCount * (KBUFFER_SIZE * sizeof(uint32_t) + 8 + 2)) / (1024.0f * 1024.0f));
+				break;
+			}
+		}
 	}
 
 	void windowResized() override
@@ -579,13 +956,17 @@ public:
 		buildCommandBuffers();
 	}
 
+	// Destroys the size dependent resources, the render passes are kept
 	void destroyGeometryPass()
 	{
-		vkDestroyRenderPass(device, geometryPass.renderPass, nullptr);
 		vkDestroyFramebuffer(device, geometryPass.framebuffer, nullptr);
+		vkDestroyFramebuffer(device, geometryPass.blended.framebuffer, nullptr);
 		geometryPass.geometry.destroy();
 		geometryPass.headIndex.destroy();
 		geometryPass.linkedList.destroy();
+		geometryPass.kBuffer.destroy();
+		geometryPass.blended.accum.destroy();
+		geometryPass.blended.revealage.destroy();
 	}
 };
 
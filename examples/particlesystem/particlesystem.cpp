@@ -2,35 +2,20 @@
 * Vulkan Example - CPU based particle system
 * 
 * This sample renders a particle system that is updated on the host (by the CPU) and rendered by the GPU using a vertex buffer
+* The particles are stored as structure of arrays and updated with SIMD on multiple threads (see particlesystem.h), the
+* results are written straight to a persistently mapped vertex buffer with a separate slot for each frame in flight
 *
-* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+* Copyright (C) 2016-2024 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "particlesystem.h"
 
 #define PARTICLE_COUNT 512
 
-#define FLAME_RADIUS 8.0f
-
-// The particle system is made from two different particle types
-// That type defines how a particle is rendered
-#define PARTICLE_TYPE_FLAME 0
-#define PARTICLE_TYPE_SMOKE 1
-
-struct Particle {
-	glm::vec4 pos;
-	glm::vec4 color;
-	float alpha;
-	float size;
-	float rotation;
-	uint32_t type;
-	glm::vec4 vel;
-	float rotationSpeed;
-};
-
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -61,8 +46,19 @@ public:
 		void *mappedMemory;
 		// Size of the particle buffer in bytes
 		size_t size{ 0 };
+		// The buffer is split into one slot per swap chain image, the CPU writes the slot of the acquired image while the GPU may still read the others
+		size_t slotSize{ 0 };
+		uint32_t slotCount{ 0 };
 	} particles;
 
+	particlesystem::ParticleSystem particleSystem;
+	vks::ThreadPool threadPool;
+	uint32_t particleCount{ PARTICLE_COUNT };
+	int32_t particleCountIndex{ 0 };
+	const std::vector<uint32_t> particleCounts = { PARTICLE_COUNT, 16 * 1024, 256 * 1024, 1024 * 1024 };
+	// Average CPU time for updating the particles and writing them to the vertex buffer
+	float updateTime{ 0.0f };
+
 	struct {
 		vks::Buffer particles;
 		vks::Buffer environment;
@@ -98,9 +94,6 @@ public:
 		VkDescriptorSet environment{ VK_NULL_HANDLE };
 	} descriptorSets;
 
-	std::vector<Particle> particleBuffer{};
-
-	std::default_random_engine rndEngine;
 
 	VulkanExample() : VulkanExampleBase()
 	{
@@ -110,7 +103,12 @@ public:
 		camera.setRotation(glm::vec3(-15.0f, 45.0f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 1.0f, 256.0f);
 		timerSpeed *= 8.0f;
-		rndEngine.seed(benchmark.active ? 0 : (unsigned)time(nullptr));
+		commandLineParser.add("particlecount", { "-pc", "--particlecount" }, 1, "Number of CPU simulated particles");
+		commandLineParser.parse(args);
+		particleCount = std::max(commandLineParser.getValueAsInt("particlecount", PARTICLE_COUNT), 1);
+		auto countIt = std::find(particleCounts.begin(), particleCounts.end(), particleCount);
+		particleCountIndex = (countIt != particleCounts.end()) ? static_cast<int32_t>(countIt - particleCounts.begin()) : 0;
+		threadPool.setThreadCount(std::max(std::thread::hardware_concurrency(), 1u));
 	}
 
 	~VulkanExample()
@@ -127,9 +125,7 @@ public:
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-			vkUnmapMemory(device, particles.memory);
-			vkDestroyBuffer(device, particles.buffer, nullptr);
-			vkFreeMemory(device, particles.memory, nullptr);
+			destroyParticleBuffer();
 
 			uniformBuffers.environment.destroy();
 			uniformBuffers.particles.destroy();
@@ -178,18 +174,17 @@ public:
 			VkRect2D scissor = vks::initializers::rect2D(width, height, 0,0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			VkDeviceSize offsets[1] = { 0 };
-
 			// Environment
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.environment, 0, nullptr);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.environment);
 			environment.draw(drawCmdBuffers[i]);
 
-			// Particle system (no index buffer)
+			// Particle system (no index buffer), sourced from the vertex buffer slot of this swap chain image
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.particles, 0, nullptr);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.particles);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &particles.buffer, offsets);
-			vkCmdDraw(drawCmdBuffers[i], static_cast<uint32_t>(particleBuffer.size()), 1, 0, 0);
+			VkDeviceSize particleOffset = particles.slotSize * (i % particles.slotCount);
+			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &particles.buffer, &particleOffset);
+			vkCmdDraw(drawCmdBuffers[i], particleSystem.count(), 1, 0, 0);
 
 			drawUI(drawCmdBuffers[i]);
 
@@ -199,119 +194,54 @@ public:
 		}
 	}
 
-	float rnd(float range)
-	{
-		std::uniform_real_distribution<float> rndDist(0.0f, range);
-		return rndDist(rndEngine);
-	}
-
-	void initParticle(Particle *particle, glm::vec3 emitterPos)
-	{
-		particle->vel = glm::vec4(0.0f, minVel.y + rnd(maxVel.y - minVel.y), 0.0f, 0.0f);
-		particle->alpha = rnd(0.75f);
-		particle->size = 1.0f + rnd(0.5f);
-		particle->color = glm::vec4(1.0f);
-		particle->type = PARTICLE_TYPE_FLAME;
-		particle->rotation = rnd(2.0f * float(M_PI));
-		particle->rotationSpeed = rnd(2.0f) - rnd(2.0f);
-
-		// Get random sphere point
-		float theta = rnd(2.0f * float(M_PI));
-		float phi = rnd(float(M_PI)) - float(M_PI) / 2.0f;
-		float r = rnd(FLAME_RADIUS);
-
-		particle->pos.x = r * cos(theta) * cos(phi);
-		particle->pos.y = r * sin(phi);
-		particle->pos.z = r * sin(theta) * cos(phi);
-
-		particle->pos += glm::vec4(emitterPos, 0.0f);
-	}
-
-	// Change the type of a particle, e.g. from flame to smoke
-	void transitionParticle(Particle *particle)
-	{
-		switch (particle->type)
-		{
-		case PARTICLE_TYPE_FLAME:
-			// Flame particles have a chance of turning into smoke
-			if (rnd(1.0f) < 0.05f)
-			{
-				particle->alpha = 0.0f;
-				particle->color = glm::vec4(0.25f + rnd(0.25f));
-				particle->pos.x *= 0.5f;
-				particle->pos.z *= 0.5f;
-				particle->vel = glm::vec4(rnd(1.0f) - rnd(1.0f), (minVel.y * 2) + rnd(maxVel.y - minVel.y), rnd(1.0f) - rnd(1.0f), 0.0f);
-				particle->size = 1.0f + rnd(0.5f);
-				particle->rotationSpeed = rnd(1.0f) - rnd(1.0f);
-				particle->type = PARTICLE_TYPE_SMOKE;
-			}
-			else
-			{
-				initParticle(particle, emitterPos);
-			}
-			break;
-		case PARTICLE_TYPE_SMOKE:
-			// Respawn at end of life
-			initParticle(particle, emitterPos);
-			break;
-		}
-	}
-
 	// Initialize the particle system and create a vertex buffer for rendering the particles
 	void prepareParticles()
 	{
-		particleBuffer.resize(PARTICLE_COUNT);
-		for (auto& particle : particleBuffer)
-		{
-			initParticle(&particle, emitterPos);
-			particle.alpha = 1.0f - (abs(particle.pos.y) / (FLAME_RADIUS * 2.0f));
-		}
+		particleSystem.emitter = { { emitterPos.x, emitterPos.y, emitterPos.z }, minVel.y, maxVel.y };
+		particleSystem.init(particleCount, benchmark.active ? 1 : (unsigned)time(nullptr));
 
-		particles.size = particleBuffer.size() * sizeof(Particle);
+		particles.slotCount = static_cast<uint32_t>(drawCmdBuffers.size());
+		particles.slotSize = particleCount * sizeof(particlesystem::Vertex);
+		particles.size = particles.slotSize * particles.slotCount;
 
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 			particles.size,
 			&particles.buffer,
-			&particles.memory,
-			particleBuffer.data()));
+			&particles.memory));
 
 		// Map the memory and store the pointer for reuse
 		VK_CHECK_RESULT(vkMapMemory(device, particles.memory, 0, particles.size, 0, &particles.mappedMemory));
+		for (uint32_t i = 0; i < particles.slotCount; i++) {
+			particleSystem.writeVertices(particleSlot(i), threadPool);
+		}
 	}
 
-	// Update the state of all particles
+	void destroyParticleBuffer()
+	{
+		vkUnmapMemory(device, particles.memory);
+		vkDestroyBuffer(device, particles.buffer, nullptr);
+		vkFreeMemory(device, particles.memory, nullptr);
+	}
+
+	particlesystem::Vertex* particleSlot(uint32_t index)
+	{
+		return reinterpret_cast<particlesystem::Vertex*>(static_cast<uint8_t*>(particles.mappedMemory) + particles.slotSize * (index % particles.slotCount));
+	}
+
+	// Update the state of all particles and write them to the vertex buffer slot of the current frame
 	void updateParticles()
 	{
-		float particleTimer = frameTimer * 0.45f;
-		for (auto& particle : particleBuffer)
-		{
-			switch (particle.type)
-			{
-			case PARTICLE_TYPE_FLAME:
-				particle.pos.y -= particle.vel.y * particleTimer * 3.5f;
-				particle.alpha += particleTimer * 2.5f;
-				particle.size -= particleTimer * 0.5f;
-				break;
-			case PARTICLE_TYPE_SMOKE:
-				particle.pos -= particle.vel * frameTimer * 1.0f;
-				particle.alpha += particleTimer * 1.25f;
-				particle.size += particleTimer * 0.125f;
-				particle.color -= particleTimer * 0.05f;
-				break;
-			}
-			particle.rotation += particleTimer * particle.rotationSpeed;
-			// If a particle has faded out, turn it into the other type (e.g. flame to smoke and vice versa)
-			if (particle.alpha > 2.0f)
-			{
-				transitionParticle(&particle);
-			}
+		auto tStart = std::chrono::high_resolution_clock::now();
+		if (!paused) {
+			particleSystem.update(frameTimer, particleSlot(currentBuffer), threadPool);
+		} else {
+			// The other slots may still contain particles from earlier frames
+			particleSystem.writeVertices(particleSlot(currentBuffer), threadPool);
 		}
-		
-		// Copy the updated particles to the vertex buffer
-		size_t size = particleBuffer.size() * sizeof(Particle);
-		memcpy(particles.mappedMemory, particleBuffer.data(), size);
+		float elapsed = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		updateTime = (updateTime == 0.0f) ? elapsed : glm::mix(updateTime, elapsed, 0.05f);
 	}
 
 	void loadAssets()
@@ -444,15 +374,15 @@ public:
 		{
 			// Vertex input state
 			VkVertexInputBindingDescription vertexInputBinding =
-				vks::initializers::vertexInputBindingDescription(0, sizeof(Particle), VK_VERTEX_INPUT_RATE_VERTEX);
+				vks::initializers::vertexInputBindingDescription(0, sizeof(particlesystem::Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
 
 			std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-				vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32A32_SFLOAT,	offsetof(Particle, pos)),	// Location 0: Position
-				vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32B32A32_SFLOAT,	offsetof(Particle, color)),	// Location 1: Color
-				vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R32_SFLOAT, offsetof(Particle, alpha)),			// Location 2: Alpha
-				vks::initializers::vertexInputAttributeDescription(0, 3, VK_FORMAT_R32_SFLOAT, offsetof(Particle, size)),			// Location 3: Size
-				vks::initializers::vertexInputAttributeDescription(0, 4, VK_FORMAT_R32_SFLOAT, offsetof(Particle, rotation)),		// Location 4: Rotation
-				vks::initializers::vertexInputAttributeDescription(0, 5, VK_FORMAT_R32_SINT, offsetof(Particle, type)),				// Location 5: Particle type
+				vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(particlesystem::Vertex, pos)),		// Location 0: Position
+				vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32_SFLOAT, offsetof(particlesystem::Vertex, color)),			// Location 1: Color
+				vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R32_SFLOAT, offsetof(particlesystem::Vertex, alpha)),			// Location 2: Alpha
+				vks::initializers::vertexInputAttributeDescription(0, 3, VK_FORMAT_R32_SFLOAT, offsetof(particlesystem::Vertex, size)),			// Location 3: Size
+				vks::initializers::vertexInputAttributeDescription(0, 4, VK_FORMAT_R32_SFLOAT, offsetof(particlesystem::Vertex, rotation)),		// Location 4: Rotation
+				vks::initializers::vertexInputAttributeDescription(0, 5, VK_FORMAT_R32_SINT, offsetof(particlesystem::Vertex, type)),			// Location 5: Particle type
 			};
 
 			VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
@@ -544,6 +474,8 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The slot of the acquired image is no longer in use by the GPU
+		updateParticles();
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -555,11 +487,29 @@ public:
 		if (!prepared)
 			return;
 		updateUniformBuffers();
-		if (!paused) {
-			updateParticles();
-		}
 		draw();
 	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Settings")) {
+			std::vector<std::string> counts;
+			for (uint32_t count : particleCounts) {
+				counts.push_back(std::to_string(count));
+			}
+			if (overlay->comboBox("Particles", &particleCountIndex, counts)) {
+				vkDeviceWaitIdle(device);
+				destroyParticleBuffer();
+				particleCount = particleCounts[particleCountIndex];
+				prepareParticles();
+				updateTime = 0.0f;
+			}
+		}
+		if (overlay->header("Statistics")) {
+			overlay->text("%d flames, %d smoke", (int32_t)particleSystem.flameCount(), (int32_t)particleSystem.smokeCount());
+			overlay->text("CPU update: %.2f ms (%d threads)", updateTime, (int32_t)threadPool.threads.size());
+		}
+	}
 };
 
 VULKAN_EXAMPLE_MAIN()
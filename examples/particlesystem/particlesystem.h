@@ -0,0 +1,439 @@
+/*
+* Vulkan Example - CPU based particle system
+*
+* Structure of arrays particle store with vectorized update kernels and multi threaded emit, update and compaction
+*
+* Flame and smoke particles are kept in separate pools, so each type is updated by its own branch free kernel.
+* A frame is simulated in two parallel passes over fixed size chunks of the pools:
+*	- Update: advance all particles of a chunk and collect the ones that expired
+*	- Compact: copy the surviving particles into the other (double buffered) store, emit replacements for the expired
+*	  ones and write all of them as vertices straight into the mapped vertex buffer
+* The destination offsets of the chunks are calculated in between with a prefix sum, so all chunks can be compacted in parallel.
+*
+* Uses SSE2 if available and a scalar fallback on other platforms.
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include "threadpool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define PARTICLES_USE_SSE2
+#endif
+
+#define FLAME_RADIUS 8.0f
+
+// The particle system is made from two different particle types
+// That type defines how a particle is rendered
+#define PARTICLE_TYPE_FLAME 0
+#define PARTICLE_TYPE_SMOKE 1
+
+namespace particlesystem
+{
+	// Vertex layout read by the particle vertex shader
+	struct Vertex {
+		float pos[3];
+		// Particles are tinted grey, so a single channel is enough
+		float color;
+		float alpha;
+		float size;
+		float rotation;
+		uint32_t type;
+	};
+
+	struct Emitter {
+		float pos[3];
+		float minVelY;
+		float maxVelY;
+	};
+
+	/*
+		Four lane float vector
+	*/
+#if defined(PARTICLES_USE_SSE2)
+	struct vfloat {
+		__m128 v;
+		vfloat(__m128 v) : v(v) {}
+		explicit vfloat(float s) : v(_mm_set1_ps(s)) {}
+		static vfloat load(const float* src) { return _mm_loadu_ps(src); }
+		void store(float* dst) const { _mm_storeu_ps(dst, v); }
+	};
+	inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+	inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+	inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+	// Bit mask of the lanes where a > b
+	inline uint32_t greaterMask(vfloat a, vfloat b) { return (uint32_t)_mm_movemask_ps(_mm_cmpgt_ps(a.v, b.v)); }
+#else
+	struct vfloat {
+		float v[4];
+		explicit vfloat(float s) { v[0] = v[1] = v[2] = v[3] = s; }
+		static vfloat load(const float* src) { vfloat r(0.0f); memcpy(r.v, src, sizeof(r.v)); return r; }
+		void store(float* dst) const { memcpy(dst, v, sizeof(v)); }
+	};
+	inline vfloat operator+(vfloat a, vfloat b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+	inline vfloat operator-(vfloat a, vfloat b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+	inline vfloat operator*(vfloat a, vfloat b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+	inline uint32_t greaterMask(vfloat a, vfloat b) { uint32_t m = 0; for (int i = 0; i < 4; i++) m |= (a.v[i] > b.v[i]) ? (1u << i) : 0u; return m; }
+#endif
+
+	// Small and fast generator, each chunk uses its own so results don't depend on the thread count
+	struct Random {
+		uint32_t state;
+		explicit Random(uint32_t seed) : state(seed ? seed : 1) {}
+		// Uniform float in [0, range)
+		float operator()(float range)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return (float)(state >> 8) * (1.0f / 16777216.0f) * range;
+		}
+	};
+
+	// Structure of arrays storage for the particles of one type
+	struct Pool {
+		std::vector<float> posX, posY, posZ;
+		std::vector<float> velX, velY, velZ;
+		std::vector<float> color, alpha, size, rotation, rotationSpeed;
+		uint32_t count{ 0 };
+
+		void resize(uint32_t capacity)
+		{
+			// Padded to full vector lanes, the update kernels run over the padding instead of handling a scalar tail
+			const size_t paddedCapacity = ((size_t)capacity + 3) & ~(size_t)3;
+			for (auto* field : { &posX, &posY, &posZ, &velX, &velY, &velZ, &color, &alpha, &size, &rotation, &rotationSpeed }) {
+				field->assign(paddedCapacity, 0.0f);
+			}
+			count = 0;
+		}
+
+		void copy(uint32_t dst, const Pool& src, uint32_t srcIndex, uint32_t count)
+		{
+			const size_t bytes = count * sizeof(float);
+			memcpy(&posX[dst], &src.posX[srcIndex], bytes);
+			memcpy(&posY[dst], &src.posY[srcIndex], bytes);
+			memcpy(&posZ[dst], &src.posZ[srcIndex], bytes);
+			memcpy(&velX[dst], &src.velX[srcIndex], bytes);
+			memcpy(&velY[dst], &src.velY[srcIndex], bytes);
+			memcpy(&velZ[dst], &src.velZ[srcIndex], bytes);
+			memcpy(&color[dst], &src.color[srcIndex], bytes);
+			memcpy(&alpha[dst], &src.alpha[srcIndex], bytes);
+			memcpy(&size[dst], &src.size[srcIndex], bytes);
+			memcpy(&rotation[dst], &src.rotation[srcIndex], bytes);
+			memcpy(&rotationSpeed[dst], &src.rotationSpeed[srcIndex], bytes);
+		}
+
+		void writeVertices(Vertex* vertices, uint32_t first, uint32_t count, uint32_t type) const
+		{
+			for (uint32_t i = first; i < first + count; i++) {
+				Vertex v;
+				v.pos[0] = posX[i];
+				v.pos[1] = posY[i];
+				v.pos[2] = posZ[i];
+				v.color = color[i];
+				v.alpha = alpha[i];
+				v.size = size[i];
+				v.rotation = rotation[i];
+				v.type = type;
+				// Mapped memory is usually write combined, so write whole vertices in order and never read back
+				vertices[i] = v;
+			}
+		}
+	};
+
+	class ParticleSystem
+	{
+	public:
+		// Number of particles of a pool handled by one job
+		static const uint32_t chunkSize = 16384;
+
+		Emitter emitter{};
+
+		// Fill the system with flame particles
+		void init(uint32_t count, uint32_t seed)
+		{
+			this->seed = seed;
+			frame = 0;
+			current = 0;
+			for (uint32_t i = 0; i < 2; i++) {
+				flames[i].resize(count);
+				smoke[i].resize(count);
+			}
+			Random rnd(seed);
+			Pool& pool = flames[current];
+			for (uint32_t i = 0; i < count; i++) {
+				initFlame(pool, i, rnd);
+				pool.alpha[i] = 1.0f - (std::abs(pool.posY[i]) / (FLAME_RADIUS * 2.0f));
+			}
+			pool.count = count;
+			smoke[current].count = 0;
+		}
+
+		uint32_t count() const { return flames[current].count + smoke[current].count; }
+		uint32_t flameCount() const { return flames[current].count; }
+		uint32_t smokeCount() const { return smoke[current].count; }
+
+		// Advance all particles by one frame and write them to the vertex buffer (flames first, then smoke)
+		void update(float frameTimer, Vertex* vertices, vks::ThreadPool& threadPool)
+		{
+			const Pool& srcFlames = flames[current];
+			const Pool& srcSmoke = smoke[current];
+			Pool& dstFlames = flames[1 - current];
+			Pool& dstSmoke = smoke[1 - current];
+			frame++;
+
+			// Split both pools into chunks
+			chunks.resize(chunkCount(srcFlames.count) + chunkCount(srcSmoke.count));
+			uint32_t chunkIndex = 0;
+			for (uint32_t type = 0; type < 2; type++) {
+				const uint32_t poolCount = (type == PARTICLE_TYPE_FLAME) ? srcFlames.count : srcSmoke.count;
+				for (uint32_t begin = 0; begin < poolCount; begin += chunkSize) {
+					Chunk& chunk = chunks[chunkIndex];
+					chunk.type = type;
+					chunk.begin = begin;
+					chunk.end = std::min(begin + chunkSize, poolCount);
+					chunk.seed = (frame * 0x9E3779B9u) ^ (seed + chunkIndex * 0x85EBCA6Bu);
+					chunkIndex++;
+				}
+			}
+
+			// Pass 1: Update the particles in place and find the expired ones
+			const float particleTimer = frameTimer * 0.45f;
+			parallelFor(threadPool, (uint32_t)chunks.size(), [&](uint32_t i) {
+				Chunk& chunk = chunks[i];
+				if (chunk.type == PARTICLE_TYPE_FLAME) {
+					updateFlames(flames[current], chunk, particleTimer);
+				} else {
+					updateSmoke(smoke[current], chunk, frameTimer, particleTimer);
+				}
+			});
+
+			// Destination offsets: flames are [survivors, respawned], smoke is [survivors, converted from flames]
+			uint32_t flameSurvivors = 0, smokeSurvivors = 0, respawned = 0, converted = 0;
+			for (Chunk& chunk : chunks) {
+				const uint32_t survivors = (chunk.end - chunk.begin) - (uint32_t)(chunk.respawn.size() + chunk.convert.size());
+				uint32_t& survivorOffset = (chunk.type == PARTICLE_TYPE_FLAME) ? flameSurvivors : smokeSurvivors;
+				chunk.survivorOffset = survivorOffset;
+				survivorOffset += survivors;
+				chunk.respawnOffset = respawned;
+				respawned += (uint32_t)chunk.respawn.size();
+				chunk.convertOffset = converted;
+				converted += (uint32_t)chunk.convert.size();
+			}
+			for (Chunk& chunk : chunks) {
+				chunk.respawnOffset += flameSurvivors;
+				chunk.convertOffset += smokeSurvivors;
+			}
+			dstFlames.count = flameSurvivors + respawned;
+			dstSmoke.count = smokeSurvivors + converted;
+			Vertex* flameVertices = vertices;
+			Vertex* smokeVertices = vertices + dstFlames.count;
+
+			// Pass 2: Compact the survivors into the other store, emit the replacements and write the vertices
+			parallelFor(threadPool, (uint32_t)chunks.size(), [&](uint32_t i) {
+				const Chunk& chunk = chunks[i];
+				const bool flame = (chunk.type == PARTICLE_TYPE_FLAME);
+				const Pool& src = flame ? srcFlames : srcSmoke;
+				Pool& dst = flame ? dstFlames : dstSmoke;
+				Vertex* dstVertices = flame ? flameVertices : smokeVertices;
+				// Copy the runs of surviving particles between the expired ones
+				uint32_t dstIndex = chunk.survivorOffset;
+				uint32_t runStart = chunk.begin;
+				size_t r = 0, c = 0;
+				while (runStart < chunk.end) {
+					// Expired particles of both lists are in ascending order
+					uint32_t next = chunk.end;
+					if (r < chunk.respawn.size()) next = std::min(next, chunk.respawn[r]);
+					if (c < chunk.convert.size()) next = std::min(next, chunk.convert[c]);
+					const uint32_t runLength = next - runStart;
+					if (runLength > 0) {
+						dst.copy(dstIndex, src, runStart, runLength);
+						dst.writeVertices(dstVertices, dstIndex, runLength, chunk.type);
+						dstIndex += runLength;
+					}
+					if (next < chunk.end) {
+						if ((r < chunk.respawn.size()) && (chunk.respawn[r] == next)) r++; else c++;
+					}
+					runStart = next + 1;
+				}
+				// Expired particles of both types are replaced by new flames
+				Random rnd(chunk.seed ^ 0x68E31DA4u);
+				for (size_t j = 0; j < chunk.respawn.size(); j++) {
+					initFlame(dstFlames, chunk.respawnOffset + (uint32_t)j, rnd);
+				}
+				dstFlames.writeVertices(flameVertices, chunk.respawnOffset, (uint32_t)chunk.respawn.size(), PARTICLE_TYPE_FLAME);
+				// Some flames turn into smoke
+				for (size_t j = 0; j < chunk.convert.size(); j++) {
+					const uint32_t d = chunk.convertOffset + (uint32_t)j;
+					dstSmoke.copy(d, src, chunk.convert[j], 1);
+					convertToSmoke(dstSmoke, d, rnd);
+				}
+				dstSmoke.writeVertices(smokeVertices, chunk.convertOffset, (uint32_t)chunk.convert.size(), PARTICLE_TYPE_SMOKE);
+			});
+
+			current = 1 - current;
+		}
+
+		// Write the current state without advancing it (e.g. while paused)
+		void writeVertices(Vertex* vertices, vks::ThreadPool& threadPool)
+		{
+			const Pool& srcFlames = flames[current];
+			const Pool& srcSmoke = smoke[current];
+			const uint32_t flameChunks = chunkCount(srcFlames.count);
+			parallelFor(threadPool, flameChunks + chunkCount(srcSmoke.count), [&](uint32_t i) {
+				const bool flame = (i < flameChunks);
+				const Pool& src = flame ? srcFlames : srcSmoke;
+				const uint32_t begin = (flame ? i : i - flameChunks) * chunkSize;
+				src.writeVertices(flame ? vertices : vertices + srcFlames.count, begin, std::min(chunkSize, src.count - begin), flame ? PARTICLE_TYPE_FLAME : PARTICLE_TYPE_SMOKE);
+			});
+		}
+
+	private:
+		struct Chunk {
+			uint32_t type;
+			uint32_t begin, end;
+			uint32_t seed;
+			// Indices of the particles that expired this frame and are respawned as flames or turned into smoke
+			std::vector<uint32_t> respawn;
+			std::vector<uint32_t> convert;
+			uint32_t survivorOffset, respawnOffset, convertOffset;
+		};
+
+		Pool flames[2];
+		Pool smoke[2];
+		// Index of the store holding the current state, the other one is the destination of the compaction
+		uint32_t current{ 0 };
+		uint32_t frame{ 0 };
+		uint32_t seed{ 0 };
+		std::vector<Chunk> chunks;
+
+		static uint32_t chunkCount(uint32_t count)
+		{
+			return (count + chunkSize - 1) / chunkSize;
+		}
+
+		// Runs small workloads on the calling thread, the overhead of the pool isn't worth it for a single chunk
+		template <typename F>
+		void parallelFor(vks::ThreadPool& threadPool, uint32_t count, F func)
+		{
+			if (count <= 1 || threadPool.threads.empty()) {
+				for (uint32_t i = 0; i < count; i++) {
+					func(i);
+				}
+				return;
+			}
+			std::atomic<uint32_t> next{ 0 };
+			for (auto& thread : threadPool.threads) {
+				thread->addJob([&] {
+					uint32_t i;
+					while ((i = next++) < count) {
+						func(i);
+					}
+				});
+			}
+			threadPool.wait();
+		}
+
+		// Particles have faded out once their alpha exceeds this value
+		static float lifetimeEnd() { return 2.0f; }
+
+		void updateFlames(Pool& pool, Chunk& chunk, float particleTimer)
+		{
+			chunk.respawn.clear();
+			chunk.convert.clear();
+			const vfloat moveY(particleTimer * 3.5f), fade(particleTimer * 2.5f), shrink(particleTimer * 0.5f), rotate(particleTimer), end(lifetimeEnd());
+			// Chunks start at a multiple of the lane count, the last one may run into the padding
+			for (uint32_t i = chunk.begin; i < chunk.end; i += 4) {
+				(vfloat::load(&pool.posY[i]) - vfloat::load(&pool.velY[i]) * moveY).store(&pool.posY[i]);
+				const vfloat alpha = vfloat::load(&pool.alpha[i]) + fade;
+				alpha.store(&pool.alpha[i]);
+				(vfloat::load(&pool.size[i]) - shrink).store(&pool.size[i]);
+				(vfloat::load(&pool.rotation[i]) + vfloat::load(&pool.rotationSpeed[i]) * rotate).store(&pool.rotation[i]);
+				if (uint32_t expired = greaterMask(alpha, end)) {
+					collectExpired(chunk, i, expired, true);
+				}
+			}
+		}
+
+		void updateSmoke(Pool& pool, Chunk& chunk, float frameTimer, float particleTimer)
+		{
+			chunk.respawn.clear();
+			chunk.convert.clear();
+			const vfloat move(frameTimer), fade(particleTimer * 1.25f), grow(particleTimer * 0.125f), darken(particleTimer * 0.05f), rotate(particleTimer), end(lifetimeEnd());
+			for (uint32_t i = chunk.begin; i < chunk.end; i += 4) {
+				(vfloat::load(&pool.posX[i]) - vfloat::load(&pool.velX[i]) * move).store(&pool.posX[i]);
+				(vfloat::load(&pool.posY[i]) - vfloat::load(&pool.velY[i]) * move).store(&pool.posY[i]);
+				(vfloat::load(&pool.posZ[i]) - vfloat::load(&pool.velZ[i]) * move).store(&pool.posZ[i]);
+				const vfloat alpha = vfloat::load(&pool.alpha[i]) + fade;
+				alpha.store(&pool.alpha[i]);
+				(vfloat::load(&pool.size[i]) + grow).store(&pool.size[i]);
+				(vfloat::load(&pool.color[i]) - darken).store(&pool.color[i]);
+				(vfloat::load(&pool.rotation[i]) + vfloat::load(&pool.rotationSpeed[i]) * rotate).store(&pool.rotation[i]);
+				if (uint32_t expired = greaterMask(alpha, end)) {
+					collectExpired(chunk, i, expired, false);
+				}
+			}
+		}
+
+		void collectExpired(Chunk& chunk, uint32_t first, uint32_t mask, bool flame)
+		{
+			Random rnd(chunk.seed + first);
+			for (uint32_t lane = 0; lane < 4; lane++) {
+				const uint32_t index = first + lane;
+				if (!(mask & (1u << lane)) || (index >= chunk.end)) {
+					continue;
+				}
+				// Flame particles have a chance of turning into smoke, smoke is respawned at the end of its life
+				if (flame && (rnd(1.0f) < 0.05f)) {
+					chunk.convert.push_back(index);
+				} else {
+					chunk.respawn.push_back(index);
+				}
+			}
+		}
+
+		void initFlame(Pool& pool, uint32_t i, Random& rnd)
+		{
+			pool.velX[i] = 0.0f;
+			pool.velY[i] = emitter.minVelY + rnd(emitter.maxVelY - emitter.minVelY);
+			pool.velZ[i] = 0.0f;
+			pool.alpha[i] = rnd(0.75f);
+			pool.size[i] = 1.0f + rnd(0.5f);
+			pool.color[i] = 1.0f;
+			pool.rotation[i] = rnd(2.0f * float(M_PI));
+			pool.rotationSpeed[i] = rnd(2.0f) - rnd(2.0f);
+
+			// Get random sphere point
+			const float theta = rnd(2.0f * float(M_PI));
+			const float phi = rnd(float(M_PI)) - float(M_PI) / 2.0f;
+			const float r = rnd(FLAME_RADIUS);
+			pool.posX[i] = r * cos(theta) * cos(phi) + emitter.pos[0];
+			pool.posY[i] = r * sin(phi) + emitter.pos[1];
+			pool.posZ[i] = r * sin(theta) * cos(phi) + emitter.pos[2];
+		}
+
+		void convertToSmoke(Pool& pool, uint32_t i, Random& rnd)
+		{
+			pool.alpha[i] = 0.0f;
+			pool.color[i] = 0.25f + rnd(0.25f);
+			pool.posX[i] *= 0.5f;
+			pool.posZ[i] *= 0.5f;
+			pool.velX[i] = rnd(1.0f) - rnd(1.0f);
+			pool.velY[i] = (emitter.minVelY * 2.0f) + rnd(emitter.maxVelY - emitter.minVelY);
+			pool.velZ[i] = rnd(1.0f) - rnd(1.0f);
+			pool.size[i] = 1.0f + rnd(0.5f);
+			pool.rotationSpeed[i] = rnd(1.0f) - rnd(1.0f);
+		}
+	};
+}
@@ -12,6 +12,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanIBLCache.h"
 
 struct Material {
 	// Parameter block used as push constant block
@@ -88,9 +89,18 @@ public:
 	std::vector<std::string> materialNames;
 	std::vector<std::string> objectNames;
 
+	// Generated image based lighting maps are cached as KTX files
+	vks::IBLCache iblCache;
+	const std::string environmentMapFile = "textures/hdr/pisa_cube.ktx";
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "PBR with image based lighting";
+		commandLineParser.add("iblcache", { "--iblcache" }, 1, "Directory for caching the generated image based lighting maps (defaults to the directory of the environment map)");
+		commandLineParser.add("noiblcache", { "--noiblcache" }, 0, "Always generate the image based lighting maps and don't write them to the cache");
+		commandLineParser.parse(args);
+		iblCache.enabled = !commandLineParser.isSet("noiblcache");
+		iblCache.path = commandLineParser.getValueAsString("iblcache", "");
 
 		camera.type = Camera::CameraType::firstperson;
 		camera.movementSpeed = 4.0f;
@@ -223,7 +233,7 @@ public:
 			models.objects[i].loadFromFile(getAssetPath() + "models/" + filenames[i], vulkanDevice, queue, glTFLoadingFlags);
 		}
 		// HDR cubemap
-		textures.environmentCube.loadFromFile(getAssetPath() + "textures/hdr/pisa_cube.ktx", VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
+		textures.environmentCube.loadFromFile(getAssetPath() + environmentMapFile, VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
 	}
 
 	void setupDescriptors()
@@ -342,12 +352,10 @@ public:
 	}
 
 	// Generate a BRDF integration map used as a look-up-table (stores roughness / NdotV)
-	void generateBRDFLUT()
+	void generateBRDFLUT(VkCommandBuffer cmdBuf)
 	{
-		auto tStart = std::chrono::high_resolution_clock::now();
-
-		const VkFormat format = VK_FORMAT_R16G16_SFLOAT;	// R16G16 is supported pretty much everywhere
-		const int32_t dim = 512;
+		const VkFormat format = iblCache.brdfLut.format;	// R16G16 is supported pretty much everywhere
+		const int32_t dim = static_cast<int32_t>(iblCache.brdfLut.dim);
 
 		// Image
 		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
@@ -360,7 +368,7 @@ public:
 		imageCI.arrayLayers = 1;
 		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &textures.lutBrdf.image));
 		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		VkMemoryRequirements memReqs;
@@ -520,7 +528,6 @@ public:
 		renderPassBeginInfo.pClearValues = clearValues;
 		renderPassBeginInfo.framebuffer = framebuffer;
 
-		VkCommandBuffer cmdBuf = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 		vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 		VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
 		VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
@@ -529,30 +536,23 @@ public:
 		vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 		vkCmdDraw(cmdBuf, 3, 1, 0, 0);
 		vkCmdEndRenderPass(cmdBuf);
-		vulkanDevice->flushCommandBuffer(cmdBuf, queue);
-
-		vkQueueWaitIdle(queue);
 
-		vkDestroyPipeline(device, pipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
-		vkDestroyRenderPass(device, renderpass, nullptr);
-		vkDestroyFramebuffer(device, framebuffer, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
-		vkDestroyDescriptorPool(device, descriptorpool, nullptr);
-
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-		std::cout << "Generating BRDF LUT took " << tDiff << " ms" << std::endl;
+		iblCache.cleanup.push_back([=]() {
+			vkDestroyPipeline(device, pipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
+			vkDestroyRenderPass(device, renderpass, nullptr);
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
+			vkDestroyDescriptorPool(device, descriptorpool, nullptr);
+		});
 	}
 
 	// Generate an irradiance cube map from the environment cube map
-	void generateIrradianceCube()
+	void generateIrradianceCube(VkCommandBuffer cmdBuf)
 	{
-		auto tStart = std::chrono::high_resolution_clock::now();
-
-		const VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT;
-		const int32_t dim = 64;
-		const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+		const VkFormat format = iblCache.irradianceCube.format;
+		const int32_t dim = static_cast<int32_t>(iblCache.irradianceCube.dim);
+		const uint32_t numMips = iblCache.irradianceCube.numMips;
 
 		// Pre-filtered cube map
 		// Image
@@ -566,7 +566,7 @@ public:
 		imageCI.arrayLayers = 6;
 		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &textures.irradianceCube.image));
 		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
@@ -705,14 +705,12 @@ public:
 			fbufCreateInfo.layers = 1;
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreen.framebuffer));
 
-			VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 			vks::tools::setImageLayout(
-				layoutCmd,
+				cmdBuf,
 				offscreen.image,
 				VK_IMAGE_ASPECT_COLOR_BIT,
 				VK_IMAGE_LAYOUT_UNDEFINED,
 				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
 		}
 
 		// Descriptors
@@ -740,9 +738,11 @@ public:
 		struct PushBlock {
 			glm::mat4 mvp;
 			// Sampling deltas
-			float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
-			float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
+			float deltaPhi;
+			float deltaTheta;
 		} pushBlock;
+		pushBlock.deltaPhi = iblCache.sampling.irradianceDeltaPhi;
+		pushBlock.deltaTheta = iblCache.sampling.irradianceDeltaTheta;
 
 		VkPipelineLayout pipelinelayout;
 		std::vector<VkPushConstantRange> pushConstantRanges = {
@@ -812,8 +812,6 @@ public:
 			glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
 		};
 
-		VkCommandBuffer cmdBuf = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
 		VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
 		VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
 
@@ -907,32 +905,26 @@ public:
 			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			subresourceRange);
 
-		vulkanDevice->flushCommandBuffer(cmdBuf, queue);
-
-		vkDestroyRenderPass(device, renderpass, nullptr);
-		vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
-		vkFreeMemory(device, offscreen.memory, nullptr);
-		vkDestroyImageView(device, offscreen.view, nullptr);
-		vkDestroyImage(device, offscreen.image, nullptr);
-		vkDestroyDescriptorPool(device, descriptorpool, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
-		vkDestroyPipeline(device, pipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
-
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-		std::cout << "Generating irradiance cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+		iblCache.cleanup.push_back([=]() {
+			vkDestroyRenderPass(device, renderpass, nullptr);
+			vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
+			vkFreeMemory(device, offscreen.memory, nullptr);
+			vkDestroyImageView(device, offscreen.view, nullptr);
+			vkDestroyImage(device, offscreen.image, nullptr);
+			vkDestroyDescriptorPool(device, descriptorpool, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
+			vkDestroyPipeline(device, pipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
+		});
 	}
 
 	// Prefilter environment cubemap
 	// See https://placeholderart.wordpress.com/2015/07/28/implementation-notes-runtime-environment-map-filtering-for-image-based-lighting/
-	void generatePrefilteredCube()
+	void generatePrefilteredCube(VkCommandBuffer cmdBuf)
 	{
-		auto tStart = std::chrono::high_resolution_clock::now();
-
-		const VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
-		const int32_t dim = 512;
-		const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+		const VkFormat format = iblCache.prefilteredCube.format;
+		const int32_t dim = static_cast<int32_t>(iblCache.prefilteredCube.dim);
+		const uint32_t numMips = iblCache.prefilteredCube.numMips;
 
 		// Pre-filtered cube map
 		// Image
@@ -946,7 +938,7 @@ public:
 		imageCI.arrayLayers = 6;
 		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &textures.prefilteredCube.image));
 		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
@@ -1085,14 +1077,12 @@ public:
 			fbufCreateInfo.layers = 1;
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreen.framebuffer));
 
-			VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 			vks::tools::setImageLayout(
-				layoutCmd,
+				cmdBuf,
 				offscreen.image,
 				VK_IMAGE_ASPECT_COLOR_BIT,
 				VK_IMAGE_LAYOUT_UNDEFINED,
 				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
 		}
 
 		// Descriptors
@@ -1120,8 +1110,9 @@ public:
 		struct PushBlock {
 			glm::mat4 mvp;
 			float roughness;
-			uint32_t numSamples = 32u;
+			uint32_t numSamples;
 		} pushBlock;
+		pushBlock.numSamples = iblCache.sampling.prefilterSampleCount;
 
 		VkPipelineLayout pipelinelayout;
 		std::vector<VkPushConstantRange> pushConstantRanges = {
@@ -1191,8 +1182,6 @@ public:
 			glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
 		};
 
-		VkCommandBuffer cmdBuf = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
 		VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
 		VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
 
@@ -1287,21 +1276,31 @@ public:
 			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			subresourceRange);
 
-		vulkanDevice->flushCommandBuffer(cmdBuf, queue);
-
-		vkDestroyRenderPass(device, renderpass, nullptr);
-		vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
-		vkFreeMemory(device, offscreen.memory, nullptr);
-		vkDestroyImageView(device, offscreen.view, nullptr);
-		vkDestroyImage(device, offscreen.image, nullptr);
-		vkDestroyDescriptorPool(device, descriptorpool, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
-		vkDestroyPipeline(device, pipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
-
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-		std::cout << "Generating pre-filtered enivornment cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+		iblCache.cleanup.push_back([=]() {
+			vkDestroyRenderPass(device, renderpass, nullptr);
+			vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
+			vkFreeMemory(device, offscreen.memory, nullptr);
+			vkDestroyImageView(device, offscreen.view, nullptr);
+			vkDestroyImage(device, offscreen.image, nullptr);
+			vkDestroyDescriptorPool(device, descriptorpool, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
+			vkDestroyPipeline(device, pipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
+		});
+	}
+
+	// Load the image based lighting maps from the cache or generate them with a single submission
+	void prepareIBLMaps()
+	{
+		const std::string shadersPath = getShadersPath() + "pbribl/";
+		const std::vector<std::string> shaderFiles = {
+			shadersPath + "genbrdflut.vert.spv", shadersPath + "genbrdflut.frag.spv", shadersPath + "filtercube.vert.spv", shadersPath + "irradiancecube.frag.spv", shadersPath + "prefilterenvmap.frag.spv"
+		};
+		iblCache.prepare(vulkanDevice, queue, "pbribl", getAssetPath() + environmentMapFile, shaderFiles, textures.lutBrdf, textures.irradianceCube, textures.prefilteredCube, [this](VkCommandBuffer cmdBuf) {
+			generateBRDFLUT(cmdBuf);
+			generateIrradianceCube(cmdBuf);
+			generatePrefilteredCube(cmdBuf);
+		});
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -1366,9 +1365,7 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
-		generateBRDFLUT();
-		generateIrradianceCube();
-		generatePrefilteredCube();
+		prepareIBLMaps();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
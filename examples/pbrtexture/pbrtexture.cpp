@@ -10,6 +10,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanIBLCache.h"
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -67,9 +68,18 @@ public:
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 
+	// Generated image based lighting maps are cached as KTX files
+	vks::IBLCache iblCache;
+	const std::string environmentMapFile = "textures/hdr/gcanyon_cube.ktx";
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Textured PBR with IBL";
+		commandLineParser.add("iblcache", { "--iblcache" }, 1, "Directory for caching the generated image based lighting maps (defaults to the directory of the environment map)");
+		commandLineParser.add("noiblcache", { "--noiblcache" }, 0, "Always generate the image based lighting maps and don't write them to the cache");
+		commandLineParser.parse(args);
+		iblCache.enabled = !commandLineParser.isSet("noiblcache");
+		iblCache.path = commandLineParser.getValueAsString("iblcache", "");
 
 		camera.type = Camera::CameraType::firstperson;
 		camera.movementSpeed = 4.0f;
@@ -172,7 +182,7 @@ public:
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
 		models.skybox.loadFromFile(getAssetPath() + "models/cube.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		models.object.loadFromFile(getAssetPath() + "models/cerberus/cerberus.gltf", vulkanDevice, queue, glTFLoadingFlags);
-		textures.environmentCube.loadFromFile(getAssetPath() + "textures/hdr/gcanyon_cube.ktx", VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
+		textures.environmentCube.loadFromFile(getAssetPath() + environmentMapFile, VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
 		textures.albedoMap.loadFromFile(getAssetPath() + "models/cerberus/albedo.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 		textures.normalMap.loadFromFile(getAssetPath() + "models/cerberus/normal.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 		textures.aoMap.loadFromFile(getAssetPath() + "models/cerberus/ao.ktx", VK_FORMAT_R8_UNORM, vulkanDevice, queue);
@@ -282,12 +292,10 @@ public:
 	}
 
 	// Generate a BRDF integration map used as a look-up-table (stores roughness / NdotV)
-	void generateBRDFLUT()
+	void generateBRDFLUT(VkCommandBuffer cmdBuf)
 	{
-		auto tStart = std::chrono::high_resolution_clock::now();
-
-		const VkFormat format = VK_FORMAT_R16G16_SFLOAT;	// R16G16 is supported pretty much everywhere
-		const int32_t dim = 512;
+		const VkFormat format = iblCache.brdfLut.format;	// R16G16 is supported pretty much everywhere
+		const int32_t dim = static_cast<int32_t>(iblCache.brdfLut.dim);
 
 		// Image
 		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
@@ -300,7 +308,7 @@ public:
 		imageCI.arrayLayers = 1;
 		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &textures.lutBrdf.image));
 		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		VkMemoryRequirements memReqs;
@@ -460,7 +468,6 @@ public:
 		renderPassBeginInfo.pClearValues = clearValues;
 		renderPassBeginInfo.framebuffer = framebuffer;
 
-		VkCommandBuffer cmdBuf = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 		vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 		VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
 		VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
@@ -469,30 +476,23 @@ public:
 		vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 		vkCmdDraw(cmdBuf, 3, 1, 0, 0);
 		vkCmdEndRenderPass(cmdBuf);
-		vulkanDevice->flushCommandBuffer(cmdBuf, queue);
-
-		vkQueueWaitIdle(queue);
-
-		vkDestroyPipeline(device, pipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
-		vkDestroyRenderPass(device, renderpass, nullptr);
-		vkDestroyFramebuffer(device, framebuffer, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
-		vkDestroyDescriptorPool(device, descriptorpool, nullptr);
 
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-		std::cout << "Generating BRDF LUT took " << tDiff << " ms" << std::endl;
+		iblCache.cleanup.push_back([=]() {
+			vkDestroyPipeline(device, pipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
+			vkDestroyRenderPass(device, renderpass, nullptr);
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
+			vkDestroyDescriptorPool(device, descriptorpool, nullptr);
+		});
 	}
 
 	// Generate an irradiance cube map from the environment cube map
-	void generateIrradianceCube()
+	void generateIrradianceCube(VkCommandBuffer cmdBuf)
 	{
-		auto tStart = std::chrono::high_resolution_clock::now();
-
-		const VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT;
-		const int32_t dim = 64;
-		const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+		const VkFormat format = iblCache.irradianceCube.format;
+		const int32_t dim = static_cast<int32_t>(iblCache.irradianceCube.dim);
+		const uint32_t numMips = iblCache.irradianceCube.numMips;
 
 		// Pre-filtered cube map
 		// Image
@@ -506,7 +506,7 @@ public:
 		imageCI.arrayLayers = 6;
 		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &textures.irradianceCube.image));
 		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
@@ -597,7 +597,7 @@ public:
 			VkFramebuffer framebuffer;
 		} offscreen;
 
-		// Offfscreen framebuffer
+		// Offscreen framebuffer
 		{
 			// Color attachment
 			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
@@ -645,14 +645,12 @@ public:
 			fbufCreateInfo.layers = 1;
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreen.framebuffer));
 
-			VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 			vks::tools::setImageLayout(
-				layoutCmd,
+				cmdBuf,
 				offscreen.image,
 				VK_IMAGE_ASPECT_COLOR_BIT,
 				VK_IMAGE_LAYOUT_UNDEFINED,
 				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
 		}
 
 		// Descriptors
@@ -680,9 +678,11 @@ public:
 		struct PushBlock {
 			glm::mat4 mvp;
 			// Sampling deltas
-			float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
-			float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
+			float deltaPhi;
+			float deltaTheta;
 		} pushBlock;
+		pushBlock.deltaPhi = iblCache.sampling.irradianceDeltaPhi;
+		pushBlock.deltaTheta = iblCache.sampling.irradianceDeltaTheta;
 
 		VkPipelineLayout pipelinelayout;
 		std::vector<VkPushConstantRange> pushConstantRanges = {
@@ -752,8 +752,6 @@ public:
 			glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
 		};
 
-		VkCommandBuffer cmdBuf = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
 		VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
 		VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
 
@@ -847,32 +845,26 @@ public:
 			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			subresourceRange);
 
-		vulkanDevice->flushCommandBuffer(cmdBuf, queue);
-
-		vkDestroyRenderPass(device, renderpass, nullptr);
-		vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
-		vkFreeMemory(device, offscreen.memory, nullptr);
-		vkDestroyImageView(device, offscreen.view, nullptr);
-		vkDestroyImage(device, offscreen.image, nullptr);
-		vkDestroyDescriptorPool(device, descriptorpool, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
-		vkDestroyPipeline(device, pipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
-
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-		std::cout << "Generating irradiance cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+		iblCache.cleanup.push_back([=]() {
+			vkDestroyRenderPass(device, renderpass, nullptr);
+			vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
+			vkFreeMemory(device, offscreen.memory, nullptr);
+			vkDestroyImageView(device, offscreen.view, nullptr);
+			vkDestroyImage(device, offscreen.image, nullptr);
+			vkDestroyDescriptorPool(device, descriptorpool, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
+			vkDestroyPipeline(device, pipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
+		});
 	}
 
 	// Prefilter environment cubemap
 	// See https://placeholderart.wordpress.com/2015/07/28/implementation-notes-runtime-environment-map-filtering-for-image-based-lighting/
-	void generatePrefilteredCube()
+	void generatePrefilteredCube(VkCommandBuffer cmdBuf)
 	{
-		auto tStart = std::chrono::high_resolution_clock::now();
-
-		const VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
-		const int32_t dim = 512;
-		const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+		const VkFormat format = iblCache.prefilteredCube.format;
+		const int32_t dim = static_cast<int32_t>(iblCache.prefilteredCube.dim);
+		const uint32_t numMips = iblCache.prefilteredCube.numMips;
 
 		// Pre-filtered cube map
 		// Image
@@ -886,7 +878,7 @@ public:
 		imageCI.arrayLayers = 6;
 		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &textures.prefilteredCube.image));
 		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
@@ -1025,14 +1017,12 @@ public:
 			fbufCreateInfo.layers = 1;
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreen.framebuffer));
 
-			VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 			vks::tools::setImageLayout(
-				layoutCmd,
+				cmdBuf,
 				offscreen.image,
 				VK_IMAGE_ASPECT_COLOR_BIT,
 				VK_IMAGE_LAYOUT_UNDEFINED,
 				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
 		}
 
 		// Descriptors
@@ -1060,8 +1050,9 @@ public:
 		struct PushBlock {
 			glm::mat4 mvp;
 			float roughness;
-			uint32_t numSamples = 32u;
+			uint32_t numSamples;
 		} pushBlock;
+		pushBlock.numSamples = iblCache.sampling.prefilterSampleCount;
 
 		VkPipelineLayout pipelinelayout;
 		std::vector<VkPushConstantRange> pushConstantRanges = {
@@ -1131,8 +1122,6 @@ public:
 			glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
 		};
 
-		VkCommandBuffer cmdBuf = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
 		VkViewport viewport = vks::initializers::viewport((float)dim, (float)dim, 0.0f, 1.0f);
 		VkRect2D scissor = vks::initializers::rect2D(dim, dim, 0, 0);
 
@@ -1227,21 +1216,31 @@ public:
 			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			subresourceRange);
 
-		vulkanDevice->flushCommandBuffer(cmdBuf, queue);
-
-		vkDestroyRenderPass(device, renderpass, nullptr);
-		vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
-		vkFreeMemory(device, offscreen.memory, nullptr);
-		vkDestroyImageView(device, offscreen.view, nullptr);
-		vkDestroyImage(device, offscreen.image, nullptr);
-		vkDestroyDescriptorPool(device, descriptorpool, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
-		vkDestroyPipeline(device, pipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
-
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-		std::cout << "Generating pre-filtered enivornment cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+		iblCache.cleanup.push_back([=]() {
+			vkDestroyRenderPass(device, renderpass, nullptr);
+			vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
+			vkFreeMemory(device, offscreen.memory, nullptr);
+			vkDestroyImageView(device, offscreen.view, nullptr);
+			vkDestroyImage(device, offscreen.image, nullptr);
+			vkDestroyDescriptorPool(device, descriptorpool, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorsetlayout, nullptr);
+			vkDestroyPipeline(device, pipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
+		});
+	}
+
+	// Load the image based lighting maps from the cache or generate them with a single submission
+	void prepareIBLMaps()
+	{
+		const std::string shadersPath = getShadersPath() + "pbrtexture/";
+		const std::vector<std::string> shaderFiles = {
+			shadersPath + "genbrdflut.vert.spv", shadersPath + "genbrdflut.frag.spv", shadersPath + "filtercube.vert.spv", shadersPath + "irradiancecube.frag.spv", shadersPath + "prefilterenvmap.frag.spv"
+		};
+		iblCache.prepare(vulkanDevice, queue, "pbrtexture", getAssetPath() + environmentMapFile, shaderFiles, textures.lutBrdf, textures.irradianceCube, textures.prefilteredCube, [this](VkCommandBuffer cmdBuf) {
+			generateBRDFLUT(cmdBuf);
+			generateIrradianceCube(cmdBuf);
+			generatePrefilteredCube(cmdBuf);
+		});
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -1306,9 +1305,7 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
-		generateBRDFLUT();
-		generateIrradianceCube();
-		generatePrefilteredCube();
+		prepareIBLMaps();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
@@ -2,6 +2,7 @@
 * Vulkan Example - Using different pipelines in a single renderpass
 * 
 * This sample shows how to setup multiple graphics pipelines and how to use them for drawing objects with differring visuals
+* Layouts and pipelines are created through the base class' pipeline manager, which deduplicates them and compiles the derived pipelines on background threads
 *
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
@@ -29,9 +30,11 @@ public:
 
 	struct {
 		VkPipeline phong{ VK_NULL_HANDLE };
-		VkPipeline wireframe{ VK_NULL_HANDLE };
-		VkPipeline toon{ VK_NULL_HANDLE };
+		vks::PipelineRequest wireframe;
+		vks::PipelineRequest toon;
 	} pipelines;
+	// Set while pipelines are still being compiled in the background, command buffers are rebuilt once they are ready
+	bool pipelinesPending{ false };
 
 	VulkanExample() : VulkanExampleBase()
 	{
@@ -46,16 +49,8 @@ public:
 	~VulkanExample()
 	{
 		if (device) {
-			vkDestroyPipeline(device, pipelines.phong, nullptr);
-			if (enabledFeatures.fillModeNonSolid)
-			{
-				vkDestroyPipeline(device, pipelines.wireframe, nullptr);
-			}
-			vkDestroyPipeline(device, pipelines.toon, nullptr);
-
-			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-
+			// Pipelines and layouts are owned by the pipeline manager, but background compilations must be finished before the example's resources are released
+			pipelineManager.wait();
 			uniformBuffer.destroy();
 		}
 	}
@@ -118,7 +113,7 @@ public:
 			// Center : Render the scene using a toon style pipeline
 			viewport.x = (float)width / 3.0f;
 			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.toon);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.toon.get());
 			// Line width > 1.0f only if wide lines feature is supported
 			if (enabledFeatures.wideLines) {
 				vkCmdSetLineWidth(drawCmdBuffers[i], 2.0f);
@@ -129,7 +124,7 @@ public:
 			if (enabledFeatures.fillModeNonSolid) {
 				viewport.x = (float)width / 3.0f + (float)width / 3.0f;
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.wireframe);
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.wireframe.get());
 				scene.draw(drawCmdBuffers[i]);
 			}
 
@@ -162,7 +157,7 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0)
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
-		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
+		descriptorSetLayout = pipelineManager.getDescriptorSetLayout(descriptorLayout);
 
 		// Set
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
@@ -179,7 +174,7 @@ public:
 	{
 		// Layout
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+		pipelineLayout = pipelineManager.getPipelineLayout(pipelineLayoutCreateInfo);
 
 		// Pipelines
 		
@@ -219,7 +214,8 @@ public:
 		// Phong shading pipeline
 		shaderStages[0] = loadShader(getShadersPath() + "pipelines/phong.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "pipelines/phong.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.phong));
+		// The base pipeline is compiled on the calling thread, as it's used as the fallback for the other pipelines
+		pipelines.phong = pipelineManager.getGraphicsPipeline(pipelineCI);
 
 		// All pipelines created after the base pipeline will be derivatives
 		pipelineCI.flags = VK_PIPELINE_CREATE_DERIVATIVE_BIT;
@@ -229,10 +225,13 @@ public:
 		// As we use the handle, we must set the index to -1 (see section 9.5 of the specification)
 		pipelineCI.basePipelineIndex = -1;
 
+		// The remaining pipelines are compiled on worker threads, until they're ready the phong pipeline is used instead
+		// All state referenced by the create info is copied by the pipeline manager, so it's safe to change it for the next request
+
 		// Toon shading pipeline
 		shaderStages[0] = loadShader(getShadersPath() + "pipelines/toon.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "pipelines/toon.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.toon));
+		pipelines.toon = pipelineManager.requestGraphicsPipeline(pipelineCI, pipelines.phong);
 
 		// Pipeline for wire frame rendering
 		// Non solid rendering is not a mandatory Vulkan feature
@@ -240,8 +239,10 @@ public:
 			rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
 			shaderStages[0] = loadShader(getShadersPath() + "pipelines/wireframe.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 			shaderStages[1] = loadShader(getShadersPath() + "pipelines/wireframe.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.wireframe));
+			pipelines.wireframe = pipelineManager.requestGraphicsPipeline(pipelineCI, pipelines.phong);
 		}
+
+		pipelinesPending = true;
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -286,12 +287,22 @@ public:
 	{
 		if (!prepared)
 			return;
+		// Once all background compilations are done, command buffers are rebuilt to use the final pipelines instead of the fallback
+		if (pipelinesPending && (pipelineManager.pendingCount() == 0)) {
+			pipelinesPending = false;
+			vkQueueWaitIdle(queue);
+			buildCommandBuffers();
+		}
 		updateUniformBuffers();
 		draw();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
+		if (overlay->header("Pipelines")) {
+			overlay->text("Compiling: %d", pipelineManager.pendingCount());
+			overlay->text("Cache hits: %d", pipelineManager.cacheHits());
+		}
 		if (!enabledFeatures.fillModeNonSolid) {
 			if (overlay->header("Info")) {
 				overlay->text("Non solid fill modes not supported!");
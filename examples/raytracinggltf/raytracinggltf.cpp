@@ -13,8 +13,25 @@
 class VulkanExample : public VulkanRaytracingSample
 {
 public:
-	AccelerationStructure bottomLevelAS{};
-	AccelerationStructure topLevelAS{};
+	// One bottom level acceleration structure per glTF node with a mesh, built in one batch and compacted
+	std::vector<AccelerationStructure> bottomLevelASes;
+	// Index of the first geometry node of each bottom level acceleration structure, passed as the instance's custom index
+	std::vector<uint32_t> bottomLevelGeometryOffsets;
+	// Refitted every frame while instances are animated
+	vks::DynamicTopLevelAccelerationStructure topLevelAS;
+	vks::AccelerationStructureBuilder accelerationStructureBuilder;
+
+	// The model is instanced on a square grid, with one top level instance per bottom level acceleration structure and grid cell
+	const std::vector<uint32_t> gridSizes = { 1, 16, 64, 128 };
+	int32_t gridSizeIndex{ 0 };
+	const float gridSpacing{ 0.75f };
+	bool animate{ false };
+	bool instancesChanged{ false };
+	float animationTime{ 0.0f };
+	VkCommandBuffer topLevelASCommandBuffer{ VK_NULL_HANDLE };
+	VkQueryPool timestampQueryPool{ VK_NULL_HANDLE };
+	// GPU time of the last top level acceleration structure update in ms
+	float topLevelASUpdateTime{ 0.0f };
 
 	vks::Buffer vertexBuffer;
 	vks::Buffer indexBuffer;
@@ -78,8 +95,15 @@ public:
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 			deleteStorageImage();
-			deleteAccelerationStructure(bottomLevelAS);
-			deleteAccelerationStructure(topLevelAS);
+			for (auto& bottomLevelAS : bottomLevelASes) {
+				deleteAccelerationStructure(bottomLevelAS);
+			}
+			topLevelAS.destroy();
+			// Releases the buffer shared by the compacted bottom level acceleration structures
+			accelerationStructureBuilder.destroy();
+			if (timestampQueryPool != VK_NULL_HANDLE) {
+				vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+			}
 			vertexBuffer.destroy();
 			indexBuffer.destroy();
 			transformBuffer.destroy();
@@ -91,31 +115,10 @@ public:
 		}
 	}
 
-	void createAccelerationStructureBuffer(AccelerationStructure &accelerationStructure, VkAccelerationStructureBuildSizesInfoKHR buildSizeInfo)
-	{
-		VkBufferCreateInfo bufferCreateInfo{};
-		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCreateInfo.size = buildSizeInfo.accelerationStructureSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-		VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &accelerationStructure.buffer));
-		VkMemoryRequirements memoryRequirements{};
-		vkGetBufferMemoryRequirements(device, accelerationStructure.buffer, &memoryRequirements);
-		VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
-		memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-		memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-		VkMemoryAllocateInfo memoryAllocateInfo{};
-		memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memoryAllocateInfo.pNext = &memoryAllocateFlagsInfo;
-		memoryAllocateInfo.allocationSize = memoryRequirements.size;
-		memoryAllocateInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &accelerationStructure.memory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device, accelerationStructure.buffer, accelerationStructure.memory, 0));
-	}
-
 	/*
-		Create the bottom level acceleration structure that contains the scene's actual geometry (vertices, triangles)
+		Create the bottom level acceleration structures that contain the scene's actual geometry (vertices, triangles)
 	*/
-	void createBottomLevelAccelerationStructure()
+	void createBottomLevelAccelerationStructures()
 	{
 		// Use transform matrices from the glTF nodes
 		std::vector<VkTransformMatrixKHR> transformMatrices{};
@@ -139,62 +142,65 @@ public:
 			&transformBuffer,
 			static_cast<uint32_t>(transformMatrices.size()) * sizeof(VkTransformMatrixKHR),
 			transformMatrices.data()));
-		
+
 		// Build
-		// One geometry per glTF node, so we can index materials using gl_GeometryIndexEXT
-		uint32_t maxPrimCount{ 0 };
-		std::vector<uint32_t> maxPrimitiveCounts{};
-		std::vector<VkAccelerationStructureGeometryKHR> geometries{};
-		std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRangeInfos{};
-		std::vector<VkAccelerationStructureBuildRangeInfoKHR*> pBuildRangeInfos{};
+		// One acceleration structure per glTF node and one geometry per primitive, so we can index materials using gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT
+		struct NodeGeometries {
+			std::vector<VkAccelerationStructureGeometryKHR> geometries;
+			std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRangeInfos;
+		};
+		std::vector<NodeGeometries> nodeGeometries{};
 		std::vector<GeometryNode> geometryNodes{};
+		bottomLevelGeometryOffsets.clear();
 		for (auto node : model.linearNodes) {
-			if (node->mesh) {
-				for (auto primitive : node->mesh->primitives) {
-					if (primitive->indexCount > 0) {
-						VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress{};
-						VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress{};
-						VkDeviceOrHostAddressConstKHR transformBufferDeviceAddress{};
-
-						vertexBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(model.vertices.buffer);// +primitive->firstVertex * sizeof(vkglTF::Vertex);
-						indexBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(model.indices.buffer) + primitive->firstIndex * sizeof(uint32_t);
-						transformBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(transformBuffer.buffer) + static_cast<uint32_t>(geometryNodes.size()) * sizeof(VkTransformMatrixKHR);
-
-						VkAccelerationStructureGeometryKHR geometry{};
-						geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-						geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-						geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-						geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-						geometry.geometry.triangles.vertexData = vertexBufferDeviceAddress;
-						geometry.geometry.triangles.maxVertex = model.vertices.count;
-						//geometry.geometry.triangles.maxVertex = primitive->vertexCount;
-						geometry.geometry.triangles.vertexStride = sizeof(vkglTF::Vertex);
-						geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
-						geometry.geometry.triangles.indexData = indexBufferDeviceAddress;
-						geometry.geometry.triangles.transformData = transformBufferDeviceAddress;
-						geometries.push_back(geometry);
-						maxPrimitiveCounts.push_back(primitive->indexCount / 3);
-						maxPrimCount += primitive->indexCount / 3;
-
-						VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
-						buildRangeInfo.firstVertex = 0;
-						buildRangeInfo.primitiveOffset = 0; // primitive->firstIndex * sizeof(uint32_t);
-						buildRangeInfo.primitiveCount = primitive->indexCount / 3;
-						buildRangeInfo.transformOffset = 0;
-						buildRangeInfos.push_back(buildRangeInfo);
-
-						GeometryNode geometryNode{};
-						geometryNode.vertexBufferDeviceAddress = vertexBufferDeviceAddress.deviceAddress;
-						geometryNode.indexBufferDeviceAddress = indexBufferDeviceAddress.deviceAddress;
-						geometryNode.textureIndexBaseColor = primitive->material.baseColorTexture->index;
-						geometryNode.textureIndexOcclusion = primitive->material.occlusionTexture ? primitive->material.occlusionTexture->index : -1;
-						geometryNodes.push_back(geometryNode);
-					}
+			if (!node->mesh) {
+				continue;
+			}
+			NodeGeometries current{};
+			const uint32_t geometryOffset = static_cast<uint32_t>(geometryNodes.size());
+			for (auto primitive : node->mesh->primitives) {
+				if (primitive->indexCount > 0) {
+					VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress{};
+					VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress{};
+					VkDeviceOrHostAddressConstKHR transformBufferDeviceAddress{};
+
+					vertexBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(model.vertices.buffer);// +primitive->firstVertex * sizeof(vkglTF::Vertex);
+					indexBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(model.indices.buffer) + primitive->firstIndex * sizeof(uint32_t);
+					transformBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(transformBuffer.buffer) + static_cast<uint32_t>(geometryNodes.size()) * sizeof(VkTransformMatrixKHR);
+
+					VkAccelerationStructureGeometryKHR geometry{};
+					geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+					geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+					geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+					geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+					geometry.geometry.triangles.vertexData = vertexBufferDeviceAddress;
+					geometry.geometry.triangles.maxVertex = model.vertices.count;
+					//geometry.geometry.triangles.maxVertex = primitive->vertexCount;
+					geometry.geometry.triangles.vertexStride = sizeof(vkglTF::Vertex);
+					geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
+					geometry.geometry.triangles.indexData = indexBufferDeviceAddress;
+					geometry.geometry.triangles.transformData = transformBufferDeviceAddress;
+					current.geometries.push_back(geometry);
+
+					VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
+					buildRangeInfo.firstVertex = 0;
+					buildRangeInfo.primitiveOffset = 0; // primitive->firstIndex * sizeof(uint32_t);
+					buildRangeInfo.primitiveCount = primitive->indexCount / 3;
+					buildRangeInfo.transformOffset = 0;
+					current.buildRangeInfos.push_back(buildRangeInfo);
+
+					GeometryNode geometryNode{};
+					geometryNode.vertexBufferDeviceAddress = vertexBufferDeviceAddress.deviceAddress;
+					geometryNode.indexBufferDeviceAddress = indexBufferDeviceAddress.deviceAddress;
+					geometryNode.textureIndexBaseColor = primitive->material.baseColorTexture->index;
+					geometryNode.textureIndexOcclusion = primitive->material.occlusionTexture ? primitive->material.occlusionTexture->index : -1;
+					geometryNodes.push_back(geometryNode);
 				}
 			}
-		}
-		for (auto& rangeInfo : buildRangeInfos) {
-			pBuildRangeInfos.push_back(&rangeInfo);
+			if (!current.geometries.empty()) {
+				nodeGeometries.push_back(current);
+				bottomLevelGeometryOffsets.push_back(geometryOffset);
+			}
 		}
 
 		vks::Buffer stagingBuffer;
@@ -215,168 +221,82 @@ public:
 		vulkanDevice->copyBuffer(&stagingBuffer, &geometryNodesBuffer, queue);
 
 		stagingBuffer.destroy();
-	
-		// Get size info
-		VkAccelerationStructureBuildGeometryInfoKHR accelerationStructureBuildGeometryInfo{};
-		accelerationStructureBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-		accelerationStructureBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-		accelerationStructureBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-		accelerationStructureBuildGeometryInfo.geometryCount = static_cast<uint32_t>(geometries.size());
-		accelerationStructureBuildGeometryInfo.pGeometries = geometries.data();
-		
-		const uint32_t numTriangles = maxPrimitiveCounts[0];
-
-		VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo{};
-		accelerationStructureBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
-		vkGetAccelerationStructureBuildSizesKHR(
-			device,
-			VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-			&accelerationStructureBuildGeometryInfo,
-			maxPrimitiveCounts.data(),
-			&accelerationStructureBuildSizesInfo);
-
-		createAccelerationStructureBuffer(bottomLevelAS, accelerationStructureBuildSizesInfo);
-
-		VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo{};
-		accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-		accelerationStructureCreateInfo.buffer = bottomLevelAS.buffer;
-		accelerationStructureCreateInfo.size = accelerationStructureBuildSizesInfo.accelerationStructureSize;
-		accelerationStructureCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-		vkCreateAccelerationStructureKHR(device, &accelerationStructureCreateInfo, nullptr, &bottomLevelAS.handle);
-
-		// Create a small scratch buffer used during build of the bottom level acceleration structure
-		ScratchBuffer scratchBuffer = createScratchBuffer(accelerationStructureBuildSizesInfo.buildScratchSize);
-
-		accelerationStructureBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-		accelerationStructureBuildGeometryInfo.dstAccelerationStructure = bottomLevelAS.handle;
-		accelerationStructureBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress;
 
-		const VkAccelerationStructureBuildRangeInfoKHR* buildOffsetInfo = buildRangeInfos.data();
-
-		// Build the acceleration structure on the device via a one-time command buffer submission
+		// Build all acceleration structures on the device with a single submission sharing one scratch buffer, then compact them
 		// Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
-		VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		vkCmdBuildAccelerationStructuresKHR(
-			commandBuffer,
-			1,
-			&accelerationStructureBuildGeometryInfo,
-			pBuildRangeInfos.data());
-		vulkanDevice->flushCommandBuffer(commandBuffer, queue);
-
-		VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo{};
-		accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-		accelerationDeviceAddressInfo.accelerationStructure = bottomLevelAS.handle;
-		bottomLevelAS.deviceAddress = vkGetAccelerationStructureDeviceAddressKHR(device, &accelerationDeviceAddressInfo);
+		bottomLevelASes.resize(nodeGeometries.size());
+		for (size_t i = 0; i < nodeGeometries.size(); i++) {
+			accelerationStructureBuilder.addBottomLevel(&bottomLevelASes[i], nodeGeometries[i].geometries, nodeGeometries[i].buildRangeInfos);
+		}
+		accelerationStructureBuilder.build(queue);
 
-		deleteScratchBuffer(scratchBuffer);
+		const vks::AccelerationStructureBuilder::Statistics& stats = accelerationStructureBuilder.statistics;
+		std::cout << "Built " << stats.count << " bottom level acceleration structures in " << stats.batchCount << " batch(es) in " << stats.milliseconds << " ms" << std::endl;
+		std::cout << "Scratch memory: " << stats.scratchSize / 1024 << " KB shared (" << stats.unbatchedScratchSize / 1024 << " KB with one buffer per build)" << std::endl;
+		std::cout << "Acceleration structure memory: " << stats.memoryBeforeCompaction / 1024 << " KB before compaction, " << stats.memoryAfterCompaction / 1024 << " KB after compaction" << std::endl;
 	}
 
 	/*
 		The top level acceleration structure contains the scene's object instances
+		It's created for the largest grid and allows updates, so animated instances only need to be refitted
 	*/
 	void createTopLevelAccelerationStructure()
 	{
-		// We flip the matrix [1][1] = -1.0f to accomodate for the glTF up vector
-		VkTransformMatrixKHR transformMatrix = {
-			1.0f, 0.0f, 0.0f, 0.0f,
-			0.0f, -1.0f, 0.0f, 0.0f,
-			0.0f, 0.0f, 1.0f, 0.0f };
-
-		VkAccelerationStructureInstanceKHR instance{};
-		instance.transform = transformMatrix;
-		instance.instanceCustomIndex = 0;
-		instance.mask = 0xFF;
-		instance.instanceShaderBindingTableRecordOffset = 0;
-		instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-		instance.accelerationStructureReference = bottomLevelAS.deviceAddress;
-
-		// Buffer for instance data
-		vks::Buffer instancesBuffer;
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&instancesBuffer,
-			sizeof(VkAccelerationStructureInstanceKHR),
-			&instance));
-
-		VkDeviceOrHostAddressConstKHR instanceDataDeviceAddress{};
-		instanceDataDeviceAddress.deviceAddress = getBufferDeviceAddress(instancesBuffer.buffer);
-
-		VkAccelerationStructureGeometryKHR accelerationStructureGeometry{};
-		accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-		accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-		accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-		accelerationStructureGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
-		accelerationStructureGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
-		accelerationStructureGeometry.geometry.instances.data = instanceDataDeviceAddress;
-
-		// Get size info
-		/*
-		The pSrcAccelerationStructure, dstAccelerationStructure, and mode members of pBuildInfo are ignored. Any VkDeviceOrHostAddressKHR members of pBuildInfo are ignored by this command, except that the hostAddress member of VkAccelerationStructureGeometryTrianglesDataKHR::transformData will be examined to check if it is NULL.*
-		*/
-		VkAccelerationStructureBuildGeometryInfoKHR accelerationStructureBuildGeometryInfo{};
-		accelerationStructureBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-		accelerationStructureBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-		accelerationStructureBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-		accelerationStructureBuildGeometryInfo.geometryCount = 1;
-		accelerationStructureBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
-
-		uint32_t primitive_count = 1;
-
-		VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo{};
-		accelerationStructureBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
-		vkGetAccelerationStructureBuildSizesKHR(
-			device, 
-			VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-			&accelerationStructureBuildGeometryInfo,
-			&primitive_count,
-			&accelerationStructureBuildSizesInfo);
-
-		createAccelerationStructureBuffer(topLevelAS, accelerationStructureBuildSizesInfo);
-
-		VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo{};
-		accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-		accelerationStructureCreateInfo.buffer = topLevelAS.buffer;
-		accelerationStructureCreateInfo.size = accelerationStructureBuildSizesInfo.accelerationStructureSize;
-		accelerationStructureCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-		vkCreateAccelerationStructureKHR(device, &accelerationStructureCreateInfo, nullptr, &topLevelAS.handle);
-
-		// Create a small scratch buffer used during build of the top level acceleration structure
-		ScratchBuffer scratchBuffer = createScratchBuffer(accelerationStructureBuildSizesInfo.buildScratchSize);
-
-		VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo{};
-		accelerationBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-		accelerationBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-		accelerationBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-		accelerationBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-		accelerationBuildGeometryInfo.dstAccelerationStructure = topLevelAS.handle;
-		accelerationBuildGeometryInfo.geometryCount = 1;
-		accelerationBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
-		accelerationBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress;
-
-		VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo{};
-		accelerationStructureBuildRangeInfo.primitiveCount = 1;
-		accelerationStructureBuildRangeInfo.primitiveOffset = 0;
-		accelerationStructureBuildRangeInfo.firstVertex = 0;
-		accelerationStructureBuildRangeInfo.transformOffset = 0;
-		std::vector<VkAccelerationStructureBuildRangeInfoKHR*> accelerationBuildStructureRangeInfos = { &accelerationStructureBuildRangeInfo };
-
-		// Build the acceleration structure on the device via a one-time command buffer submission
-		// Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
+		const uint32_t maxGridSize = gridSizes.back();
+		topLevelAS.create(&accelerationStructureBuilder, maxGridSize * maxGridSize * static_cast<uint32_t>(bottomLevelASes.size()));
+		topLevelAS.referenceSize = gridSpacing;
+
 		VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		vkCmdBuildAccelerationStructuresKHR(
-			commandBuffer,
-			1,
-			&accelerationBuildGeometryInfo,
-			accelerationBuildStructureRangeInfos.data());
+		topLevelAS.record(commandBuffer, updateInstances());
 		vulkanDevice->flushCommandBuffer(commandBuffer, queue);
 
-		VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo{};
-		accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-		accelerationDeviceAddressInfo.accelerationStructure = topLevelAS.handle;
+		// Per-frame updates are recorded into a separate command buffer and submitted with the ray tracing command buffer
+		VkCommandBufferAllocateInfo commandBufferAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &topLevelASCommandBuffer));
 
-		deleteScratchBuffer(scratchBuffer);
-		instancesBuffer.destroy();
+		if (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0) {
+			VkQueryPoolCreateInfo queryPoolInfo{};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool));
+		}
+	}
+
+	/*
+		Write the instances of the current grid to the top level acceleration structure's mapped instance buffer, returns the number of instances
+	*/
+	uint32_t updateInstances()
+	{
+		const uint32_t gridSize = gridSizes[gridSizeIndex];
+		const float gridOffset = (float)(gridSize - 1) * gridSpacing * 0.5f;
+		uint32_t instanceIndex = 0;
+		for (uint32_t z = 0; z < gridSize; z++) {
+			for (uint32_t x = 0; x < gridSize; x++) {
+				// Each model rotates around the up axis and bobs up and down with its own phase
+				const float phase = (float)(x * 7 + z * 13) * 0.37f;
+				const float angle = animate ? animationTime + phase : 0.0f;
+				const float height = animate ? sin(animationTime * 2.0f + phase) * 0.1f : 0.0f;
+				const float c = cos(angle);
+				const float s = sin(angle);
+				// We flip the matrix [1][1] = -1.0f to accomodate for the glTF up vector
+				const VkTransformMatrixKHR transformMatrix = {
+					c, 0.0f, s, (float)x * gridSpacing - gridOffset,
+					0.0f, -1.0f, 0.0f, height,
+					-s, 0.0f, c, (float)z * gridSpacing - gridOffset };
+				// One instance per bottom level acceleration structure, the custom index points to its first geometry node
+				for (size_t i = 0; i < bottomLevelASes.size(); i++) {
+					VkAccelerationStructureInstanceKHR& instance = topLevelAS.instances[instanceIndex++];
+					instance.transform = transformMatrix;
+					instance.instanceCustomIndex = bottomLevelGeometryOffsets[i];
+					instance.mask = 0xFF;
+					instance.instanceShaderBindingTableRecordOffset = 0;
+					instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+					instance.accelerationStructureReference = bottomLevelASes[i].deviceAddress;
+				}
+			}
+		}
+		return instanceIndex;
 	}
 
 	/*
@@ -549,7 +469,7 @@ public:
 
 		VkWriteDescriptorSetAccelerationStructureKHR descriptorAccelerationStructureInfo = vks::initializers::writeDescriptorSetAccelerationStructureKHR();
 		descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
-		descriptorAccelerationStructureInfo.pAccelerationStructures = &topLevelAS.handle;
+		descriptorAccelerationStructureInfo.pAccelerationStructures = &topLevelAS.accelerationStructure.handle;
 
 		VkWriteDescriptorSet accelerationStructureWrite{};
 		accelerationStructureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -760,7 +680,8 @@ public:
 		loadAssets();
 
 		// Create the acceleration structures used to render the ray traced scene
-		createBottomLevelAccelerationStructure();
+		accelerationStructureBuilder.init(vulkanDevice);
+		createBottomLevelAccelerationStructures();
 		createTopLevelAccelerationStructure();
 
 		createStorageImage(swapChain.colorFormat, { width, height, 1 });
@@ -775,8 +696,35 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		std::vector<VkCommandBuffer> commandBuffers = { drawCmdBuffers[currentBuffer] };
+		if (animate || instancesChanged) {
+			// The previous frame has finished (submitFrame waits for the queue to become idle), so the instance buffer and the timestamps can be accessed
+			if (timestampQueryPool != VK_NULL_HANDLE && topLevelAS.statistics.refitCount + topLevelAS.statistics.rebuildCount > 1) {
+				uint64_t timestamps[2] = {};
+				if (vkGetQueryPoolResults(device, timestampQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+					topLevelASUpdateTime = (float)(timestamps[1] - timestamps[0]) * deviceProperties.limits.timestampPeriod / 1000000.0f;
+				}
+			}
+			if (animate && !paused) {
+				animationTime += frameTimer;
+			}
+			const uint32_t instanceCount = updateInstances();
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			VK_CHECK_RESULT(vkBeginCommandBuffer(topLevelASCommandBuffer, &cmdBufInfo));
+			if (timestampQueryPool != VK_NULL_HANDLE) {
+				vkCmdResetQueryPool(topLevelASCommandBuffer, timestampQueryPool, 0, 2);
+				vkCmdWriteTimestamp(topLevelASCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, 0);
+			}
+			topLevelAS.record(topLevelASCommandBuffer, instanceCount);
+			if (timestampQueryPool != VK_NULL_HANDLE) {
+				vkCmdWriteTimestamp(topLevelASCommandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, timestampQueryPool, 1);
+			}
+			VK_CHECK_RESULT(vkEndCommandBuffer(topLevelASCommandBuffer));
+			commandBuffers.insert(commandBuffers.begin(), topLevelASCommandBuffer);
+			instancesChanged = false;
+		}
+		submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+		submitInfo.pCommandBuffers = commandBuffers.data();
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 		VulkanExampleBase::submitFrame();
 	}
@@ -786,12 +734,44 @@ public:
 		if (!prepared)
 			return;
 		updateUniformBuffers();
-		if (camera.updated) {
-			// If the camera's view has been updated we reset the frame accumulation
+		if (camera.updated || animate || instancesChanged) {
+			// If the camera's view or the instances have been updated we reset the frame accumulation
 			uniformData.frame = -1;
 		}
 		draw();
 	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay)
+	{
+		if (overlay->header("Acceleration structures")) {
+			const vks::AccelerationStructureBuilder::Statistics& stats = accelerationStructureBuilder.statistics;
+			overlay->text("BLAS count: %d (%d batch(es))", stats.count, stats.batchCount);
+			overlay->text("Build time: %.2f ms", stats.milliseconds);
+			overlay->text("Scratch: %.2f MB (unbatched %.2f MB)", stats.scratchSize / (1024.0f * 1024.0f), stats.unbatchedScratchSize / (1024.0f * 1024.0f));
+			overlay->text("Memory: %.2f MB, compacted %.2f MB", stats.memoryBeforeCompaction / (1024.0f * 1024.0f), stats.memoryAfterCompaction / (1024.0f * 1024.0f));
+		}
+		if (overlay->header("Instances")) {
+			std::vector<std::string> gridNames;
+			for (uint32_t gridSize : gridSizes) {
+				gridNames.push_back(std::to_string(gridSize) + " x " + std::to_string(gridSize));
+			}
+			if (overlay->comboBox("Grid", &gridSizeIndex, gridNames)) {
+				instancesChanged = true;
+			}
+			if (overlay->checkBox("Animate", &animate)) {
+				instancesChanged = true;
+			}
+			overlay->sliderFloat("Rebuild threshold", &topLevelAS.rebuildThreshold, 0.0f, 2.0f);
+			const vks::DynamicTopLevelAccelerationStructure::Statistics& tlasStats = topLevelAS.statistics;
+			const uint32_t gridSize = gridSizes[gridSizeIndex];
+			overlay->text("TLAS instances: %d", gridSize * gridSize * static_cast<uint32_t>(bottomLevelASes.size()));
+			overlay->text("Refits: %d, rebuilds: %d", tlasStats.refitCount, tlasStats.rebuildCount);
+			overlay->text("Degradation: %.3f (%d refits since rebuild)", tlasStats.degradation, tlasStats.refitsSinceRebuild);
+			if (timestampQueryPool != VK_NULL_HANDLE) {
+				overlay->text("Last %s: %.3f ms", tlasStats.lastWasRebuild ? "rebuild" : "refit", topLevelASUpdateTime);
+			}
+		}
+	}
 };
 
 VULKAN_EXAMPLE_MAIN()
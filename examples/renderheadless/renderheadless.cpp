@@ -1,6 +1,9 @@
 /*
 * Vulkan Example - Minimal headless rendering example
 *
+* Renders a sequence of frames (e.g. a camera path) to offscreen targets and stores them to disk
+* Two sets of targets are used, so the GPU renders the next frame while the previous one is read back and written on the host
+*
 * Copyright (C) 2017-2022 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -24,6 +27,8 @@
 #include <array>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <string>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -91,10 +96,24 @@ public:
 		VkImageView view;
 	};
 	int32_t width, height;
-	VkFramebuffer framebuffer;
-	FrameBufferAttachment colorAttachment, depthAttachment;
 	VkRenderPass renderPass;
 
+	// Offscreen targets and readback resources for one frame in flight
+	struct Frame {
+		FrameBufferAttachment colorAttachment, depthAttachment;
+		VkFramebuffer framebuffer;
+		// The color attachment is copied to this buffer in the frame's command buffer
+		VkBuffer readbackBuffer;
+		VkDeviceMemory readbackMemory;
+		const char* readbackData;
+		VkCommandBuffer commandBuffer;
+		VkFence fence;
+		// Index of the frame in the sequence currently using these resources
+		uint32_t frameIndex;
+	};
+	std::array<Frame, 2> frames;
+	uint32_t frameCount{ 1 };
+
 	VkDebugReportCallbackEXT debugReportCallback{};
 
 	uint32_t getMemoryTypeIndex(uint32_t typeBits, VkMemoryPropertyFlags properties) {
@@ -409,14 +428,17 @@ public:
 		}
 
 		/*
-			Create framebuffer attachments
+			Create framebuffer attachments, one set per frame in flight
 		*/
 		width = 1024;
 		height = 1024;
 		VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
 		VkFormat depthFormat;
 		vks::tools::getSupportedDepthFormat(physicalDevice, &depthFormat);
-		{
+		for (auto& frame : frames) {
+			FrameBufferAttachment& colorAttachment = frame.colorAttachment;
+			FrameBufferAttachment& depthAttachment = frame.depthAttachment;
+
 			// Color attachment
 			VkImageCreateInfo image = vks::initializers::imageCreateInfo();
 			image.imageType = VK_IMAGE_TYPE_2D;
@@ -523,12 +545,13 @@ public:
 			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+			// The color attachment is copied to the readback buffer after the render pass
 			dependencies[1].srcSubpass = 0;
 			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
 			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
 			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 			// Create the actual renderpass
@@ -542,18 +565,20 @@ public:
 			renderPassInfo.pDependencies = dependencies.data();
 			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
 
-			VkImageView attachments[2];
-			attachments[0] = colorAttachment.view;
-			attachments[1] = depthAttachment.view;
-
-			VkFramebufferCreateInfo framebufferCreateInfo = vks::initializers::framebufferCreateInfo();
-			framebufferCreateInfo.renderPass = renderPass;
-			framebufferCreateInfo.attachmentCount = 2;
-			framebufferCreateInfo.pAttachments = attachments;
-			framebufferCreateInfo.width = width;
-			framebufferCreateInfo.height = height;
-			framebufferCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferCreateInfo, nullptr, &framebuffer));
+			for (auto& frame : frames) {
+				VkImageView attachments[2];
+				attachments[0] = frame.colorAttachment.view;
+				attachments[1] = frame.depthAttachment.view;
+
+				VkFramebufferCreateInfo framebufferCreateInfo = vks::initializers::framebufferCreateInfo();
+				framebufferCreateInfo.renderPass = renderPass;
+				framebufferCreateInfo.attachmentCount = 2;
+				framebufferCreateInfo.pAttachments = attachments;
+				framebufferCreateInfo.width = width;
+				framebufferCreateInfo.height = height;
+				framebufferCreateInfo.layers = 1;
+				VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferCreateInfo, nullptr, &frame.framebuffer));
+			}
 		}
 
 		/*
@@ -667,217 +692,186 @@ public:
 		}
 
 		/*
-			Command buffer creation
+			Readback buffers, command buffers and fences for the frames in flight
 		*/
 		{
-			VkCommandBuffer commandBuffer;
-			VkCommandBufferAllocateInfo cmdBufAllocateInfo =
-				vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
-			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &commandBuffer));
-
-			VkCommandBufferBeginInfo cmdBufInfo =
-				vks::initializers::commandBufferBeginInfo();
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
-
-			VkClearValue clearValues[2];
-			clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
-			clearValues[1].depthStencil = { 1.0f, 0 };
-
-			VkRenderPassBeginInfo renderPassBeginInfo = {};
-			renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassBeginInfo.renderArea.extent.width = width;
-			renderPassBeginInfo.renderArea.extent.height = height;
-			renderPassBeginInfo.clearValueCount = 2;
-			renderPassBeginInfo.pClearValues = clearValues;
-			renderPassBeginInfo.renderPass = renderPass;
-			renderPassBeginInfo.framebuffer = framebuffer;
-
-			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-			VkViewport viewport = {};
-			viewport.height = (float)height;
-			viewport.width = (float)width;
-			viewport.minDepth = (float)0.0f;
-			viewport.maxDepth = (float)1.0f;
-			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-			// Update dynamic scissor state
-			VkRect2D scissor = {};
-			scissor.extent.width = width;
-			scissor.extent.height = height;
-			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-			// Render scene
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-
-			std::vector<glm::vec3> pos = {
-				glm::vec3(-1.5f, 0.0f, -4.0f),
-				glm::vec3( 0.0f, 0.0f, -2.5f),
-				glm::vec3( 1.5f, 0.0f, -4.0f),
-			};
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+			VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo();
+			for (auto& frame : frames) {
+				// Memory must be host visible to read from, the buffer stays mapped for the whole sequence
+				createBuffer(
+					VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					&frame.readbackBuffer,
+					&frame.readbackMemory,
+					width * height * 4);
+				VK_CHECK_RESULT(vkMapMemory(device, frame.readbackMemory, 0, VK_WHOLE_SIZE, 0, (void**)&frame.readbackData));
+				VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &frame.commandBuffer));
+				VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &frame.fence));
+			}
+		}
 
-			for (auto v : pos) {
-				glm::mat4 mvpMatrix = glm::perspective(glm::radians(60.0f), (float)width / (float)height, 0.1f, 256.0f) * glm::translate(glm::mat4(1.0f), v);
-				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mvpMatrix), &mvpMatrix);
-				vkCmdDrawIndexed(commandBuffer, 3, 1, 0, 0, 0);
+		/*
+			Render the sequence
+			Frame k is submitted before frame k - 1 is waited for and written to disk, so the GPU renders while the host reads back and encodes
+		*/
+		if (commandLineParser.isSet("frames")) {
+			frameCount = std::max(commandLineParser.getValueAsInt("frames", 1), 1);
+		}
+		LOG("Rendering %d frame(s) at %dx%d\n", frameCount, width, height);
+
+		double waitMilliseconds = 0.0;
+		double writeMilliseconds = 0.0;
+		auto tStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < frameCount + 1; i++) {
+			if (i < frameCount) {
+				Frame& frame = frames[i % frames.size()];
+				frame.frameIndex = i;
+				recordCommandBuffer(frame);
+				VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &frame.commandBuffer;
+				VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frame.fence));
 			}
+			if (i > 0) {
+				Frame& frame = frames[(i - 1) % frames.size()];
+				auto tWaitStart = std::chrono::high_resolution_clock::now();
+				VK_CHECK_RESULT(vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+				VK_CHECK_RESULT(vkResetFences(device, 1, &frame.fence));
+				auto tWriteStart = std::chrono::high_resolution_clock::now();
+				saveFrame(frame);
+				auto tWriteEnd = std::chrono::high_resolution_clock::now();
+				waitMilliseconds += std::chrono::duration<double, std::milli>(tWriteStart - tWaitStart).count();
+				writeMilliseconds += std::chrono::duration<double, std::milli>(tWriteEnd - tWriteStart).count();
+			}
+		}
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		const double totalMilliseconds = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 
-			vkCmdEndRenderPass(commandBuffer);
+		LOG("Rendered and saved %d frame(s) in %.2f ms (%.2f frames per second)\n", frameCount, totalMilliseconds, frameCount * 1000.0 / totalMilliseconds);
+		LOG("Average per frame: %.2f ms waiting for the GPU, %.2f ms writing to disk\n", waitMilliseconds / frameCount, writeMilliseconds / frameCount);
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+		vkQueueWaitIdle(queue);
+	}
 
-			submitWork(commandBuffer, queue);
+	/*
+		Record the rendering of a frame and the copy of its color attachment to the frame's readback buffer
+	*/
+	void recordCommandBuffer(Frame& frame)
+	{
+		VkCommandBuffer commandBuffer = frame.commandBuffer;
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = {};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = frame.framebuffer;
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport = {};
+		viewport.height = (float)height;
+		viewport.width = (float)width;
+		viewport.minDepth = (float)0.0f;
+		viewport.maxDepth = (float)1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		// Update dynamic scissor state
+		VkRect2D scissor = {};
+		scissor.extent.width = width;
+		scissor.extent.height = height;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+		// Render scene
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+		std::vector<glm::vec3> pos = {
+			glm::vec3(-1.5f, 0.0f, -4.0f),
+			glm::vec3( 0.0f, 0.0f, -2.5f),
+			glm::vec3( 1.5f, 0.0f, -4.0f),
+		};
 
-			vkDeviceWaitIdle(device);
-		}
+		// The camera swings around the center of the scene over the sequence, the first frame matches a single frame render
+		const float angle = sin(glm::radians(360.0f) * (float)frame.frameIndex / (float)frameCount) * glm::radians(45.0f);
+		const glm::vec3 center = glm::vec3(0.0f, 0.0f, -3.25f);
+		glm::mat4 viewMatrix = glm::translate(glm::mat4(1.0f), center) * glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), -center);
 
-		/*
-			Copy framebuffer image to host visible image
-		*/
-		const char* imagedata;
-		{
-			// Create the linear tiled destination image to copy to and to read the memory from
-			VkImageCreateInfo imgCreateInfo(vks::initializers::imageCreateInfo());
-			imgCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-			imgCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-			imgCreateInfo.extent.width = width;
-			imgCreateInfo.extent.height = height;
-			imgCreateInfo.extent.depth = 1;
-			imgCreateInfo.arrayLayers = 1;
-			imgCreateInfo.mipLevels = 1;
-			imgCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imgCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-			imgCreateInfo.tiling = VK_IMAGE_TILING_LINEAR;
-			imgCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-			// Create the image
-			VkImage dstImage;
-			VK_CHECK_RESULT(vkCreateImage(device, &imgCreateInfo, nullptr, &dstImage));
-			// Create memory to back up the image
-			VkMemoryRequirements memRequirements;
-			VkMemoryAllocateInfo memAllocInfo(vks::initializers::memoryAllocateInfo());
-			VkDeviceMemory dstImageMemory;
-			vkGetImageMemoryRequirements(device, dstImage, &memRequirements);
-			memAllocInfo.allocationSize = memRequirements.size;
-			// Memory must be host visible to copy from
-			memAllocInfo.memoryTypeIndex = getMemoryTypeIndex(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &dstImageMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device, dstImage, dstImageMemory, 0));
-
-			// Do the actual blit from the offscreen image to our host visible destination image
-			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
-			VkCommandBuffer copyCmd;
-			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &copyCmd));
-			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-			VK_CHECK_RESULT(vkBeginCommandBuffer(copyCmd, &cmdBufInfo));
-
-			// Transition destination image to transfer destination layout
-			vks::tools::insertImageMemoryBarrier(
-				copyCmd,
-				dstImage,
-				0,
-				VK_ACCESS_TRANSFER_WRITE_BIT,
-				VK_IMAGE_LAYOUT_UNDEFINED,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-			// colorAttachment.image is already in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, and does not need to be transitioned
-
-			VkImageCopy imageCopyRegion{};
-			imageCopyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageCopyRegion.srcSubresource.layerCount = 1;
-			imageCopyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageCopyRegion.dstSubresource.layerCount = 1;
-			imageCopyRegion.extent.width = width;
-			imageCopyRegion.extent.height = height;
-			imageCopyRegion.extent.depth = 1;
-
-			vkCmdCopyImage(
-				copyCmd,
-				colorAttachment.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1,
-				&imageCopyRegion);
-
-			// Transition destination image to general layout, which is the required layout for mapping the image memory later on
-			vks::tools::insertImageMemoryBarrier(
-				copyCmd,
-				dstImage,
-				VK_ACCESS_TRANSFER_WRITE_BIT,
-				VK_ACCESS_MEMORY_READ_BIT,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				VK_IMAGE_LAYOUT_GENERAL,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-			VK_CHECK_RESULT(vkEndCommandBuffer(copyCmd));
-
-			submitWork(copyCmd, queue);
-
-			// Get layout of the image (including row pitch)
-			VkImageSubresource subResource{};
-			subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			VkSubresourceLayout subResourceLayout;
-
-			vkGetImageSubresourceLayout(device, dstImage, &subResource, &subResourceLayout);
-
-			// Map image memory so we can start copying from it
-			vkMapMemory(device, dstImageMemory, 0, VK_WHOLE_SIZE, 0, (void**)&imagedata);
-			imagedata += subResourceLayout.offset;
+		for (auto v : pos) {
+			glm::mat4 mvpMatrix = glm::perspective(glm::radians(60.0f), (float)width / (float)height, 0.1f, 256.0f) * viewMatrix * glm::translate(glm::mat4(1.0f), v);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mvpMatrix), &mvpMatrix);
+			vkCmdDrawIndexed(commandBuffer, 3, 1, 0, 0, 0);
+		}
 
-		/*
-			Save host visible framebuffer image to disk (ppm format)
-		*/
+		vkCmdEndRenderPass(commandBuffer);
+
+		// The color attachment is already in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL (render pass final layout), and does not need to be transitioned
+		// Copying to a buffer gives tightly packed rows without having to query the layout of a linear image
+		VkBufferImageCopy copyRegion{};
+		copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copyRegion.imageSubresource.layerCount = 1;
+		copyRegion.imageExtent.width = width;
+		copyRegion.imageExtent.height = height;
+		copyRegion.imageExtent.depth = 1;
+		vkCmdCopyImageToBuffer(commandBuffer, frame.colorAttachment.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame.readbackBuffer, 1, &copyRegion);
+
+		// Make the copy visible to the host
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.buffer = frame.readbackBuffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+	}
 
+	/*
+		Save the host visible copy of a frame to disk (ppm format)
+	*/
+	void saveFrame(const Frame& frame)
+	{
+		// A single frame is stored as headless.ppm, sequences get numbered file names
+		std::string filename = "headless.ppm";
+		if (frameCount > 1) {
+			char name[32];
+			snprintf(name, sizeof(name), "headless_%06d.ppm", frame.frameIndex);
+			filename = name;
+		}
 #if defined (VK_USE_PLATFORM_ANDROID_KHR)
-			const char* filename = strcat(getenv("EXTERNAL_STORAGE"), "/headless.ppm");
-#else
-			const char* filename = "headless.ppm";
+		filename = std::string(getenv("EXTERNAL_STORAGE")) + "/" + filename;
 #endif
-			std::ofstream file(filename, std::ios::out | std::ios::binary);
-
-			// ppm header
-			file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
-
-			// If source is BGR (destination is always RGB) and we can't use blit (which does automatic conversion), we'll have to manually swizzle color components
-			// Check if source is BGR and needs swizzle
-			std::vector<VkFormat> formatsBGR = { VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_B8G8R8A8_SNORM };
-			const bool colorSwizzle = (std::find(formatsBGR.begin(), formatsBGR.end(), VK_FORMAT_R8G8B8A8_UNORM) != formatsBGR.end());
-
-			// ppm binary pixel data
-			for (int32_t y = 0; y < height; y++) {
-				unsigned int *row = (unsigned int*)imagedata;
-				for (int32_t x = 0; x < width; x++) {
-					if (colorSwizzle) {
-						file.write((char*)row + 2, 1);
-						file.write((char*)row + 1, 1);
-						file.write((char*)row, 1);
-					}
-					else {
-						file.write((char*)row, 3);
-					}
-					row++;
-				}
-				imagedata += subResourceLayout.rowPitch;
-			}
-			file.close();
-
-			LOG("Framebuffer image saved to %s\n", filename);
-
-			// Clean up resources
-			vkUnmapMemory(device, dstImageMemory);
-			vkFreeMemory(device, dstImageMemory, nullptr);
-			vkDestroyImage(device, dstImage, nullptr);
+		std::ofstream file(filename, std::ios::out | std::ios::binary);
+
+		// ppm header
+		file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
+
+		// The color attachment is RGBA, so only the alpha channel needs to be dropped
+		std::vector<char> rgb(width * height * 3);
+		const char* src = frame.readbackData;
+		for (size_t i = 0; i < static_cast<size_t>(width * height); i++) {
+			rgb[i * 3 + 0] = src[i * 4 + 0];
+			rgb[i * 3 + 1] = src[i * 4 + 1];
+			rgb[i * 3 + 2] = src[i * 4 + 2];
 		}
+		file.write(rgb.data(), rgb.size());
+		file.close();
 
-		vkQueueWaitIdle(queue);
+		if (frameCount == 1) {
+			LOG("Framebuffer image saved to %s\n", filename.c_str());
+		}
 	}
 
 	~VulkanExample()
@@ -886,14 +880,20 @@ public:
 		vkFreeMemory(device, vertexMemory, nullptr);
 		vkDestroyBuffer(device, indexBuffer, nullptr);
 		vkFreeMemory(device, indexMemory, nullptr);
-		vkDestroyImageView(device, colorAttachment.view, nullptr);
-		vkDestroyImage(device, colorAttachment.image, nullptr);
-		vkFreeMemory(device, colorAttachment.memory, nullptr);
-		vkDestroyImageView(device, depthAttachment.view, nullptr);
-		vkDestroyImage(device, depthAttachment.image, nullptr);
-		vkFreeMemory(device, depthAttachment.memory, nullptr);
+		for (auto& frame : frames) {
+			vkDestroyImageView(device, frame.colorAttachment.view, nullptr);
+			vkDestroyImage(device, frame.colorAttachment.image, nullptr);
+			vkFreeMemory(device, frame.colorAttachment.memory, nullptr);
+			vkDestroyImageView(device, frame.depthAttachment.view, nullptr);
+			vkDestroyImage(device, frame.depthAttachment.image, nullptr);
+			vkFreeMemory(device, frame.depthAttachment.memory, nullptr);
+			vkDestroyFramebuffer(device, frame.framebuffer, nullptr);
+			vkUnmapMemory(device, frame.readbackMemory);
+			vkDestroyBuffer(device, frame.readbackBuffer, nullptr);
+			vkFreeMemory(device, frame.readbackMemory, nullptr);
+			vkDestroyFence(device, frame.fence, nullptr);
+		}
 		vkDestroyRenderPass(device, renderPass, nullptr);
-		vkDestroyFramebuffer(device, framebuffer, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 		vkDestroyPipeline(device, pipeline, nullptr);
@@ -943,6 +943,7 @@ void android_main(android_app* state) {
 int main(int argc, char* argv[]) {
 	commandLineParser.add("help", { "--help" }, 0, "Show help");
 	commandLineParser.add("shaders", { "-s", "--shaders" }, 1, "Select shader type to use (glsl or hlsl)");
+	commandLineParser.add("frames", { "-f", "--frames" }, 1, "Number of frames to render and save (default 1)");
 	commandLineParser.parse(argc, argv);
 	if (commandLineParser.isSet("help")) {
 		commandLineParser.printHelp();
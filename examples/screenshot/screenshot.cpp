@@ -1,15 +1,23 @@
 /*
 * Vulkan Example - Taking screenshots
 * 
-* This sample shows how to get the conents of the swapchain (render output) and store them to disk (see saveScreenshot)
+* This sample shows how to get the conents of the swapchain (render output) and store them to disk (see captureFrame)
+* Readbacks go through a ring of host visible buffers and are encoded on worker threads, so frames can be captured continuously without stalling rendering
 *
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "threadpool.hpp"
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -29,7 +37,42 @@ public:
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 
-	bool screenshotSaved{ false };
+	enum class ImageFormat { PNG = 0, QOI = 1 };
+	int32_t imageFormat{ static_cast<int32_t>(ImageFormat::PNG) };
+
+	// Ring of host visible buffers the swapchain images are copied to
+	// A slot is copying until its fence is signaled, then encoded on a worker thread and free again once the file has been written
+	enum class SlotState { Free, Copying, Encoding };
+	struct ReadbackSlot {
+		vks::Buffer buffer;
+		VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+		VkFence fence{ VK_NULL_HANDLE };
+		std::atomic<SlotState> state{ SlotState::Free };
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		bool swizzle{ false };
+		ImageFormat format{ ImageFormat::PNG };
+		std::string fileName;
+		bool screenshot{ false };
+	};
+	static const uint32_t maxReadbackSlots = 6;
+	std::array<ReadbackSlot, maxReadbackSlots> readbackSlots;
+	uint32_t readbackSlotCount{ 0 };
+	VkMemoryPropertyFlags readbackMemoryFlags{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT };
+	vks::ThreadPool threadPool;
+	uint32_t nextEncodeThread{ 0 };
+
+	bool screenshotRequested{ false };
+	bool captureFrames{ false };
+	uint32_t capturedFrameIndex{ 0 };
+	std::atomic<bool> screenshotSaved{ false };
+	std::string screenshotFileName;
+	struct CaptureStats {
+		uint32_t encodedFrames{ 0 };
+		uint32_t droppedFrames{ 0 };
+		double encodeMilliseconds{ 0.0 };
+	} captureStats;
+	std::mutex captureStatsMutex;
 
 	VulkanExample() : VulkanExampleBase()
 	{
@@ -43,6 +86,14 @@ public:
 	~VulkanExample()
 	{
 		if (device) {
+			// Wait for the encodes in flight, they read from the readback buffers
+			threadPool.wait();
+			for (auto& slot : readbackSlots) {
+				slot.buffer.destroy();
+				if (slot.fence != VK_NULL_HANDLE) {
+					vkDestroyFence(device, slot.fence, nullptr);
+				}
+			}
 			vkDestroyPipeline(device, pipeline, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
@@ -175,217 +226,314 @@ public:
 		uniformBuffer.copyTo(&uniformData, sizeof(UniformData));
 	}
 
-	// Take a screenshot from the current swapchain image
-	// This is done using a blit from the swapchain image to a linear image whose memory content is then saved as a ppm image
-	// Getting the image date directly from a swapchain image wouldn't work as they're usually stored in an implementation dependent optimal tiling format
-	// Note: This requires the swapchain images to be created with the VK_IMAGE_USAGE_TRANSFER_SRC_BIT flag (see VulkanSwapChain::create)
-	void saveScreenshot(const char *filename)
+	void prepareReadback()
 	{
-		screenshotSaved = false;
-		bool supportsBlit = true;
+		// Reading back from cached memory is a lot faster, this requires invalidating the memory after the copy has finished
+		VkBool32 cachedMemoryFound = false;
+		vulkanDevice->getMemoryType(~0u, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &cachedMemoryFound);
+		if (cachedMemoryFound) {
+			readbackMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		}
 
-		// Check blit support for source and destination
-		VkFormatProperties formatProps;
+		// Encoding is the slowest part, so the ring has a few more slots than there are worker threads to keep copies going while all threads are busy
+		const uint32_t threadCount = std::max(std::min(std::thread::hardware_concurrency(), 5u) - 1, 1u);
+		threadPool.setThreadCount(threadCount);
+		readbackSlotCount = std::min(threadCount + 2, maxReadbackSlots);
 
-		// Check if the device supports blitting from optimal images (the swapchain images are in optimal format)
-		vkGetPhysicalDeviceFormatProperties(physicalDevice, swapChain.colorFormat, &formatProps);
-		if (!(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT)) {
-			std::cerr << "Device does not support blitting from optimal tiled images, using copy instead of blit!" << std::endl;
-			supportsBlit = false;
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+		for (uint32_t i = 0; i < readbackSlotCount; i++) {
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &readbackSlots[i].commandBuffer));
+			VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &readbackSlots[i].fence));
 		}
+	}
 
-		// Check if the device supports blitting to linear images
-		vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &formatProps);
-		if (!(formatProps.linearTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
-			std::cerr << "Device does not support blitting to linear tiled images, using copy instead of blit!" << std::endl;
-			supportsBlit = false;
+	// Record the copy from the current swapchain image into the slot's buffer, which is submitted along with the frame's command buffer
+	// Copying to a buffer instead of blitting to a linear image doesn't need blit support and the result is tightly packed
+	// Note: This requires the swapchain images to be created with the VK_IMAGE_USAGE_TRANSFER_SRC_BIT flag (see VulkanSwapChain::create)
+	void recordCapture(ReadbackSlot& slot)
+	{
+		// Buffers are only reallocated once the size changed, the slot is free so it's not in use by the device or a worker thread
+		const VkDeviceSize size = width * height * 4;
+		if ((slot.buffer.buffer == VK_NULL_HANDLE) || (slot.buffer.size < size)) {
+			slot.buffer.destroy();
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, readbackMemoryFlags, &slot.buffer, size));
+			VK_CHECK_RESULT(slot.buffer.map());
 		}
+		slot.width = width;
+		slot.height = height;
+		// The copy keeps the component order of the swapchain, BGR has to be swizzled to RGB by the encoder
+		const std::vector<VkFormat> formatsBGR = { VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_B8G8R8A8_UNORM };
+		slot.swizzle = (std::find(formatsBGR.begin(), formatsBGR.end(), swapChain.colorFormat) != formatsBGR.end());
 
-		// Source for the copy is the last rendered swapchain image
 		VkImage srcImage = swapChain.images[currentBuffer];
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(slot.commandBuffer, &cmdBufInfo));
 
-		// Create the linear tiled destination image to copy to and to read the memory from
-		VkImageCreateInfo imageCreateCI(vks::initializers::imageCreateInfo());
-		imageCreateCI.imageType = VK_IMAGE_TYPE_2D;
-		// Note that vkCmdBlitImage (if supported) will also do format conversions if the swapchain color format would differ
-		imageCreateCI.format = VK_FORMAT_R8G8B8A8_UNORM;
-		imageCreateCI.extent.width = width;
-		imageCreateCI.extent.height = height;
-		imageCreateCI.extent.depth = 1;
-		imageCreateCI.arrayLayers = 1;
-		imageCreateCI.mipLevels = 1;
-		imageCreateCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageCreateCI.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCreateCI.tiling = VK_IMAGE_TILING_LINEAR;
-		imageCreateCI.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-		// Create the image
-		VkImage dstImage;
-		VK_CHECK_RESULT(vkCreateImage(device, &imageCreateCI, nullptr, &dstImage));
-		// Create memory to back up the image
-		VkMemoryRequirements memRequirements;
-		VkMemoryAllocateInfo memAllocInfo(vks::initializers::memoryAllocateInfo());
-		VkDeviceMemory dstImageMemory;
-		vkGetImageMemoryRequirements(device, dstImage, &memRequirements);
-		memAllocInfo.allocationSize = memRequirements.size;
-		// Memory must be host visible to copy from
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &dstImageMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device, dstImage, dstImageMemory, 0));
-
-		// Do the actual blit from the swapchain image to our host visible destination image
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Transition destination image to transfer destination layout
-		vks::tools::insertImageMemoryBarrier(
-			copyCmd,
-			dstImage,
-			0,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-		// Transition swapchain image from present to transfer source layout
+		// Transition swapchain image from present to transfer source layout once rendering has finished
 		vks::tools::insertImageMemoryBarrier(
-			copyCmd,
+			slot.commandBuffer,
 			srcImage,
-			VK_ACCESS_MEMORY_READ_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
 			VK_ACCESS_TRANSFER_READ_BIT,
 			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
 			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
 
-		// If source and destination support blit we'll blit as this also does automatic format conversion (e.g. from BGR to RGB)
-		if (supportsBlit)
-		{
-			// Define the region to blit (we will blit the whole swapchain image)
-			VkOffset3D blitSize;
-			blitSize.x = width;
-			blitSize.y = height;
-			blitSize.z = 1;
-			VkImageBlit imageBlitRegion{};
-			imageBlitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlitRegion.srcSubresource.layerCount = 1;
-			imageBlitRegion.srcOffsets[1] = blitSize;
-			imageBlitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlitRegion.dstSubresource.layerCount = 1;
-			imageBlitRegion.dstOffsets[1] = blitSize;
-
-			// Issue the blit command
-			vkCmdBlitImage(
-				copyCmd,
-				srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1,
-				&imageBlitRegion,
-				VK_FILTER_NEAREST);
-		}
-		else
-		{
-			// Otherwise use image copy (requires us to manually flip components)
-			VkImageCopy imageCopyRegion{};
-			imageCopyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageCopyRegion.srcSubresource.layerCount = 1;
-			imageCopyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageCopyRegion.dstSubresource.layerCount = 1;
-			imageCopyRegion.extent.width = width;
-			imageCopyRegion.extent.height = height;
-			imageCopyRegion.extent.depth = 1;
-
-			// Issue the copy command
-			vkCmdCopyImage(
-				copyCmd,
-				srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1,
-				&imageCopyRegion);
-		}
-
-		// Transition destination image to general layout, which is the required layout for mapping the image memory later on
+		VkBufferImageCopy copyRegion{};
+		copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copyRegion.imageSubresource.layerCount = 1;
+		copyRegion.imageExtent = { width, height, 1 };
+		vkCmdCopyImageToBuffer(slot.commandBuffer, srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &copyRegion);
+
+		// Make the copy visible to the host
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.buffer = slot.buffer.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+		// Transition back the swap chain image for presentation
 		vks::tools::insertImageMemoryBarrier(
-			copyCmd,
-			dstImage,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_MEMORY_READ_BIT,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_GENERAL,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-
-		// Transition back the swap chain image after the blit is done
-		vks::tools::insertImageMemoryBarrier(
-			copyCmd,
+			slot.commandBuffer,
 			srcImage,
 			VK_ACCESS_TRANSFER_READ_BIT,
-			VK_ACCESS_MEMORY_READ_BIT,
+			0,
 			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
 			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
 
-		vulkanDevice->flushCommandBuffer(copyCmd, queue);
+		VK_CHECK_RESULT(vkEndCommandBuffer(slot.commandBuffer));
+	}
+
+	// Hand slots whose copy has finished over to the worker threads, never waits for the device
+	void processReadbacks()
+	{
+		for (uint32_t i = 0; i < readbackSlotCount; i++) {
+			ReadbackSlot& slot = readbackSlots[i];
+			if ((slot.state != SlotState::Copying) || (vkGetFenceStatus(device, slot.fence) != VK_SUCCESS)) {
+				continue;
+			}
+			VK_CHECK_RESULT(vkResetFences(device, 1, &slot.fence));
+			if (readbackMemoryFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) {
+				VK_CHECK_RESULT(slot.buffer.invalidate());
+			}
+			slot.state = SlotState::Encoding;
+			threadPool.threads[nextEncodeThread]->addJob([this, &slot] { encodeReadback(slot); });
+			nextEncodeThread = (nextEncodeThread + 1) % static_cast<uint32_t>(threadPool.threads.size());
+		}
+	}
+
+	// Called on a worker thread
+	void encodeReadback(ReadbackSlot& slot)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		// Drop the alpha channel and swizzle to RGB, the branch is hoisted out of the pixel loop
+		const uint32_t pixelCount = slot.width * slot.height;
+		const uint8_t* src = static_cast<const uint8_t*>(slot.buffer.mapped);
+		const uint32_t r = slot.swizzle ? 2 : 0;
+		const uint32_t b = slot.swizzle ? 0 : 2;
+		std::vector<uint8_t> rgb(pixelCount * 3);
+		for (uint32_t i = 0; i < pixelCount; i++) {
+			rgb[i * 3 + 0] = src[i * 4 + r];
+			rgb[i * 3 + 1] = src[i * 4 + 1];
+			rgb[i * 3 + 2] = src[i * 4 + b];
+		}
+		// The buffer isn't needed anymore, so the slot can already be reused for the next copy
+		const uint32_t imageWidth = slot.width;
+		const uint32_t imageHeight = slot.height;
+		const ImageFormat format = slot.format;
+		const std::string fileName = slot.fileName;
+		const bool screenshot = slot.screenshot;
+		slot.state = SlotState::Free;
+
+		const std::vector<uint8_t> data = (format == ImageFormat::PNG) ? encodePNG(rgb, imageWidth, imageHeight) : encodeQOI(rgb, imageWidth, imageHeight);
+		std::ofstream file(fileName, std::ios::out | std::ios::binary);
+		file.write((const char*)data.data(), data.size());
+		file.close();
 
-		// Get layout of the image (including row pitch)
-		VkImageSubresource subResource { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0 };
-		VkSubresourceLayout subResourceLayout;
-		vkGetImageSubresourceLayout(device, dstImage, &subResource, &subResourceLayout);
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		{
+			std::lock_guard<std::mutex> lock(captureStatsMutex);
+			captureStats.encodedFrames++;
+			captureStats.encodeMilliseconds += std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+		}
+		if (screenshot) {
+			std::cout << "Screenshot saved to disk" << std::endl;
+			screenshotSaved = true;
+		}
+	}
 
-		// Map image memory so we can start copying from it
-		const char* data;
-		vkMapMemory(device, dstImageMemory, 0, VK_WHOLE_SIZE, 0, (void**)&data);
-		data += subResourceLayout.offset;
+	static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+	{
+		// Encoding runs on several worker threads, the initialization of a function-local static is thread-safe
+		static const std::array<uint32_t, 256> table = [] {
+			std::array<uint32_t, 256> result{};
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t c = i;
+				for (uint32_t k = 0; k < 8; k++) {
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : (c >> 1);
+				}
+				result[i] = c;
+			}
+			return result;
+		}();
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++) {
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
 
-		std::ofstream file(filename, std::ios::out | std::ios::binary);
+	static void writeBigEndian(std::vector<uint8_t>& data, uint32_t value)
+	{
+		data.push_back((value >> 24) & 0xff);
+		data.push_back((value >> 16) & 0xff);
+		data.push_back((value >> 8) & 0xff);
+		data.push_back(value & 0xff);
+	}
 
-		// ppm header
-		file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
+	// Writes an uncompressed PNG (deflate stored blocks), which is fast enough for continuous capture
+	std::vector<uint8_t> encodePNG(const std::vector<uint8_t>& rgb, uint32_t imageWidth, uint32_t imageHeight)
+	{
+		std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		auto writeChunk = [&png](const char* type, const std::vector<uint8_t>& chunkData) {
+			writeBigEndian(png, static_cast<uint32_t>(chunkData.size()));
+			const size_t start = png.size();
+			png.insert(png.end(), type, type + 4);
+			png.insert(png.end(), chunkData.begin(), chunkData.end());
+			writeBigEndian(png, crc32(png.data() + start, png.size() - start));
+		};
 
-		// If source is BGR (destination is always RGB) and we can't use blit (which does automatic conversion), we'll have to manually swizzle color components
-		bool colorSwizzle = false;
-		// Check if source is BGR
-		// Note: Not complete, only contains most common and basic BGR surface formats for demonstration purposes
-		if (!supportsBlit)
-		{
-			std::vector<VkFormat> formatsBGR = { VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_B8G8R8A8_SNORM };
-			colorSwizzle = (std::find(formatsBGR.begin(), formatsBGR.end(), swapChain.colorFormat) != formatsBGR.end());
+		// 8 bit RGB, no interlacing
+		std::vector<uint8_t> header;
+		writeBigEndian(header, imageWidth);
+		writeBigEndian(header, imageHeight);
+		header.insert(header.end(), { 8, 2, 0, 0, 0 });
+		writeChunk("IHDR", header);
+
+		// Zlib stream of stored blocks, each row is prefixed with filter type 0 (none)
+		const size_t rowSize = imageWidth * 3 + 1;
+		std::vector<uint8_t> raw(rowSize * imageHeight);
+		for (uint32_t y = 0; y < imageHeight; y++) {
+			raw[y * rowSize] = 0;
+			memcpy(&raw[y * rowSize + 1], &rgb[y * imageWidth * 3], imageWidth * 3);
+		}
+		std::vector<uint8_t> zlib = { 0x78, 0x01 };
+		zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+		size_t offset = 0;
+		do {
+			const uint16_t blockSize = static_cast<uint16_t>(std::min<size_t>(raw.size() - offset, 65535));
+			const bool last = (offset + blockSize == raw.size());
+			zlib.insert(zlib.end(), { (uint8_t)(last ? 1 : 0), (uint8_t)(blockSize & 0xff), (uint8_t)(blockSize >> 8), (uint8_t)(~blockSize & 0xff), (uint8_t)((~blockSize >> 8) & 0xff) });
+			zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+			offset += blockSize;
+		} while (offset < raw.size());
+		// Adler-32 checksum of the uncompressed data
+		uint32_t a = 1, b = 0;
+		for (size_t i = 0; i < raw.size(); i++) {
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
 		}
+		writeBigEndian(zlib, (b << 16) | a);
+		writeChunk("IDAT", zlib);
+		writeChunk("IEND", {});
+		return png;
+	}
 
-		// ppm binary pixel data
-		for (uint32_t y = 0; y < height; y++)
-		{
-			unsigned int *row = (unsigned int*)data;
-			for (uint32_t x = 0; x < width; x++)
-			{
-				if (colorSwizzle)
-				{
-					file.write((char*)row+2, 1);
-					file.write((char*)row+1, 1);
-					file.write((char*)row, 1);
+	// Writes a QOI image (https://qoiformat.org), which compresses about as well as PNG at a fraction of the cost
+	std::vector<uint8_t> encodeQOI(const std::vector<uint8_t>& rgb, uint32_t imageWidth, uint32_t imageHeight)
+	{
+		const uint8_t QOI_OP_INDEX = 0x00;
+		const uint8_t QOI_OP_DIFF = 0x40;
+		const uint8_t QOI_OP_LUMA = 0x80;
+		const uint8_t QOI_OP_RUN = 0xc0;
+		const uint8_t QOI_OP_RGB = 0xfe;
+
+		std::vector<uint8_t> qoi = { 'q', 'o', 'i', 'f' };
+		qoi.reserve(14 + rgb.size() + 8);
+		writeBigEndian(qoi, imageWidth);
+		writeBigEndian(qoi, imageHeight);
+		// 3 channels, sRGB
+		qoi.push_back(3);
+		qoi.push_back(0);
+
+		// All pixels are opaque, so alpha is not tracked
+		std::array<uint32_t, 64> index{};
+		uint8_t prev[3] = { 0, 0, 0 };
+		uint32_t run = 0;
+		const size_t pixelCount = rgb.size() / 3;
+		for (size_t i = 0; i < pixelCount; i++) {
+			const uint8_t* px = &rgb[i * 3];
+			if ((px[0] == prev[0]) && (px[1] == prev[1]) && (px[2] == prev[2])) {
+				run++;
+				if ((run == 62) || (i == pixelCount - 1)) {
+					qoi.push_back(QOI_OP_RUN | (run - 1));
+					run = 0;
 				}
-				else
-				{
-					file.write((char*)row, 3);
+				continue;
+			}
+			if (run > 0) {
+				qoi.push_back(QOI_OP_RUN | (run - 1));
+				run = 0;
+			}
+			const uint32_t packed = px[0] | (px[1] << 8) | (px[2] << 16) | (255u << 24);
+			const uint32_t hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+			if (index[hash] == packed) {
+				qoi.push_back(QOI_OP_INDEX | hash);
+			} else {
+				index[hash] = packed;
+				const int8_t vr = (int8_t)(px[0] - prev[0]);
+				const int8_t vg = (int8_t)(px[1] - prev[1]);
+				const int8_t vb = (int8_t)(px[2] - prev[2]);
+				const int8_t vgr = vr - vg;
+				const int8_t vgb = vb - vg;
+				if ((vr > -3) && (vr < 2) && (vg > -3) && (vg < 2) && (vb > -3) && (vb < 2)) {
+					qoi.push_back(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+				} else if ((vgr > -9) && (vgr < 8) && (vg > -33) && (vg < 32) && (vgb > -9) && (vgb < 8)) {
+					qoi.push_back(QOI_OP_LUMA | (vg + 32));
+					qoi.push_back(((vgr + 8) << 4) | (vgb + 8));
+				} else {
+					qoi.insert(qoi.end(), { QOI_OP_RGB, px[0], px[1], px[2] });
 				}
-				row++;
 			}
-			data += subResourceLayout.rowPitch;
+			prev[0] = px[0];
+			prev[1] = px[1];
+			prev[2] = px[2];
 		}
-		file.close();
-
-		std::cout << "Screenshot saved to disk" << std::endl;
+		// End marker
+		qoi.insert(qoi.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+		return qoi;
+	}
 
-		// Clean up resources
-		vkUnmapMemory(device, dstImageMemory);
-		vkFreeMemory(device, dstImageMemory, nullptr);
-		vkDestroyImage(device, dstImage, nullptr);
+	// Only 8 bit per component swapchain formats can be stored without conversion
+	bool captureSupported()
+	{
+		const std::vector<VkFormat> formats = { VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM };
+		return std::find(formats.begin(), formats.end(), swapChain.colorFormat) != formats.end();
+	}
 
-		screenshotSaved = true;
+	// Returns a free slot with the capture of the current frame recorded, or nullptr if all slots are busy
+	ReadbackSlot* captureFrame(const std::string& fileName, bool screenshot)
+	{
+		for (uint32_t i = 0; i < readbackSlotCount; i++) {
+			ReadbackSlot& slot = readbackSlots[i];
+			if (slot.state == SlotState::Free) {
+				slot.format = static_cast<ImageFormat>(imageFormat);
+				slot.fileName = fileName;
+				slot.screenshot = screenshot;
+				recordCapture(slot);
+				slot.state = SlotState::Copying;
+				return &slot;
+			}
+		}
+		return nullptr;
 	}
 
 	void prepare()
@@ -395,6 +543,7 @@ public:
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
+		prepareReadback();
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -402,9 +551,38 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		processReadbacks();
+		std::vector<VkCommandBuffer> commandBuffers = { drawCmdBuffers[currentBuffer] };
+		VkFence fence = VK_NULL_HANDLE;
+		if ((screenshotRequested || captureFrames) && captureSupported()) {
+			const std::string extension = (static_cast<ImageFormat>(imageFormat) == ImageFormat::PNG) ? ".png" : ".qoi";
+			std::string fileName;
+			if (screenshotRequested) {
+				screenshotFileName = "screenshot" + extension;
+				fileName = screenshotFileName;
+			} else {
+				std::stringstream ss;
+				ss << "frame_" << std::setfill('0') << std::setw(6) << capturedFrameIndex << extension;
+				fileName = ss.str();
+			}
+			ReadbackSlot* slot = captureFrame(fileName, screenshotRequested);
+			if (slot) {
+				commandBuffers.push_back(slot->commandBuffer);
+				fence = slot->fence;
+				if (screenshotRequested) {
+					screenshotRequested = false;
+				} else {
+					capturedFrameIndex++;
+				}
+			} else if (!screenshotRequested) {
+				// All slots are still busy, skip this frame instead of stalling
+				std::lock_guard<std::mutex> lock(captureStatsMutex);
+				captureStats.droppedFrames++;
+			}
+		}
+		submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+		submitInfo.pCommandBuffers = commandBuffers.data();
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
 		VulkanExampleBase::submitFrame();
 	}
 
@@ -419,12 +597,26 @@ public:
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Functions")) {
+			overlay->comboBox("Format", &imageFormat, { "PNG", "QOI" });
 			if (overlay->button("Take screenshot")) {
-				saveScreenshot("screenshot.ppm");
+				screenshotSaved = false;
+				screenshotRequested = true;
 			}
 			if (screenshotSaved) {
-				overlay->text("Screenshot saved as screenshot.ppm");
+				overlay->text("Screenshot saved as %s", screenshotFileName.c_str());
+			}
+			overlay->checkBox("Capture frames", &captureFrames);
+			if (!captureSupported()) {
+				overlay->text("Swapchain format not supported for capturing");
+			}
+		}
+		if (overlay->header("Capture statistics")) {
+			std::lock_guard<std::mutex> lock(captureStatsMutex);
+			overlay->text("Encoded: %d, dropped: %d", captureStats.encodedFrames, captureStats.droppedFrames);
+			if (captureStats.encodedFrames > 0) {
+				overlay->text("Average encode time: %.2f ms", captureStats.encodeMilliseconds / captureStats.encodedFrames);
 			}
+			overlay->text("Readback slots: %d, worker threads: %d", readbackSlotCount, static_cast<uint32_t>(threadPool.threads.size()));
 		}
 	}
 
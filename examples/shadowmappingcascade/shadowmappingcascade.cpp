@@ -15,6 +15,11 @@
 
 	A further optimization could be done using a geometry shader to do a single-pass render for the depth map
 	cascades instead of multiple passes (geometry shaders are not supported on all target devices).
+
+	Cascades are cached in their depth image layers and only rendered again when needed: Cascade projections are
+	snapped to shadow map texels and farther cascades are padded, so they can be reused while the camera's split
+	still fits into them. Far cascades are updated less frequently and on different frames (staggered), and each
+	cascade only renders the objects that can cast shadows into it.
 */
 
 #include "vulkanexamplebase.h"
@@ -27,6 +32,8 @@
 #endif
 
 #define SHADOW_MAP_CASCADE_COUNT 4
+// One timestamp at the start, one after each cascade and one after the scene pass
+#define TIMESTAMP_COUNT (SHADOW_MAP_CASCADE_COUNT + 2)
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -38,6 +45,15 @@ public:
 
 	float cascadeSplitLambda = 0.95f;
 
+	// If disabled, all cascades are rendered every frame
+	bool cacheCascades = true;
+	// Update interval in frames of the farthest cascade, the intervals of the cascades in between are interpolated
+	int32_t farCascadeInterval = 4;
+	// Cascades that are not updated every frame are enlarged by this fraction of their radius, so they stay valid while the camera moves
+	float cascadePadding = 0.1f;
+	bool cullCasters = true;
+	uint32_t frameIndex = 0;
+
 	float zNear = 0.5f;
 	float zFar = 48.0f;
 
@@ -48,6 +64,15 @@ public:
 		vkglTF::Model tree;
 	} models;
 
+	// Objects rendered by the scene and the depth passes with their world space bounding spheres
+	struct SceneObject {
+		vkglTF::Model* model;
+		glm::vec3 position;
+		glm::vec3 center;
+		float radius;
+	};
+	std::vector<SceneObject> sceneObjects;
+
 	struct uniformBuffers {
 		vks::Buffer VS;
 		vks::Buffer FS;
@@ -110,7 +135,18 @@ public:
 		VkFramebuffer frameBuffer;
 		VkImageView view;
 		float splitDepth;
+		// Matrix used for the contents of the cascade's depth image layer
 		glm::mat4 viewProjMatrix;
+		// Light space bounds of the depth image layer's contents, used to cull casters and to check if the cascade can be reused
+		glm::mat4 lightViewMatrix;
+		glm::vec3 center;
+		float radius{ 0.0f };
+		// Set if the cascade has to be rendered with the next frame
+		bool update{ true };
+		bool valid{ false };
+		uint32_t lastUpdateFrame{ 0 };
+		// Indices of the objects that may cast shadows into this cascade
+		std::vector<uint32_t> casters;
 		void destroy(VkDevice device) {
 			vkDestroyImageView(device, view, nullptr);
 			vkDestroyFramebuffer(device, frameBuffer, nullptr);
@@ -120,6 +156,22 @@ public:
 	// Per-cascade matrices will be passed to the shaders as a linear array
 	vks::Buffer cascadeViewProjMatricesBuffer;
 
+	// Stays null if the graphics queue family doesn't support timestamps
+	VkQueryPool queryPool{ VK_NULL_HANDLE };
+	// Cascades rendered with each of the command buffers, as only their timestamps get written
+	std::vector<std::array<bool, SHADOW_MAP_CASCADE_COUNT>> recordedCascades;
+	struct Statistics {
+		// GPU time of each cascade the last time it was rendered
+		std::array<float, SHADOW_MAP_CASCADE_COUNT> cascadeTimes{};
+		float depthPassTime{ 0.0f };
+		float scenePassTime{ 0.0f };
+		// Time the cascades that were reused in the last frame took when they were last rendered
+		float savedTime{ 0.0f };
+		uint32_t renderedCascades{ 0 };
+		uint32_t drawnCasters{ 0 };
+		uint32_t culledCasters{ 0 };
+	} stats;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Cascaded shadow mapping";
@@ -151,6 +203,10 @@ public:
 
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
+
 		cascadeViewProjMatricesBuffer.destroy();
 		uniformBuffers.VS.destroy();
 		uniformBuffers.FS.destroy();
@@ -166,32 +222,22 @@ public:
 	/*
 		Render the example scene to acommand buffer using the supplied pipeline layout and for the selected shadow cascade index
 		Used by the scene rendering and depth pass generation command buffer
+		If a list of object indices is passed, only those objects are rendered
 	*/
-	void renderScene(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t cascadeIndex = 0) {
+	void renderScene(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t cascadeIndex = 0, const std::vector<uint32_t>* objectIndices = nullptr) {
 		// We use push constants for passing shadow cascade info to the shaders
 		PushConstBlock pushConstBlock = { glm::vec4(0.0f), cascadeIndex };
 
 		// Set 0 contains the vertex and fragment shader uniform buffers, set 1 for images will be set by the glTF model class at draw time
 		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 
-		// Floor
-		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
-		models.terrain.draw(commandBuffer, vkglTF::RenderFlags::BindImages, pipelineLayout);
-
-		// Trees
-		const std::vector<glm::vec3> positions = {
-			glm::vec3(0.0f, 0.0f, 0.0f),
-			glm::vec3(1.25f, 0.25f, 1.25f),
-			glm::vec3(-1.25f, -0.2f, 1.25f),
-			glm::vec3(1.25f, 0.1f, -1.25f),
-			glm::vec3(-1.25f, -0.25f, -1.25f),
-		};
-
-		for (auto& position : positions) {
-			pushConstBlock.position = glm::vec4(position, 0.0f);
+		const uint32_t objectCount = objectIndices ? static_cast<uint32_t>(objectIndices->size()) : static_cast<uint32_t>(sceneObjects.size());
+		for (uint32_t i = 0; i < objectCount; i++) {
+			const SceneObject& object = sceneObjects[objectIndices ? (*objectIndices)[i] : i];
+			pushConstBlock.position = glm::vec4(object.position, 0.0f);
 			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 			// This will also bind the texture images to set 1
-			models.tree.draw(commandBuffer, vkglTF::RenderFlags::BindImages, pipelineLayout);
+			object.model->draw(commandBuffer, vkglTF::RenderFlags::BindImages, pipelineLayout);
 		}
 	}
 
@@ -335,17 +381,35 @@ public:
 
 	void buildCommandBuffers()
 	{
-		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		for (uint32_t i = 0; i < static_cast<uint32_t>(drawCmdBuffers.size()); i++) {
+			buildCommandBuffer(i);
+		}
+	}
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); i++) {
+	/*
+		The cascades that need to be rendered change from frame to frame, so the command buffer for the current frame is recorded again in draw()
+	*/
+	void buildCommandBuffer(uint32_t i)
+	{
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
+		{
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (recordedCascades.size() != drawCmdBuffers.size()) {
+				recordedCascades.resize(drawCmdBuffers.size());
+			}
+			if (queryPool != VK_NULL_HANDLE) {
+				vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, TIMESTAMP_COUNT);
+				vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			}
+
 			/*
 				Generate depth map cascades
 
 				Uses multiple passes with each pass rendering the scene to the cascade's depth image layer
 				Could be optimized using a geometry shader (and layered frame buffer) on devices that support geometry shaders
+				Cascades that are reused keep the contents of their depth image layer from an earlier frame
 			*/
 			{
 				VkClearValue clearValues[1];
@@ -368,11 +432,18 @@ public:
 
 				// One pass per cascade
 				for (uint32_t j = 0; j < SHADOW_MAP_CASCADE_COUNT; j++) {
+					recordedCascades[i][j] = cascades[j].update;
+					if (!cascades[j].update) {
+						continue;
+					}
 					renderPassBeginInfo.framebuffer = cascades[j].frameBuffer;
 					vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass.pipeline);
-					renderScene(drawCmdBuffers[i], depthPass.pipelineLayout, j);
+					renderScene(drawCmdBuffers[i], depthPass.pipelineLayout, j, cullCasters ? &cascades[j].casters : nullptr);
 					vkCmdEndRenderPass(drawCmdBuffers[i]);
+					if (queryPool != VK_NULL_HANDLE) {
+						vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1 + j);
+					}
 				}
 			}
 
@@ -424,6 +495,9 @@ public:
 				drawUI(drawCmdBuffers[i]);
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, TIMESTAMP_COUNT - 1);
+				}
 			}
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -435,6 +509,19 @@ public:
 		uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::FlipY;
 		models.terrain.loadFromFile(getAssetPath() + "models/terrain_gridlines.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		models.tree.loadFromFile(getAssetPath() + "models/oaktree.gltf", vulkanDevice, queue, glTFLoadingFlags);
+
+		// Floor and trees
+		const std::vector<glm::vec3> treePositions = {
+			glm::vec3(0.0f, 0.0f, 0.0f),
+			glm::vec3(1.25f, 0.25f, 1.25f),
+			glm::vec3(-1.25f, -0.2f, 1.25f),
+			glm::vec3(1.25f, 0.1f, -1.25f),
+			glm::vec3(-1.25f, -0.25f, -1.25f),
+		};
+		sceneObjects.push_back({ &models.terrain, glm::vec3(0.0f), models.terrain.dimensions.center, models.terrain.dimensions.radius });
+		for (auto& position : treePositions) {
+			sceneObjects.push_back({ &models.tree, position, models.tree.dimensions.center + position, models.tree.dimensions.radius });
+		}
 	}
 
 	void setupLayoutsAndDescriptors()
@@ -603,11 +690,38 @@ public:
 		updateUniformBuffers();
 	}
 
+	// Cascade i is updated every cascadeInterval(i) frames at most, the first cascade every frame
+	uint32_t cascadeInterval(uint32_t i)
+	{
+		if (!cacheCascades) {
+			return 1;
+		}
+		return std::max(1u, (uint32_t)farCascadeInterval * i / (SHADOW_MAP_CASCADE_COUNT - 1));
+	}
+
+	// Collect the objects that can cast shadows into the cascade
+	// Only objects beyond the far plane or outside the sides of the light's orthographic projection are culled, as objects between
+	// the light and the near plane still cast shadows into the cascade (their depth is clamped)
+	void cullCascadeCasters(Cascade& cascade)
+	{
+		cascade.casters.clear();
+		for (uint32_t i = 0; i < static_cast<uint32_t>(sceneObjects.size()); i++) {
+			const glm::vec3 pos = glm::vec3(cascade.lightViewMatrix * glm::vec4(sceneObjects[i].center, 1.0f));
+			const float radius = sceneObjects[i].radius;
+			const bool outside = (std::abs(pos.x) - radius > cascade.radius) || (std::abs(pos.y) - radius > cascade.radius) || (-pos.z - radius > cascade.radius * 2.0f);
+			if (!outside) {
+				cascade.casters.push_back(i);
+			}
+		}
+	}
+
 	/*
 		Calculate frustum split depths and matrices for the shadow map cascades
 		Based on https://johanmedestrom.wordpress.com/2016/03/18/opengl-cascaded-shadow-maps/
+		Cascades are only recalculated (and rendered) if the cached one doesn't cover the current split anymore, or if their
+		projection changed and they are due for an update. Set invalidate to update all cascades.
 	*/
-	void updateCascades()
+	void updateCascades(bool invalidate = false)
 	{
 		float cascadeSplits[SHADOW_MAP_CASCADE_COUNT];
 
@@ -674,18 +788,55 @@ public:
 			}
 			radius = std::ceil(radius * 16.0f) / 16.0f;
 
-			glm::vec3 maxExtents = glm::vec3(radius);
+			Cascade& cascade = cascades[i];
+			cascade.splitDepth = (camera.getNearClip() + splitDist * clipRange) * -1.0f;
+			lastSplitDist = cascadeSplits[i];
+
+			const uint32_t interval = cascadeInterval(i);
+			// The cached cascade can be used as long as the bounding sphere of the split is inside of it
+			const bool covered = cascade.valid && (glm::length(frustumCenter - cascade.center) + radius <= cascade.radius);
+			const bool due = (interval == 1) || ((frameIndex + i) % interval == 0);
+			if (covered && !due && !invalidate) {
+				continue;
+			}
+
+			// Enlarge cascades that are kept for several frames
+			const float cascadeRadius = (interval > 1) ? radius * (1.0f + cascadePadding) : radius;
+			glm::vec3 maxExtents = glm::vec3(cascadeRadius);
 			glm::vec3 minExtents = -maxExtents;
 
 			glm::vec3 lightDir = normalize(-lightPos);
 			glm::mat4 lightViewMatrix = glm::lookAt(frustumCenter - lightDir * -minExtents.z, frustumCenter, glm::vec3(0.0f, 1.0f, 0.0f));
 			glm::mat4 lightOrthoMatrix = glm::ortho(minExtents.x, maxExtents.x, minExtents.y, maxExtents.y, 0.0f, maxExtents.z - minExtents.z);
 
-			// Store split distance and matrix in cascade
-			cascades[i].splitDepth = (camera.getNearClip() + splitDist * clipRange) * -1.0f;
-			cascades[i].viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
+			// Snap the projection to shadow map texels, so camera movement only changes it once it moved by at least a texel
+			// This avoids shimmering edges and lets unchanged cascades be skipped
+			glm::vec4 shadowOrigin = (lightOrthoMatrix * lightViewMatrix) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			shadowOrigin *= (float)SHADOWMAP_DIM / 2.0f;
+			glm::vec4 roundOffset = glm::vec4(std::round(shadowOrigin.x) - shadowOrigin.x, std::round(shadowOrigin.y) - shadowOrigin.y, 0.0f, 0.0f);
+			roundOffset *= 2.0f / (float)SHADOWMAP_DIM;
+			lightOrthoMatrix[3] += roundOffset;
+
+			const glm::mat4 viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
+			bool changed = !cascade.valid || invalidate || !cacheCascades;
+			for (uint32_t c = 0; c < 4 && !changed; c++) {
+				for (uint32_t r = 0; r < 4 && !changed; r++) {
+					changed = std::abs(viewProjMatrix[c][r] - cascade.viewProjMatrix[c][r]) > 1e-6f;
+				}
+			}
+			if (covered && !changed) {
+				continue;
+			}
 
-			lastSplitDist = cascadeSplits[i];
+			// Store matrix and bounds in cascade
+			cascade.viewProjMatrix = viewProjMatrix;
+			cascade.lightViewMatrix = lightViewMatrix;
+			cascade.center = frustumCenter;
+			cascade.radius = cascadeRadius;
+			cascade.update = true;
+			cascade.valid = true;
+			cascade.lastUpdateFrame = frameIndex;
+			cullCascadeCasters(cascade);
 		}
 	}
 
@@ -724,13 +875,70 @@ public:
 		memcpy(uniformBuffers.FS.mapped, &uboFS, sizeof(uboFS));
 	}
 
+	void prepareTimestamps()
+	{
+		if (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits == 0) {
+			return;
+		}
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = TIMESTAMP_COUNT;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+	}
+
+	// Only the timestamps of the cascades rendered in the last frame were written, the other cascades keep their last timing
+	void getTimings(uint32_t bufferIndex)
+	{
+		if (queryPool == VK_NULL_HANDLE) {
+			return;
+		}
+		const float timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+		uint64_t start;
+		if (vkGetQueryPoolResults(device, queryPool, 0, 1, sizeof(uint64_t), &start, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+			return;
+		}
+		uint64_t last = start;
+		stats.savedTime = 0.0f;
+		stats.renderedCascades = 0;
+		stats.drawnCasters = 0;
+		stats.culledCasters = 0;
+		for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+			if (!recordedCascades[bufferIndex][i]) {
+				stats.savedTime += stats.cascadeTimes[i];
+				continue;
+			}
+			uint64_t timestamp;
+			if (vkGetQueryPoolResults(device, queryPool, 1 + i, 1, sizeof(uint64_t), &timestamp, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+				stats.cascadeTimes[i] = (float)(timestamp - last) * timestampPeriod / 1000000.0f;
+				last = timestamp;
+			}
+			const uint32_t drawn = cullCasters ? static_cast<uint32_t>(cascades[i].casters.size()) : static_cast<uint32_t>(sceneObjects.size());
+			stats.renderedCascades++;
+			stats.drawnCasters += drawn;
+			stats.culledCasters += static_cast<uint32_t>(sceneObjects.size()) - drawn;
+		}
+		stats.depthPassTime = (float)(last - start) * timestampPeriod / 1000000.0f;
+		uint64_t end;
+		if (vkGetQueryPoolResults(device, queryPool, TIMESTAMP_COUNT - 1, 1, sizeof(uint64_t), &end, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			stats.scenePassTime = (float)(end - last) * timestampPeriod / 1000000.0f;
+		}
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		const uint32_t bufferIndex = currentBuffer;
+		buildCommandBuffer(bufferIndex);
+		// The cascades rendered with this frame stay valid until they need to be updated again
+		for (auto& cascade : cascades) {
+			cascade.update = false;
+		}
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		submitInfo.pCommandBuffers = &drawCmdBuffers[bufferIndex];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 		VulkanExampleBase::submitFrame();
+		getTimings(bufferIndex);
 	}
 
 	void prepare()
@@ -738,9 +946,10 @@ public:
 		VulkanExampleBase::prepare();
 		loadAssets();
 		updateLight();
-		updateCascades();
+		updateCascades(true);
 		prepareDepthPass();
 		prepareUniformBuffers();
+		prepareTimestamps();
 		setupLayoutsAndDescriptors();
 		preparePipelines();
 		buildCommandBuffers();
@@ -751,19 +960,21 @@ public:
 	{
 		if (!prepared)
 			return;
-		draw();
+		// Cascades are selected for update before drawing, as the command buffer only renders the ones that changed
 		if (!paused || camera.updated) {
 			updateLight();
 			updateCascades();
 			updateUniformBuffers();
 		}
+		draw();
+		frameIndex++;
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
 			if (overlay->sliderFloat("Split lambda", &cascadeSplitLambda, 0.1f, 1.0f)) {
-				updateCascades();
+				updateCascades(true);
 				updateUniformBuffers();
 			}
 			if (overlay->checkBox("Color cascades", &colorCascades)) {
@@ -781,6 +992,30 @@ public:
 				buildCommandBuffers();
 			}
 		}
+		if (overlay->header("Cascade updates")) {
+			// Padding and snapping differ between cached and uncached cascades, so all of them are updated if the settings change
+			if (overlay->checkBox("Cache cascades", &cacheCascades)) {
+				updateCascades(true);
+				updateUniformBuffers();
+			}
+			if (overlay->sliderInt("Far cascade interval", &farCascadeInterval, 1, 16)) {
+				updateCascades(true);
+				updateUniformBuffers();
+			}
+			if (overlay->checkBox("Cull casters", &cullCasters)) {
+				updateCascades(true);
+			}
+		}
+		if ((queryPool != VK_NULL_HANDLE) && overlay->header("GPU timings")) {
+			for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+				overlay->text("Cascade %d: %.3f ms, %d casters (%s)", i, stats.cascadeTimes[i], static_cast<int32_t>(cascades[i].casters.size()),
+					(frameIndex - cascades[i].lastUpdateFrame <= 1) ? "updated" : "cached");
+			}
+			overlay->text("Depth passes: %.3f ms (%d of %d cascades)", stats.depthPassTime, stats.renderedCascades, SHADOW_MAP_CASCADE_COUNT);
+			overlay->text("Skipped cascades: %.3f ms saved", stats.savedTime);
+			overlay->text("Casters drawn: %d, culled: %d", stats.drawnCasters, stats.culledCasters);
+			overlay->text("Scene pass: %.3f ms", stats.scenePassTime);
+		}
 	}
 };
 
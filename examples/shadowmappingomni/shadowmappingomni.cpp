@@ -1,7 +1,11 @@
 /*
 * Vulkan Example - Omni directional shadows using a dynamic cube map
 *
-* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+* The shadow cube map can be rendered with one render pass per face, or in a single render pass for all faces using
+* either multiview (VK_KHR_multiview) or layered rendering (VK_EXT_shader_viewport_index_layer)
+* Casters outside of a face's frustum are culled for that face
+*
+* Copyright (C) 2016-2024 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
@@ -14,6 +18,35 @@ class VulkanExample : public VulkanExampleBase
 public:
 	bool displayCubeMap{ false };
 
+	enum ShadowPassMode { PerFace = 0, Multiview = 1, Layered = 2 };
+	int32_t shadowPassMode{ PerFace };
+	bool multiviewSupported{ false };
+	bool layeredSupported{ false };
+	bool faceCulling{ true };
+
+	VkPhysicalDeviceMultiviewFeaturesKHR physicalDeviceMultiviewFeatures{};
+
+	// Casters are the primitives of the scene model with their world space bounding spheres
+	struct Caster {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		glm::vec3 center;
+		float radius;
+		// Bit n is set if the caster is inside the frustum of cube face n
+		uint32_t faceMask;
+	};
+	std::vector<Caster> casters;
+
+	// Stays null if the graphics queue family doesn't support timestamps
+	VkQueryPool queryPool{ VK_NULL_HANDLE };
+	struct Statistics {
+		float shadowPassTime{ 0.0f };
+		uint32_t drawCalls{ 0 };
+		// Sum of the caster draws over all faces, with and without culling
+		uint32_t faceDraws{ 0 };
+		uint32_t culledFaceDraws{ 0 };
+	} stats;
+
 	// Defines the depth range used for the shadow maps
 	// This should be kept as small as possible for precision
 	float zNear{ 0.1f };
@@ -32,7 +65,24 @@ public:
 		glm::mat4 model;
 		glm::vec4 lightPos;
 	};
-	UniformData uniformDataScene, uniformDataOffscreen;
+	UniformData uniformDataScene;
+
+	// The view matrices for all faces are only used by the single pass shadow modes
+	struct UniformDataOffscreen {
+		glm::mat4 projection;
+		glm::mat4 view;
+		glm::mat4 model;
+		glm::vec4 lightPos;
+		glm::mat4 faceViews[6];
+	} uniformDataOffscreen;
+
+	// For simplicity all shadow pass pipelines use the same push constant block layout
+	struct PushConstBlock {
+		// View matrix of the face rendered with one pass per face
+		glm::mat4 view;
+		// Faces the caster is rendered to by the single pass modes
+		uint32_t faceMask;
+	};
 
 	struct {
 		vks::Buffer scene;
@@ -42,6 +92,8 @@ public:
 	struct {
 		VkPipeline scene{ VK_NULL_HANDLE };
 		VkPipeline offscreen{ VK_NULL_HANDLE };
+		VkPipeline offscreenMultiview{ VK_NULL_HANDLE };
+		VkPipeline offscreenLayered{ VK_NULL_HANDLE };
 		VkPipeline cubemapDisplay{ VK_NULL_HANDLE };
 	} pipelines;
 
@@ -50,15 +102,20 @@ public:
 		VkPipelineLayout offscreen{ VK_NULL_HANDLE };
 	} pipelineLayouts;
 
+	// Sets used by the command buffer that is currently being recorded
 	struct {
 		VkDescriptorSet scene{ VK_NULL_HANDLE };
 		VkDescriptorSet offscreen{ VK_NULL_HANDLE };
 	} descriptorSets;
 
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+	// The descriptor sets are allocated from transient pools of the command buffer's frame slot each time it's recorded
+	vks::FrameDescriptorAllocator frameDescriptors;
 
 	vks::Texture shadowCubeMap;
 	std::array<VkImageView, 6> shadowCubeMapFaceImageViews{};
+	// All faces as a 2D array, used as the attachment of the single pass modes
+	VkImageView shadowCubeMapArrayView{ VK_NULL_HANDLE };
 
 	// Framebuffer for offscreen rendering
 	struct FrameBufferAttachment {
@@ -69,8 +126,14 @@ public:
 	struct OffscreenPass {
 		int32_t width, height;
 		std::array<VkFramebuffer, 6> frameBuffers;
+		// Depth attachment with one layer per face, view contains the first layer only (used by the per face passes)
 		FrameBufferAttachment depth;
+		VkImageView depthArrayView{ VK_NULL_HANDLE };
 		VkRenderPass renderPass;
+		// Single pass modes render to all layers of the cube map at once
+		VkRenderPass renderPassMultiview{ VK_NULL_HANDLE };
+		VkFramebuffer frameBufferMultiview{ VK_NULL_HANDLE };
+		VkFramebuffer frameBufferLayered{ VK_NULL_HANDLE };
 		VkSampler sampler;
 		VkDescriptorImageInfo descriptor;
 	} offscreenPass;
@@ -90,6 +153,27 @@ public:
 		camera.setRotation(glm::vec3(-20.5f, -673.0f, 0.0f));
 		camera.setPosition(glm::vec3(0.0f, 0.5f, -15.0f));
 		timerSpeed *= 0.5f;
+		// VK_KHR_multiview requires VK_KHR_get_physical_device_properties2
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	}
+
+	// Both single pass modes are optional, if neither is supported the shadow cube map is rendered with one pass per face
+	virtual void getEnabledExtensions()
+	{
+		multiviewSupported = vulkanDevice->extensionSupported(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+		if (multiviewSupported) {
+			// The multiview feature is always supported if the extension is
+			enabledDeviceExtensions.push_back(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+			physicalDeviceMultiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES_KHR;
+			physicalDeviceMultiviewFeatures.multiview = VK_TRUE;
+			deviceCreatepNextChain = &physicalDeviceMultiviewFeatures;
+		}
+		layeredSupported = vulkanDevice->extensionSupported(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME);
+		if (layeredSupported) {
+			enabledDeviceExtensions.push_back(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME);
+		}
+		// Layered rendering culls casters per face on the host, so it's preferred over multiview
+		shadowPassMode = layeredSupported ? Layered : (multiviewSupported ? Multiview : PerFace);
 	}
 
 	~VulkanExample()
@@ -99,6 +183,7 @@ public:
 			for (uint32_t i = 0; i < 6; i++) {
 				vkDestroyImageView(device, shadowCubeMapFaceImageViews[i], nullptr);
 			}
+			vkDestroyImageView(device, shadowCubeMapArrayView, nullptr);
 
 			vkDestroyImageView(device, shadowCubeMap.view, nullptr);
 			vkDestroyImage(device, shadowCubeMap.image, nullptr);
@@ -107,6 +192,7 @@ public:
 
 			// Depth attachment
 			vkDestroyImageView(device, offscreenPass.depth.view, nullptr);
+			vkDestroyImageView(device, offscreenPass.depthArrayView, nullptr);
 			vkDestroyImage(device, offscreenPass.depth.image, nullptr);
 			vkFreeMemory(device, offscreenPass.depth.mem, nullptr);
 
@@ -114,18 +200,26 @@ public:
 			{
 				vkDestroyFramebuffer(device, offscreenPass.frameBuffers[i], nullptr);
 			}
+			vkDestroyFramebuffer(device, offscreenPass.frameBufferMultiview, nullptr);
+			vkDestroyFramebuffer(device, offscreenPass.frameBufferLayered, nullptr);
 
 			vkDestroyRenderPass(device, offscreenPass.renderPass, nullptr);
+			vkDestroyRenderPass(device, offscreenPass.renderPassMultiview, nullptr);
+
+			vkDestroyQueryPool(device, queryPool, nullptr);
 
 			// Pipelines
 			vkDestroyPipeline(device, pipelines.scene, nullptr);
 			vkDestroyPipeline(device, pipelines.offscreen, nullptr);
+			vkDestroyPipeline(device, pipelines.offscreenMultiview, nullptr);
+			vkDestroyPipeline(device, pipelines.offscreenLayered, nullptr);
 			vkDestroyPipeline(device, pipelines.cubemapDisplay, nullptr);
 
 			vkDestroyPipelineLayout(device, pipelineLayouts.scene, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayouts.offscreen, nullptr);
 
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+			frameDescriptors.destroy();
 
 			// Uniform buffers
 			uniformBuffers.offscreen.destroy();
@@ -218,6 +312,11 @@ public:
 			view.subresourceRange.baseArrayLayer = i;
 			VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &shadowCubeMapFaceImageViews[i]));
 		}
+
+		view.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		view.subresourceRange.baseArrayLayer = 0;
+		view.subresourceRange.layerCount = 6;
+		VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &shadowCubeMapArrayView));
 	}
 
 	// Set up a separate render pass for the offscreen frame buffer
@@ -272,6 +371,22 @@ public:
 		renderPassCreateInfo.pSubpasses = &subpass;
 
 		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &offscreenPass.renderPass));
+
+		// The layered mode uses the same render pass with a framebuffer that has six layers, multiview needs a separate one
+		if (multiviewSupported) {
+			// Broadcast to all six faces (layers)
+			const uint32_t viewMask = 0b00111111;
+			// The faces don't share anything that would benefit from concurrent rendering
+			const uint32_t correlationMask = 0;
+			VkRenderPassMultiviewCreateInfo renderPassMultiviewCI{};
+			renderPassMultiviewCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+			renderPassMultiviewCI.subpassCount = 1;
+			renderPassMultiviewCI.pViewMasks = &viewMask;
+			renderPassMultiviewCI.correlationMaskCount = 1;
+			renderPassMultiviewCI.pCorrelationMasks = &correlationMask;
+			renderPassCreateInfo.pNext = &renderPassMultiviewCI;
+			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &offscreenPass.renderPassMultiview));
+		}
 	}
 
 	// Prepare a new framebuffer for offscreen rendering
@@ -315,6 +430,9 @@ public:
 		imageCreateInfo.format = offscreenDepthFormat;
 		imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
+		// One layer per face for the single pass modes
+		imageCreateInfo.arrayLayers = 6;
+
 		VkImageViewCreateInfo depthStencilView = vks::initializers::imageViewCreateInfo();
 		depthStencilView.viewType = VK_IMAGE_VIEW_TYPE_2D;
 		depthStencilView.format = offscreenDepthFormat;
@@ -340,17 +458,22 @@ public:
 		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &offscreenPass.depth.mem));
 		VK_CHECK_RESULT(vkBindImageMemory(device, offscreenPass.depth.image, offscreenPass.depth.mem, 0));
 
+		VkImageSubresourceRange depthSubresourceRange = depthStencilView.subresourceRange;
+		depthSubresourceRange.layerCount = 6;
 		vks::tools::setImageLayout(
 			layoutCmd,
 			offscreenPass.depth.image,
-			VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
 			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			depthSubresourceRange);
 
 		vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
 
 		depthStencilView.image = offscreenPass.depth.image;
 		VK_CHECK_RESULT(vkCreateImageView(device, &depthStencilView, nullptr, &offscreenPass.depth.view));
+		depthStencilView.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		depthStencilView.subresourceRange.layerCount = 6;
+		VK_CHECK_RESULT(vkCreateImageView(device, &depthStencilView, nullptr, &offscreenPass.depthArrayView));
 
 		VkImageView attachments[2];
 		attachments[1] = offscreenPass.depth.view;
@@ -368,28 +491,26 @@ public:
 			attachments[0] = shadowCubeMapFaceImageViews[i];
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenPass.frameBuffers[i]));
 		}
+
+		// Single pass modes
+		attachments[0] = shadowCubeMapArrayView;
+		attachments[1] = offscreenPass.depthArrayView;
+		if (multiviewSupported) {
+			// With multiview the layers are selected by the view mask of the render pass
+			fbufCreateInfo.renderPass = offscreenPass.renderPassMultiview;
+			fbufCreateInfo.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenPass.frameBufferMultiview));
+		}
+		if (layeredSupported) {
+			fbufCreateInfo.renderPass = offscreenPass.renderPass;
+			fbufCreateInfo.layers = 6;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenPass.frameBufferLayered));
+		}
 	}
 
-	// Updates a single cube map face
-	// Renders the scene with face's view directly to the cubemap layer `faceIndex`
-	// Uses push constants for quick update of view matrix for the current cube map face
-	void updateCubeFace(uint32_t faceIndex, VkCommandBuffer commandBuffer)
+	// View matrix for rendering the given cube map face
+	glm::mat4 cubeFaceViewMatrix(uint32_t faceIndex)
 	{
-		VkClearValue clearValues[2];
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-		clearValues[1].depthStencil = { 1.0f, 0 };
-
-		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		// Reuse render pass from example pass
-		renderPassBeginInfo.renderPass = offscreenPass.renderPass;
-		renderPassBeginInfo.framebuffer = offscreenPass.frameBuffers[faceIndex];
-		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
-		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
-		renderPassBeginInfo.clearValueCount = 2;
-		renderPassBeginInfo.pClearValues = clearValues;
-
-		// Update view matrix via push constant
-
 		glm::mat4 viewMatrix = glm::mat4(1.0f);
 		switch (faceIndex)
 		{
@@ -414,6 +535,30 @@ public:
 			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 			break;
 		}
+		return viewMatrix;
+	}
+
+	// Updates a single cube map face
+	// Renders the scene with face's view directly to the cubemap layer `faceIndex`
+	// Uses push constants for quick update of view matrix for the current cube map face
+	void updateCubeFace(uint32_t faceIndex, VkCommandBuffer commandBuffer)
+	{
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		// Reuse render pass from example pass
+		renderPassBeginInfo.renderPass = offscreenPass.renderPass;
+		renderPassBeginInfo.framebuffer = offscreenPass.frameBuffers[faceIndex];
+		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
+		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		// Update view matrix via push constant
+		PushConstBlock pushConstBlock{};
+		pushConstBlock.view = cubeFaceViewMatrix(faceIndex);
 
 		// Render scene from cube face's point of view
 		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
@@ -425,36 +570,135 @@ public:
 			pipelineLayouts.offscreen,
 			VK_SHADER_STAGE_VERTEX_BIT,
 			0,
-			sizeof(glm::mat4),
-			&viewMatrix);
+			sizeof(PushConstBlock),
+			&pushConstBlock);
 
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
 		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.offscreen, 0, 1, &descriptorSets.offscreen, 0, NULL);
-		models.scene.draw(commandBuffer);
+		models.scene.bindBuffers(commandBuffer);
+		for (const Caster& caster : casters) {
+			if (caster.faceMask & (1u << faceIndex)) {
+				vkCmdDrawIndexed(commandBuffer, caster.indexCount, 1, caster.firstIndex, 0, 0);
+				stats.drawCalls++;
+				stats.faceDraws++;
+			}
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	// Renders all faces in a single render pass
+	// Multiview broadcasts every draw to all faces, the vertex shader collapses casters for faces they're culled for
+	// Layered rendering draws an instance of the caster per face it's visible in, and the vertex shader selects the face's layer
+	void updateCubeFacesSinglePass(VkCommandBuffer commandBuffer)
+	{
+		const bool multiview = (shadowPassMode == Multiview);
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = multiview ? offscreenPass.renderPassMultiview : offscreenPass.renderPass;
+		renderPassBeginInfo.framebuffer = multiview ? offscreenPass.frameBufferMultiview : offscreenPass.frameBufferLayered;
+		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
+		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
 
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, multiview ? pipelines.offscreenMultiview : pipelines.offscreenLayered);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.offscreen, 0, 1, &descriptorSets.offscreen, 0, NULL);
+		models.scene.bindBuffers(commandBuffer);
+		PushConstBlock pushConstBlock{};
+		for (const Caster& caster : casters) {
+			uint32_t faceCount = 0;
+			for (uint32_t face = 0; face < 6; face++) {
+				faceCount += (caster.faceMask >> face) & 1;
+			}
+			if (faceCount == 0) {
+				continue;
+			}
+			pushConstBlock.faceMask = caster.faceMask;
+			vkCmdPushConstants(commandBuffer, pipelineLayouts.offscreen, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+			vkCmdDrawIndexed(commandBuffer, caster.indexCount, multiview ? 1 : faceCount, caster.firstIndex, 0, 0);
+			stats.drawCalls++;
+			stats.faceDraws += faceCount;
+		}
 		vkCmdEndRenderPass(commandBuffer);
 	}
 
+	// Test the casters' bounding spheres against the frustums of the cube map faces
+	void cullCasters()
+	{
+		stats.culledFaceDraws = 0;
+		const glm::vec3 lightPosition = glm::vec3(lightPos);
+		for (Caster& caster : casters) {
+			caster.faceMask = 0;
+			for (uint32_t face = 0; face < 6; face++) {
+				bool visible = true;
+				if (faceCulling) {
+					// The faces have a 90 degree field of view looking down the negative z axis in view space
+					const glm::vec3 pos = glm::vec3(cubeFaceViewMatrix(face) * glm::vec4(caster.center - lightPosition, 1.0f));
+					const float depth = -pos.z;
+					const float sideDistance = caster.radius * std::sqrt(2.0f);
+					visible = (depth + caster.radius >= zNear) && (depth - caster.radius <= zFar)
+						&& (std::abs(pos.x) - depth <= sideDistance) && (std::abs(pos.y) - depth <= sideDistance);
+				}
+				if (visible) {
+					caster.faceMask |= (1u << face);
+				} else {
+					stats.culledFaceDraws++;
+				}
+			}
+		}
+	}
+
 	void buildCommandBuffers()
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(drawCmdBuffers.size()); ++i)
+		{
+			buildCommandBuffer(i);
+		}
+	}
+
+	void buildCommandBuffer(uint32_t i)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
+		// The previous submission of this command buffer has finished, so the sets of its frame slot can be reset and allocated again
+		allocateDescriptorSets(frameDescriptors.beginFrame(i));
+
 		{
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
 			/*
-				Generate shadow cube maps using one render pass per face
+				Generate shadow cube maps using one render pass per face or a single render pass for all faces
 			*/
 			{
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, 2);
+					vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+				}
+
 				VkViewport viewport = vks::initializers::viewport((float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 
 				VkRect2D scissor = vks::initializers::rect2D(offscreenPass.width, offscreenPass.height, 0, 0);
 				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-				for (uint32_t face = 0; face < 6; face++) {
-					updateCubeFace(face, drawCmdBuffers[i]);
+				stats.drawCalls = 0;
+				stats.faceDraws = 0;
+				if (shadowPassMode == PerFace) {
+					for (uint32_t face = 0; face < 6; face++) {
+						updateCubeFace(face, drawCmdBuffers[i]);
+					}
+				} else {
+					updateCubeFacesSinglePass(drawCmdBuffers[i]);
+				}
+
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
 				}
 			}
 
@@ -515,18 +759,30 @@ public:
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
 		models.debugcube.loadFromFile(getAssetPath() + "models/cube.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		models.scene.loadFromFile(getAssetPath() + "models/shadowscene_fire.gltf", vulkanDevice, queue, glTFLoadingFlags);
+
+		// Get the world space bounds of the scene's primitives, vertices have been transformed by the node hierarchy and flipped at load time
+		for (vkglTF::Node* node : models.scene.linearNodes) {
+			if (!node->mesh) {
+				continue;
+			}
+			const glm::mat4 nodeMatrix = node->getMatrix();
+			for (vkglTF::Primitive* primitive : node->mesh->primitives) {
+				glm::vec3 min = glm::vec3(FLT_MAX);
+				glm::vec3 max = glm::vec3(-FLT_MAX);
+				for (uint32_t j = 0; j < 8; j++) {
+					glm::vec3 corner = glm::vec3((j & 1) ? primitive->dimensions.max.x : primitive->dimensions.min.x, (j & 2) ? primitive->dimensions.max.y : primitive->dimensions.min.y, (j & 4) ? primitive->dimensions.max.z : primitive->dimensions.min.z);
+					corner = glm::vec3(nodeMatrix * glm::vec4(corner, 1.0f));
+					corner.y *= -1.0f;
+					min = glm::min(min, corner);
+					max = glm::max(max, corner);
+				}
+				casters.push_back({ primitive->firstIndex, primitive->indexCount, (min + max) * 0.5f, glm::length(max - min) * 0.5f, 0x3F });
+			}
+		}
 	}
 
 	void setupDescriptors()
 	{
-		// Pool
-		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
-		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
-		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
-
 		// Layout
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 			// Binding 0 : Vertex shader uniform buffer
@@ -537,11 +793,18 @@ public:
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
 
-		// Sets
-		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
-		
+		// Transient pools, one chain per command buffer
+		const std::vector<vks::DescriptorAllocator::PoolSizeRatio> poolRatios = {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f }
+		};
+		frameDescriptors.init(device, static_cast<uint32_t>(drawCmdBuffers.size()), 2, poolRatios);
+	}
+
+	// Allocate and write the sets used by a command buffer from the transient allocator of its frame slot
+	void allocateDescriptorSets(vks::DescriptorAllocator& allocator)
+	{
 		// 3D scene
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.scene));
 		// Image descriptor for the cube map
 		VkDescriptorImageInfo texDescriptor =
 			vks::initializers::descriptorImageInfo(
@@ -551,19 +814,18 @@ public:
 
 		std::vector<VkWriteDescriptorSet> sceneDescriptorSets = {
 			// Binding 0 : Vertex shader uniform buffer
-			vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.scene.descriptor),
+			vks::initializers::writeDescriptorSet(VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.scene.descriptor),
 			// Binding 1 : Fragment shader shadow sampler
-			vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptor)
+			vks::initializers::writeDescriptorSet(VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptor)
 		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(sceneDescriptorSets.size()), sceneDescriptorSets.data(), 0, nullptr);
+		descriptorSets.scene = allocator.allocate(descriptorSetLayout, sceneDescriptorSets);
 
 		// Offscreen
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.offscreen));
 		std::vector<VkWriteDescriptorSet> offScreenWriteDescriptorSets = {
 			// Binding 0 : Vertex shader uniform buffer
-			vks::initializers::writeDescriptorSet(descriptorSets.offscreen, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.offscreen.descriptor),
+			vks::initializers::writeDescriptorSet(VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.offscreen.descriptor),
 		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(offScreenWriteDescriptorSets.size()), offScreenWriteDescriptorSets.data(), 0, nullptr);
+		descriptorSets.offscreen = allocator.allocate(descriptorSetLayout, offScreenWriteDescriptorSets);
 	}
 
 	void preparePipelines()
@@ -574,8 +836,8 @@ public:
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.scene));
 
 		// Offscreen pipeline layout
-		// Push constants for cube map face view matrices
-		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0);
+		// Push constants for cube map face view matrices (per face passes) and the caster's face mask (single pass modes)
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(PushConstBlock), 0);
 		// Push constant ranges are part of the pipeline layout
 		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
 		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
@@ -619,6 +881,16 @@ public:
 		pipelineCI.layout = pipelineLayouts.offscreen;
 		pipelineCI.renderPass = offscreenPass.renderPass;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreen));
+		if (multiviewSupported) {
+			shaderStages[0] = loadShader(getShadersPath() + "shadowmappingomni/offscreen_multiview.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+			pipelineCI.renderPass = offscreenPass.renderPassMultiview;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreenMultiview));
+		}
+		if (layeredSupported) {
+			shaderStages[0] = loadShader(getShadersPath() + "shadowmappingomni/offscreen_layered.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+			pipelineCI.renderPass = offscreenPass.renderPass;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreenLayered));
+		}
 
 		// Cube map display pipeline
 		shaderStages[0] = loadShader(getShadersPath() + "shadowmappingomni/cubemapdisplay.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
@@ -635,7 +907,7 @@ public:
 	void prepareUniformBuffers()
 	{
 		// Offscreen vertex shader uniform buffer
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.offscreen, sizeof(UniformData)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.offscreen, sizeof(UniformDataOffscreen)));
 		// Scene vertex shader uniform buffer
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.scene, sizeof(UniformData)));
 		// Map persistent
@@ -660,16 +932,46 @@ public:
 		uniformDataOffscreen.view = glm::mat4(1.0f);
 		uniformDataOffscreen.model = glm::translate(glm::mat4(1.0f), glm::vec3(-lightPos.x, -lightPos.y, -lightPos.z));
 		uniformDataOffscreen.lightPos = lightPos;
-		memcpy(uniformBuffers.offscreen.mapped, &uniformDataOffscreen, sizeof(UniformData));
+		for (uint32_t i = 0; i < 6; i++) {
+			uniformDataOffscreen.faceViews[i] = cubeFaceViewMatrix(i);
+		}
+		memcpy(uniformBuffers.offscreen.mapped, &uniformDataOffscreen, sizeof(UniformDataOffscreen));
+	}
+
+	void prepareTimestamps()
+	{
+		if (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits == 0) {
+			return;
+		}
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 2;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+	}
+
+	void getTimings()
+	{
+		if (queryPool == VK_NULL_HANDLE) {
+			return;
+		}
+		uint64_t timestamps[2];
+		if (vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			stats.shadowPassTime = (float)(timestamps[1] - timestamps[0]) * vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+		}
 	}
 
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The light moves every frame, so the casters are culled again and the current command buffer is recorded with the new face masks
+		cullCasters();
+		buildCommandBuffer(currentBuffer);
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 		VulkanExampleBase::submitFrame();
+		getTimings();
 	}
 
 	void prepare()
@@ -682,6 +984,7 @@ public:
 		prepareOffscreenRenderpass();
 		preparePipelines();
 		prepareOffscreenFramebuffer();
+		prepareTimestamps();
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -701,6 +1004,31 @@ public:
 			if (overlay->checkBox("Display shadow cube render target", &displayCubeMap)) {
 				buildCommandBuffers();
 			}
+			std::vector<std::string> modes = { "One pass per face" };
+			if (multiviewSupported) {
+				modes.push_back("Multiview");
+			}
+			if (layeredSupported) {
+				modes.push_back("Layered");
+			}
+			// The combo box only lists the supported modes, so the index has to be mapped
+			int32_t modeIndex = 0;
+			for (int32_t i = 0; i < static_cast<int32_t>(modes.size()); i++) {
+				if (((modes[i] == "Multiview") && (shadowPassMode == Multiview)) || ((modes[i] == "Layered") && (shadowPassMode == Layered))) {
+					modeIndex = i;
+				}
+			}
+			if (overlay->comboBox("Shadow pass", &modeIndex, modes)) {
+				shadowPassMode = (modes[modeIndex] == "Multiview") ? Multiview : ((modes[modeIndex] == "Layered") ? Layered : PerFace);
+			}
+			overlay->checkBox("Cull casters per face", &faceCulling);
+		}
+		if (overlay->header("Statistics")) {
+			if (queryPool != VK_NULL_HANDLE) {
+				overlay->text("Shadow pass: %.3f ms", stats.shadowPassTime);
+			}
+			overlay->text("Draw calls: %d", stats.drawCalls);
+			overlay->text("Caster faces: %d drawn, %d culled", stats.faceDraws, stats.culledFaceDraws);
 		}
 	}
 };
@@ -1,6 +1,10 @@
 /*
 * Vulkan Example - Screen space ambient occlusion example
 *
+* The ambient occlusion can be calculated at full, half or quarter resolution and is upsampled with a depth aware (bilateral) filter
+* Optional temporal accumulation evaluates only a part of the sample kernel per frame and blends the result with the reprojected
+* results of previous frames. The GPU time of each pass is measured with timestamp queries
+*
 * Copyright (C) by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -11,6 +15,8 @@
 
 #define SSAO_KERNEL_SIZE 64
 #define SSAO_RADIUS 0.3f
+// Number of sets the kernel is split into, with temporal accumulation one set is evaluated per frame
+#define SSAO_KERNEL_SETS 4
 
 // We use a smaller noise kernel size on Android due to lower computational power
 #if defined(__ANDROID__)
@@ -35,21 +41,49 @@ public:
 
 	struct UBOSSAOParams {
 		glm::mat4 projection;
+		// Transforms view space positions of the current frame into clip space of the previous frame
+		glm::mat4 reprojection;
 		int32_t ssao = true;
 		int32_t ssaoOnly = false;
 		int32_t ssaoBlur = true;
+		// Range of the sample kernel evaluated in the current frame
+		int32_t kernelOffset = 0;
+		int32_t sampleCount = SSAO_KERNEL_SIZE;
+		// Rotation of the noise vectors, changes with each frame if temporal accumulation is enabled
+		float noiseRotation = 0.0f;
+		// Weight of the current frame when blending with the reprojected history
+		float temporalWeight = 0.25f;
 	} uboSSAOParams;
 
+	// The SSAO target size is the frame buffer size divided by 2^ssaoResolution
+	enum SSAOResolution { Full = 0, Half = 1, Quarter = 2 };
+#if defined(__ANDROID__)
+	int32_t ssaoResolution{ Half };
+#else
+	int32_t ssaoResolution{ Full };
+#endif
+	int32_t temporalAccumulation{ false };
+	uint32_t frameIndex{ 0 };
+	glm::mat4 prevView{ 1.0f };
+
+	// Timestamps written after each pass, used to display the GPU time per pass
+	// The pool stays null if the graphics queue family doesn't support timestamps
+	static const uint32_t timestampCount = 6;
+	VkQueryPool queryPool{ VK_NULL_HANDLE };
+	std::array<float, timestampCount - 1> passTimings{};
+
 	struct {
 		VkPipeline offscreen{ VK_NULL_HANDLE };
 		VkPipeline composition{ VK_NULL_HANDLE };
 		VkPipeline ssao{ VK_NULL_HANDLE };
+		VkPipeline ssaoTemporal{ VK_NULL_HANDLE };
 		VkPipeline ssaoBlur{ VK_NULL_HANDLE };
 	} pipelines;
 
 	struct {
 		VkPipelineLayout gBuffer{ VK_NULL_HANDLE };
 		VkPipelineLayout ssao{ VK_NULL_HANDLE };
+		VkPipelineLayout ssaoTemporal{ VK_NULL_HANDLE };
 		VkPipelineLayout ssaoBlur{ VK_NULL_HANDLE };
 		VkPipelineLayout composition{ VK_NULL_HANDLE };
 	} pipelineLayouts;
@@ -57,14 +91,16 @@ public:
 	struct {
 		VkDescriptorSet gBuffer{ VK_NULL_HANDLE };
 		VkDescriptorSet ssao{ VK_NULL_HANDLE };
+		VkDescriptorSet ssaoTemporal{ VK_NULL_HANDLE };
 		VkDescriptorSet ssaoBlur{ VK_NULL_HANDLE };
 		VkDescriptorSet composition{ VK_NULL_HANDLE };
-		const uint32_t count = 4;
+		const uint32_t count = 5;
 	} descriptorSets;
 
 	struct {
 		VkDescriptorSetLayout gBuffer{ VK_NULL_HANDLE };
 		VkDescriptorSetLayout ssao{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout ssaoTemporal{ VK_NULL_HANDLE };
 		VkDescriptorSetLayout ssaoBlur{ VK_NULL_HANDLE };
 		VkDescriptorSetLayout composition{ VK_NULL_HANDLE };
 	} descriptorSetLayouts;
@@ -111,6 +147,10 @@ public:
 		struct SSAO : public FrameBuffer {
 			FrameBufferAttachment color;
 		} ssao, ssaoBlur;
+		// Accumulated occlusion (r) and linear depth (g), copied to the history for the next frame
+		struct Temporal : public SSAO {
+			FrameBufferAttachment history;
+		} ssaoTemporal;
 	} frameBuffers{};
 
 	// One sampler for the frame buffer color attachments
@@ -126,41 +166,40 @@ public:
 		camera.position = { 1.0f, 0.75f, 0.0f };
 		camera.setRotation(glm::vec3(0.0f, 90.0f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, uboSceneParams.nearPlane, uboSceneParams.farPlane);
+		commandLineParser.add("ssaoresolution", { "-sr", "--ssaoresolution" }, 1, "SSAO resolution (0 = full, 1 = half, 2 = quarter)");
+		commandLineParser.add("ssaotemporal", { "-st", "--ssaotemporal" }, 0, "Enable temporal accumulation of the SSAO");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("ssaoresolution")) {
+			ssaoResolution = std::min(std::max(commandLineParser.getValueAsInt("ssaoresolution", ssaoResolution), (int32_t)Full), (int32_t)Quarter);
+		}
+		temporalAccumulation = commandLineParser.isSet("ssaotemporal");
 	}
 
 	~VulkanExample()
 	{
 		if (device) {
-			vkDestroySampler(device, colorSampler, nullptr);
-
-			// Attachments
-			frameBuffers.offscreen.position.destroy(device);
-			frameBuffers.offscreen.normal.destroy(device);
-			frameBuffers.offscreen.albedo.destroy(device);
-			frameBuffers.offscreen.depth.destroy(device);
-			frameBuffers.ssao.color.destroy(device);
-			frameBuffers.ssaoBlur.color.destroy(device);
-
-			// Framebuffers
-			frameBuffers.offscreen.destroy(device);
-			frameBuffers.ssao.destroy(device);
-			frameBuffers.ssaoBlur.destroy(device);
+			destroyOffscreenFramebuffers();
 
 			vkDestroyPipeline(device, pipelines.offscreen, nullptr);
 			vkDestroyPipeline(device, pipelines.composition, nullptr);
 			vkDestroyPipeline(device, pipelines.ssao, nullptr);
+			vkDestroyPipeline(device, pipelines.ssaoTemporal, nullptr);
 			vkDestroyPipeline(device, pipelines.ssaoBlur, nullptr);
 
 			vkDestroyPipelineLayout(device, pipelineLayouts.gBuffer, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayouts.ssao, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayouts.ssaoTemporal, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayouts.ssaoBlur, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayouts.composition, nullptr);
 
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.gBuffer, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.ssao, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.ssaoTemporal, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.ssaoBlur, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.composition, nullptr);
 
+			vkDestroyQueryPool(device, queryPool, nullptr);
+
 			// Uniform buffers
 			uniformBuffers.sceneParams.destroy();
 			uniformBuffers.ssaoKernel.destroy();
@@ -178,7 +217,7 @@ public:
 	// Create a frame buffer attachment
 	void createAttachment(
 		VkFormat format,
-		VkImageUsageFlagBits usage,
+		VkImageUsageFlags usage,
 		FrameBufferAttachment *attachment,
 		uint32_t width,
 		uint32_t height)
@@ -235,19 +274,73 @@ public:
 		VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &attachment->view));
 	}
 
+	// Create a render pass and frame buffer for a pass writing a single color attachment
+	void prepareColorFramebuffer(FrameBuffer* frameBuffer, FrameBufferAttachment* attachment)
+	{
+		VkAttachmentDescription attachmentDescription{};
+		attachmentDescription.format = attachment->format;
+		attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.pColorAttachments = &colorReference;
+		subpass.colorAttachmentCount = 1;
+
+		std::array<VkSubpassDependency, 2> dependencies;
+
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		VkRenderPassCreateInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.pAttachments = &attachmentDescription;
+		renderPassInfo.attachmentCount = 1;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = 2;
+		renderPassInfo.pDependencies = dependencies.data();
+		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffer->renderPass));
+
+		VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
+		fbufCreateInfo.renderPass = frameBuffer->renderPass;
+		fbufCreateInfo.pAttachments = &attachment->view;
+		fbufCreateInfo.attachmentCount = 1;
+		fbufCreateInfo.width = frameBuffer->width;
+		fbufCreateInfo.height = frameBuffer->height;
+		fbufCreateInfo.layers = 1;
+		VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffer->frameBuffer));
+	}
+
 	void prepareOffscreenFramebuffers()
 	{
 		// Attachments
-#if defined(__ANDROID__)
-		const uint32_t ssaoWidth = width / 2;
-		const uint32_t ssaoHeight = height / 2;
-#else
-		const uint32_t ssaoWidth = width;
-		const uint32_t ssaoHeight = height;
-#endif
+		const uint32_t ssaoWidth = std::max(width >> ssaoResolution, 1u);
+		const uint32_t ssaoHeight = std::max(height >> ssaoResolution, 1u);
 
 		frameBuffers.offscreen.setSize(width, height);
 		frameBuffers.ssao.setSize(ssaoWidth, ssaoHeight);
+		frameBuffers.ssaoTemporal.setSize(ssaoWidth, ssaoHeight);
 		frameBuffers.ssaoBlur.setSize(width, height);
 
 		// Find a suitable depth format
@@ -264,6 +357,10 @@ public:
 		// SSAO
 		createAttachment(VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssao.color, ssaoWidth, ssaoHeight);				// Color
 
+		// SSAO temporal accumulation
+		createAttachment(VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, &frameBuffers.ssaoTemporal.color, ssaoWidth, ssaoHeight);			// Occlusion + depth
+		createAttachment(VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, &frameBuffers.ssaoTemporal.history, ssaoWidth, ssaoHeight);		// Previous frame
+
 		// SSAO blur
 		createAttachment(VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssaoBlur.color, width, height);					// Color
 
@@ -350,119 +447,23 @@ public:
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.offscreen.frameBuffer));
 		}
 
-		// SSAO
-		{
-			VkAttachmentDescription attachmentDescription{};
-			attachmentDescription.format = frameBuffers.ssao.color.format;
-			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-			attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-			VkSubpassDescription subpass = {};
-			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass.pColorAttachments = &colorReference;
-			subpass.colorAttachmentCount = 1;
-
-			std::array<VkSubpassDependency, 2> dependencies;
-
-			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			dependencies[1].srcSubpass = 0;
-			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			VkRenderPassCreateInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = &attachmentDescription;
-			renderPassInfo.attachmentCount = 1;
-			renderPassInfo.subpassCount = 1;
-			renderPassInfo.pSubpasses = &subpass;
-			renderPassInfo.dependencyCount = 2;
-			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.ssao.renderPass));
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.ssao.renderPass;
-			fbufCreateInfo.pAttachments = &frameBuffers.ssao.color.view;
-			fbufCreateInfo.attachmentCount = 1;
-			fbufCreateInfo.width = frameBuffers.ssao.width;
-			fbufCreateInfo.height = frameBuffers.ssao.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.ssao.frameBuffer));
-		}
-
-		// SSAO Blur
-		{
-			VkAttachmentDescription attachmentDescription{};
-			attachmentDescription.format = frameBuffers.ssaoBlur.color.format;
-			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-			attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-			VkSubpassDescription subpass = {};
-			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass.pColorAttachments = &colorReference;
-			subpass.colorAttachmentCount = 1;
-
-			std::array<VkSubpassDependency, 2> dependencies;
-
-			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			dependencies[1].srcSubpass = 0;
-			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			VkRenderPassCreateInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = &attachmentDescription;
-			renderPassInfo.attachmentCount = 1;
-			renderPassInfo.subpassCount = 1;
-			renderPassInfo.pSubpasses = &subpass;
-			renderPassInfo.dependencyCount = 2;
-			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.ssaoBlur.renderPass));
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
-			fbufCreateInfo.pAttachments = &frameBuffers.ssaoBlur.color.view;
-			fbufCreateInfo.attachmentCount = 1;
-			fbufCreateInfo.width = frameBuffers.ssaoBlur.width;
-			fbufCreateInfo.height = frameBuffers.ssaoBlur.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.ssaoBlur.frameBuffer));
+		// SSAO, temporal accumulation and blur
+		prepareColorFramebuffer(&frameBuffers.ssao, &frameBuffers.ssao.color);
+		prepareColorFramebuffer(&frameBuffers.ssaoTemporal, &frameBuffers.ssaoTemporal.color);
+		prepareColorFramebuffer(&frameBuffers.ssaoBlur, &frameBuffers.ssaoBlur.color);
+
+		// All targets are sampled by the composition pass, even if the pass writing them is disabled, so they need to be in a valid layout
+		// The history is cleared to a depth of zero, which is rejected by the temporal pass
+		VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		for (FrameBufferAttachment* attachment : { &frameBuffers.ssao.color, &frameBuffers.ssaoTemporal.color, &frameBuffers.ssaoBlur.color }) {
+			vks::tools::setImageLayout(layoutCmd, attachment->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
 		}
+		vks::tools::setImageLayout(layoutCmd, frameBuffers.ssaoTemporal.history.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+		VkClearColorValue clearColor = { { 1.0f, 0.0f, 0.0f, 0.0f } };
+		vkCmdClearColorImage(layoutCmd, frameBuffers.ssaoTemporal.history.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &subresourceRange);
+		vks::tools::setImageLayout(layoutCmd, frameBuffers.ssaoTemporal.history.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
 
 		// Shared sampler used for all color attachments
 		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
@@ -480,6 +481,36 @@ public:
 		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &colorSampler));
 	}
 
+	void destroyOffscreenFramebuffers()
+	{
+		vkDestroySampler(device, colorSampler, nullptr);
+
+		// Attachments
+		frameBuffers.offscreen.position.destroy(device);
+		frameBuffers.offscreen.normal.destroy(device);
+		frameBuffers.offscreen.albedo.destroy(device);
+		frameBuffers.offscreen.depth.destroy(device);
+		frameBuffers.ssao.color.destroy(device);
+		frameBuffers.ssaoTemporal.color.destroy(device);
+		frameBuffers.ssaoTemporal.history.destroy(device);
+		frameBuffers.ssaoBlur.color.destroy(device);
+
+		// Framebuffers
+		frameBuffers.offscreen.destroy(device);
+		frameBuffers.ssao.destroy(device);
+		frameBuffers.ssaoTemporal.destroy(device);
+		frameBuffers.ssaoBlur.destroy(device);
+	}
+
+	// Resolution or pass setup changed, the render passes stay compatible with the pipelines
+	void recreateOffscreenFramebuffers()
+	{
+		vkDeviceWaitIdle(device);
+		destroyOffscreenFramebuffers();
+		prepareOffscreenFramebuffers();
+		updateDescriptorSets();
+	}
+
 	void loadAssets()
 	{
 		vkglTF::descriptorBindingFlags  = vkglTF::DescriptorBindingFlags::ImageBaseColor;
@@ -491,10 +522,18 @@ public:
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
+		// Passes that don't contribute to the final image are skipped, so the timings reflect the selected settings
+		const bool ssaoPasses = uboSSAOParams.ssao || uboSSAOParams.ssaoOnly;
+
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (queryPool != VK_NULL_HANDLE) {
+				vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, timestampCount);
+				vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			}
+
 			/*
 				Offscreen SSAO generation
 			*/
@@ -533,6 +572,10 @@ public:
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+				}
+
 				/*
 					Second pass: SSAO generation
 				*/
@@ -540,47 +583,113 @@ public:
 				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
 				clearValues[1].depthStencil = { 1.0f, 0 };
 
-				renderPassBeginInfo.framebuffer = frameBuffers.ssao.frameBuffer;
-				renderPassBeginInfo.renderPass = frameBuffers.ssao.renderPass;
-				renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssao.width;
-				renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssao.height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues.data();
+				if (ssaoPasses) {
+					renderPassBeginInfo.framebuffer = frameBuffers.ssao.frameBuffer;
+					renderPassBeginInfo.renderPass = frameBuffers.ssao.renderPass;
+					renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssao.width;
+					renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssao.height;
+					renderPassBeginInfo.clearValueCount = 2;
+					renderPassBeginInfo.pClearValues = clearValues.data();
 
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+					vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-				viewport = vks::initializers::viewport((float)frameBuffers.ssao.width, (float)frameBuffers.ssao.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				scissor = vks::initializers::rect2D(frameBuffers.ssao.width, frameBuffers.ssao.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+					viewport = vks::initializers::viewport((float)frameBuffers.ssao.width, (float)frameBuffers.ssao.height, 0.0f, 1.0f);
+					vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+					scissor = vks::initializers::rect2D(frameBuffers.ssao.width, frameBuffers.ssao.height, 0, 0);
+					vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssao, 0, 1, &descriptorSets.ssao, 0, nullptr);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssao);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssao, 0, 1, &descriptorSets.ssao, 0, nullptr);
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssao);
+					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+					vkCmdEndRenderPass(drawCmdBuffers[i]);
+				}
+
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2);
+				}
 
 				/*
-					Third pass: SSAO blur
+					Optional: Blend with the reprojected results of previous frames
 				*/
 
-				renderPassBeginInfo.framebuffer = frameBuffers.ssaoBlur.frameBuffer;
-				renderPassBeginInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
-				renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssaoBlur.width;
-				renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssaoBlur.height;
+				if (ssaoPasses && temporalAccumulation) {
+					renderPassBeginInfo.framebuffer = frameBuffers.ssaoTemporal.frameBuffer;
+					renderPassBeginInfo.renderPass = frameBuffers.ssaoTemporal.renderPass;
+					renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssaoTemporal.width;
+					renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssaoTemporal.height;
+
+					vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssaoTemporal, 0, 1, &descriptorSets.ssaoTemporal, 0, nullptr);
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoTemporal);
+					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+
+					vkCmdEndRenderPass(drawCmdBuffers[i]);
+
+					// The result becomes the history of the next frame
+					VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+					std::array<VkImageMemoryBarrier, 2> imageBarriers = { vks::initializers::imageMemoryBarrier(), vks::initializers::imageMemoryBarrier() };
+					imageBarriers[0].image = frameBuffers.ssaoTemporal.color.image;
+					imageBarriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+					imageBarriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+					imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+					imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+					imageBarriers[0].subresourceRange = subresourceRange;
+					imageBarriers[1].image = frameBuffers.ssaoTemporal.history.image;
+					imageBarriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+					imageBarriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					imageBarriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+					imageBarriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+					imageBarriers[1].subresourceRange = subresourceRange;
+					vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+					VkImageCopy copyRegion{};
+					copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+					copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+					copyRegion.extent = { (uint32_t)frameBuffers.ssaoTemporal.width, (uint32_t)frameBuffers.ssaoTemporal.height, 1 };
+					vkCmdCopyImage(drawCmdBuffers[i], frameBuffers.ssaoTemporal.color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frameBuffers.ssaoTemporal.history.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+					for (auto& imageBarrier : imageBarriers) {
+						imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+						imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+						imageBarrier.oldLayout = imageBarrier.newLayout;
+						imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+					}
+					vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+				}
+
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 3);
+				}
 
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				/*
+					Third pass: SSAO blur and depth aware upsampling to full resolution
+				*/
 
-				viewport = vks::initializers::viewport((float)frameBuffers.ssaoBlur.width, (float)frameBuffers.ssaoBlur.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				scissor = vks::initializers::rect2D(frameBuffers.ssaoBlur.width, frameBuffers.ssaoBlur.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+				if (ssaoPasses && uboSSAOParams.ssaoBlur) {
+					renderPassBeginInfo.framebuffer = frameBuffers.ssaoBlur.frameBuffer;
+					renderPassBeginInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
+					renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssaoBlur.width;
+					renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssaoBlur.height;
 
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssaoBlur, 0, 1, &descriptorSets.ssaoBlur, 0, nullptr);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoBlur);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+					vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+					viewport = vks::initializers::viewport((float)frameBuffers.ssaoBlur.width, (float)frameBuffers.ssaoBlur.height, 0.0f, 1.0f);
+					vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+					scissor = vks::initializers::rect2D(frameBuffers.ssaoBlur.width, frameBuffers.ssaoBlur.height, 0, 0);
+					vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssaoBlur, 0, 1, &descriptorSets.ssaoBlur, 0, nullptr);
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoBlur);
+					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+
+					vkCmdEndRenderPass(drawCmdBuffers[i]);
+				}
+
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 4);
+				}
 			}
 
 			/*
@@ -617,6 +726,10 @@ public:
 				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition);
 				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdWriteTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 5);
+				}
+
 				drawUI(drawCmdBuffers[i]);
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
@@ -631,7 +744,7 @@ public:
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 12)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes,  descriptorSets.count);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -639,8 +752,6 @@ public:
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
 		VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo;
 		VkDescriptorSetAllocateInfo descriptorAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, nullptr, 1);
-		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
-		std::vector<VkDescriptorImageInfo> imageDescriptors;
 
 		// Layouts and Sets
 
@@ -650,13 +761,8 @@ public:
 		};
 		setLayoutCreateInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &descriptorSetLayouts.gBuffer));
-
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.gBuffer;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.gBuffer));
-		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets.gBuffer, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.sceneParams.descriptor),
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
 		// SSAO Generation
 		setLayoutBindings = {
@@ -668,37 +774,30 @@ public:
 		};
 		setLayoutCreateInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &descriptorSetLayouts.ssao));
-
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.ssao;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.ssao));
-		imageDescriptors = {
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.position.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.normal.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-		};
-		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),					// FS Position+Depth
-			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),					// FS Normals
-			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &ssaoNoise.descriptor),		// FS SSAO Noise
-			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoKernel.descriptor),		// FS SSAO Kernel UBO
-			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.ssaoParams.descriptor),		// FS SSAO Params UBO
+
+		// SSAO temporal accumulation
+		setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),						// FS Sampler SSAO
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),						// FS Sampler history
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),						// FS Position+Depth
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),								// FS Params UBO
 		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		setLayoutCreateInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &descriptorSetLayouts.ssaoTemporal));
+		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.ssaoTemporal;
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.ssaoTemporal));
 
 		// SSAO Blur
 		setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),						// FS Sampler SSAO
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),						// FS Position+Depth
 		};
 		setLayoutCreateInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &descriptorSetLayouts.ssaoBlur));
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.ssaoBlur;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.ssaoBlur));
-		imageDescriptors = {
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssao.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-		};
-		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets.ssaoBlur, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
 		// Composition
 		setLayoutBindings = {
@@ -713,11 +812,70 @@ public:
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &descriptorSetLayouts.composition));
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.composition;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.composition));
+
+		updateDescriptorSets();
+	}
+
+	// The image descriptors need to be updated if the offscreen frame buffers are recreated
+	void updateDescriptorSets()
+	{
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+		std::vector<VkDescriptorImageInfo> imageDescriptors;
+
+		// With temporal accumulation, the blur and composition passes use the accumulated occlusion
+		FrameBufferAttachment& ssaoResult = temporalAccumulation ? frameBuffers.ssaoTemporal.color : frameBuffers.ssao.color;
+
+		// G-Buffer creation (offscreen scene rendering)
+		writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.gBuffer, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.sceneParams.descriptor),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// SSAO Generation
 		imageDescriptors = {
 			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.position.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
 			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.normal.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.albedo.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		};
+		writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),					// FS Position+Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),					// FS Normals
+			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &ssaoNoise.descriptor),		// FS SSAO Noise
+			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoKernel.descriptor),		// FS SSAO Kernel UBO
+			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.ssaoParams.descriptor),		// FS SSAO Params UBO
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// SSAO temporal accumulation
+		imageDescriptors = {
 			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssao.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoTemporal.history.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.position.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		};
+		writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoTemporal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),			// FS Sampler SSAO
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoTemporal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),			// FS Sampler history
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoTemporal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[2]),			// FS Sampler Position+Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoTemporal, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoParams.descriptor),	// FS SSAO Params UBO
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// SSAO Blur
+		imageDescriptors = {
+			vks::initializers::descriptorImageInfo(colorSampler, ssaoResult.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.position.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		};
+		writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoBlur, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoBlur, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// Composition
+		imageDescriptors = {
+			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.position.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.normal.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.albedo.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(colorSampler, ssaoResult.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
 			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoBlur.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
 		};
 		writeDescriptorSets = {
@@ -745,6 +903,10 @@ public:
 		pipelineLayoutCreateInfo.setLayoutCount = 1;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.ssao));
 
+		pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.ssaoTemporal;
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.ssaoTemporal));
+
 		pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.ssaoBlur;
 		pipelineLayoutCreateInfo.setLayoutCount = 1;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.ssaoBlur));
@@ -803,6 +965,12 @@ public:
 		shaderStages[1].pSpecializationInfo = &specializationInfo;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.ssao));
 
+		// SSAO temporal accumulation pipeline
+		pipelineCreateInfo.renderPass = frameBuffers.ssaoTemporal.renderPass;
+		pipelineCreateInfo.layout = pipelineLayouts.ssaoTemporal;
+		shaderStages[1] = loadShader(getShadersPath() + "ssao/temporal.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.ssaoTemporal));
+
 		// SSAO blur pipeline
 		pipelineCreateInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
 		pipelineCreateInfo.layout = pipelineLayouts.ssaoBlur;
@@ -861,13 +1029,16 @@ public:
 		std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
 
 		// Sample kernel
+		// The kernel consists of consecutive sets that are evaluated on different frames with temporal accumulation
+		// Each set is distributed over the whole radius, so a single set gives a (noisier) estimate of the full kernel
+		const uint32_t setSize = SSAO_KERNEL_SIZE / SSAO_KERNEL_SETS;
 		std::vector<glm::vec4> ssaoKernel(SSAO_KERNEL_SIZE);
 		for (uint32_t i = 0; i < SSAO_KERNEL_SIZE; ++i)
 		{
 			glm::vec3 sample(rndDist(rndEngine) * 2.0 - 1.0, rndDist(rndEngine) * 2.0 - 1.0, rndDist(rndEngine));
 			sample = glm::normalize(sample);
 			sample *= rndDist(rndEngine);
-			float scale = float(i) / float(SSAO_KERNEL_SIZE);
+			float scale = float(i % setSize) / float(setSize);
 			scale = lerp(0.1f, 1.0f, scale * scale);
 			ssaoKernel[i] = glm::vec4(sample * scale, 0.0f);
 		}
@@ -903,6 +1074,22 @@ public:
 	void updateUniformBufferSSAOParams()
 	{
 		uboSSAOParams.projection = camera.matrices.perspective;
+		uboSSAOParams.reprojection = camera.matrices.perspective * prevView * glm::inverse(camera.matrices.view);
+		prevView = camera.matrices.view;
+
+		if (temporalAccumulation) {
+			// Evaluate one set of the kernel per frame and rotate the noise, so consecutive frames sample different directions
+			const uint32_t setSize = SSAO_KERNEL_SIZE / SSAO_KERNEL_SETS;
+			uboSSAOParams.kernelOffset = (frameIndex % SSAO_KERNEL_SETS) * setSize;
+			uboSSAOParams.sampleCount = setSize;
+			// Golden angle, so the rotations don't repeat
+			uboSSAOParams.noiseRotation = std::fmod((float)frameIndex * 2.39996323f, glm::two_pi<float>());
+			frameIndex++;
+		} else {
+			uboSSAOParams.kernelOffset = 0;
+			uboSSAOParams.sampleCount = SSAO_KERNEL_SIZE;
+			uboSSAOParams.noiseRotation = 0.0f;
+		}
 
 		VK_CHECK_RESULT(uniformBuffers.ssaoParams.map());
 		uniformBuffers.ssaoParams.copyTo(&uboSSAOParams, sizeof(uboSSAOParams));
@@ -917,10 +1104,32 @@ public:
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
+		if (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0) {
+			VkQueryPoolCreateInfo queryPoolInfo{};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = timestampCount;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+		}
 		buildCommandBuffers();
 		prepared = true;
 	}
 
+	// Get the GPU times of the passes from the last frame, the base class waits for the queue to become idle after each frame
+	void getPassTimings()
+	{
+		if (queryPool == VK_NULL_HANDLE) {
+			return;
+		}
+		std::array<uint64_t, timestampCount> timestamps;
+		if (vkGetQueryPoolResults(device, queryPool, 0, timestampCount, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			const float timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+			for (uint32_t i = 0; i < static_cast<uint32_t>(passTimings.size()); i++) {
+				passTimings[i] = (float)(timestamps[i + 1] - timestamps[i]) * timestampPeriod / 1000000.0f;
+			}
+		}
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
@@ -938,6 +1147,7 @@ public:
 		updateUniformBufferMatrices();
 		updateUniformBufferSSAOParams();
 		draw();
+		getPassTimings();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
@@ -946,7 +1156,31 @@ public:
 			overlay->checkBox("Enable SSAO", &uboSSAOParams.ssao);
 			overlay->checkBox("SSAO blur", &uboSSAOParams.ssaoBlur);
 			overlay->checkBox("SSAO pass only", &uboSSAOParams.ssaoOnly);
+			if (overlay->comboBox("Resolution", &ssaoResolution, { "Full", "Half", "Quarter" })) {
+				recreateOffscreenFramebuffers();
+			}
+			// The history is cleared when the frame buffers are recreated, so no stale results are blended in
+			if (overlay->checkBox("Temporal accumulation", &temporalAccumulation)) {
+				recreateOffscreenFramebuffers();
+			}
 		}
+		if (overlay->header("GPU timings")) {
+			overlay->text("SSAO: %dx%d, %d samples", frameBuffers.ssao.width, frameBuffers.ssao.height, uboSSAOParams.sampleCount);
+			if (queryPool != VK_NULL_HANDLE) {
+				overlay->text("G-Buffer: %.3f ms", passTimings[0]);
+				overlay->text("SSAO: %.3f ms", passTimings[1]);
+				overlay->text("Temporal: %.3f ms", passTimings[2]);
+				overlay->text("Blur + upsample: %.3f ms", passTimings[3]);
+				overlay->text("Composition: %.3f ms", passTimings[4]);
+				overlay->text("SSAO total: %.3f ms", passTimings[1] + passTimings[2] + passTimings[3]);
+			}
+		}
+	}
+
+	virtual void windowResized()
+	{
+		recreateOffscreenFramebuffers();
+		buildCommandBuffers();
 	}
 };
 
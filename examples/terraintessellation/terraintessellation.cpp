@@ -2,7 +2,9 @@
 * Vulkan Example - Dynamic terrain tessellation
 * 
 * This samples draw a terrain from a heightmap texture and uses tessellation to add in details based on camera distance
-* The height level is generated in the vertex shader by reading from the heightmap image
+* The terrain is split into a quadtree of chunks (CDLOD), the height map tiles of the chunks are streamed from disk on worker threads
+* into a fixed size tile cache, so only the tiles required for the current view are kept in memory
+* The height level is generated in the tessellation evaluation shader by reading from the tile cache
 *
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
@@ -12,8 +14,16 @@
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
 #include "frustum.hpp"
-#include <ktx.h>
-#include <ktxvulkan.h>
+#include "terraintessellation.h"
+
+// Number of patches along each edge of a terrain chunk
+#define TERRAIN_CHUNK_GRID 16
+// Number of tiles that can be resident on the GPU at the same time
+#define TERRAIN_TILE_CACHE_SIZE 256
+// Max. number of chunks drawn per frame
+#define TERRAIN_MAX_CHUNKS 4096
+// Max. number of streamed tiles uploaded to the tile cache per frame
+#define TERRAIN_UPLOADS_PER_FRAME 8
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -21,21 +31,53 @@ public:
 	bool wireframe = false;
 	bool tessellation = true;
 
+	// Per instance data of a terrain chunk
+	struct ChunkInstance {
+		// xy = world space origin, z = size
+		glm::vec4 rect;
+		// x = tile cache layer, y = tile cache layer of the parent, zw = offset of the chunk within the parent tile
+		glm::vec4 tile;
+		// x = morph start distance, y = morph end distance
+		glm::vec4 morph;
+	};
+
 	// Holds the buffers for rendering the tessellated terrain
 	struct {
-		struct Vertices {
-			VkBuffer buffer{ VK_NULL_HANDLE };
-			VkDeviceMemory memory{ VK_NULL_HANDLE };
-		} vertices;
-		struct Indices {
-			int count;
-			VkBuffer buffer{ VK_NULL_HANDLE };
-			VkDeviceMemory memory{ VK_NULL_HANDLE };
-		} indices;
+		// Patch grid shared by all chunks
+		vks::Buffer vertices;
+		vks::Buffer indices;
+		uint32_t indexCount{ 0 };
+		// Chunk instances for each command buffer (persistently mapped)
+		vks::Buffer instances;
+		// Indexed indirect draw command for each command buffer, the instance count is updated with the chunk selection
+		vks::Buffer indirect;
+		// Terrain dimensions in world units
+		float size{ 128.0f };
+		float sampleSpacing{ 1.0f };
+		// Chunks are subdivided if the camera is closer than this multiple of their size
+		float lodRangeScale{ 8.0f };
+		uint32_t chunkCount{ 0 };
 	} terrain;
 
+	// Height map tiles are streamed from disk and uploaded to a fixed number of texture array layers
+	struct {
+		TerrainTileStreamer streamer;
+		TerrainTileCache cache;
+		vks::Texture2DArray heights{};
+		vks::Texture2DArray normals{};
+		// Persistently mapped staging buffer for the tiles uploaded in one frame
+		vks::Buffer staging;
+		VkDeviceSize heightStride{ 0 };
+		VkDeviceSize normalStride{ 0 };
+		std::vector<VkBufferImageCopy> heightCopies;
+		std::vector<VkBufferImageCopy> normalCopies;
+		VkCommandBuffer uploadCmdBuffer{ VK_NULL_HANDLE };
+		// Incremented for every frame, used for least recently used eviction of the tile cache
+		uint64_t frameIndex{ 1 };
+		std::vector<uint64_t> requests;
+	} tiles;
+
 	struct {
-		vks::Texture2D heightMap;
 		vks::Texture2D skySphere;
 		vks::Texture2DArray terrainArray;
 	} textures;
@@ -54,12 +96,14 @@ public:
 		glm::mat4 projection;
 		glm::mat4 modelview;
 		glm::vec4 lightPos = glm::vec4(-48.0f, -40.0f, 46.0f, 0.0f);
+		glm::vec4 cameraPos;
 		glm::vec4 frustumPlanes[6];
 		float displacementFactor = 32.0f;
 		float tessellationFactor = 0.75f;
 		glm::vec2 viewportDim;
 		// Desired size of tessellated quad patch edge
 		float tessellatedEdgeSize = 20.0f;
+		float terrainSize;
 	} uniformDataTessellation;
 
 	// Skysphere vertex shader stage
@@ -111,6 +155,7 @@ public:
 
 	~VulkanExample()
 	{
+		tiles.streamer.stop();
 		if (device) {
 			vkDestroyPipeline(device, pipelines.terrain, nullptr);
 			if (pipelines.wireframe != VK_NULL_HANDLE) {
@@ -127,14 +172,18 @@ public:
 			uniformBuffers.skysphereVertex.destroy();
 			uniformBuffers.terrainTessellation.destroy();
 
-			textures.heightMap.destroy();
 			textures.skySphere.destroy();
 			textures.terrainArray.destroy();
 
-			vkDestroyBuffer(device, terrain.vertices.buffer, nullptr);
-			vkFreeMemory(device, terrain.vertices.memory, nullptr);
-			vkDestroyBuffer(device, terrain.indices.buffer, nullptr);
-			vkFreeMemory(device, terrain.indices.memory, nullptr);
+			terrain.vertices.destroy();
+			terrain.indices.destroy();
+			terrain.instances.destroy();
+			terrain.indirect.destroy();
+
+			tiles.heights.destroy();
+			tiles.normals.destroy();
+			tiles.staging.destroy();
+			vkFreeCommandBuffers(device, cmdPool, 1, &tiles.uploadCmdBuffer);
 
 			if (queryPool != VK_NULL_HANDLE) {
 				vkDestroyQueryPool(device, queryPool, nullptr);
@@ -224,29 +273,9 @@ public:
 		// Terrain textures are stored in a texture array with layers corresponding to terrain height
 		textures.terrainArray.loadFromFile(getAssetPath() + "textures/terrain_texturearray_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 
-		// Height data is stored in a one-channel texture
-		textures.heightMap.loadFromFile(getAssetPath() + "textures/terrain_heightmap_r16.ktx", VK_FORMAT_R16_UNORM, vulkanDevice, queue);
-
-		VkSamplerCreateInfo samplerInfo = vks::initializers::samplerCreateInfo();
-
-		// Setup a mirroring sampler for the height map
-		vkDestroySampler(device, textures.heightMap.sampler, nullptr);
-		samplerInfo.magFilter = VK_FILTER_LINEAR;
-		samplerInfo.minFilter = VK_FILTER_LINEAR;
-		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
-		samplerInfo.addressModeV = samplerInfo.addressModeU;
-		samplerInfo.addressModeW = samplerInfo.addressModeU;
-		samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
-		samplerInfo.minLod = 0.0f;
-		samplerInfo.maxLod = (float)textures.heightMap.mipLevels;
-		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device, &samplerInfo, nullptr, &textures.heightMap.sampler));
-		textures.heightMap.descriptor.sampler = textures.heightMap.sampler;
-
 		// Setup a repeating sampler for the terrain texture layers
 		vkDestroySampler(device, textures.terrainArray.sampler, nullptr);
-		samplerInfo = vks::initializers::samplerCreateInfo();
+		VkSamplerCreateInfo samplerInfo = vks::initializers::samplerCreateInfo();
 		samplerInfo.magFilter = VK_FILTER_LINEAR;
 		samplerInfo.minFilter = VK_FILTER_LINEAR;
 		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
@@ -315,11 +344,14 @@ public:
 				vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, 0);
 			}
 			// Render
+			// The chunks are drawn as instances of the patch grid, the selected chunks and their count are written to this command buffer's part of the instance and indirect buffers each frame
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframe : pipelines.terrain);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.terrain, 0, 1, &descriptorSets.terrain, 0, nullptr);
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &terrain.vertices.buffer, offsets);
+			VkDeviceSize instanceOffset = i * TERRAIN_MAX_CHUNKS * sizeof(ChunkInstance);
+			vkCmdBindVertexBuffers(drawCmdBuffers[i], 1, 1, &terrain.instances.buffer, &instanceOffset);
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], terrain.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], terrain.indices.count, 1, 0, 0, 0);
+			vkCmdDrawIndexedIndirect(drawCmdBuffers[i], terrain.indirect.buffer, i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
 			if (deviceFeatures.pipelineStatisticsQuery) {
 				// End pipeline statistics query
 				vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
@@ -333,182 +365,311 @@ public:
 		}
 	}
 
-	// Generate a terrain quad patch with normals based on heightmap data
-	void generateTerrain()
+	// Create the patch grid shared by all chunks and the per command buffer instance and indirect draw buffers
+	void prepareChunkBuffers()
 	{
-		const uint32_t patchSize{ 64 };
-		const float uvScale{ 1.0f };
-
-		uint16_t* heightdata;
-		uint32_t dim;
-		uint32_t scale;
-
-		ktxResult result;
-		ktxTexture* ktxTexture;
-
-		// We load the heightmap from an un-compressed ktx image with one channel that contains heights
-		std::string filename = getAssetPath() + "textures/terrain_heightmap_r16.ktx";
-#if defined(__ANDROID__)
-		// On Android we need to load the file using the asset manager
-		AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
-		assert(asset);
-		size_t size = AAsset_getLength(asset);
-		assert(size > 0);
-		ktx_uint8_t* textureData = new ktx_uint8_t[size];
-		AAsset_read(asset, textureData, size);
-		AAsset_close(asset);
-		result = ktxTexture_CreateFromMemory(textureData, size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
-		delete[] textureData;
-
-#else
-		result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
-#endif
-		assert(result == KTX_SUCCESS);
-		ktx_size_t ktxSize = ktxTexture_GetImageSize(ktxTexture, 0);
-		ktx_uint8_t* ktxImage = ktxTexture_GetData(ktxTexture);
-		dim = ktxTexture->baseWidth;
-		heightdata = new uint16_t[dim * dim];
-		memcpy(heightdata, ktxImage, ktxSize);
-		scale = dim / patchSize;
-		ktxTexture_Destroy(ktxTexture);
-
-		const uint32_t vertexCount = patchSize * patchSize;
-		// We use the Vertex definition from the glTF model loader, so we can re-use the vertex input state
-		vkglTF::Vertex *vertices = new vkglTF::Vertex[vertexCount];
-
-		const float wx = 2.0f;
-		const float wy = 2.0f;
-
-		// Generate a two-dimensional vertex patch
-		for (auto x = 0; x < patchSize; x++) {
-			for (auto y = 0; y < patchSize; y++) {
-				uint32_t index = (x + y * patchSize);
-				vertices[index].pos[0] = x * wx + wx / 2.0f - (float)patchSize * wx / 2.0f;
-				vertices[index].pos[1] = 0.0f;
-				vertices[index].pos[2] = y * wy + wy / 2.0f - (float)patchSize * wy / 2.0f;
-				vertices[index].uv = glm::vec2((float)x / (patchSize - 1), (float)y / (patchSize - 1)) * uvScale;
+		const uint32_t gridDim = TERRAIN_CHUNK_GRID + 1;
+		std::vector<glm::vec2> vertices(gridDim * gridDim);
+		for (uint32_t z = 0; z < gridDim; z++) {
+			for (uint32_t x = 0; x < gridDim; x++) {
+				vertices[x + z * gridDim] = glm::vec2((float)x, (float)z) / (float)TERRAIN_CHUNK_GRID;
 			}
 		}
-
-		// Calculate normals from the height map using a sobel filter
-		for (auto x = 0; x < patchSize; x++) {
-			for (auto y = 0; y < patchSize; y++) {
-				// We get 
-				float heights[3][3];
-				for (auto sx = -1; sx <= 1; sx++) {
-					for (auto sy = -1; sy <= 1; sy++) {
-						// Get height at sampled position from heightmap
-						glm::ivec2 rpos = glm::ivec2(x + sx, y + sy) * glm::ivec2(scale);
-						rpos.x = std::max(0, std::min(rpos.x, (int)dim - 1));
-						rpos.y = std::max(0, std::min(rpos.y, (int)dim - 1));
-						rpos /= glm::ivec2(scale);
-						heights[sx + 1][sy + 1] = *(heightdata + (rpos.x + rpos.y * dim) * scale) / 65535.0f;
-					}
-				}
-				glm::vec3 normal;
-				// Gx sobel filter
-				normal.x = heights[0][0] - heights[2][0] + 2.0f * heights[0][1] - 2.0f * heights[2][1] + heights[0][2] - heights[2][2];
-				// Gy sobel filter
-				normal.z = heights[0][0] + 2.0f * heights[1][0] + heights[2][0] - heights[0][2] - 2.0f * heights[1][2] - heights[2][2];
-				// Calculate missing up component of the normal using the filtered x and y axis
-				// The first value controls the bump strength
-				normal.y = 0.25f * sqrt( 1.0f - normal.x * normal.x - normal.z * normal.z);
-
-				vertices[x + y * patchSize].normal = glm::normalize(normal * glm::vec3(2.0f, 1.0f, 2.0f));
+		std::vector<uint32_t> indices;
+		indices.reserve(TERRAIN_CHUNK_GRID * TERRAIN_CHUNK_GRID * 4);
+		for (uint32_t z = 0; z < TERRAIN_CHUNK_GRID; z++) {
+			for (uint32_t x = 0; x < TERRAIN_CHUNK_GRID; x++) {
+				const uint32_t index = x + z * gridDim;
+				indices.push_back(index);
+				indices.push_back(index + gridDim);
+				indices.push_back(index + gridDim + 1);
+				indices.push_back(index + 1);
 			}
 		}
+		terrain.indexCount = static_cast<uint32_t>(indices.size());
+
+		// Stage the patch grid to the device
+		vks::Buffer vertexStaging, indexStaging;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vertexStaging, vertices.size() * sizeof(glm::vec2), vertices.data()));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indexStaging, indices.size() * sizeof(uint32_t), indices.data()));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &terrain.vertices, vertexStaging.size));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &terrain.indices, indexStaging.size));
+		vulkanDevice->copyBuffer(&vertexStaging, &terrain.vertices, queue);
+		vulkanDevice->copyBuffer(&indexStaging, &terrain.indices, queue);
+		vertexStaging.destroy();
+		indexStaging.destroy();
+
+		// Chunk instances are written by the host every frame, each command buffer uses its own part of the buffers
+		const uint32_t bufferCount = static_cast<uint32_t>(drawCmdBuffers.size());
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &terrain.instances, bufferCount * TERRAIN_MAX_CHUNKS * sizeof(ChunkInstance)));
+		VK_CHECK_RESULT(terrain.instances.map());
+		std::vector<VkDrawIndexedIndirectCommand> drawCommands(bufferCount, { terrain.indexCount, 0, 0, 0, 0 });
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &terrain.indirect, bufferCount * sizeof(VkDrawIndexedIndirectCommand), drawCommands.data()));
+		VK_CHECK_RESULT(terrain.indirect.map());
+	}
 
-		delete[] heightdata;
+	// Create one texture array layer per tile cache slot
+	void createTileArray(vks::Texture2DArray& texture, VkFormat format)
+	{
+		texture.device = vulkanDevice;
+		texture.width = TERRAIN_TILE_DIM;
+		texture.height = TERRAIN_TILE_DIM;
+		texture.mipLevels = 1;
+		texture.layerCount = TERRAIN_TILE_CACHE_SIZE;
+
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = format;
+		imageCI.extent = { texture.width, texture.height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = texture.layerCount;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &texture.image));
 
-		// Generate indices
-		const uint32_t w = (patchSize - 1);
-		const uint32_t indexCount = w * w * 4;
-		uint32_t *indices = new uint32_t[indexCount];
-		for (auto x = 0; x < w; x++)
-		{
-			for (auto y = 0; y < w; y++)
-			{
-				uint32_t index = (x + y * w) * 4;
-				indices[index] = (x + y * patchSize);
-				indices[index + 1] = indices[index] + patchSize;
-				indices[index + 2] = indices[index + 1] + 1;
-				indices[index + 3] = indices[index] + 1;
-			}
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, texture.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &texture.deviceMemory));
+		VK_CHECK_RESULT(vkBindImageMemory(device, texture.image, texture.deviceMemory, 0));
+
+		// Tiles are sampled at texel centers with the border texels providing the neighbouring samples, so no tile ever samples another layer
+		VkSamplerCreateInfo samplerInfo = vks::initializers::samplerCreateInfo();
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = samplerInfo.addressModeU;
+		samplerInfo.addressModeW = samplerInfo.addressModeU;
+		samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = 0.0f;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device, &samplerInfo, nullptr, &texture.sampler));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewCI.format = format;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, texture.layerCount };
+		viewCI.image = texture.image;
+		VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &texture.view));
+
+		texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		texture.updateDescriptor();
+	}
+
+	// Copy a streamed tile into the staging buffer and add the copies to its tile cache layer
+	void stageTile(const TerrainTile& tile, uint32_t slot)
+	{
+		const uint32_t index = static_cast<uint32_t>(tiles.heightCopies.size());
+		const VkDeviceSize heightOffset = index * tiles.heightStride;
+		const VkDeviceSize normalOffset = TERRAIN_UPLOADS_PER_FRAME * tiles.heightStride + index * tiles.normalStride;
+		memcpy((uint8_t*)tiles.staging.mapped + heightOffset, tile.heights.data(), tile.heights.size() * sizeof(uint16_t));
+		memcpy((uint8_t*)tiles.staging.mapped + normalOffset, tile.normals.data(), tile.normals.size() * sizeof(uint32_t));
+
+		VkBufferImageCopy copyRegion{};
+		copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, slot, 1 };
+		copyRegion.imageExtent = { TERRAIN_TILE_DIM, TERRAIN_TILE_DIM, 1 };
+		copyRegion.bufferOffset = heightOffset;
+		tiles.heightCopies.push_back(copyRegion);
+		copyRegion.bufferOffset = normalOffset;
+		tiles.normalCopies.push_back(copyRegion);
+	}
+
+	// Record the copies of all staged tiles, the tile cache images are in shader read layout before and after the copies
+	void recordTileCopies(VkCommandBuffer cmdBuffer)
+	{
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, TERRAIN_TILE_CACHE_SIZE };
+		for (vks::Texture2DArray* texture : { &tiles.heights, &tiles.normals }) {
+			vks::tools::setImageLayout(cmdBuffer, texture->image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		}
+		vkCmdCopyBufferToImage(cmdBuffer, tiles.staging.buffer, tiles.heights.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(tiles.heightCopies.size()), tiles.heightCopies.data());
+		vkCmdCopyBufferToImage(cmdBuffer, tiles.staging.buffer, tiles.normals.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(tiles.normalCopies.size()), tiles.normalCopies.data());
+		for (vks::Texture2DArray* texture : { &tiles.heights, &tiles.normals }) {
+			vks::tools::setImageLayout(cmdBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT);
 		}
-		terrain.indices.count = indexCount;
-
-		// Upload vertices and indices to device
-
-		uint32_t vertexBufferSize = vertexCount * sizeof(vkglTF::Vertex);
-		uint32_t indexBufferSize = indexCount * sizeof(uint32_t);
-
-		struct {
-			VkBuffer buffer;
-			VkDeviceMemory memory;
-		} vertexStaging, indexStaging;
-
-		// Stage the terrain vertex data to the device
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			vertexBufferSize,
-			&vertexStaging.buffer,
-			&vertexStaging.memory,
-			vertices));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			indexBufferSize,
-			&indexStaging.buffer,
-			&indexStaging.memory,
-			indices));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			vertexBufferSize,
-			&terrain.vertices.buffer,
-			&terrain.vertices.memory));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			indexBufferSize,
-			&terrain.indices.buffer,
-			&terrain.indices.memory));
-
-		// Copy from staging buffers
+		tiles.heightCopies.clear();
+		tiles.normalCopies.clear();
+	}
+
+	// Open the height map for streaming and make the coarsest tile, which covers the whole terrain, resident
+	void prepareTerrain()
+	{
+		const std::string fileName = getAssetPath() + "textures/terrain_heightmap_r16.ktx";
+		if (!tiles.streamer.heightMap.open(fileName)) {
+			vks::tools::exitFatal("Could not open the height map \"" + fileName + "\" for streaming, an uncompressed 16 bit single channel KTX file is required", -1);
+		}
+		terrain.sampleSpacing = terrain.size / (float)tiles.streamer.heightMap.dim;
+		tiles.streamer.heightMap.close();
+		const uint32_t workerCount = std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 2));
+		tiles.streamer.start(fileName, workerCount, terrain.sampleSpacing, uniformDataTessellation.displacementFactor);
+		tiles.cache.init(TERRAIN_TILE_CACHE_SIZE);
+
+		createTileArray(tiles.heights, VK_FORMAT_R16_UNORM);
+		createTileArray(tiles.normals, VK_FORMAT_R8G8B8A8_UNORM);
+		tiles.heightStride = vks::tools::alignedSize((uint32_t)(TERRAIN_TILE_DIM * TERRAIN_TILE_DIM * sizeof(uint16_t)), 4);
+		tiles.normalStride = TERRAIN_TILE_DIM * TERRAIN_TILE_DIM * sizeof(uint32_t);
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &tiles.staging, TERRAIN_UPLOADS_PER_FRAME * (tiles.heightStride + tiles.normalStride)));
+		VK_CHECK_RESULT(tiles.staging.map());
+
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &tiles.uploadCmdBuffer));
+
+		// The root tile is loaded synchronously and never evicted, so there always is a tile to fall back to
+		TerrainTile root = tiles.streamer.load(terrainTileKey(tiles.streamer.lodCount() - 1, 0, 0));
+		const int32_t slot = tiles.cache.allocate(root, 0);
+		tiles.cache.slots[slot].pinned = true;
+		stageTile(root, slot);
 		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, TERRAIN_TILE_CACHE_SIZE };
+		vks::tools::setImageLayout(copyCmd, tiles.heights.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		vks::tools::setImageLayout(copyCmd, tiles.normals.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		recordTileCopies(copyCmd);
+		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
 
-		VkBufferCopy copyRegion = {};
+		prepareChunkBuffers();
+	}
 
-		copyRegion.size = vertexBufferSize;
-		vkCmdCopyBuffer(
-			copyCmd,
-			vertexStaging.buffer,
-			terrain.vertices.buffer,
-			1,
-			&copyRegion);
+	// Move tiles that finished streaming into the tile cache, returns true if the upload command buffer needs to be submitted
+	bool uploadTiles()
+	{
+		TerrainTile tile;
+		while ((tiles.heightCopies.size() < TERRAIN_UPLOADS_PER_FRAME) && tiles.streamer.fetch(tile)) {
+			if (tiles.cache.find(tile.key) >= 0) {
+				continue;
+			}
+			// Tiles used by the current frame are not evicted, if the cache is full with those the tile is dropped and requested again later
+			const int32_t slot = tiles.cache.allocate(tile, tiles.frameIndex);
+			if (slot >= 0) {
+				stageTile(tile, slot);
+			}
+		}
+		if (tiles.heightCopies.empty()) {
+			return false;
+		}
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(tiles.uploadCmdBuffer, &cmdBufInfo));
+		recordTileCopies(tiles.uploadCmdBuffer);
+		VK_CHECK_RESULT(vkEndCommandBuffer(tiles.uploadCmdBuffer));
+		return true;
+	}
 
-		copyRegion.size = indexBufferSize;
-		vkCmdCopyBuffer(
-			copyCmd,
-			indexStaging.buffer,
-			terrain.indices.buffer,
-			1,
-			&copyRegion);
+	float chunkSize(uint32_t lod)
+	{
+		return (float)(TERRAIN_TILE_SIZE << lod) * terrain.sampleSpacing;
+	}
 
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+	bool chunkInTerrain(uint32_t lod, uint32_t x, uint32_t z)
+	{
+		const uint32_t texels = TERRAIN_TILE_SIZE << lod;
+		return (x * texels < tiles.streamer.heightMap.dim) && (z * texels < tiles.streamer.heightMap.dim);
+	}
 
-		vkDestroyBuffer(device, vertexStaging.buffer, nullptr);
-		vkFreeMemory(device, vertexStaging.memory, nullptr);
-		vkDestroyBuffer(device, indexStaging.buffer, nullptr);
-		vkFreeMemory(device, indexStaging.memory, nullptr);
+	glm::vec2 chunkOrigin(uint32_t lod, uint32_t x, uint32_t z)
+	{
+		return glm::vec2(-0.5f * terrain.size) + glm::vec2((float)x, (float)z) * chunkSize(lod);
+	}
 
-		delete[] vertices;
-		delete[] indices;
+	// The terrain is displaced along the negative y axis
+	bool chunkVisible(uint32_t lod, uint32_t x, uint32_t z, float minHeight, float maxHeight)
+	{
+		const float halfSize = 0.5f * chunkSize(lod);
+		const glm::vec2 center = chunkOrigin(lod, x, z) + glm::vec2(halfSize);
+		const float displacement = uniformDataTessellation.displacementFactor;
+		const float radius = glm::length(glm::vec3(halfSize, 0.5f * (maxHeight - minHeight) * displacement, halfSize));
+		return frustum.checkSphere(glm::vec3(center.x, -0.5f * (minHeight + maxHeight) * displacement, center.y), radius);
+	}
+
+	// Distance from the camera to the closest point of the (undisplaced) chunk, the same distance is used for geomorphing in the shaders
+	float chunkDistance(uint32_t lod, uint32_t x, uint32_t z, const glm::vec3& cameraPos)
+	{
+		const glm::vec2 origin = chunkOrigin(lod, x, z);
+		const glm::vec2 closest = glm::clamp(glm::vec2(cameraPos.x, cameraPos.z), origin, origin + glm::vec2(chunkSize(lod)));
+		return glm::length(cameraPos - glm::vec3(closest.x, 0.0f, closest.y));
+	}
+
+	float lodRange(uint32_t lod)
+	{
+		return chunkSize(lod) * terrain.lodRangeScale;
+	}
+
+	/*
+		Select the chunks to draw by descending the quadtree
+
+		A chunk is split into its four children if the camera is within the lod range of the next finer level and all visible children are resident.
+		Missing children are requested from the streamer, and the chunk is drawn in their place until they arrive.
+	*/
+	void selectChunk(uint32_t lod, uint32_t x, uint32_t z, int32_t slot, int32_t parentSlot, const glm::vec2& parentOffset, const glm::vec3& cameraPos, ChunkInstance* instances)
+	{
+		tiles.cache.touch(slot, tiles.frameIndex);
+		const TerrainTileCache::Slot& tile = tiles.cache.slots[slot];
+		if (!chunkVisible(lod, x, z, tile.minHeight, tile.maxHeight)) {
+			return;
+		}
+
+		if ((lod > 0) && (chunkDistance(lod, x, z, cameraPos) < lodRange(lod - 1))) {
+			int32_t childSlots[4];
+			bool childrenResident = true;
+			for (uint32_t i = 0; i < 4; i++) {
+				const uint32_t childX = x * 2 + (i & 1);
+				const uint32_t childZ = z * 2 + (i >> 1);
+				childSlots[i] = -1;
+				// The child's height range is not known before it has been loaded, the parent's range contains it
+				if (!chunkInTerrain(lod - 1, childX, childZ) || !chunkVisible(lod - 1, childX, childZ, tile.minHeight, tile.maxHeight)) {
+					continue;
+				}
+				const uint64_t key = terrainTileKey(lod - 1, childX, childZ);
+				childSlots[i] = tiles.cache.find(key);
+				if (childSlots[i] < 0) {
+					tiles.requests.push_back(key);
+					childrenResident = false;
+				}
+			}
+			if (childrenResident) {
+				for (uint32_t i = 0; i < 4; i++) {
+					if (childSlots[i] >= 0) {
+						selectChunk(lod - 1, x * 2 + (i & 1), z * 2 + (i >> 1), childSlots[i], slot, glm::vec2((float)(i & 1), (float)(i >> 1)) * 0.5f, cameraPos, instances);
+					}
+				}
+				return;
+			}
+		}
+
+		if (terrain.chunkCount >= TERRAIN_MAX_CHUNKS) {
+			return;
+		}
+		ChunkInstance& instance = instances[terrain.chunkCount++];
+		const glm::vec2 origin = chunkOrigin(lod, x, z);
+		instance.rect = glm::vec4(origin.x, origin.y, chunkSize(lod), 0.0f);
+		instance.tile = glm::vec4((float)slot, (float)parentSlot, parentOffset.x, parentOffset.y);
+		// Chunks morph into their parent towards the end of their lod range, the root has no parent to morph into
+		if (lod + 1 < tiles.streamer.lodCount()) {
+			instance.morph = glm::vec4(0.7f * lodRange(lod), lodRange(lod), 0.0f, 0.0f);
+		} else {
+			instance.morph = glm::vec4(1.0e30f, 2.0e30f, 0.0f, 0.0f);
+		}
+	}
+
+	// Select the chunks for the current frame, write them to the current command buffer's instances and request missing tiles
+	void selectChunks()
+	{
+		tiles.frameIndex++;
+		tiles.requests.clear();
+		terrain.chunkCount = 0;
+		const glm::vec3 cameraPos = glm::vec3(uniformDataTessellation.cameraPos);
+		ChunkInstance* instances = (ChunkInstance*)terrain.instances.mapped + currentBuffer * TERRAIN_MAX_CHUNKS;
+		const uint32_t rootLod = tiles.streamer.lodCount() - 1;
+		const int32_t rootSlot = tiles.cache.find(terrainTileKey(rootLod, 0, 0));
+		selectChunk(rootLod, 0, 0, rootSlot, rootSlot, glm::vec2(0.0f), cameraPos, instances);
+		VkDrawIndexedIndirectCommand* drawCommand = (VkDrawIndexedIndirectCommand*)terrain.indirect.mapped + currentBuffer;
+		drawCommand->instanceCount = terrain.chunkCount;
+		// Coarser tiles first, as finer tiles can only be used once their parents are resident
+		std::sort(tiles.requests.begin(), tiles.requests.end(), std::greater<uint64_t>());
+		tiles.streamer.request(tiles.requests);
 	}
 
 	void setupDescriptors()
@@ -516,7 +677,7 @@ public:
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -528,11 +689,13 @@ public:
 		// Terrain
 		setLayoutBindings = {
 			// Binding 0 : Shared Tessellation shader ubo
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 0),
-			// Binding 1 : Height map
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 0),
+			// Binding 1 : Height tile cache
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 1),
 			// Binding 2 : Terrain texture array layers
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+			// Binding 3 : Normal tile cache
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 3),
 		};
 		descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayouts.terrain));
@@ -558,10 +721,12 @@ public:
 		writeDescriptorSets = {
 			// Binding 0 : Shared tessellation shader ubo
 			vks::initializers::writeDescriptorSet(descriptorSets.terrain, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.terrainTessellation.descriptor),
-			// Binding 1 : Height map
-			vks::initializers::writeDescriptorSet(descriptorSets.terrain, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textures.heightMap.descriptor),
+			// Binding 1 : Height tile cache
+			vks::initializers::writeDescriptorSet(descriptorSets.terrain, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &tiles.heights.descriptor),
 			// Binding 2 : Terrain texture array layers
 			vks::initializers::writeDescriptorSet(descriptorSets.terrain, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.terrainArray.descriptor),
+			// Binding 3 : Normal tile cache
+			vks::initializers::writeDescriptorSet(descriptorSets.terrain, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &tiles.normals.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
@@ -619,7 +784,20 @@ public:
 		pipelineCI.pTessellationState = &tessellationState;
 		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
 		pipelineCI.pStages = shaderStages.data();
-		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::UV });
+
+		// Binding 0 is the patch grid, binding 1 the per chunk instance data
+		std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
+			vks::initializers::vertexInputBindingDescription(0, sizeof(glm::vec2), VK_VERTEX_INPUT_RATE_VERTEX),
+			vks::initializers::vertexInputBindingDescription(1, sizeof(ChunkInstance), VK_VERTEX_INPUT_RATE_INSTANCE),
+		};
+		std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
+			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32_SFLOAT, 0),
+			vks::initializers::vertexInputAttributeDescription(1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(ChunkInstance, rect)),
+			vks::initializers::vertexInputAttributeDescription(1, 2, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(ChunkInstance, tile)),
+			vks::initializers::vertexInputAttributeDescription(1, 3, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(ChunkInstance, morph)),
+		};
+		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo(vertexInputBindings, vertexInputAttributes);
+		pipelineCI.pVertexInputState = &vertexInputState;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.terrain));
 
 		// Terrain wireframe pipeline (if devie supports it)
@@ -639,6 +817,7 @@ public:
 		depthStencilState.depthWriteEnable = VK_FALSE;
 		pipelineCI.stageCount = 2;
 		pipelineCI.layout = pipelineLayouts.skysphere;
+		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::UV });
 		shaderStages[0] = loadShader(getShadersPath() + "terraintessellation/skysphere.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "terraintessellation/skysphere.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.skysphere));
@@ -665,6 +844,8 @@ public:
 		uniformDataTessellation.modelview = camera.matrices.view * glm::mat4(1.0f);
 		uniformDataTessellation.lightPos.y = -0.5f - uniformDataTessellation.displacementFactor; // todo: Not uesed yet
 		uniformDataTessellation.viewportDim = glm::vec2((float)width, (float)height);
+		uniformDataTessellation.cameraPos = glm::inverse(camera.matrices.view)[3];
+		uniformDataTessellation.terrainSize = terrain.size;
 
 		frustum.update(uniformDataTessellation.projection * uniformDataTessellation.modelview);
 		memcpy(uniformDataTessellation.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
@@ -692,7 +873,7 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
-		generateTerrain();
+		prepareTerrain();
 		if (deviceFeatures.pipelineStatisticsQuery) {
 			setupQueryResultBuffer();
 		}
@@ -706,8 +887,12 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		selectChunks();
+		// Tiles that finished streaming are copied to the tile cache in the same submission, ahead of the frame's draw commands
+		const bool upload = uploadTiles();
+		VkCommandBuffer commandBuffers[2] = { tiles.uploadCmdBuffer, drawCmdBuffers[currentBuffer] };
+		submitInfo.commandBufferCount = upload ? 2 : 1;
+		submitInfo.pCommandBuffers = upload ? &commandBuffers[0] : &commandBuffers[1];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 		// Read query results for displaying in next frame (if the device supports pipeline statistics)
 		if (deviceFeatures.pipelineStatisticsQuery) {
@@ -746,6 +931,11 @@ public:
 				overlay->text("TE invocations: %d", pipelineStats[1]);
 			}
 		}
+		if (overlay->header("Terrain streaming")) {
+			overlay->text("Resident tiles: %d / %d", tiles.cache.residentCount(), TERRAIN_TILE_CACHE_SIZE);
+			overlay->text("Pending tiles: %d", tiles.streamer.pendingCount());
+			overlay->text("Chunks drawn: %d", terrain.chunkCount);
+		}
 	}
 };
 
@@ -0,0 +1,391 @@
+/*
+* Vulkan Example - Dynamic terrain tessellation
+*
+* Streaming of height map tiles for the chunked (quadtree) terrain
+*
+* Tiles are read from a memory mapped height map on worker threads, so only the pages of the file that are
+* actually accessed are loaded. Normals are calculated per tile, finished tiles are handed to the renderer
+* which keeps them in a fixed size tile cache.
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "VulkanTools.h"
+
+// Number of quads a tile spans, a tile stores one more height sample than this along each edge
+#define TERRAIN_TILE_SIZE 64
+// Additional samples stored on each side of a tile, so that filtering at the tile edges does not need neighbouring tiles
+#define TERRAIN_TILE_BORDER 1
+// Dimension of a tile in texels
+#define TERRAIN_TILE_DIM (TERRAIN_TILE_SIZE + 1 + 2 * TERRAIN_TILE_BORDER)
+
+// Tiles are identified by their level of detail (0 = finest) and their position within that level
+inline uint64_t terrainTileKey(uint32_t lod, uint32_t x, uint32_t z)
+{
+	return ((uint64_t)lod << 48) | ((uint64_t)x << 24) | (uint64_t)z;
+}
+
+inline void terrainTileCoords(uint64_t key, uint32_t& lod, uint32_t& x, uint32_t& z)
+{
+	lod = (uint32_t)(key >> 48);
+	x = (uint32_t)((key >> 24) & 0xffffff);
+	z = (uint32_t)(key & 0xffffff);
+}
+
+struct TerrainTile
+{
+	uint64_t key{ 0 };
+	// TERRAIN_TILE_DIM x TERRAIN_TILE_DIM normalized heights
+	std::vector<uint16_t> heights;
+	// Normals packed into RGBA8 (xyz * 0.5 + 0.5)
+	std::vector<uint32_t> normals;
+	// Normalized height range of the tile, used for culling
+	float minHeight{ 0.0f };
+	float maxHeight{ 1.0f };
+};
+
+/*
+	Read only random access to the first mip level of an uncompressed 16 bit single channel KTX height map
+*/
+class TerrainHeightMap
+{
+public:
+	uint32_t dim{ 0 };
+
+	bool open(const std::string& fileName)
+	{
+#if defined(__ANDROID__)
+		// Uncompressed assets can be accessed directly from the apk without copying them
+		asset = AAssetManager_open(androidApp->activity->assetManager, fileName.c_str(), AASSET_MODE_BUFFER);
+		if (!asset) {
+			return false;
+		}
+		const uint8_t* data = static_cast<const uint8_t*>(AAsset_getBuffer(asset));
+		const size_t size = AAsset_getLength(asset);
+#else
+		if (!file.open(fileName)) {
+			return false;
+		}
+		const uint8_t* data = static_cast<const uint8_t*>(file.data());
+		const size_t size = file.size();
+#endif
+		// KTX 1.1 header: 12 byte identifier followed by 13 uint32 fields
+		const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+		if ((size < 64) || (memcmp(data, identifier, 12) != 0)) {
+			return false;
+		}
+		uint32_t header[13];
+		memcpy(header, data + 12, sizeof(header));
+		const uint32_t endianness = header[0];
+		const uint32_t pixelWidth = header[6];
+		const uint32_t pixelHeight = header[7];
+		const uint32_t bytesOfKeyValueData = header[12];
+		// The first mip level follows the key/value data and its size
+		const size_t imageOffset = 64 + bytesOfKeyValueData + sizeof(uint32_t);
+		if ((endianness != 0x04030201) || (pixelWidth != pixelHeight) || (imageOffset + (size_t)pixelWidth * pixelHeight * sizeof(uint16_t) > size)) {
+			return false;
+		}
+		dim = pixelWidth;
+		pixels = reinterpret_cast<const uint16_t*>(data + imageOffset);
+		return true;
+	}
+
+	void close()
+	{
+#if defined(__ANDROID__)
+		if (asset) {
+			AAsset_close(asset);
+			asset = nullptr;
+		}
+#else
+		file.close();
+#endif
+		pixels = nullptr;
+		dim = 0;
+	}
+
+	// Positions outside of the height map are clamped to the edge
+	uint16_t sample(int32_t x, int32_t z) const
+	{
+		x = std::min(std::max(x, 0), (int32_t)dim - 1);
+		z = std::min(std::max(z, 0), (int32_t)dim - 1);
+		return pixels[(size_t)z * dim + x];
+	}
+private:
+#if defined(__ANDROID__)
+	AAsset* asset{ nullptr };
+#else
+	vks::tools::MappedFile file;
+#endif
+	const uint16_t* pixels{ nullptr };
+};
+
+/*
+	Loads terrain tiles on worker threads
+
+	A tile at level of detail n covers TERRAIN_TILE_SIZE * 2^n texels of the height map and point samples every 2^n-th texel,
+	so the samples of a tile coincide with every other sample of its children and tiles of all levels share the same corners
+*/
+class TerrainTileStreamer
+{
+public:
+	TerrainHeightMap heightMap;
+
+	/**
+	* Open the height map and start the worker threads
+	*
+	* @param fileName Uncompressed 16 bit single channel KTX height map
+	* @param workerCount Number of threads loading tiles
+	* @param sampleSpacing Distance between two height map texels in world units
+	* @param heightScale Height of a fully white height map texel in world units
+	*/
+	bool start(const std::string& fileName, uint32_t workerCount, float sampleSpacing, float heightScale)
+	{
+		if (!heightMap.open(fileName)) {
+			return false;
+		}
+		this->sampleSpacing = sampleSpacing;
+		this->heightScale = heightScale;
+		lods = 1;
+		while (((uint32_t)TERRAIN_TILE_SIZE << (lods - 1)) < heightMap.dim) {
+			lods++;
+		}
+		stopping = false;
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers.push_back(std::thread(&TerrainTileStreamer::work, this));
+		}
+		return true;
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+		heightMap.close();
+	}
+
+	/** @brief Number of levels of detail, the coarsest level consists of a single tile */
+	uint32_t lodCount() const { return lods; }
+
+	/**
+	* Replace all requests that have not been started yet
+	*
+	* Requests are issued every frame for all tiles that are currently missing, so requests for tiles that are no longer required are dropped
+	*
+	* @param keys Tiles to load, in order of priority
+	*/
+	void request(const std::vector<uint64_t>& keys)
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			queue.clear();
+			for (auto key : keys) {
+				if ((loading.find(key) == loading.end()) && (completedKeys.find(key) == completedKeys.end())) {
+					queue.push_back(key);
+				}
+			}
+		}
+		condition.notify_all();
+	}
+
+	/** @brief Take a finished tile, returns false if no tile is ready */
+	bool fetch(TerrainTile& tile)
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		if (completed.empty()) {
+			return false;
+		}
+		tile = std::move(completed.front());
+		completed.pop_front();
+		completedKeys.erase(tile.key);
+		return true;
+	}
+
+	/** @brief Number of tiles queued or being loaded */
+	uint32_t pendingCount()
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		return static_cast<uint32_t>(queue.size() + loading.size());
+	}
+
+	/** @brief Read a tile and calculate its normals on the calling thread */
+	TerrainTile load(uint64_t key) const
+	{
+		uint32_t lod, tileX, tileZ;
+		terrainTileCoords(key, lod, tileX, tileZ);
+		const int32_t stride = 1 << lod;
+		const int32_t originX = (int32_t)tileX * TERRAIN_TILE_SIZE - TERRAIN_TILE_BORDER;
+		const int32_t originZ = (int32_t)tileZ * TERRAIN_TILE_SIZE - TERRAIN_TILE_BORDER;
+		auto height = [&](int32_t x, int32_t z) {
+			return heightMap.sample((originX + x) * stride, (originZ + z) * stride);
+		};
+
+		TerrainTile tile;
+		tile.key = key;
+		tile.heights.resize(TERRAIN_TILE_DIM * TERRAIN_TILE_DIM);
+		tile.normals.resize(TERRAIN_TILE_DIM * TERRAIN_TILE_DIM);
+		uint16_t minHeight = UINT16_MAX, maxHeight = 0;
+		for (int32_t z = 0; z < TERRAIN_TILE_DIM; z++) {
+			for (int32_t x = 0; x < TERRAIN_TILE_DIM; x++) {
+				const uint16_t h = height(x, z);
+				tile.heights[z * TERRAIN_TILE_DIM + x] = h;
+				minHeight = std::min(minHeight, h);
+				maxHeight = std::max(maxHeight, h);
+			}
+		}
+		tile.minHeight = minHeight / 65535.0f;
+		tile.maxHeight = maxHeight / 65535.0f;
+
+		// Normals from a sobel filter over the height samples of this level, the border samples read one further sample from the height map
+		const float scale = heightScale / 65535.0f / (8.0f * sampleSpacing * stride);
+		for (int32_t z = 0; z < TERRAIN_TILE_DIM; z++) {
+			for (int32_t x = 0; x < TERRAIN_TILE_DIM; x++) {
+				float h[3][3];
+				for (int32_t sx = -1; sx <= 1; sx++) {
+					for (int32_t sz = -1; sz <= 1; sz++) {
+						h[sx + 1][sz + 1] = height(x + sx, z + sz);
+					}
+				}
+				const float dx = (h[2][0] + 2.0f * h[2][1] + h[2][2] - h[0][0] - 2.0f * h[0][1] - h[0][2]) * scale;
+				const float dz = (h[0][2] + 2.0f * h[1][2] + h[2][2] - h[0][0] - 2.0f * h[1][0] - h[2][0]) * scale;
+				const float length = std::sqrt(dx * dx + 1.0f + dz * dz);
+				const uint32_t nx = (uint32_t)((-dx / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+				const uint32_t ny = (uint32_t)((1.0f / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+				const uint32_t nz = (uint32_t)((-dz / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+				tile.normals[z * TERRAIN_TILE_DIM + x] = nx | (ny << 8) | (nz << 16) | (255u << 24);
+			}
+		}
+		return tile;
+	}
+private:
+	float sampleSpacing{ 1.0f };
+	float heightScale{ 1.0f };
+	uint32_t lods{ 1 };
+	std::vector<std::thread> workers;
+	std::mutex queueMutex;
+	std::condition_variable condition;
+	bool stopping{ false };
+	std::deque<uint64_t> queue;
+	std::unordered_set<uint64_t> loading;
+	std::deque<TerrainTile> completed;
+	std::unordered_set<uint64_t> completedKeys;
+
+	void work()
+	{
+		while (true) {
+			uint64_t key;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				condition.wait(lock, [this] { return stopping || !queue.empty(); });
+				if (stopping) {
+					return;
+				}
+				key = queue.front();
+				queue.pop_front();
+				loading.insert(key);
+			}
+			TerrainTile tile = load(key);
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				loading.erase(key);
+				completedKeys.insert(key);
+				completed.push_back(std::move(tile));
+			}
+		}
+	}
+};
+
+/*
+	Fixed number of tile slots (texture array layers) with least recently used eviction
+*/
+class TerrainTileCache
+{
+public:
+	struct Slot {
+		uint64_t key{ UINT64_MAX };
+		uint64_t lastUsed{ 0 };
+		float minHeight{ 0.0f };
+		float maxHeight{ 1.0f };
+		// Pinned slots are never evicted (e.g. the root tile)
+		bool pinned{ false };
+	};
+	std::vector<Slot> slots;
+
+	void init(uint32_t slotCount)
+	{
+		slots.assign(slotCount, Slot());
+		residentTiles.clear();
+	}
+
+	/** @brief Get the slot a tile is resident in, -1 if the tile is not resident */
+	int32_t find(uint64_t key) const
+	{
+		auto it = residentTiles.find(key);
+		return (it != residentTiles.end()) ? it->second : -1;
+	}
+
+	/** @brief Mark a slot as used in the given frame */
+	void touch(int32_t slot, uint64_t frame)
+	{
+		slots[slot].lastUsed = frame;
+	}
+
+	/**
+	* Get a slot for a new tile, evicting the least recently used tile if the cache is full
+	*
+	* @note Tiles used in the current frame are never evicted
+	*
+	* @return Slot index or -1 if all slots are in use
+	*/
+	int32_t allocate(const TerrainTile& tile, uint64_t frame)
+	{
+		int32_t best = -1;
+		for (int32_t i = 0; i < (int32_t)slots.size(); i++) {
+			const Slot& slot = slots[i];
+			if (slot.key == UINT64_MAX) {
+				best = i;
+				break;
+			}
+			if (!slot.pinned && (slot.lastUsed < frame) && ((best < 0) || (slot.lastUsed < slots[best].lastUsed))) {
+				best = i;
+			}
+		}
+		if (best < 0) {
+			return -1;
+		}
+		if (slots[best].key != UINT64_MAX) {
+			residentTiles.erase(slots[best].key);
+		}
+		slots[best] = { tile.key, frame, tile.minHeight, tile.maxHeight, false };
+		residentTiles[tile.key] = best;
+		return best;
+	}
+
+	/** @brief Number of slots holding a tile */
+	uint32_t residentCount() const { return static_cast<uint32_t>(residentTiles.size()); }
+private:
+	std::unordered_map<uint64_t, int32_t> residentTiles;
+};
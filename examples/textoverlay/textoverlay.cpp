@@ -15,13 +15,21 @@
 #include "VulkanglTFModel.h"
 #include "../external/stb/stb_font_consolas_24_latin1.inl"
 
-// Max. number of chars the text overlay buffer can hold
-#define TEXTOVERLAY_MAX_CHAR_COUNT 2048
+// Max. number of glyphs the text overlay instance buffer can hold
+#define TEXTOVERLAY_MAX_GLYPH_COUNT 262144
+// Max. number of laid out text runs kept in the cache before runs not used in the current update are evicted
+#define TEXTOVERLAY_MAX_CACHED_RUNS 16384
 
 /*
 	Mostly self-contained text overlay class
 	This class contains all Vulkan resources for drawing the text overlay
 	It can be plugged into an existing renderpass/command buffer
+
+	Each glyph is drawn as one instance of a four vertex quad, the glyph's quad and texture coordinates
+	are fetched in the vertex shader from a storage buffer with the metrics of all glyphs of the font.
+	Strings are laid out once and cached, so adding a text only copies the cached glyph instances.
+	The number of instances is read from an indirect draw buffer, so command buffers don't need to be
+	rebuilt if the text changes.
 */
 class TextOverlay
 {
@@ -32,9 +40,12 @@ private:
 	VkImage image;
 	VkImageView view;
 	VkDeviceMemory imageMemory;
-	// Character vertex buffer
-	VkBuffer buffer;
-	VkDeviceMemory memory;
+	// Per-glyph instance buffer (persistently mapped)
+	vks::Buffer instanceBuffer;
+	// Quad and texture coordinates for all glyphs of the font
+	vks::Buffer glyphBuffer;
+	// Indirect draw command with the number of glyph instances to draw
+	vks::Buffer indirectBuffer;
 	VkDescriptorPool descriptorPool;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSet descriptorSet;
@@ -51,14 +62,39 @@ private:
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
 	float scale;
 
-	// Pointer to mapped vertex buffer
-	glm::vec4 *mapped = nullptr;
+	struct GlyphMetrics {
+		glm::vec4 rect;
+		glm::vec4 uv;
+	};
+
+	struct GlyphInstance {
+		glm::vec2 pos;
+		uint32_t glyph;
+		uint32_t color;
+	};
+
+	struct PushConstants {
+		glm::vec2 invViewportSize;
+		float scale;
+	};
+
+	// Glyphs of a laid out string, positioned relative to the text origin
+	struct TextRun {
+		std::vector<GlyphInstance> glyphs;
+		uint32_t lastUsed{ 0 };
+	};
+	// One cache per alignment, keyed by the string
+	std::array<std::unordered_map<std::string, TextRun>, 3> runCache;
+	uint32_t updateIndex{ 0 };
+
+	// Pointer to mapped instance buffer
+	GlyphInstance *mapped = nullptr;
 
 	stb_fontchar stbFontData[STB_FONT_consolas_24_latin1_NUM_CHARS];
 public:
 	enum TextAlign { alignLeft, alignCenter, alignRight };
 
-	uint32_t numLetters;
+	uint32_t numLetters{ 0 };
 	bool visible = true;
 
 	TextOverlay(
@@ -88,8 +124,9 @@ public:
 		vkDestroySampler(vulkanDevice->logicalDevice, sampler, nullptr);
 		vkDestroyImage(vulkanDevice->logicalDevice, image, nullptr);
 		vkDestroyImageView(vulkanDevice->logicalDevice, view, nullptr);
-		vkDestroyBuffer(vulkanDevice->logicalDevice, buffer, nullptr);
-		vkFreeMemory(vulkanDevice->logicalDevice, memory, nullptr);
+		instanceBuffer.destroy();
+		glyphBuffer.destroy();
+		indirectBuffer.destroy();
 		vkFreeMemory(vulkanDevice->logicalDevice, imageMemory, nullptr);
 		vkDestroyDescriptorSetLayout(vulkanDevice->logicalDevice, descriptorSetLayout, nullptr);
 		vkDestroyDescriptorPool(vulkanDevice->logicalDevice, descriptorPool, nullptr);
@@ -108,22 +145,28 @@ public:
 		static unsigned char font24pixels[fontHeight][fontWidth];
 		stb_font_consolas_24_latin1(stbFontData, font24pixels, fontHeight);
 
-		// Vertex buffer
-		VkDeviceSize bufferSize = TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(glm::vec4);
-
-		VkBufferCreateInfo bufferInfo = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, bufferSize);
-		VK_CHECK_RESULT(vkCreateBuffer(vulkanDevice->logicalDevice, &bufferInfo, nullptr, &buffer));
+		// Instance buffer, kept mapped for the lifetime of the overlay
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &instanceBuffer, TEXTOVERLAY_MAX_GLYPH_COUNT * sizeof(GlyphInstance)));
+		VK_CHECK_RESULT(instanceBuffer.map());
+		mapped = (GlyphInstance*)instanceBuffer.mapped;
+
+		// Indirect draw command, the instance count is updated with the text
+		VkDrawIndirectCommand drawCommand{ 4, 0, 0, 0 };
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indirectBuffer, sizeof(VkDrawIndirectCommand), &drawCommand));
+		VK_CHECK_RESULT(indirectBuffer.map());
+
+		// Glyph metrics
+		std::vector<GlyphMetrics> glyphMetrics(STB_FONT_consolas_24_latin1_NUM_CHARS);
+		for (size_t i = 0; i < glyphMetrics.size(); i++) {
+			const stb_fontchar& charData = stbFontData[i];
+			glyphMetrics[i].rect = glm::vec4((float)charData.x0, (float)charData.y0, (float)charData.x1, (float)charData.y1);
+			glyphMetrics[i].uv = glm::vec4(charData.s0, charData.t0, charData.s1, charData.t1);
+		}
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &glyphBuffer, glyphMetrics.size() * sizeof(GlyphMetrics), glyphMetrics.data()));
 
 		VkMemoryRequirements memReqs;
 		VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
 
-		vkGetBufferMemoryRequirements(vulkanDevice->logicalDevice, buffer, &memReqs);
-		allocInfo.allocationSize = memReqs.size;
-		allocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(vulkanDevice->logicalDevice, &allocInfo, nullptr, &memory));
-		VK_CHECK_RESULT(vkBindBufferMemory(vulkanDevice->logicalDevice, buffer, memory, 0));
-
 		// Font texture
 		VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -245,8 +288,9 @@ public:
 
 		// Descriptor
 		// Font uses a separate descriptor pool
-		std::array<VkDescriptorPoolSize, 1> poolSizes;
+		std::array<VkDescriptorPoolSize, 2> poolSizes;
 		poolSizes[0] = vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1);
+		poolSizes[1] = vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1);
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
@@ -257,8 +301,9 @@ public:
 		VK_CHECK_RESULT(vkCreateDescriptorPool(vulkanDevice->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 		// Descriptor set layout
-		std::array<VkDescriptorSetLayoutBinding, 1> setLayoutBindings;
+		std::array<VkDescriptorSetLayoutBinding, 2> setLayoutBindings;
 		setLayoutBindings[0] = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+		setLayoutBindings[1] = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 1);
 		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(vulkanDevice->logicalDevice, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout));
 
@@ -269,8 +314,9 @@ public:
 		// Descriptor for the font image
 		VkDescriptorImageInfo texDescriptor = vks::initializers::descriptorImageInfo(sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	
-		std::array<VkWriteDescriptorSet, 1> writeDescriptorSets;
+		std::array<VkWriteDescriptorSet, 2> writeDescriptorSets;
 		writeDescriptorSets[0] = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &texDescriptor);
+		writeDescriptorSets[1] = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &glyphBuffer.descriptor);
 		vkUpdateDescriptorSets(vulkanDevice->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 	}
 
@@ -283,7 +329,10 @@ public:
 		VK_CHECK_RESULT(vkCreatePipelineCache(vulkanDevice->logicalDevice, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
 
 		// Layout
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(PushConstants), 0);
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(vulkanDevice->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
 
 		// Enable blending, using alpha from red channel of the font texture (see text.frag)
@@ -306,13 +355,14 @@ public:
 		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
 
-		std::array<VkVertexInputBindingDescription, 2> vertexInputBindings = {
-			vks::initializers::vertexInputBindingDescription(0, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX),
-			vks::initializers::vertexInputBindingDescription(1, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX),
+		// The quad corners are generated in the vertex shader, so only per-instance glyph data is passed
+		std::array<VkVertexInputBindingDescription, 1> vertexInputBindings = {
+			vks::initializers::vertexInputBindingDescription(0, sizeof(GlyphInstance), VK_VERTEX_INPUT_RATE_INSTANCE),
 		};
-		std::array<VkVertexInputAttributeDescription, 2> vertexInputAttributes = {
-			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32_SFLOAT, 0),					// Location 0: Position
-			vks::initializers::vertexInputAttributeDescription(1, 1, VK_FORMAT_R32G32_SFLOAT, sizeof(glm::vec2)),	// Location 1: UV
+		std::array<VkVertexInputAttributeDescription, 3> vertexInputAttributes = {
+			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(GlyphInstance, pos)),		// Location 0: Position
+			vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32_UINT, offsetof(GlyphInstance, glyph)),		// Location 1: Glyph index
+			vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R8G8B8A8_UNORM, offsetof(GlyphInstance, color)),	// Location 2: Color
 		};
 
 		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
@@ -336,105 +386,114 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(vulkanDevice->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
 	}
 
-	// Map buffer
-	void beginTextUpdate()
+	// Font pixels are scaled by 0.75 (times the UI scale) for display
+	float glyphScale() const
 	{
-		VK_CHECK_RESULT(vkMapMemory(vulkanDevice->logicalDevice, memory, 0, VK_WHOLE_SIZE, 0, (void **)&mapped));
-		numLetters = 0;
+		return 0.75f * scale;
 	}
 
-	// Add text to the current buffer
-	void addText(std::string text, float x, float y, TextAlign align)
+	// Get the laid out glyphs of a string, laying it out if it's not in the cache yet
+	const TextRun& getRun(const std::string& text, TextAlign align)
 	{
-		const uint32_t firstChar = STB_FONT_consolas_24_latin1_FIRST_CHAR;
-
-		assert(mapped != nullptr);
-
-		const float charW = 1.5f * scale / *frameBufferWidth;
-		const float charH = 1.5f * scale / *frameBufferHeight;
-
-		float fbW = (float)*frameBufferWidth;
-		float fbH = (float)*frameBufferHeight;
-		x = (x / fbW * 2.0f) - 1.0f;
-		y = (y / fbH * 2.0f) - 1.0f;
+		auto& cache = runCache[align];
+		auto it = cache.find(text);
+		if (it != cache.end()) {
+			it->second.lastUsed = updateIndex;
+			return it->second;
+		}
 
-		// Calculate text width
-		float textWidth = 0;
+		const uint32_t firstChar = STB_FONT_consolas_24_latin1_FIRST_CHAR;
+		TextRun run;
+		run.lastUsed = updateIndex;
+		run.glyphs.reserve(text.size());
+		float x = 0.0f;
 		for (auto letter : text)
 		{
-			stb_fontchar *charData = &stbFontData[(uint32_t)letter - firstChar];
-			textWidth += charData->advance * charW;
+			const uint32_t glyph = (uint32_t)(uint8_t)letter - firstChar;
+			if (glyph >= STB_FONT_consolas_24_latin1_NUM_CHARS) {
+				continue;
+			}
+			run.glyphs.push_back({ glm::vec2(x, 0.0f), glyph, 0 });
+			x += stbFontData[glyph].advance * glyphScale();
 		}
 
+		// x now is the width of the text
+		float alignOffset = 0.0f;
 		switch (align)
 		{
 			case alignRight:
-				x -= textWidth;
+				alignOffset = -x;
 				break;
 			case alignCenter:
-				x -= textWidth / 2.0f;
+				alignOffset = -x / 2.0f;
 				break;
 			case alignLeft:
 				break;
 		}
+		for (auto& glyph : run.glyphs) {
+			glyph.pos.x += alignOffset;
+		}
 
-		// Generate a uv mapped quad per char in the new text
-		for (auto letter : text)
-		{
-			stb_fontchar *charData = &stbFontData[(uint32_t)letter - firstChar];
-
-			mapped->x = (x + (float)charData->x0 * charW);
-			mapped->y = (y + (float)charData->y0 * charH);
-			mapped->z = charData->s0;
-			mapped->w = charData->t0;
-			mapped++;
-
-			mapped->x = (x + (float)charData->x1 * charW);
-			mapped->y = (y + (float)charData->y0 * charH);
-			mapped->z = charData->s1;
-			mapped->w = charData->t0;
-			mapped++;
-
-			mapped->x = (x + (float)charData->x0 * charW);
-			mapped->y = (y + (float)charData->y1 * charH);
-			mapped->z = charData->s0;
-			mapped->w = charData->t1;
-			mapped++;
-
-			mapped->x = (x + (float)charData->x1 * charW);
-			mapped->y = (y + (float)charData->y1 * charH);
-			mapped->z = charData->s1;
-			mapped->w = charData->t1;
-			mapped++;
-
-			x += charData->advance * charW;
-
-			numLetters++;
+		return cache.emplace(text, std::move(run)).first->second;
+	}
+
+	// Start a new text update, the text of the previous update is discarded
+	void beginTextUpdate()
+	{
+		updateIndex++;
+		numLetters = 0;
+	}
+
+	// Add text to the current buffer
+	void addText(const std::string& text, float x, float y, TextAlign align, uint32_t color = 0xffffffff)
+	{
+		const TextRun& run = getRun(text, align);
+		if (numLetters + run.glyphs.size() > TEXTOVERLAY_MAX_GLYPH_COUNT) {
+			return;
+		}
+		// Only the glyph instances of the cached run are copied and moved to the text position
+		GlyphInstance* dst = &mapped[numLetters];
+		for (auto& glyph : run.glyphs) {
+			dst->pos = glm::vec2(glyph.pos.x + x, glyph.pos.y + y);
+			dst->glyph = glyph.glyph;
+			dst->color = color;
+			dst++;
 		}
+		numLetters += static_cast<uint32_t>(run.glyphs.size());
 	}
 
-	// Unmap buffer and update command buffers
+	// Update the number of instances to draw and evict text runs no longer in use
 	void endTextUpdate()
 	{
-		vkUnmapMemory(vulkanDevice->logicalDevice, memory);
-		mapped = nullptr;
-		//updateCommandBuffers();
+		VkDrawIndirectCommand* drawCommand = (VkDrawIndirectCommand*)indirectBuffer.mapped;
+		drawCommand->instanceCount = visible ? numLetters : 0;
+
+		for (auto& cache : runCache) {
+			if (cache.size() <= TEXTOVERLAY_MAX_CACHED_RUNS) {
+				continue;
+			}
+			for (auto it = cache.begin(); it != cache.end();) {
+				it = (it->second.lastUsed != updateIndex) ? cache.erase(it) : std::next(it);
+			}
+		}
 	}
 
-	// Issue the draw commands for the characters of the overlay
+	// Issue the draw command for the glyphs of the overlay
+	// This only needs to be called again if the frame buffer size changes, as the glyph count is read from the indirect buffer
 	void draw(VkCommandBuffer cmdBuffer)
 	{
 		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
 
+		PushConstants pushConstants{};
+		pushConstants.invViewportSize = glm::vec2(1.0f / (float)*frameBufferWidth, 1.0f / (float)*frameBufferHeight);
+		pushConstants.scale = glyphScale();
+		vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &pushConstants);
+
 		VkDeviceSize offsets = 0;
-		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &buffer, &offsets);
-		vkCmdBindVertexBuffers(cmdBuffer, 1, 1, &buffer, &offsets);
-		// One draw command for every character. This is okay for a debug overlay, but not optimal
-		// In a real-world application one would try to batch draw commands
-		for (uint32_t j = 0; j < numLetters; j++) {
-			vkCmdDraw(cmdBuffer, 4, 1, j * 4, 0);
-		}
+		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &instanceBuffer.buffer, &offsets);
+		// All glyphs are drawn with a single instanced draw
+		vkCmdDrawIndirect(cmdBuffer, indirectBuffer.buffer, 0, 1, sizeof(VkDrawIndirectCommand));
 	}
 };
 
@@ -460,6 +519,11 @@ public:
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 
+	// Grid of labels attached to points in the scene, used to stress the text overlay
+	bool showDebugLabels = false;
+	const uint32_t debugLabelGridSize = 100;
+	std::vector<std::string> debugLabels;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Vulkan Example - Text overlay";
@@ -516,9 +580,8 @@ public:
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 			model.draw(drawCmdBuffers[i]);
 
-			if (textOverlay->visible) {
-				textOverlay->draw(drawCmdBuffers[i]);
-			}
+			// The overlay is always recorded, visibility and glyph count are passed via the indirect draw buffer
+			textOverlay->draw(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
@@ -531,8 +594,6 @@ public:
 	// Update the text buffer displayed by the text overlay
 	void updateTextOverlay(void)
 	{
-		uint32_t lastNumLetters = textOverlay->numLetters;
-
 		textOverlay->beginTextUpdate();
 
 		textOverlay->addText(title, 5.0f * ui.scale, 5.0f * ui.scale, TextOverlay::alignLeft);
@@ -557,18 +618,36 @@ public:
 		glm::vec3 projected = glm::project(glm::vec3(0.0f), uniformData.modelView, uniformData.projection, glm::vec4(0, 0, (float)width, (float)height));
 		textOverlay->addText("A torus knot", projected.x, projected.y, TextOverlay::alignCenter);
 
+		if (showDebugLabels) {
+			// Label each point of a grid on the ground plane with its index
+			const glm::vec4 viewport = glm::vec4(0, 0, (float)width, (float)height);
+			const glm::mat4 viewProjection = uniformData.projection * uniformData.modelView;
+			const float gridExtent = 4.0f;
+			for (uint32_t i = 0; i < debugLabels.size(); i++) {
+				const float u = (float)(i % debugLabelGridSize) / (float)(debugLabelGridSize - 1);
+				const float v = (float)(i / debugLabelGridSize) / (float)(debugLabelGridSize - 1);
+				const glm::vec4 clipPos = viewProjection * glm::vec4((u - 0.5f) * gridExtent, 1.0f, (v - 0.5f) * gridExtent, 1.0f);
+				// Skip labels behind the camera or outside of the viewport
+				if (clipPos.w <= 0.0f) {
+					continue;
+				}
+				const glm::vec2 ndc = glm::vec2(clipPos.x, clipPos.y) / clipPos.w;
+				if ((std::abs(ndc.x) > 1.0f) || (std::abs(ndc.y) > 1.0f)) {
+					continue;
+				}
+				const float x = viewport.x + (ndc.x * 0.5f + 0.5f) * viewport.z;
+				const float y = viewport.y + (ndc.y * 0.5f + 0.5f) * viewport.w;
+				textOverlay->addText(debugLabels[i], x, y, TextOverlay::alignCenter, 0xff40c0ff);
+			}
+		}
+
 #if defined(__ANDROID__)
 #else
 		textOverlay->addText("Press \"space\" to toggle text overlay", 5.0f * ui.scale, 65.0f * ui.scale, TextOverlay::alignLeft);
-		textOverlay->addText("Hold middle mouse button and drag to move", 5.0f * ui.scale, 85.0f * ui.scale, TextOverlay::alignLeft);
+		textOverlay->addText("Press \"l\" to toggle " + std::to_string(debugLabels.size()) + " debug labels", 5.0f * ui.scale, 85.0f * ui.scale, TextOverlay::alignLeft);
+		textOverlay->addText("Hold middle mouse button and drag to move", 5.0f * ui.scale, 105.0f * ui.scale, TextOverlay::alignLeft);
 #endif
 		textOverlay->endTextUpdate();
-
-		// If the no. of letters changed, the no. of draw commands also changes which requires a rebuild of the command buffers
-		if (lastNumLetters != textOverlay->numLetters) {
-			std::cout << "rebuild cb\n";
-			buildCommandBuffers();
-		}
 	}
 
 	void loadAssets()
@@ -655,6 +734,11 @@ public:
 
 	void prepareTextOverlay()
 	{
+		debugLabels.resize(debugLabelGridSize * debugLabelGridSize);
+		for (uint32_t i = 0; i < debugLabels.size(); i++) {
+			debugLabels[i] = "#" + std::to_string(i);
+		}
+
 		// Load the text rendering shaders
 		std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
 		shaderStages.push_back(loadShader(getShadersPath() + "textoverlay/text.vert.spv", VK_SHADER_STAGE_VERTEX_BIT));
@@ -711,7 +795,12 @@ public:
 		case KEY_KPADD:
 		case KEY_SPACE:
 			textOverlay->visible = !textOverlay->visible;
-			buildCommandBuffers();
+			updateTextOverlay();
+			break;
+		case KEY_L:
+			showDebugLabels = !showDebugLabels;
+			updateTextOverlay();
+			break;
 		}
 	}
 };
@@ -1,12 +1,18 @@
 /*
 * Vulkan Example - 3D texture loading (and generation using perlin noise) example
 *
+* The noise volume is split into bricks that are generated on multiple threads using SIMD fractal noise.
+* Only bricks that changed are regenerated and copied to the texture, which keeps animated noise interactive at large volume sizes.
+* Run with --noisebenchmark to measure the noise generation throughput on the CPU only.
+*
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include "vulkanexamplebase.h"
+#include "threadpool.hpp"
+#include "texture3d.h"
 
 // Vertex layout for this example
 struct Vertex {
@@ -15,112 +21,6 @@ struct Vertex {
 	float normal[3];
 };
 
-// Translation of Ken Perlin's JAVA implementation (http://mrl.nyu.edu/~perlin/noise/)
-template <typename T>
-class PerlinNoise
-{
-private:
-	uint32_t permutations[512];
-	T fade(T t)
-	{
-		return t * t * t * (t * (t * (T)6 - (T)15) + (T)10);
-	}
-	T lerp(T t, T a, T b)
-	{
-		return a + t * (b - a);
-	}
-	T grad(int hash, T x, T y, T z)
-	{
-		// Convert LO 4 bits of hash code into 12 gradient directions
-		int h = hash & 15;
-		T u = h < 8 ? x : y;
-		T v = h < 4 ? y : h == 12 || h == 14 ? x : z;
-		return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
-	}
-public:
-	PerlinNoise(bool applyRandomSeed)
-	{
-		// Generate random lookup for permutations containing all numbers from 0..255
-		std::vector<uint8_t> plookup;
-		plookup.resize(256);
-		std::iota(plookup.begin(), plookup.end(), 0);
-		std::default_random_engine rndEngine(applyRandomSeed ? std::random_device{}() : 0);
-		std::shuffle(plookup.begin(), plookup.end(), rndEngine);
-
-		for (uint32_t i = 0; i < 256; i++)
-		{
-			permutations[i] = permutations[256 + i] = plookup[i];
-		}
-	}
-	T noise(T x, T y, T z)
-	{
-		// Find unit cube that contains point
-		int32_t X = (int32_t)floor(x) & 255;
-		int32_t Y = (int32_t)floor(y) & 255;
-		int32_t Z = (int32_t)floor(z) & 255;
-		// Find relative x,y,z of point in cube
-		x -= floor(x);
-		y -= floor(y);
-		z -= floor(z);
-
-		// Compute fade curves for each of x,y,z
-		T u = fade(x);
-		T v = fade(y);
-		T w = fade(z);
-
-		// Hash coordinates of the 8 cube corners
-		uint32_t A = permutations[X] + Y;
-		uint32_t AA = permutations[A] + Z;
-		uint32_t AB = permutations[A + 1] + Z;
-		uint32_t B = permutations[X + 1] + Y;
-		uint32_t BA = permutations[B] + Z;
-		uint32_t BB = permutations[B + 1] + Z;
-
-		// And add blended results for 8 corners of the cube;
-		T res = lerp(w, lerp(v,
-			lerp(u, grad(permutations[AA], x, y, z), grad(permutations[BA], x - 1, y, z)), lerp(u, grad(permutations[AB], x, y - 1, z), grad(permutations[BB], x - 1, y - 1, z))),
-			lerp(v, lerp(u, grad(permutations[AA + 1], x, y, z - 1), grad(permutations[BA + 1], x - 1, y, z - 1)), lerp(u, grad(permutations[AB + 1], x, y - 1, z - 1), grad(permutations[BB + 1], x - 1, y - 1, z - 1))));
-		return res;
-	}
-};
-
-// Fractal noise generator based on perlin noise above
-template <typename T>
-class FractalNoise
-{
-private:
-	PerlinNoise<T> perlinNoise;
-	uint32_t octaves;
-	T frequency;
-	T amplitude;
-	T persistence;
-public:
-	FractalNoise(const PerlinNoise<T> &perlinNoiseIn) :
-		perlinNoise(perlinNoiseIn)
-	{
-		octaves = 6;
-		persistence = (T)0.5;
-	}
-
-	T noise(T x, T y, T z)
-	{
-		T sum = 0;
-		T frequency = (T)1;
-		T amplitude = (T)1;
-		T max = (T)0;
-		for (uint32_t i = 0; i < octaves; i++)
-		{
-			sum += perlinNoise.noise(x * frequency, y * frequency, z * frequency) * amplitude;
-			max += amplitude;
-			amplitude *= persistence;
-			frequency *= (T)2;
-		}
-
-		sum = sum / max;
-		return (sum + (T)1.0) / (T)2.0;
-	}
-};
-
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -143,6 +43,31 @@ public:
 	vks::Buffer indexBuffer;
 	uint32_t indexCount{ 0 };
 
+	// Noise volume, split into bricks that are regenerated independently
+	struct {
+		noise::VolumeDesc desc;
+		noise::FractalNoise fractalNoise{ noise::PerlinNoise() };
+		// A brick is out of date if its version differs from the current version
+		uint32_t version{ 1 };
+		std::vector<uint32_t> brickVersions;
+		// Out of date bricks outside of the displayed slice are updated round robin
+		uint32_t nextBrick{ 0 };
+		bool animate{ false };
+		// Max. number of bricks outside the displayed slice updated per frame while animating
+		int32_t brickBudget{ 32 };
+		// Statistics for the last update
+		uint32_t bricksUpdated{ 0 };
+		float generationTime{ 0.0f };
+	} volume;
+	int32_t volumeSizeIndex{ 1 };
+	const std::vector<uint32_t> volumeSizes = { 128, 256, 512 };
+
+	vks::ThreadPool threadPool;
+	// Persistently mapped staging buffer holding the whole volume, bricks are generated straight into it and copied to the texture as sub regions
+	vks::Buffer stagingBuffer;
+	std::vector<VkBufferImageCopy> copyRegions;
+	VkCommandBuffer uploadCmdBuffer{ VK_NULL_HANDLE };
+
 	struct UniformData {
 		glm::mat4 projection;
 		glm::mat4 modelView;
@@ -158,6 +83,8 @@ public:
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 
+	bool noiseBenchmark{ false };
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "3D textures";
@@ -166,12 +93,18 @@ public:
 		camera.setRotation(glm::vec3(0.0f, 15.0f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
 		srand(benchmark.active ? 0 : (unsigned int)time(NULL));
+		threadPool.setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
+		commandLineParser.add("noisebenchmark", { "-nb", "--noisebenchmark" }, 0, "Measure noise generation throughput on the CPU and exit");
+		commandLineParser.parse(args);
+		noiseBenchmark = commandLineParser.isSet("noisebenchmark");
 	}
 
 	~VulkanExample()
 	{
 		if (device) {
 			destroyTextureImage(texture);
+			stagingBuffer.destroy();
+			vkFreeCommandBuffers(device, cmdPool, 1, &uploadCmdBuffer);
 			vkDestroyPipeline(device, pipeline, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
@@ -270,132 +203,187 @@ public:
 		texture.descriptor.imageView = texture.view;
 		texture.descriptor.sampler = texture.sampler;
 
+		// The whole volume is kept in a host visible buffer, so bricks can be regenerated in place without a new staging allocation
+		const VkDeviceSize volumeSize = (VkDeviceSize)width * height * depth;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, volumeSize));
+		VK_CHECK_RESULT(stagingBuffer.map());
+
+		volume.desc.width = width;
+		volume.desc.height = height;
+		volume.desc.depth = depth;
+		uint32_t bricksX, bricksY, bricksZ;
+		noise::brickCount(volume.desc, bricksX, bricksY, bricksZ);
+		volume.brickVersions.assign(bricksX * bricksY * bricksZ, 0);
+		volume.nextBrick = 0;
+
+		// Generate the whole volume and move the image to shader read layout
 		updateNoiseTexture();
+		generateBricks(true);
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		recordBrickCopies(copyCmd);
+		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+		std::cout << "Generated " << texture.width << " x " << texture.height << " x " << texture.depth << " noise texture in " << volume.generationTime << "ms" << std::endl;
 	}
 
-	// Generate randomized noise and upload it to the 3D texture using staging
+	// Start a new randomized noise volume, this makes all bricks out of date
 	void updateNoiseTexture()
 	{
-		const uint32_t texMemSize = texture.width * texture.height * texture.depth;
+		volume.fractalNoise = noise::FractalNoise(noise::PerlinNoise(benchmark.active ? 0 : std::random_device{}()));
+		volume.desc.scale = static_cast<float>(rand() % 10) + 4.0f;
+		volume.version++;
+	}
 
-		uint8_t *data = new uint8_t[texMemSize];
-		memset(data, 0, texMemSize);
+	// Resize the volume, this recreates the texture and the staging buffer
+	void resizeNoiseTexture(uint32_t size)
+	{
+		vkDeviceWaitIdle(device);
+		destroyTextureImage(texture);
+		stagingBuffer.destroy();
+		prepareNoiseTexture(size, size, size);
+		updateDescriptorSet();
+		buildCommandBuffers();
+	}
 
-		// Generate perlin based noise
-		std::cout << "Generating " << texture.width << " x " << texture.height << " x " << texture.depth << " noise texture..." << std::endl;
+	/*
+		Select the out of date bricks to regenerate
 
-		auto tStart = std::chrono::high_resolution_clock::now();
-
-		PerlinNoise<float> perlinNoise(!benchmark.active);
-		FractalNoise<float> fractalNoise(perlinNoise);
+		Bricks intersecting the displayed slice always come first. Other bricks follow round robin, limited to the brick budget
+		if not all bricks are to be updated, so that animated noise only regenerates what is visible plus a fixed amount of work.
+	*/
+	std::vector<uint32_t> selectBricks(bool all)
+	{
+		std::vector<uint32_t> bricks;
+		uint32_t bricksX, bricksY, bricksZ;
+		noise::brickCount(volume.desc, bricksX, bricksY, bricksZ);
+		const uint32_t brickCount = static_cast<uint32_t>(volume.brickVersions.size());
+		auto select = [&](uint32_t brick) {
+			if (volume.brickVersions[brick] != volume.version) {
+				volume.brickVersions[brick] = volume.version;
+				bricks.push_back(brick);
+			}
+		};
 
-		const float noiseScale = static_cast<float>(rand() % 10) + 4.0f;
+		// The displayed slice is filtered between two layers of voxels, which may lie in different bricks
+		const int32_t sliceZ = (int32_t)std::floor(uniformData.depth * (float)volume.desc.depth - 0.5f);
+		for (int32_t z : { sliceZ, sliceZ + 1 }) {
+			const uint32_t brickZ = (uint32_t)std::min(std::max(z, 0), (int32_t)volume.desc.depth - 1) / NOISE_BRICK_SIZE;
+			for (uint32_t i = 0; i < bricksX * bricksY; i++) {
+				select(brickZ * bricksX * bricksY + i);
+			}
+		}
 
-#pragma omp parallel for
-		for (int32_t z = 0; z < static_cast<int32_t>(texture.depth); z++)
-		{
-			for (int32_t y = 0; y < static_cast<int32_t>(texture.height); y++)
-			{
-				for (int32_t x = 0; x < static_cast<int32_t>(texture.width); x++)
-				{
-					float nx = (float)x / (float)texture.width;
-					float ny = (float)y / (float)texture.height;
-					float nz = (float)z / (float)texture.depth;
-					float n = fractalNoise.noise(nx * noiseScale, ny * noiseScale, nz * noiseScale);
-					n = n - floor(n);
-					data[x + y * texture.width + z * texture.width * texture.height] = static_cast<uint8_t>(floor(n * 255));
+		uint32_t budget = all ? brickCount : (uint32_t)volume.brickBudget;
+		for (uint32_t i = 0; (i < brickCount) && (budget > 0); i++) {
+			const uint32_t brick = (volume.nextBrick + i) % brickCount;
+			if (volume.brickVersions[brick] != volume.version) {
+				select(brick);
+				budget--;
+				if (budget == 0) {
+					volume.nextBrick = (brick + 1) % brickCount;
 				}
 			}
 		}
+		return bricks;
+	}
 
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-
-		std::cout << "Done in " << tDiff << "ms" << std::endl;
-
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		// Buffer object
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = texMemSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		// Allocate host visible memory for data upload
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs = {};
-		vkGetBufferMemoryRequirements(device, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0));
-
-		// Copy texture data into staging buffer
-		uint8_t *mapped;
-		VK_CHECK_RESULT(vkMapMemory(device, stagingMemory, 0, memReqs.size, 0, (void **)&mapped));
-		memcpy(mapped, data, texMemSize);
-		vkUnmapMemory(device, stagingMemory);
+	/*
+		Regenerate out of date bricks on all threads of the pool, directly into the staging buffer
+		Adds a copy region for each regenerated brick and returns the number of bricks
+	*/
+	uint32_t generateBricks(bool all)
+	{
+		const std::vector<uint32_t> bricks = selectBricks(all);
+		volume.bricksUpdated = static_cast<uint32_t>(bricks.size());
+		if (bricks.empty()) {
+			volume.generationTime = 0.0f;
+			return 0;
+		}
 
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		auto tStart = std::chrono::high_resolution_clock::now();
+		uint8_t* data = (uint8_t*)stagingBuffer.mapped;
+		std::atomic<uint32_t> nextJob{ 0 };
+		for (auto& thread : threadPool.threads) {
+			thread->addJob([&] {
+				uint32_t job;
+				while ((job = nextJob++) < bricks.size()) {
+					noise::generateBrick(volume.fractalNoise, volume.desc, bricks[job], data);
+				}
+			});
+		}
+		threadPool.wait();
+		volume.generationTime = (float)std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+		// The staging buffer has the same layout as the volume, so each brick is a sub region of it
+		uint32_t bricksX, bricksY, bricksZ;
+		noise::brickCount(volume.desc, bricksX, bricksY, bricksZ);
+		for (uint32_t brick : bricks) {
+			const uint32_t x = (brick % bricksX) * NOISE_BRICK_SIZE;
+			const uint32_t y = ((brick / bricksX) % bricksY) * NOISE_BRICK_SIZE;
+			const uint32_t z = (brick / (bricksX * bricksY)) * NOISE_BRICK_SIZE;
+			VkBufferImageCopy bufferCopyRegion{};
+			bufferCopyRegion.bufferOffset = x + (VkDeviceSize)y * texture.width + (VkDeviceSize)z * texture.width * texture.height;
+			bufferCopyRegion.bufferRowLength = texture.width;
+			bufferCopyRegion.bufferImageHeight = texture.height;
+			bufferCopyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			bufferCopyRegion.imageOffset = { (int32_t)x, (int32_t)y, (int32_t)z };
+			bufferCopyRegion.imageExtent = { NOISE_BRICK_SIZE, NOISE_BRICK_SIZE, NOISE_BRICK_SIZE };
+			copyRegions.push_back(bufferCopyRegion);
+		}
+		return static_cast<uint32_t>(bricks.size());
+	}
 
-		// The sub resource range describes the regions of the image we will be transitioned
-		VkImageSubresourceRange subresourceRange = {};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.baseMipLevel = 0;
-		subresourceRange.levelCount = 1;
-		subresourceRange.layerCount = 1;
-
-		// Optimal image will be used as destination for the copy, so we must transfer from our
-		// initial undefined image layout to the transfer destination layout
-		vks::tools::setImageLayout(
-			copyCmd,
-			texture.image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			subresourceRange);
-
-		// Copy 3D noise data to texture
-
-		// Setup buffer copy regions
-		VkBufferImageCopy bufferCopyRegion{};
-		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		bufferCopyRegion.imageSubresource.mipLevel = 0;
-		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-		bufferCopyRegion.imageSubresource.layerCount = 1;
-		bufferCopyRegion.imageExtent.width = texture.width;
-		bufferCopyRegion.imageExtent.height = texture.height;
-		bufferCopyRegion.imageExtent.depth = texture.depth;
-
-		vkCmdCopyBufferToImage(
-			copyCmd,
-			stagingBuffer,
-			texture.image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1,
-			&bufferCopyRegion);
-
-		// Change texture image layout to shader read after all mip levels have been copied
-		texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		vks::tools::setImageLayout(
-			copyCmd,
-			texture.image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			texture.imageLayout,
-			subresourceRange);
+	// Record the copies of all regenerated bricks, the texture is in shader read layout before and after the copies
+	void recordBrickCopies(VkCommandBuffer cmdBuffer)
+	{
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vks::tools::setImageLayout(cmdBuffer, texture.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		vkCmdCopyBufferToImage(cmdBuffer, stagingBuffer.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+		vks::tools::setImageLayout(cmdBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		copyRegions.clear();
+	}
 
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+	// Measure the noise throughput of the scalar and SIMD paths on a single thread and of the SIMD path on all threads
+	void runNoiseBenchmark()
+	{
+		noise::VolumeDesc desc;
+		desc.width = desc.height = desc.depth = 128;
+		desc.scale = 8.0f;
+		const noise::FractalNoise fractalNoise(noise::PerlinNoise(0));
+		uint32_t bricksX, bricksY, bricksZ;
+		noise::brickCount(desc, bricksX, bricksY, bricksZ);
+		const uint32_t brickCount = bricksX * bricksY * bricksZ;
+		const size_t voxelCount = (size_t)desc.width * desc.height * desc.depth;
+		std::vector<uint8_t> reference(voxelCount), data(voxelCount);
+
+		auto measure = [&](const std::string& name, uint8_t* target, bool simd, uint32_t threadCount) {
+			auto tStart = std::chrono::high_resolution_clock::now();
+			std::atomic<uint32_t> nextJob{ 0 };
+			for (uint32_t i = 0; i < threadCount; i++) {
+				threadPool.threads[i]->addJob([&] {
+					uint32_t job;
+					while ((job = nextJob++) < brickCount) {
+						noise::generateBrick(fractalNoise, desc, job, target, simd);
+					}
+				});
+			}
+			threadPool.wait();
+			const double tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+			std::cout << std::left << std::setw(32) << name << std::fixed << std::setprecision(2) << std::setw(10) << tDiff << " ms " << (voxelCount / tDiff / 1000.0) << " Mvoxels/s\n";
+		};
 
-		// Clean up staging resources
-		delete[] data;
-		vkFreeMemory(device, stagingMemory, nullptr);
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
+		const uint32_t threadCount = static_cast<uint32_t>(threadPool.threads.size());
+		std::cout << "Fractal noise, " << desc.width << " x " << desc.height << " x " << desc.depth << " voxels, SIMD path: " << noise::simdPath() << "\n";
+		measure("Scalar, 1 thread", reference.data(), false, 1);
+		measure("SIMD, 1 thread", data.data(), true, 1);
+		measure("SIMD, " + std::to_string(threadCount) + " threads", data.data(), true, threadCount);
+		std::cout << "SIMD output " << ((reference == data) ? "matches" : "differs from") << " scalar output\n";
 	}
 
 	// Free all Vulkan resources used a texture object
-	void destroyTextureImage(Texture texture)
+	void destroyTextureImage(Texture& texture)
 	{
 		if (texture.view != VK_NULL_HANDLE)
 			vkDestroyImageView(device, texture.view, nullptr);
@@ -405,6 +393,7 @@ public:
 			vkDestroySampler(device, texture.sampler, nullptr);
 		if (texture.deviceMemory != VK_NULL_HANDLE)
 			vkFreeMemory(device, texture.deviceMemory, nullptr);
+		texture = Texture();
 	}
 
 	void buildCommandBuffers()
@@ -518,7 +507,11 @@ public:
 		// Set
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+		updateDescriptorSet();
+	}
 
+	void updateDescriptorSet()
+	{
 		// Image descriptor for the 3D texture
 		VkDescriptorImageInfo textureDescriptor =
 			vks::initializers::descriptorImageInfo(
@@ -605,6 +598,12 @@ public:
 			if (uniformData.depth > 1.0f) {
 				uniformData.depth = uniformData.depth - 1.0f;
 			}
+			// Animate the noise by moving through it, this makes all bricks out of date
+			if (volume.animate) {
+				volume.desc.offset[0] += frameTimer * 0.25f;
+				volume.desc.offset[1] += frameTimer * 0.1f;
+				volume.version++;
+			}
 		}
 		memcpy(uniformBuffer.mapped, &uniformData, sizeof(UniformData));
 	}
@@ -612,9 +611,21 @@ public:
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
+		if (noiseBenchmark) {
+#if defined(_WIN32)
+			setupConsole("Noise benchmark");
+#endif
+			runNoiseBenchmark();
+			// Skip the render loop, the example is then destroyed regularly
+			exitRequested = true;
+			return;
+		}
 		generateQuad();
 		prepareUniformBuffers();
-		prepareNoiseTexture(128, 128, 128);
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &uploadCmdBuffer));
+		const uint32_t size = volumeSizes[volumeSizeIndex];
+		prepareNoiseTexture(size, size, size);
 		setupDescriptors();
 		preparePipelines();
 		buildCommandBuffers();
@@ -624,8 +635,18 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		// Regenerated bricks are copied to the texture in the same submission, ahead of the frame's draw commands
+		// While animating, only the displayed slice and a budget of other bricks are updated per frame
+		const bool upload = generateBricks(!volume.animate) > 0;
+		if (upload) {
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			VK_CHECK_RESULT(vkBeginCommandBuffer(uploadCmdBuffer, &cmdBufInfo));
+			recordBrickCopies(uploadCmdBuffer);
+			VK_CHECK_RESULT(vkEndCommandBuffer(uploadCmdBuffer));
+		}
+		VkCommandBuffer commandBuffers[2] = { uploadCmdBuffer, drawCmdBuffers[currentBuffer] };
+		submitInfo.commandBufferCount = upload ? 2 : 1;
+		submitInfo.pCommandBuffers = upload ? &commandBuffers[0] : &commandBuffers[1];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 		VulkanExampleBase::submitFrame();
 	}
@@ -644,6 +665,17 @@ public:
 			if (overlay->button("Generate new texture")) {
 				updateNoiseTexture();
 			}
+			if (overlay->comboBox("Size", &volumeSizeIndex, { "128^3", "256^3", "512^3" })) {
+				resizeNoiseTexture(volumeSizes[volumeSizeIndex]);
+			}
+			overlay->checkBox("Animate", &volume.animate);
+			if (volume.animate) {
+				overlay->sliderInt("Brick budget", &volume.brickBudget, 0, 512);
+			}
+		}
+		if (overlay->header("Noise generation")) {
+			overlay->text("Bricks updated: %d / %d", volume.bricksUpdated, (uint32_t)volume.brickVersions.size());
+			overlay->text("Generation: %.2f ms", volume.generationTime);
 		}
 	}
 };
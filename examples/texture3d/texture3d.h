@@ -0,0 +1,389 @@
+/*
+* Vulkan Example - 3D texture loading (and generation using perlin noise) example
+*
+* Fractal perlin noise evaluated for eight voxels of a row at once
+*
+* The noise is generated brick by brick, so that only bricks that changed need to be regenerated and uploaded.
+* Uses AVX2 if the example is compiled with AVX2 enabled, SSE2 (as two four lane halves) otherwise,
+* and a scalar fallback on other platforms.
+*
+* Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NOISE_USE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define NOISE_USE_SSE2
+#endif
+
+// Edge length of a brick in voxels, volume dimensions must be a multiple of this
+#define NOISE_BRICK_SIZE 32
+
+namespace noise
+{
+	/*
+		Eight lane float and integer vectors
+	*/
+#if defined(NOISE_USE_AVX2)
+	struct vint {
+		__m256i v;
+		vint(__m256i v) : v(v) {}
+		explicit vint(int32_t s) : v(_mm256_set1_epi32(s)) {}
+	};
+	struct vfloat {
+		__m256 v;
+		vfloat(__m256 v) : v(v) {}
+		explicit vfloat(float s) : v(_mm256_set1_ps(s)) {}
+		static vfloat ramp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+		void store(float* dst) const { _mm256_storeu_ps(dst, v); }
+	};
+	inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+	inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+	inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+	inline vfloat floor(vfloat a) { return _mm256_floor_ps(a.v); }
+	inline vint toInt(vfloat a) { return _mm256_cvttps_epi32(a.v); }
+	// Flip the sign of lanes where bit 31 of the mask is set
+	inline vfloat flipSign(vfloat a, vint m) { return _mm256_xor_ps(a.v, _mm256_castsi256_ps(m.v)); }
+	// Select a where the mask lanes are all ones, b otherwise
+	inline vfloat select(vint m, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, _mm256_castsi256_ps(m.v)); }
+	inline vint operator+(vint a, vint b) { return _mm256_add_epi32(a.v, b.v); }
+	inline vint operator&(vint a, vint b) { return _mm256_and_si256(a.v, b.v); }
+	inline vint operator|(vint a, vint b) { return _mm256_or_si256(a.v, b.v); }
+	inline vint operator<(vint a, vint b) { return _mm256_cmpgt_epi32(b.v, a.v); }
+	inline vint operator==(vint a, vint b) { return _mm256_cmpeq_epi32(a.v, b.v); }
+	template <int bits>
+	inline vint shiftLeft(vint a) { return _mm256_slli_epi32(a.v, bits); }
+	inline vint gather(const uint32_t* table, vint index) { return _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), index.v, 4); }
+#elif defined(NOISE_USE_SSE2)
+	struct vint {
+		__m128i lo, hi;
+		vint(__m128i lo, __m128i hi) : lo(lo), hi(hi) {}
+		explicit vint(int32_t s) : lo(_mm_set1_epi32(s)), hi(lo) {}
+	};
+	struct vfloat {
+		__m128 lo, hi;
+		vfloat(__m128 lo, __m128 hi) : lo(lo), hi(hi) {}
+		explicit vfloat(float s) : lo(_mm_set1_ps(s)), hi(lo) {}
+		static vfloat ramp() { return vfloat(_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), _mm_setr_ps(4.0f, 5.0f, 6.0f, 7.0f)); }
+		void store(float* dst) const { _mm_storeu_ps(dst, lo); _mm_storeu_ps(dst + 4, hi); }
+	};
+	inline vfloat operator+(vfloat a, vfloat b) { return vfloat(_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)); }
+	inline vfloat operator-(vfloat a, vfloat b) { return vfloat(_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)); }
+	inline vfloat operator*(vfloat a, vfloat b) { return vfloat(_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)); }
+	// SSE2 has no floor, truncate and correct negative values
+	inline __m128 floor(__m128 a)
+	{
+		const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+	}
+	inline vfloat floor(vfloat a) { return vfloat(floor(a.lo), floor(a.hi)); }
+	inline vint toInt(vfloat a) { return vint(_mm_cvttps_epi32(a.lo), _mm_cvttps_epi32(a.hi)); }
+	inline vfloat flipSign(vfloat a, vint m) { return vfloat(_mm_xor_ps(a.lo, _mm_castsi128_ps(m.lo)), _mm_xor_ps(a.hi, _mm_castsi128_ps(m.hi))); }
+	inline __m128 select(__m128i m, __m128 a, __m128 b) { const __m128 mf = _mm_castsi128_ps(m); return _mm_or_ps(_mm_and_ps(mf, a), _mm_andnot_ps(mf, b)); }
+	inline vfloat select(vint m, vfloat a, vfloat b) { return vfloat(select(m.lo, a.lo, b.lo), select(m.hi, a.hi, b.hi)); }
+	inline vint operator+(vint a, vint b) { return vint(_mm_add_epi32(a.lo, b.lo), _mm_add_epi32(a.hi, b.hi)); }
+	inline vint operator&(vint a, vint b) { return vint(_mm_and_si128(a.lo, b.lo), _mm_and_si128(a.hi, b.hi)); }
+	inline vint operator|(vint a, vint b) { return vint(_mm_or_si128(a.lo, b.lo), _mm_or_si128(a.hi, b.hi)); }
+	inline vint operator<(vint a, vint b) { return vint(_mm_cmplt_epi32(a.lo, b.lo), _mm_cmplt_epi32(a.hi, b.hi)); }
+	inline vint operator==(vint a, vint b) { return vint(_mm_cmpeq_epi32(a.lo, b.lo), _mm_cmpeq_epi32(a.hi, b.hi)); }
+	template <int bits>
+	inline vint shiftLeft(vint a) { return vint(_mm_slli_epi32(a.lo, bits), _mm_slli_epi32(a.hi, bits)); }
+	// No gather instruction, the table lookups are done per lane
+	inline vint gather(const uint32_t* table, vint index)
+	{
+		alignas(16) int32_t i[8];
+		_mm_store_si128(reinterpret_cast<__m128i*>(i), index.lo);
+		_mm_store_si128(reinterpret_cast<__m128i*>(i + 4), index.hi);
+		return vint(_mm_setr_epi32(table[i[0]], table[i[1]], table[i[2]], table[i[3]]), _mm_setr_epi32(table[i[4]], table[i[5]], table[i[6]], table[i[7]]));
+	}
+#else
+	struct vint {
+		int32_t v[8];
+		vint() {}
+		explicit vint(int32_t s) { for (int i = 0; i < 8; i++) { v[i] = s; } }
+	};
+	struct vfloat {
+		float v[8];
+		vfloat() {}
+		explicit vfloat(float s) { for (int i = 0; i < 8; i++) { v[i] = s; } }
+		static vfloat ramp() { vfloat r; for (int i = 0; i < 8; i++) { r.v[i] = (float)i; } return r; }
+		void store(float* dst) const { memcpy(dst, v, sizeof(v)); }
+	};
+	inline vfloat operator+(vfloat a, vfloat b) { for (int i = 0; i < 8; i++) { a.v[i] += b.v[i]; } return a; }
+	inline vfloat operator-(vfloat a, vfloat b) { for (int i = 0; i < 8; i++) { a.v[i] -= b.v[i]; } return a; }
+	inline vfloat operator*(vfloat a, vfloat b) { for (int i = 0; i < 8; i++) { a.v[i] *= b.v[i]; } return a; }
+	inline vfloat floor(vfloat a) { for (int i = 0; i < 8; i++) { a.v[i] = std::floor(a.v[i]); } return a; }
+	inline vint toInt(vfloat a) { vint r; for (int i = 0; i < 8; i++) { r.v[i] = (int32_t)a.v[i]; } return r; }
+	inline vfloat flipSign(vfloat a, vint m) { for (int i = 0; i < 8; i++) { a.v[i] = m.v[i] ? -a.v[i] : a.v[i]; } return a; }
+	inline vfloat select(vint m, vfloat a, vfloat b) { for (int i = 0; i < 8; i++) { a.v[i] = m.v[i] ? a.v[i] : b.v[i]; } return a; }
+	inline vint operator+(vint a, vint b) { for (int i = 0; i < 8; i++) { a.v[i] += b.v[i]; } return a; }
+	inline vint operator&(vint a, vint b) { for (int i = 0; i < 8; i++) { a.v[i] &= b.v[i]; } return a; }
+	inline vint operator|(vint a, vint b) { for (int i = 0; i < 8; i++) { a.v[i] |= b.v[i]; } return a; }
+	inline vint operator<(vint a, vint b) { for (int i = 0; i < 8; i++) { a.v[i] = (a.v[i] < b.v[i]) ? -1 : 0; } return a; }
+	inline vint operator==(vint a, vint b) { for (int i = 0; i < 8; i++) { a.v[i] = (a.v[i] == b.v[i]) ? -1 : 0; } return a; }
+	template <int bits>
+	inline vint shiftLeft(vint a) { for (int i = 0; i < 8; i++) { a.v[i] = (int32_t)((uint32_t)a.v[i] << bits); } return a; }
+	inline vint gather(const uint32_t* table, vint index) { for (int i = 0; i < 8; i++) { index.v[i] = (int32_t)table[index.v[i]]; } return index; }
+#endif
+
+	// Name of the instruction set used for the eight lane vectors
+	inline const char* simdPath()
+	{
+#if defined(NOISE_USE_AVX2)
+		return "AVX2";
+#elif defined(NOISE_USE_SSE2)
+		return "SSE2";
+#else
+		return "scalar";
+#endif
+	}
+
+	// Translation of Ken Perlin's JAVA implementation (http://mrl.nyu.edu/~perlin/noise/)
+	class PerlinNoise
+	{
+	private:
+		uint32_t permutations[512];
+		static float fade(float t)
+		{
+			return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+		}
+		static float lerp(float t, float a, float b)
+		{
+			return a + t * (b - a);
+		}
+		static float grad(int hash, float x, float y, float z)
+		{
+			// Convert LO 4 bits of hash code into 12 gradient directions
+			int h = hash & 15;
+			float u = h < 8 ? x : y;
+			float v = h < 4 ? y : h == 12 || h == 14 ? x : z;
+			return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+		}
+		static vfloat fade(vfloat t)
+		{
+			return t * t * t * (t * (t * vfloat(6.0f) - vfloat(15.0f)) + vfloat(10.0f));
+		}
+		static vfloat lerp(vfloat t, vfloat a, vfloat b)
+		{
+			return a + t * (b - a);
+		}
+		static vfloat lerp(float t, vfloat a, vfloat b)
+		{
+			return a + vfloat(t) * (b - a);
+		}
+		// Same as the scalar version, with the hash tests turned into lane masks
+		static vfloat grad(vint hash, vfloat x, vfloat y, vfloat z)
+		{
+			const vint h = hash & vint(15);
+			const vfloat u = select(h < vint(8), x, y);
+			const vfloat v = select(h < vint(4), y, select((h == vint(12)) | (h == vint(14)), x, z));
+			return flipSign(u, shiftLeft<31>(h)) + flipSign(v, shiftLeft<30>(h & vint(2)));
+		}
+	public:
+		PerlinNoise(uint32_t seed = 0)
+		{
+			// Generate random lookup for permutations containing all numbers from 0..255
+			std::vector<uint8_t> plookup;
+			plookup.resize(256);
+			std::iota(plookup.begin(), plookup.end(), 0);
+			std::default_random_engine rndEngine(seed);
+			std::shuffle(plookup.begin(), plookup.end(), rndEngine);
+
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				permutations[i] = permutations[256 + i] = plookup[i];
+			}
+		}
+
+		float noise(float x, float y, float z) const
+		{
+			// Find unit cube that contains point
+			int32_t X = (int32_t)std::floor(x) & 255;
+			int32_t Y = (int32_t)std::floor(y) & 255;
+			int32_t Z = (int32_t)std::floor(z) & 255;
+			// Find relative x,y,z of point in cube
+			x -= std::floor(x);
+			y -= std::floor(y);
+			z -= std::floor(z);
+
+			// Compute fade curves for each of x,y,z
+			float u = fade(x);
+			float v = fade(y);
+			float w = fade(z);
+
+			// Hash coordinates of the 8 cube corners
+			uint32_t A = permutations[X] + Y;
+			uint32_t AA = permutations[A] + Z;
+			uint32_t AB = permutations[A + 1] + Z;
+			uint32_t B = permutations[X + 1] + Y;
+			uint32_t BA = permutations[B] + Z;
+			uint32_t BB = permutations[B + 1] + Z;
+
+			// And add blended results for 8 corners of the cube;
+			float res = lerp(w, lerp(v,
+				lerp(u, grad(permutations[AA], x, y, z), grad(permutations[BA], x - 1, y, z)), lerp(u, grad(permutations[AB], x, y - 1, z), grad(permutations[BB], x - 1, y - 1, z))),
+				lerp(v, lerp(u, grad(permutations[AA + 1], x, y, z - 1), grad(permutations[BA + 1], x - 1, y, z - 1)), lerp(u, grad(permutations[AB + 1], x, y - 1, z - 1), grad(permutations[BB + 1], x - 1, y - 1, z - 1))));
+			return res;
+		}
+
+		/*
+			Noise for eight points along the x axis that share the same y and z
+
+			As y and z are the same for all lanes, their lattice cell and fade curves are only calculated once
+		*/
+		vfloat noise(vfloat x, float y, float z) const
+		{
+			const vfloat xFloor = floor(x);
+			const vint X = toInt(xFloor) & vint(255);
+			const vint Y = vint((int32_t)std::floor(y) & 255);
+			const vint Z = vint((int32_t)std::floor(z) & 255);
+			x = x - xFloor;
+			y -= std::floor(y);
+			z -= std::floor(z);
+
+			const vfloat u = fade(x);
+			const float v = fade(y);
+			const float w = fade(z);
+
+			const vint one(1);
+			const vint A = gather(permutations, X) + Y;
+			const vint AA = gather(permutations, A) + Z;
+			const vint AB = gather(permutations, A + one) + Z;
+			const vint B = gather(permutations, X + one) + Y;
+			const vint BA = gather(permutations, B) + Z;
+			const vint BB = gather(permutations, B + one) + Z;
+
+			const vfloat x1 = x - vfloat(1.0f);
+			const vfloat y0(y), y1(y - 1.0f), z0(z), z1(z - 1.0f);
+			return lerp(w, lerp(v,
+				lerp(u, grad(gather(permutations, AA), x, y0, z0), grad(gather(permutations, BA), x1, y0, z0)), lerp(u, grad(gather(permutations, AB), x, y1, z0), grad(gather(permutations, BB), x1, y1, z0))),
+				lerp(v, lerp(u, grad(gather(permutations, AA + one), x, y0, z1), grad(gather(permutations, BA + one), x1, y0, z1)), lerp(u, grad(gather(permutations, AB + one), x, y1, z1), grad(gather(permutations, BB + one), x1, y1, z1))));
+		}
+	};
+
+	// Fractal noise generator based on perlin noise above
+	class FractalNoise
+	{
+	private:
+		PerlinNoise perlinNoise;
+		uint32_t octaves{ 6 };
+		float persistence{ 0.5f };
+	public:
+		FractalNoise(const PerlinNoise& perlinNoiseIn) : perlinNoise(perlinNoiseIn) {}
+
+		float noise(float x, float y, float z) const
+		{
+			float sum = 0.0f;
+			float frequency = 1.0f;
+			float amplitude = 1.0f;
+			float max = 0.0f;
+			for (uint32_t i = 0; i < octaves; i++)
+			{
+				sum += perlinNoise.noise(x * frequency, y * frequency, z * frequency) * amplitude;
+				max += amplitude;
+				amplitude *= persistence;
+				frequency *= 2.0f;
+			}
+			// Map from [-1..1] to [0..1]
+			return sum * (0.5f / max) + 0.5f;
+		}
+
+		vfloat noise(vfloat x, float y, float z) const
+		{
+			vfloat sum(0.0f);
+			float frequency = 1.0f;
+			float amplitude = 1.0f;
+			float max = 0.0f;
+			for (uint32_t i = 0; i < octaves; i++)
+			{
+				sum = sum + perlinNoise.noise(x * vfloat(frequency), y * frequency, z * frequency) * vfloat(amplitude);
+				max += amplitude;
+				amplitude *= persistence;
+				frequency *= 2.0f;
+			}
+			return (sum * vfloat(0.5f / max)) + vfloat(0.5f);
+		}
+	};
+
+	/*
+		Parameters for filling a volume with fractal noise
+		A voxel at (x, y, z) gets the noise value at (x / width, y / height, z / depth) * scale + offset
+	*/
+	struct VolumeDesc {
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t depth{ 0 };
+		float scale{ 1.0f };
+		float offset[3]{ 0.0f, 0.0f, 0.0f };
+	};
+
+	inline uint8_t quantize(float n)
+	{
+		n = n - std::floor(n);
+		return static_cast<uint8_t>(std::floor(n * 255.0f));
+	}
+
+	// Number of bricks along each axis of the volume
+	inline void brickCount(const VolumeDesc& desc, uint32_t& x, uint32_t& y, uint32_t& z)
+	{
+		x = desc.width / NOISE_BRICK_SIZE;
+		y = desc.height / NOISE_BRICK_SIZE;
+		z = desc.depth / NOISE_BRICK_SIZE;
+	}
+
+	/**
+	* Fill one brick of a linearly laid out volume (x + y * width + z * width * height) with fractal noise
+	*
+	* @param fractalNoise Noise generator
+	* @param desc Volume dimensions and noise parameters
+	* @param brick Index of the brick (x + y * bricksX + z * bricksX * bricksY)
+	* @param data Volume to write to, only the voxels of the brick are written
+	* @param simd Evaluate eight voxels at once, the scalar path is kept as a reference
+	*/
+	inline void generateBrick(const FractalNoise& fractalNoise, const VolumeDesc& desc, uint32_t brick, uint8_t* data, bool simd = true)
+	{
+		uint32_t bricksX, bricksY, bricksZ;
+		brickCount(desc, bricksX, bricksY, bricksZ);
+		const uint32_t x0 = (brick % bricksX) * NOISE_BRICK_SIZE;
+		const uint32_t y0 = ((brick / bricksX) % bricksY) * NOISE_BRICK_SIZE;
+		const uint32_t z0 = (brick / (bricksX * bricksY)) * NOISE_BRICK_SIZE;
+		const float sx = desc.scale / (float)desc.width;
+		const float sy = desc.scale / (float)desc.height;
+		const float sz = desc.scale / (float)desc.depth;
+		for (uint32_t z = z0; z < z0 + NOISE_BRICK_SIZE; z++) {
+			const float nz = (float)z * sz + desc.offset[2];
+			for (uint32_t y = y0; y < y0 + NOISE_BRICK_SIZE; y++) {
+				const float ny = (float)y * sy + desc.offset[1];
+				uint8_t* row = data + (size_t)z * desc.width * desc.height + (size_t)y * desc.width;
+				if (simd) {
+					for (uint32_t x = x0; x < x0 + NOISE_BRICK_SIZE; x += 8) {
+						const vfloat nx = (vfloat((float)x) + vfloat::ramp()) * vfloat(sx) + vfloat(desc.offset[0]);
+						float n[8];
+						fractalNoise.noise(nx, ny, nz).store(n);
+						for (uint32_t i = 0; i < 8; i++) {
+							row[x + i] = quantize(n[i]);
+						}
+					}
+				} else {
+					for (uint32_t x = x0; x < x0 + NOISE_BRICK_SIZE; x++) {
+						row[x] = quantize(fractalNoise.noise((float)x * sx + desc.offset[0], ny, nz));
+					}
+				}
+			}
+		}
+	}
+}
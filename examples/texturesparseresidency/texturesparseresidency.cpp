@@ -21,6 +21,9 @@ VirtualTexturePage::VirtualTexturePage()
 {
 	// Pages are initially not backed up by memory (non-resident)
 	imageMemoryBind.memory = VK_NULL_HANDLE;
+	poolSlot = 0;
+	loading = false;
+	lastRequested = 0;
 }
 
 bool VirtualTexturePage::resident()
@@ -28,46 +31,6 @@ bool VirtualTexturePage::resident()
 	return (imageMemoryBind.memory != VK_NULL_HANDLE);
 }
 
-// Allocate Vulkan memory for the virtual page
-bool VirtualTexturePage::allocate(VkDevice device, uint32_t memoryTypeIndex)
-{
-	if (imageMemoryBind.memory != VK_NULL_HANDLE)
-	{
-		return false;
-	};
-
-	imageMemoryBind = {};
-
-	VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
-	allocInfo.allocationSize = size;
-	allocInfo.memoryTypeIndex = memoryTypeIndex;
-	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &imageMemoryBind.memory));
-
-	VkImageSubresource subResource{};
-	subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subResource.mipLevel = mipLevel;
-	subResource.arrayLayer = layer;
-
-	// Sparse image memory binding
-	imageMemoryBind.subresource = subResource;
-	imageMemoryBind.extent = extent;
-	imageMemoryBind.offset = offset;
-	return true;
-}
-
-// Release Vulkan memory allocated for this page
-bool VirtualTexturePage::release(VkDevice device)
-{
-	del= false;
-	if (imageMemoryBind.memory != VK_NULL_HANDLE)
-	{
-		vkFreeMemory(device, imageMemoryBind.memory, nullptr);
-		imageMemoryBind.memory = VK_NULL_HANDLE;
-		return true;
-	}
-	return false;
-}
-
 /*
 	Virtual texture
 	Contains the virtual pages and memory binding information for a whole virtual texture
@@ -85,30 +48,17 @@ VirtualTexturePage* VirtualTexture::addPage(VkOffset3D offset, VkExtent3D extent
 	newPage.imageMemoryBind = {};
 	newPage.imageMemoryBind.offset = offset;
 	newPage.imageMemoryBind.extent = extent;
-	newPage.del = false;
 	pages.push_back(newPage);
 	return &pages.back();
 }
 
 // Call before sparse binding to update memory bind list etc.
-void VirtualTexture::updateSparseBindInfo(std::vector<VirtualTexturePage> &bindingChangedPages, bool del)
+void VirtualTexture::updateSparseBindInfo(const std::vector<VkSparseImageMemoryBind> &binds)
 {
-	// Update list of memory-backed sparse image memory binds
-	//sparseImageMemoryBinds.resize(pages.size());
-	sparseImageMemoryBinds.clear();
-	for (auto page : bindingChangedPages)
-	{
-		sparseImageMemoryBinds.push_back(page.imageMemoryBind);
-		if (del)
-		{
-			sparseImageMemoryBinds[sparseImageMemoryBinds.size() - 1].memory = VK_NULL_HANDLE;
-		}
-	}
+	// Update list of sparse image memory binds, binds without memory unbind the page
+	sparseImageMemoryBinds = binds;
 	// Update sparse bind info
 	bindSparseInfo = vks::initializers::bindSparseInfo();
-	// todo: Semaphore for queue submission
-	// bindSparseInfo.signalSemaphoreCount = 1;
-	// bindSparseInfo.pSignalSemaphores = &bindSparseSemaphore;
 
 	// Image memory binds
 	imageMemoryBindInfo = {};
@@ -118,29 +68,65 @@ void VirtualTexture::updateSparseBindInfo(std::vector<VirtualTexturePage> &bindi
 	bindSparseInfo.imageBindCount = (imageMemoryBindInfo.bindCount > 0) ? 1 : 0;
 	bindSparseInfo.pImageBinds = &imageMemoryBindInfo;
 
-	// Opaque image memory binds for the mip tail
+	// Opaque image memory binds for the mip tail, these only need to be bound once
 	opaqueMemoryBindInfo.image = image;
-	opaqueMemoryBindInfo.bindCount = static_cast<uint32_t>(opaqueMemoryBinds.size());
+	opaqueMemoryBindInfo.bindCount = bindMipTail ? static_cast<uint32_t>(opaqueMemoryBinds.size()) : 0;
 	opaqueMemoryBindInfo.pBinds = opaqueMemoryBinds.data();
 	bindSparseInfo.imageOpaqueBindCount = (opaqueMemoryBindInfo.bindCount > 0) ? 1 : 0;
 	bindSparseInfo.pImageOpaqueBinds = &opaqueMemoryBindInfo;
+	bindMipTail = false;
+}
+
+void VirtualTexture::createPagePool(uint32_t slotCount)
+{
+	// All pages have the same memory size, so a slot can be reused by any page
+	pageMemorySize = pages.empty() ? 0 : pages[0].size;
+	VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
+	allocInfo.allocationSize = pageMemorySize * slotCount;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &pagePool));
+	freePoolSlots.resize(slotCount);
+	for (uint32_t i = 0; i < slotCount; i++) {
+		// Hand out the lowest slots first
+		freePoolSlots[i] = slotCount - 1 - i;
+	}
+	lruPages.clear();
+	lruPositions.resize(pages.size());
+}
+
+VkSparseImageMemoryBind VirtualTexture::bindPage(VirtualTexturePage &page, uint32_t slot)
+{
+	page.poolSlot = slot;
+	page.imageMemoryBind.memory = pagePool;
+	page.imageMemoryBind.memoryOffset = slot * pageMemorySize;
+	lruPositions[page.index] = lruPages.insert(lruPages.end(), page.index);
+	return page.imageMemoryBind;
+}
+
+VkSparseImageMemoryBind VirtualTexture::evictPage(VirtualTexturePage &page)
+{
+	freePoolSlots.push_back(page.poolSlot);
+	lruPages.erase(lruPositions[page.index]);
+	page.imageMemoryBind.memory = VK_NULL_HANDLE;
+	page.imageMemoryBind.memoryOffset = 0;
+	return page.imageMemoryBind;
+}
+
+void VirtualTexture::touchPage(VirtualTexturePage &page)
+{
+	lruPages.splice(lruPages.end(), lruPages, lruPositions[page.index]);
 }
 
 // Release all Vulkan resources
 void VirtualTexture::destroy()
 {
-	for (auto page : pages)
-	{
-		page.release(device);
+	if (pagePool != VK_NULL_HANDLE) {
+		vkFreeMemory(device, pagePool, nullptr);
 	}
 	for (auto bind : opaqueMemoryBinds)
 	{
 		vkFreeMemory(device, bind.memory, nullptr);
 	}
-	// Clean up mip tail
-	if (mipTailimageMemoryBind.memory != VK_NULL_HANDLE) {
-		vkFreeMemory(device, mipTailimageMemoryBind.memory, nullptr);
-	}
 }
 
 /*
@@ -154,13 +140,29 @@ VulkanExample::VulkanExample() : VulkanExampleBase()
 	camera.setPosition(glm::vec3(0.0f, 0.0f, -12.0f));
 	camera.setRotation(glm::vec3(-90.0f, 0.0f, 0.0f));
 	camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
+	commandLineParser.add("texturesize", { "--texturesize" }, 1, "Width and height of the virtual texture (default 4096)");
+	commandLineParser.add("pagepool", { "--pagepool" }, 1, "Number of pages in the memory pool backing the streamed pages (default 256)");
+	commandLineParser.add("tiledfile", { "--tiledfile" }, 1, "Tiled file to stream the page contents from, generated if not present");
+	commandLineParser.parse(args);
+	textureSize = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("texturesize", 4096), 256));
+	pagePoolSize = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("pagepool", 256), 1));
+	tiledFileName = commandLineParser.getValueAsString("tiledfile", "texturesparseresidency_" + std::to_string(textureSize) + ".tiles");
 }
 
 VulkanExample::~VulkanExample()
 {
 	// Clean up used Vulkan resources
 	// Note : Inherited destructor cleans up resources stored in base class
+	// Page loads in flight write to the staging buffer
+	threadPool.wait();
 	destroyTextureImage(texture);
+	vkDestroyFence(device, uploadFence, nullptr);
+	stagingBuffer.destroy();
+	feedbackBuffer.destroy();
+	for (auto& buffer : feedbackReadbackBuffers) {
+		buffer.destroy();
+	}
+	pageTableBuffer.destroy();
 	vkDestroySemaphore(device, bindSparseSemaphore, nullptr);
 	vkDestroyPipeline(device, pipeline, nullptr);
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
@@ -178,6 +180,10 @@ void VulkanExample::getEnabledFeatures()
 	else {
 		std::cout << "Sparse binding not supported" << std::endl;
 	}
+	// Required for writing the page feedback in the fragment shader
+	if (deviceFeatures.fragmentStoresAndAtomics) {
+		enabledFeatures.fragmentStoresAndAtomics = VK_TRUE;
+	}
 }
 
 glm::uvec3 VulkanExample::alignedDivision(const VkExtent3D& extent, const VkExtent3D& granularity)
@@ -342,6 +348,9 @@ void VulkanExample::prepareSparseTexture(uint32_t width, uint32_t height, uint32
 			// Aligned sizes by image granularity
 			VkExtent3D imageGranularity = sparseMemoryReq.formatProperties.imageGranularity;
 			glm::uvec3 sparseBindCounts = alignedDivision(extent, imageGranularity);
+			if (layer == 0) {
+				texture.mipInfos.push_back({ static_cast<uint32_t>(texture.pages.size()), sparseBindCounts.x, sparseBindCounts.y });
+			}
 			glm::uvec3 lastBlockExtent;
 			lastBlockExtent.x = (extent.width % imageGranularity.width) ? extent.width % imageGranularity.width : imageGranularity.width;
 			lastBlockExtent.y = (extent.height % imageGranularity.height) ? extent.height % imageGranularity.height : imageGranularity.height;
@@ -427,13 +436,10 @@ void VulkanExample::prepareSparseTexture(uint32_t width, uint32_t height, uint32
 	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
 	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &bindSparseSemaphore));
 
-	// Prepare bind sparse info for reuse in queue submission
-	texture.updateSparseBindInfo(texture.pages);
-
-	// Bind to queue
-	// todo: in draw?
+	// Bind the mip tail, pages are bound once they have been requested
+	texture.bindMipTail = true;
+	texture.updateSparseBindInfo({});
 	vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE);
-	//todo: use sparse bind semaphore
 	vkQueueWaitIdle(queue);
 
 	// Create sampler
@@ -498,12 +504,30 @@ void VulkanExample::buildCommandBuffers()
 	renderPassBeginInfo.clearValueCount = 2;
 	renderPassBeginInfo.pClearValues = clearValues;
 
+	// The feedback of each command buffer is copied to its own readback buffer
+	while (feedbackReadbackBuffers.size() < drawCmdBuffers.size()) {
+		vks::Buffer readbackBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, feedbackBuffer.size));
+		VK_CHECK_RESULT(readbackBuffer.map());
+		memset(readbackBuffer.mapped, 0, feedbackBuffer.size);
+		feedbackReadbackBuffers.push_back(readbackBuffer);
+	}
+
 	for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 	{
 		renderPassBeginInfo.framebuffer = frameBuffers[i];
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+		// Clear the page requests of the previous frame
+		vkCmdFillBuffer(drawCmdBuffers[i], feedbackBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.buffer = feedbackBuffer.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
 		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -520,6 +544,17 @@ void VulkanExample::buildCommandBuffers()
 
 		vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+		// Copy the page requests written by the fragment shader for reading them on the host
+		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+		VkBufferCopy copyRegion{ 0, 0, feedbackBuffer.size };
+		vkCmdCopyBuffer(drawCmdBuffers[i], feedbackBuffer.buffer, feedbackReadbackBuffers[i].buffer, 1, &copyRegion);
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.buffer = feedbackReadbackBuffers[i].buffer;
+		vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
 		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 	}
 }
@@ -534,8 +569,9 @@ void VulkanExample::setupDescriptors()
 {
 	// Pool
 	std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
 	};
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -551,7 +587,17 @@ void VulkanExample::setupDescriptors()
 		vks::initializers::descriptorSetLayoutBinding(
 			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 			VK_SHADER_STAGE_FRAGMENT_BIT,
-			1)
+			1),
+		// Binding 2 : Fragment shader page feedback buffer
+		vks::initializers::descriptorSetLayoutBinding(
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_SHADER_STAGE_FRAGMENT_BIT,
+			2),
+		// Binding 3 : Fragment shader page table uniform buffer
+		vks::initializers::descriptorSetLayoutBinding(
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			VK_SHADER_STAGE_FRAGMENT_BIT,
+			3)
 	};
 	VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
@@ -564,7 +610,11 @@ void VulkanExample::setupDescriptors()
 		// Binding 0 : Vertex shader uniform buffer
 		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptor),
 		// Binding 1 : Fragment shader texture sampler
-		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texture.descriptor)
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texture.descriptor),
+		// Binding 2 : Fragment shader page feedback buffer
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &feedbackBuffer.descriptor),
+		// Binding 3 : Fragment shader page table uniform buffer
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &pageTableBuffer.descriptor)
 	};
 	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 }
@@ -630,10 +680,18 @@ void VulkanExample::prepare()
 	if (!vulkanDevice->features.sparseResidencyImage2D) {
 		vks::tools::exitFatal("Device does not support sparse residency for 2D images!", VK_ERROR_FEATURE_NOT_PRESENT);
 	}
+	// The fragment shader writes the pages it requests to a storage buffer
+	if (!vulkanDevice->features.fragmentStoresAndAtomics) {
+		vks::tools::exitFatal("Device does not support stores in fragment shaders!", VK_ERROR_FEATURE_NOT_PRESENT);
+	}
 	loadAssets();
 	prepareUniformBuffers();
-	// Create a virtual texture with max. possible dimension (does not take up any VRAM yet)
-	prepareSparseTexture(4096, 4096, 1, VK_FORMAT_R8G8B8A8_UNORM);
+	// Create a virtual texture (does not take up any VRAM yet), only the pages requested by the shader feedback are streamed into a fixed size memory pool
+	textureSize = std::min(textureSize, vulkanDevice->properties.limits.maxImageDimension2D);
+	prepareSparseTexture(textureSize, textureSize, 1, VK_FORMAT_R8G8B8A8_UNORM);
+	prepareStreaming();
+	fillMipTail();
+	prepareFeedback();
 	setupDescriptors();
 	preparePipelines();
 	buildCommandBuffers();
@@ -654,193 +712,351 @@ void VulkanExample::render()
 	if (!prepared)
 		return;
 	updateUniformBuffers();
+	updateResidency();
 	draw();
 }
 
-// Fills a buffer with random colors
-void VulkanExample::randomPattern(uint8_t* buffer, uint32_t width, uint32_t height)
+// Procedural content of the tiled file, each mip level gets its own tint and page borders are darkened to make the streamed pages visible
+void VulkanExample::generateTexels(uint8_t* buffer, uint32_t mipLevel, VkOffset3D offset, uint32_t width, uint32_t height, uint32_t rowLength)
 {
-	std::random_device rd;
-	std::mt19937 rndEngine(rd());
-	std::uniform_int_distribution<uint32_t> rndDist(0, 255);
-	uint8_t rndVal[4] = { 0, 0, 0, 0 };
-	while (rndVal[0] + rndVal[1] + rndVal[2] < 10) {
-		rndVal[0] = (uint8_t)rndDist(rndEngine);
-		rndVal[1] = (uint8_t)rndDist(rndEngine);
-		rndVal[2] = (uint8_t)rndDist(rndEngine);
-	}
-	rndVal[3] = 255;
+	const std::array<glm::vec3, 6> tints = {
+		glm::vec3(1.0f, 1.0f, 1.0f),
+		glm::vec3(1.0f, 0.6f, 0.6f),
+		glm::vec3(0.6f, 1.0f, 0.6f),
+		glm::vec3(0.6f, 0.6f, 1.0f),
+		glm::vec3(1.0f, 1.0f, 0.5f),
+		glm::vec3(1.0f, 0.5f, 1.0f)
+	};
+	const glm::vec3 tint = tints[mipLevel % tints.size()];
+	const VkExtent3D granularity = texture.sparseImageMemoryRequirements.formatProperties.imageGranularity;
+	const float levelWidth = (float)std::max(texture.width >> mipLevel, 1u);
+	const float levelHeight = (float)std::max(texture.height >> mipLevel, 1u);
 	for (uint32_t y = 0; y < height; y++) {
+		uint8_t* row = buffer + (size_t)y * rowLength * 4;
 		for (uint32_t x = 0; x < width; x++) {
-			for (uint32_t c = 0; c < 4; c++, ++buffer) {
-				*buffer = rndVal[c];
-			}
+			const uint32_t tx = offset.x + x;
+			const uint32_t ty = offset.y + y;
+			const float u = ((float)tx + 0.5f) / levelWidth;
+			const float v = ((float)ty + 0.5f) / levelHeight;
+			// Checkerboard with the same number of cells on all mip levels
+			const bool checker = ((static_cast<uint32_t>(u * 128.0f) + static_cast<uint32_t>(v * 128.0f)) & 1) != 0;
+			const bool pageBorder = (tx % granularity.width == 0) || (ty % granularity.height == 0);
+			const glm::vec3 color = glm::vec3(u, v, 1.0f - u * 0.5f) * tint * (checker ? 1.0f : 0.6f) * (pageBorder ? 0.25f : 1.0f);
+			row[x * 4 + 0] = static_cast<uint8_t>(color.r * 255.0f);
+			row[x * 4 + 1] = static_cast<uint8_t>(color.g * 255.0f);
+			row[x * 4 + 2] = static_cast<uint8_t>(color.b * 255.0f);
+			row[x * 4 + 3] = 255;
 		}
 	}
 }
 
-void VulkanExample::uploadContent(VirtualTexturePage page, VkImage image)
+VulkanExample::TiledFileHeader VulkanExample::getTiledFileHeader()
 {
-	// Generate some random image data and upload as a buffer
-	const size_t bufferSize = 4 * page.extent.width * page.extent.height;
+	const VkExtent3D granularity = texture.sparseImageMemoryRequirements.formatProperties.imageGranularity;
+	TiledFileHeader header{};
+	header.magic = 0x53505654;
+	header.version = 1;
+	header.width = texture.width;
+	header.height = texture.height;
+	header.mipLevels = texture.mipLevels;
+	header.mipTailStart = texture.mipTailStart;
+	header.pageWidth = granularity.width;
+	header.pageHeight = granularity.height;
+	return header;
+}
 
-	vks::Buffer imageBuffer;
+// Check if the tiled file exists and matches the layout of the virtual texture
+bool VulkanExample::tiledFileValid()
+{
+	std::ifstream file(tiledFileName, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return false;
+	}
+	const VkDeviceSize expectedSize = sizeof(TiledFileHeader) + texture.pages.size() * pageDataSize + mipTailDataSize;
+	if (static_cast<VkDeviceSize>(file.tellg()) < expectedSize) {
+		return false;
+	}
+	file.seekg(0);
+	TiledFileHeader header{};
+	file.read((char*)&header, sizeof(TiledFileHeader));
+	const TiledFileHeader expectedHeader = getTiledFileHeader();
+	return memcmp(&header, &expectedHeader, sizeof(TiledFileHeader)) == 0;
+}
+
+void VulkanExample::generateTiledFile()
+{
+	std::cout << "Generating tiled file \"" << tiledFileName << "\"" << std::endl;
+	std::ofstream file(tiledFileName, std::ios::binary);
+	if (!file.is_open()) {
+		vks::tools::exitFatal("Could not create the tiled file \"" + tiledFileName + "\"", -1);
+		return;
+	}
+	const TiledFileHeader header = getTiledFileHeader();
+	file.write((const char*)&header, sizeof(TiledFileHeader));
+	// Pages at the right and bottom border may be smaller than the page extent, but are padded to the full page size
+	std::vector<uint8_t> data(pageDataSize);
+	for (auto& page : texture.pages) {
+		std::fill(data.begin(), data.end(), 0);
+		generateTexels(data.data(), page.mipLevel, page.offset, page.extent.width, page.extent.height, header.pageWidth);
+		file.write((const char*)data.data(), pageDataSize);
+	}
+	for (uint32_t i = texture.mipTailStart; i < texture.mipLevels; i++) {
+		const uint32_t width = std::max(texture.width >> i, 1u);
+		const uint32_t height = std::max(texture.height >> i, 1u);
+		data.resize((size_t)width * height * 4);
+		generateTexels(data.data(), i, {}, width, height, width);
+		file.write((const char*)data.data(), data.size());
+	}
+}
+
+void VulkanExample::prepareFeedback()
+{
+	// One flag per page, cleared at the start of each frame
+	const VkDeviceSize feedbackSize = std::max<VkDeviceSize>(texture.pages.size(), 1) * sizeof(uint32_t);
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&feedbackBuffer,
+		feedbackSize));
+
+	const VkExtent3D granularity = texture.sparseImageMemoryRequirements.formatProperties.imageGranularity;
+	pageTableData = {};
+	pageTableData.info = glm::uvec4(granularity.width, granularity.height, texture.mipTailStart, texture.mipLevels);
+	for (size_t i = 0; i < std::min<size_t>(texture.mipInfos.size(), 16); i++) {
+		pageTableData.mips[i] = glm::uvec4(texture.mipInfos[i].firstPage, texture.mipInfos[i].pagesX, texture.mipInfos[i].pagesY, 0);
+	}
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &pageTableBuffer, sizeof(PageTableData), &pageTableData));
+}
+
+void VulkanExample::prepareStreaming()
+{
+	const VkExtent3D granularity = texture.sparseImageMemoryRequirements.formatProperties.imageGranularity;
+	pageDataSize = granularity.width * granularity.height * 4;
+	mipTailDataSize = 0;
+	for (uint32_t i = texture.mipTailStart; i < texture.mipLevels; i++) {
+		mipTailDataSize += std::max(texture.width >> i, 1u) * std::max(texture.height >> i, 1u) * 4;
+	}
+	if (!tiledFileValid()) {
+		generateTiledFile();
+	}
+
+	// The page memory pool is the only memory used by the streamed pages, no matter how large the virtual texture is
+	pagePoolSize = std::max(std::min(pagePoolSize, static_cast<uint32_t>(texture.pages.size())), 1u);
+	texture.createPagePool(pagePoolSize);
+
+	// Staging memory the worker threads load the pages into
+	const uint32_t stagingSlotCount = maxPageRequestsPerFrame * 2;
 	VK_CHECK_RESULT(vulkanDevice->createBuffer(
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&imageBuffer,
-		bufferSize));
-	imageBuffer.map();
+		&stagingBuffer,
+		stagingSlotCount * pageDataSize));
+	VK_CHECK_RESULT(stagingBuffer.map());
+	for (uint32_t i = 0; i < stagingSlotCount; i++) {
+		freeStagingSlots.push_back(stagingSlotCount - 1 - i);
+	}
 
-	uint8_t* data = (uint8_t*)imageBuffer.mapped;
-	randomPattern(data, page.extent.height, page.extent.width);
+	const uint32_t threadCount = std::max(std::min(std::thread::hardware_concurrency(), 4u), 1u);
+	threadPool.setThreadCount(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++) {
+		streamingFiles.emplace_back(tiledFileName, std::ios::binary);
+	}
+	std::cout << "Streaming pages with " << threadCount << " worker threads into a pool of " << pagePoolSize << " pages" << std::endl;
 
-	VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-	VkBufferImageCopy region{};
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.layerCount = 1;
-	region.imageSubresource.mipLevel = page.mipLevel;
-	region.imageOffset = page.offset;
-	region.imageExtent = page.extent;
-	vkCmdCopyBufferToImage(copyCmd, imageBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-	vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
-	vulkanDevice->flushCommandBuffer(copyCmd, queue);
+	VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &uploadCmdBuffer));
+	VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+	VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &uploadFence));
+}
 
-	imageBuffer.destroy();
+// Called on a worker thread, reads the page's contents into its staging slot
+void VulkanExample::loadPage(uint32_t threadIndex, PageLoad load)
+{
+	std::ifstream& file = streamingFiles[threadIndex];
+	file.seekg(static_cast<std::streamoff>(sizeof(TiledFileHeader) + load.pageIndex * pageDataSize));
+	file.read((char*)stagingBuffer.mapped + load.stagingSlot * pageDataSize, static_cast<std::streamsize>(pageDataSize));
+	std::lock_guard<std::mutex> lock(completedLoadsMutex);
+	completedLoads.push_back(load);
 }
 
-void VulkanExample::fillRandomPages()
+/*
+	Decide which pages need to be resident based on the feedback of the last frame
+	Missing pages are loaded on the worker threads, and bound to the memory pool and uploaded once loaded
+	If the pool is full, the least recently requested pages are evicted
+*/
+void VulkanExample::updateResidency()
 {
-	vkDeviceWaitIdle(device);
+	residencyFrame++;
+
+	// Staging slots of the last upload can be reused once it has finished
+	if (uploadPending) {
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &uploadFence, VK_TRUE, UINT64_MAX));
+		VK_CHECK_RESULT(vkResetFences(device, 1, &uploadFence));
+		freeStagingSlots.insert(freeStagingSlots.end(), uploadingStagingSlots.begin(), uploadingStagingSlots.end());
+		uploadingStagingSlots.clear();
+		uploadPending = false;
+	}
 
-	std::default_random_engine rndEngine(benchmark.active ? 0 : std::random_device{}());
-	std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+	std::vector<VkSparseImageMemoryBind> binds;
+	if (evictAllPages) {
+		for (auto& page : texture.pages) {
+			if (page.resident()) {
+				binds.push_back(texture.evictPage(page));
+				streamingStats.evictedPages++;
+			}
+		}
+		evictAllPages = false;
+	}
 
-	std::vector<VirtualTexturePage> updatedPages;
-	std::vector<VirtualTexturePage> bindingChangedPages;
-	for (auto& page : texture.pages) {
-		if (rndDist(rndEngine) < 0.5f) {
+	// The readback buffer of the last frame's command buffer, that frame has finished as the base class waits for the queue after submitting it
+	const uint32_t* requests = static_cast<const uint32_t*>(feedbackReadbackBuffers[currentBuffer].mapped);
+	std::vector<uint32_t> missingPages;
+	streamingStats.requestedPages = 0;
+	for (uint32_t i = 0; i < static_cast<uint32_t>(texture.pages.size()); i++) {
+		if (requests[i] == 0) {
 			continue;
 		}
-		if (page.allocate(device, texture.memoryTypeIndex))
-		{
-			bindingChangedPages.push_back(page);
+		VirtualTexturePage& page = texture.pages[i];
+		page.lastRequested = residencyFrame;
+		streamingStats.requestedPages++;
+		if (page.resident()) {
+			texture.touchPage(page);
+		} else if (!page.loading) {
+			missingPages.push_back(i);
 		}
-		updatedPages.push_back(page);
 	}
 
-	// Update sparse queue binding
-	texture.updateSparseBindInfo(bindingChangedPages);
-	VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-	VkFence fence;
-	VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
-	vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, fence);
-	vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
-	vkDestroyFence(device, fence, nullptr);
+	// Load coarser mip levels first, so the finer levels have a fallback as soon as possible
+	std::sort(missingPages.begin(), missingPages.end(), [this](uint32_t a, uint32_t b) { return texture.pages[a].mipLevel > texture.pages[b].mipLevel; });
+	const size_t loadCount = std::min({ missingPages.size(), static_cast<size_t>(maxPageRequestsPerFrame), freeStagingSlots.size() });
+	for (size_t i = 0; i < loadCount; i++) {
+		const PageLoad load{ missingPages[i], freeStagingSlots.back() };
+		freeStagingSlots.pop_back();
+		texture.pages[load.pageIndex].loading = true;
+		streamingStats.pendingLoads++;
+		const uint32_t threadIndex = nextStreamingThread;
+		nextStreamingThread = (nextStreamingThread + 1) % static_cast<uint32_t>(threadPool.threads.size());
+		threadPool.threads[threadIndex]->addJob([this, threadIndex, load] { loadPage(threadIndex, load); });
+	}
 
-	for (auto &page: updatedPages) {
-		uploadContent(page, texture.image);
+	// Bind the pages that finished loading to the pool and upload them
+	std::vector<PageLoad> loads;
+	{
+		std::lock_guard<std::mutex> lock(completedLoadsMutex);
+		std::swap(loads, completedLoads);
 	}
-}
+	const VkExtent3D granularity = texture.sparseImageMemoryRequirements.formatProperties.imageGranularity;
+	std::vector<VkBufferImageCopy> copyRegions;
+	for (auto& load : loads) {
+		VirtualTexturePage& page = texture.pages[load.pageIndex];
+		page.loading = false;
+		streamingStats.pendingLoads--;
+		if (texture.freePoolSlots.empty()) {
+			// Pages requested by the last frame are never evicted, if the pool is too small for them the page will be requested again later
+			if (texture.lruPages.empty() || (texture.pages[texture.lruPages.front()].lastRequested == residencyFrame)) {
+				freeStagingSlots.push_back(load.stagingSlot);
+				streamingStats.droppedLoads++;
+				continue;
+			}
+			binds.push_back(texture.evictPage(texture.pages[texture.lruPages.front()]));
+			streamingStats.evictedPages++;
+		}
+		const uint32_t poolSlot = texture.freePoolSlots.back();
+		texture.freePoolSlots.pop_back();
+		// Keeps the page from being evicted by the other pages bound in this update
+		page.lastRequested = residencyFrame;
+		binds.push_back(texture.bindPage(page, poolSlot));
 
-void VulkanExample::fillMipTail()
-{
-	// Clean up previous mip tail memory allocation
-	if (texture.mipTailimageMemoryBind.memory != VK_NULL_HANDLE) {
-		vkFreeMemory(device, texture.mipTailimageMemoryBind.memory, nullptr);
+		VkBufferImageCopy region{};
+		region.bufferOffset = load.stagingSlot * pageDataSize;
+		region.bufferRowLength = granularity.width;
+		region.bufferImageHeight = granularity.height;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = page.mipLevel;
+		region.imageSubresource.baseArrayLayer = page.layer;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = page.offset;
+		region.imageExtent = page.extent;
+		copyRegions.push_back(region);
+		uploadingStagingSlots.push_back(load.stagingSlot);
+		streamingStats.loadedPages++;
 	}
 
-	//@todo: WIP
-	VkDeviceSize imageMipTailSize = texture.sparseImageMemoryRequirements.imageMipTailSize;
-	VkDeviceSize imageMipTailOffset = texture.sparseImageMemoryRequirements.imageMipTailOffset;
-	// Stride between memory bindings for each mip level if not single mip tail (VK_SPARSE_IMAGE_FORMAT_SINGLE_MIPTAIL_BIT not set)
-	VkDeviceSize imageMipTailStride = texture.sparseImageMemoryRequirements.imageMipTailStride;
+	if (binds.empty()) {
+		return;
+	}
 
-	VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
-	allocInfo.allocationSize = imageMipTailSize;
-	allocInfo.memoryTypeIndex = texture.memoryTypeIndex;
-	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &texture.mipTailimageMemoryBind.memory));
+	// Sparse binding isn't ordered against earlier command buffer submissions, but no frame still sampling evicted pages is in flight as the base class waits for the queue after each frame
+	texture.updateSparseBindInfo(binds);
+	if (!copyRegions.empty()) {
+		texture.bindSparseInfo.signalSemaphoreCount = 1;
+		texture.bindSparseInfo.pSignalSemaphores = &bindSparseSemaphore;
+	}
+	VK_CHECK_RESULT(vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE));
+	if (copyRegions.empty()) {
+		return;
+	}
 
-	uint32_t mipLevel = texture.sparseImageMemoryRequirements.imageMipTailFirstLod;
-	uint32_t width = std::max(texture.width >> texture.sparseImageMemoryRequirements.imageMipTailFirstLod, 1u);
-	uint32_t height = std::max(texture.height >> texture.sparseImageMemoryRequirements.imageMipTailFirstLod, 1u);
-	uint32_t depth = 1;
+	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+	VK_CHECK_RESULT(vkBeginCommandBuffer(uploadCmdBuffer, &cmdBufInfo));
+	vks::tools::setImageLayout(uploadCmdBuffer, texture.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	vkCmdCopyBufferToImage(uploadCmdBuffer, stagingBuffer.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+	vks::tools::setImageLayout(uploadCmdBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	VK_CHECK_RESULT(vkEndCommandBuffer(uploadCmdBuffer));
+
+	// The upload waits for the pages to be bound
+	const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	VkSubmitInfo uploadSubmitInfo = vks::initializers::submitInfo();
+	uploadSubmitInfo.waitSemaphoreCount = 1;
+	uploadSubmitInfo.pWaitSemaphores = &bindSparseSemaphore;
+	uploadSubmitInfo.pWaitDstStageMask = &waitStageMask;
+	uploadSubmitInfo.commandBufferCount = 1;
+	uploadSubmitInfo.pCommandBuffers = &uploadCmdBuffer;
+	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &uploadSubmitInfo, uploadFence));
+	uploadPending = true;
+}
 
-	for (uint32_t i = texture.mipTailStart; i < texture.mipLevels; i++) {
+// The mip tail is always resident and serves as the fallback for pages that haven't been streamed in yet
+void VulkanExample::fillMipTail()
+{
+	if (texture.mipTailStart >= texture.mipLevels) {
+		return;
+	}
 
+	vks::Buffer imageBuffer;
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&imageBuffer,
+		mipTailDataSize));
+	VK_CHECK_RESULT(imageBuffer.map());
+	std::ifstream file(tiledFileName, std::ios::binary);
+	file.seekg(static_cast<std::streamoff>(sizeof(TiledFileHeader) + texture.pages.size() * pageDataSize));
+	file.read((char*)imageBuffer.mapped, static_cast<std::streamsize>(mipTailDataSize));
+
+	std::vector<VkBufferImageCopy> regions;
+	VkDeviceSize bufferOffset = 0;
+	for (uint32_t i = texture.mipTailStart; i < texture.mipLevels; i++) {
 		const uint32_t width = std::max(texture.width >> i, 1u);
 		const uint32_t height = std::max(texture.height >> i, 1u);
-
-		// Generate some random image data and upload as a buffer
-		const size_t bufferSize = 4 * width * height;
-
-		vks::Buffer imageBuffer;
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&imageBuffer,
-			bufferSize));
-		imageBuffer.map();
-
-		// Fill buffer with random colors
-		std::random_device rd;
-		std::mt19937 rndEngine(rd());
-		std::uniform_int_distribution<uint32_t> rndDist(0, 255);
-		uint8_t* data = (uint8_t*)imageBuffer.mapped;
-		randomPattern(data, width, height);
-
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 		VkBufferImageCopy region{};
+		region.bufferOffset = bufferOffset;
 		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		region.imageSubresource.layerCount = 1;
 		region.imageSubresource.mipLevel = i;
 		region.imageOffset = {};
 		region.imageExtent = { width, height, 1 };
-		vkCmdCopyBufferToImage(copyCmd, imageBuffer.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-		vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
-		vulkanDevice->flushCommandBuffer(copyCmd, queue);
-
-		imageBuffer.destroy();
+		regions.push_back(region);
+		bufferOffset += width * height * 4;
 	}
-}
-
-void VulkanExample::flushRandomPages()
-{
-	vkDeviceWaitIdle(device);
 
-	std::default_random_engine rndEngine(benchmark.active ? 0 : std::random_device{}());
-	std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
-
-	std::vector<VirtualTexturePage> updatedPages;
-	std::vector<VirtualTexturePage> bindingChangedPages;
-	for (auto& page : texture.pages)
-	{
-		if (rndDist(rndEngine) < 0.5f) {
-			continue;
-		}
-		if (page.imageMemoryBind.memory != VK_NULL_HANDLE){
-			page.del = true;
-			bindingChangedPages.push_back(page);
-		}
-	}
+	VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	vkCmdCopyBufferToImage(copyCmd, imageBuffer.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+	vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	vulkanDevice->flushCommandBuffer(copyCmd, queue);
 
-	// Update sparse queue binding
-	texture.updateSparseBindInfo(bindingChangedPages, true);
-	VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-	VkFence fence;
-	VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
-	vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, fence);
-	vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
-	vkDestroyFence(device, fence, nullptr);
-	for (auto& page : texture.pages)
-	{
-		if (page.del)
-		{
-			page.release(device);
-		}
-	}
+	imageBuffer.destroy();
 }
 
 void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
@@ -849,20 +1065,19 @@ void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 		if (overlay->sliderFloat("LOD bias", &uniformData.lodBias, -(float)texture.mipLevels, (float)texture.mipLevels)) {
 			updateUniformBuffers();
 		}
-		if (overlay->button("Fill random pages")) {
-			fillRandomPages();
-		}
-		if (overlay->button("Flush random pages")) {
-			flushRandomPages();
-		}
-		if (overlay->button("Fill mip tail")) {
-			fillMipTail();
+		if (overlay->button("Evict all pages")) {
+			evictAllPages = true;
 		}
 	}
 	if (overlay->header("Statistics")) {
-		uint32_t respages = 0;
-		std::for_each(texture.pages.begin(), texture.pages.end(), [&respages](VirtualTexturePage page) { respages += (page.resident()) ? 1 : 0; });
-		overlay->text("Resident pages: %d of %d", respages, static_cast<uint32_t>(texture.pages.size()));
+		const float toMB = 1.0f / (1024.0f * 1024.0f);
+		overlay->text("Resident pages: %d of %d", static_cast<uint32_t>(texture.lruPages.size()), static_cast<uint32_t>(texture.pages.size()));
+		overlay->text("Page pool: %d pages (%.1f MB)", pagePoolSize, (float)(pagePoolSize * texture.pageMemorySize) * toMB);
+		overlay->text("Virtual texture: %d x %d (%.1f MB)", texture.width, texture.height, (float)(texture.pages.size() * texture.pageMemorySize) * toMB);
+		overlay->text("Requested pages: %d", streamingStats.requestedPages);
+		overlay->text("Pending loads: %d", streamingStats.pendingLoads);
+		overlay->text("Loaded: %d, evicted: %d", streamingStats.loadedPages, streamingStats.evictedPages);
+		overlay->text("Dropped (pool full): %d", streamingStats.droppedLoads);
 		overlay->text("Mip tail starts at: %d", texture.mipTailStart);
 	}
 
@@ -10,8 +10,13 @@
 * Important note : This sample is work-in-progress and works basically, but it's not finished
 */
 
+#include <fstream>
+#include <list>
+#include <mutex>
+
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "threadpool.hpp"
 
 // Virtual texture page as a part of the partially resident texture
 // Contains memory bindings, offsets and status information
@@ -24,12 +29,12 @@ struct VirtualTexturePage
 	uint32_t mipLevel;													// Mip level that this page belongs to
 	uint32_t layer;														// Array layer that this page belongs to
 	uint32_t index;
-    bool del;
+	uint32_t poolSlot;													// Slot of the page memory pool backing this page (if resident)
+	bool loading;														// Page contents are currently being streamed in
+	uint64_t lastRequested;												// Last frame the page was requested by the shader feedback
 
 	VirtualTexturePage();
 	bool resident();
-	bool allocate(VkDevice device, uint32_t memoryTypeIndex);
-	bool release(VkDevice device);
 };
 
 // Virtual texture object containing all pages
@@ -41,13 +46,28 @@ struct VirtualTexture
 	std::vector<VirtualTexturePage> pages;								// Contains all virtual pages of the texture
 	std::vector<VkSparseImageMemoryBind> sparseImageMemoryBinds;		// Sparse image memory bindings of all memory-backed virtual tables
 	std::vector<VkSparseMemoryBind>	opaqueMemoryBinds;					// Sparse opaque memory bindings for the mip tail (if present)
+	bool bindMipTail{ false };											// Include the mip tail bindings in the next sparse bind
 	VkSparseImageMemoryBindInfo imageMemoryBindInfo;					// Sparse image memory bind info
 	VkSparseImageOpaqueMemoryBindInfo opaqueMemoryBindInfo;				// Sparse image opaque memory bind info (mip tail)
 	uint32_t mipTailStart;												// First mip level in mip tail
 	VkSparseImageMemoryRequirements sparseImageMemoryRequirements;		// @todo: Comment
 	uint32_t memoryTypeIndex;											// @todo: Comment
 
-	VkSparseImageMemoryBind mipTailimageMemoryBind{};
+	// Pages of a mip level outside the mip tail, stored row by row starting at firstPage
+	struct MipInfo {
+		uint32_t firstPage;
+		uint32_t pagesX;
+		uint32_t pagesY;
+	};
+	std::vector<MipInfo> mipInfos;
+
+	// All streamed pages are bound from a single memory pool with a fixed number of page sized slots
+	VkDeviceMemory pagePool{ VK_NULL_HANDLE };
+	VkDeviceSize pageMemorySize{ 0 };
+	std::vector<uint32_t> freePoolSlots;
+	// Resident pages from least to most recently requested
+	std::list<uint32_t> lruPages;
+	std::vector<std::list<uint32_t>::iterator> lruPositions;
 
 	// @todo: comment
 	struct MipTailInfo {
@@ -56,7 +76,14 @@ struct VirtualTexture
 	} mipTailInfo;
 
 	VirtualTexturePage *addPage(VkOffset3D offset, VkExtent3D extent, const VkDeviceSize size, const uint32_t mipLevel, uint32_t layer);
-	void updateSparseBindInfo(std::vector<VirtualTexturePage> &bindingChangedPages, bool del = false);
+	void updateSparseBindInfo(const std::vector<VkSparseImageMemoryBind> &binds);
+	void createPagePool(uint32_t slotCount);
+	// Bind a page to a pool slot, returns the sparse bind for it
+	VkSparseImageMemoryBind bindPage(VirtualTexturePage &page, uint32_t slot);
+	// Unbind a page and return its pool slot to the free list, returns the sparse bind for it
+	VkSparseImageMemoryBind evictPage(VirtualTexturePage &page);
+	// Mark a resident page as most recently used
+	void touchPage(VirtualTexturePage &page);
 	// @todo: replace with dtor?
 	void destroy();
 };
@@ -79,6 +106,67 @@ public:
 
 	vkglTF::Model plane;
 
+	// Tiled file the page contents are streamed from
+	// Pages outside the mip tail are stored in the order of texture.pages, each padded to the full page extent, followed by the mip tail levels
+	struct TiledFileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		uint32_t mipTailStart;
+		uint32_t pageWidth;
+		uint32_t pageHeight;
+	};
+	std::string tiledFileName;
+	uint32_t textureSize{ 4096 };
+	// Size of a page in the file, with the full page extent
+	VkDeviceSize pageDataSize{ 0 };
+	VkDeviceSize mipTailDataSize{ 0 };
+
+	// Page requests written by the fragment shader, one flag per page outside the mip tail
+	vks::Buffer feedbackBuffer;
+	// One readback buffer per draw command buffer, read on the host once the frame using it has finished
+	std::vector<vks::Buffer> feedbackReadbackBuffers;
+	// Page layout passed to the fragment shader for writing the feedback
+	struct PageTableData {
+		// x = page width, y = page height, z = first mip level in the mip tail, w = mip level count
+		glm::uvec4 info;
+		// x = first page, y = pages per row, z = page rows
+		glm::uvec4 mips[16];
+	} pageTableData;
+	vks::Buffer pageTableBuffer;
+
+	// Page streaming
+	struct PageLoad {
+		uint32_t pageIndex;
+		uint32_t stagingSlot;
+	};
+	uint32_t pagePoolSize{ 256 };
+	uint32_t maxPageRequestsPerFrame{ 32 };
+	vks::ThreadPool threadPool;
+	uint32_t nextStreamingThread{ 0 };
+	// Each worker thread reads from its own file stream
+	std::vector<std::ifstream> streamingFiles;
+	vks::Buffer stagingBuffer;
+	std::vector<uint32_t> freeStagingSlots;
+	// Staging slots of the last upload, released once its fence has been signaled
+	std::vector<uint32_t> uploadingStagingSlots;
+	std::mutex completedLoadsMutex;
+	std::vector<PageLoad> completedLoads;
+	VkCommandBuffer uploadCmdBuffer{ VK_NULL_HANDLE };
+	VkFence uploadFence{ VK_NULL_HANDLE };
+	bool uploadPending{ false };
+	uint64_t residencyFrame{ 0 };
+	bool evictAllPages{ false };
+	struct StreamingStats {
+		uint32_t requestedPages{ 0 };
+		uint32_t pendingLoads{ 0 };
+		uint32_t loadedPages{ 0 };
+		uint32_t evictedPages{ 0 };
+		uint32_t droppedLoads{ 0 };
+	} streamingStats;
+
 	struct UniformData {
 		glm::mat4 projection;
 		glm::mat4 model;
@@ -92,14 +180,17 @@ public:
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 
-	//todo: comment
+	// Signaled by sparse binding, waited on by the upload of the newly bound pages
 	VkSemaphore bindSparseSemaphore{ VK_NULL_HANDLE };
 
 	VulkanExample();
 	~VulkanExample();
 	virtual void getEnabledFeatures();
 	glm::uvec3 alignedDivision(const VkExtent3D& extent, const VkExtent3D& granularity);
-	void randomPattern(uint8_t* buffer, uint32_t width, uint32_t height);
+	void generateTexels(uint8_t* buffer, uint32_t mipLevel, VkOffset3D offset, uint32_t width, uint32_t height, uint32_t rowLength);
+	TiledFileHeader getTiledFileHeader();
+	bool tiledFileValid();
+	void generateTiledFile();
 	void prepareSparseTexture(uint32_t width, uint32_t height, uint32_t layerCount, VkFormat format);
 	// @todo: move to dtor of texture
 	void destroyTextureImage(SparseTexture texture);
@@ -112,9 +203,10 @@ public:
 	void updateUniformBuffers();
 	void prepare();
 	virtual void render();
-	void uploadContent(VirtualTexturePage page, VkImage image);
-	void fillRandomPages();
+	void prepareFeedback();
+	void prepareStreaming();
+	void loadPage(uint32_t threadIndex, PageLoad load);
+	void updateResidency();
 	void fillMipTail();
-	void flushRandomPages();
 	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay);
 };
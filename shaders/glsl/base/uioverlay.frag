@@ -4,10 +4,15 @@ layout (binding = 0) uniform sampler2D fontSampler;
 
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in vec4 inColor;
+layout (location = 2) flat in vec4 inClipRect;
 
 layout (location = 0) out vec4 outColor;
 
 void main() 
 {
+	// Clip rectangle as min/max in framebuffer coordinates
+	if (any(lessThan(gl_FragCoord.xy, inClipRect.xy)) || any(greaterThanEqual(gl_FragCoord.xy, inClipRect.zw))) {
+		discard;
+	}
 	outColor = inColor * texture(fontSampler, inUV);
 }
\ No newline at end of file
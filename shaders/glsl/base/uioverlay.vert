@@ -3,6 +3,7 @@
 layout (location = 0) in vec2 inPos;
 layout (location = 1) in vec2 inUV;
 layout (location = 2) in vec4 inColor;
+layout (location = 3) in vec4 inClipRect;
 
 layout (push_constant) uniform PushConstants {
 	vec2 scale;
@@ -11,6 +12,7 @@ layout (push_constant) uniform PushConstants {
 
 layout (location = 0) out vec2 outUV;
 layout (location = 1) out vec4 outColor;
+layout (location = 2) flat out vec4 outClipRect;
 
 out gl_PerVertex 
 {
@@ -21,5 +23,6 @@ void main()
 {
 	outUV = inUV;
 	outColor = inColor;
+	outClipRect = inClipRect;
 	gl_Position = vec4(inPos * pushConstants.scale + pushConstants.translate, 0.0, 1.0);
 }
\ No newline at end of file
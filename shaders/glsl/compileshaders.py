@@ -30,7 +30,7 @@ def findGlslang():
 
     sys.exit("Could not find glslangvalidator executable on PATH, and was not specified with --glslang")
 
-file_extensions = tuple([".vert", ".frag", ".comp", ".geom", ".tesc", ".tese", ".rgen", ".rchit", ".rmiss", ".mesh", ".task"])
+file_extensions = tuple([".vert", ".frag", ".comp", ".geom", ".tesc", ".tese", ".rgen", ".rchit", ".rahit", ".rmiss", ".mesh", ".task"])
 
 glslang_path = findGlslang()
 dir_path = os.path.dirname(os.path.realpath(__file__))
@@ -47,8 +47,9 @@ for root, dirs, files in os.walk(dir_path):
 
 
             # Ray tracing shaders require a different target environment           
-            if file.endswith(".rgen") or file.endswith(".rchit") or file.endswith(".rmiss"):
-               add_params = add_params + " --target-env vulkan1.2"
+            # SPIR-V is kept at 1.4, as the ray tracing samples run on Vulkan 1.1 with VK_KHR_spirv_1_4
+            if file.endswith(".rgen") or file.endswith(".rchit") or file.endswith(".rahit") or file.endswith(".rmiss"):
+               add_params = add_params + " --target-env vulkan1.2 --target-env spirv1.4"
             # Same goes for samples that use ray queries
             if root.endswith("rayquery") and file.endswith(".frag"):
                 add_params = add_params + " --target-env vulkan1.2"
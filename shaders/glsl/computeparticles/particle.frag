@@ -11,5 +11,8 @@ layout (location = 0) out vec4 outFragColor;
 void main () 
 {
 	vec3 color = texture(samplerGradientRamp, vec2(inGradientPos, 0.0)).rgb;
-	outFragColor.rgb = texture(samplerColorMap, gl_PointCoord).rgb * color;
+	vec3 particle = texture(samplerColorMap, gl_PointCoord).rgb;
+	outFragColor.rgb = particle * color;
+	// Opacity for alpha blending, ignored with additive blending
+	outFragColor.a = dot(particle, vec3(0.299, 0.587, 0.114));
 }
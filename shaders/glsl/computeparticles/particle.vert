@@ -3,6 +3,13 @@
 layout (location = 0) in vec2 inPos;
 layout (location = 1) in vec4 inGradientPos;
 
+layout (binding = 2) uniform UBO
+{
+	mat4 projection;
+	mat4 view;
+	vec2 screenDim;
+} ubo;
+
 layout (location = 0) out vec4 outColor;
 layout (location = 1) out float outGradientPos;
 
@@ -17,5 +24,6 @@ void main ()
   gl_PointSize = 8.0;
   outColor = vec4(0.035);
   outGradientPos = inGradientPos.x;
-  gl_Position = vec4(inPos.xy, 1.0, 1.0);
-}
\ No newline at end of file
+  // The z position of the particle is stored in the gradient position
+  gl_Position = ubo.projection * ubo.view * vec4(inPos.xy, inGradientPos.y, 1.0);
+}
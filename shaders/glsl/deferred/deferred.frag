@@ -1,5 +1,6 @@
 #version 450
 
+// Depth with the packed G-Buffer layout
 layout (binding = 1) uniform sampler2D samplerposition;
 layout (binding = 2) uniform sampler2D samplerNormal;
 layout (binding = 3) uniform sampler2D samplerAlbedo;
@@ -8,6 +9,12 @@ layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragcolor;
 
+// Must match the defines in deferred.cpp
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define CLUSTER_MAX_LIGHTS 512
+
 struct Light {
 	vec4 position;
 	vec3 color;
@@ -16,17 +23,105 @@ struct Light {
 
 layout (binding = 4) uniform UBO 
 {
-	Light lights[6];
+	mat4 view;
+	mat4 invViewProjection;
 	vec4 viewPos;
+	// x = projection[0][0], y = projection[1][1], z = near plane, w = far plane
+	vec4 clusterParams;
 	int displayDebugTarget;
+	uint lightCount;
+	uint clustered;
 } ubo;
 
+layout (std430, binding = 5) readonly buffer Lights {
+	Light lights[];
+};
+
+layout (std430, binding = 6) readonly buffer ClusterLightCounts {
+	uint clusterLightCounts[];
+};
+
+layout (std430, binding = 7) readonly buffer ClusterLightIndices {
+	uint clusterLightIndices[];
+};
+
+// The packed G-Buffer layout reconstructs the position from depth and stores octahedral encoded normals
+layout (constant_id = 0) const bool PACKED_GBUFFER = false;
+
+#define ambient 0.0
+
+vec3 decodeNormal(vec2 f)
+{
+	f = f * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+vec3 reconstructPosition(vec2 uv, float depth)
+{
+	// Cleared to the far plane, matches the cleared position of the full layout
+	if (depth >= 1.0) {
+		return vec3(0.0);
+	}
+	vec4 pos = ubo.invViewProjection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	return pos.xyz / pos.w;
+}
+
+vec3 shadeLight(Light light, vec3 fragPos, vec3 N, vec3 V, vec4 albedo)
+{
+	// Vector to light
+	vec3 L = light.position.xyz - fragPos;
+	// Distance from light to fragment position
+	float dist = length(L);
+	if (dist > light.position.w) {
+		return vec3(0.0);
+	}
+
+	// Light to fragment
+	L = normalize(L);
+
+	// Attenuation, faded out towards the range of the light so culling doesn't cause visible seams
+	float atten = light.radius / (pow(dist, 2.0) + 1.0);
+	float window = clamp(1.0 - pow(dist / light.position.w, 4.0), 0.0, 1.0);
+	atten *= window * window;
+
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	vec3 diff = light.color * albedo.rgb * NdotL * atten;
+
+	// Specular part
+	// Specular map values are stored in alpha of albedo mrt
+	vec3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	vec3 spec = light.color * albedo.a * pow(NdotR, 16.0) * atten;
+
+	return diff + spec;
+}
+
 void main() 
 {
 	// Get G-Buffer values
-	vec3 fragPos = texture(samplerposition, inUV).rgb;
-	vec3 normal = texture(samplerNormal, inUV).rgb;
+	vec3 fragPos;
+	vec3 normal;
+	if (PACKED_GBUFFER) {
+		fragPos = reconstructPosition(inUV, texture(samplerposition, inUV).r);
+		normal = decodeNormal(texture(samplerNormal, inUV).rg);
+	} else {
+		fragPos = texture(samplerposition, inUV).rgb;
+		normal = texture(samplerNormal, inUV).rgb;
+	}
 	vec4 albedo = texture(samplerAlbedo, inUV);
+
+	// Cluster of the fragment, the slices are distributed exponentially along the view depth
+	float depth = -(ubo.view * vec4(fragPos, 1.0)).z;
+	float zNear = ubo.clusterParams.z;
+	float zFar = ubo.clusterParams.w;
+	uint slice = uint(clamp(log(max(depth, zNear) / zNear) / log(zFar / zNear) * float(CLUSTER_COUNT_Z), 0.0, float(CLUSTER_COUNT_Z - 1)));
+	uvec2 tile = min(uvec2(inUV * vec2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y)), uvec2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1));
+	uint clusterIndex = (slice * CLUSTER_COUNT_Y + tile.y) * CLUSTER_COUNT_X + tile.x;
 	
 	// Debug display
 	if (ubo.displayDebugTarget > 0) {
@@ -43,6 +138,12 @@ void main()
 			case 4: 
 				outFragcolor.rgb = albedo.aaa;
 				break;
+			case 5: {
+				// Heat map of the number of lights in the fragment's cluster (red = full)
+				float load = (ubo.clustered == 1) ? float(clusterLightCounts[clusterIndex]) / float(CLUSTER_MAX_LIGHTS) : 0.0;
+				outFragcolor.rgb = mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), sqrt(load)) * step(0.0001, load);
+				break;
+			}
 		}		
 		outFragcolor.a = 1.0;
 		return;
@@ -50,45 +151,24 @@ void main()
 
 	// Render-target composition
 
-	#define lightCount 6
-	#define ambient 0.0
-	
 	// Ambient part
 	vec3 fragcolor  = albedo.rgb * ambient;
-	
-	for(int i = 0; i < lightCount; ++i)
-	{
-		// Vector to light
-		vec3 L = ubo.lights[i].position.xyz - fragPos;
-		// Distance from light to fragment position
-		float dist = length(L);
-
-		// Viewer to fragment
-		vec3 V = ubo.viewPos.xyz - fragPos;
-		V = normalize(V);
-		
-		//if(dist < ubo.lights[i].radius)
-		{
-			// Light to fragment
-			L = normalize(L);
-
-			// Attenuation
-			float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
-
-			// Diffuse part
-			vec3 N = normalize(normal);
-			float NdotL = max(0.0, dot(N, L));
-			vec3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
-
-			// Specular part
-			// Specular map values are stored in alpha of albedo mrt
-			vec3 R = reflect(-L, N);
-			float NdotR = max(0.0, dot(R, V));
-			vec3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 16.0) * atten;
-
-			fragcolor += diff + spec;	
-		}	
-	}    	
+
+	vec3 N = normalize(normal);
+	// Viewer to fragment
+	vec3 V = normalize(ubo.viewPos.xyz - fragPos);
+
+	if (ubo.clustered == 1) {
+		// Only the lights binned into the fragment's cluster
+		uint count = clusterLightCounts[clusterIndex];
+		for (uint i = 0; i < count; ++i) {
+			fragcolor += shadeLight(lights[clusterLightIndices[clusterIndex * CLUSTER_MAX_LIGHTS + i]], fragPos, N, V, albedo);
+		}
+	} else {
+		for (uint i = 0; i < ubo.lightCount; ++i) {
+			fragcolor += shadeLight(lights[i], fragPos, N, V, albedo);
+		}
+	}
    
   outFragcolor = vec4(fragcolor, 1.0);	
-}
\ No newline at end of file
+}
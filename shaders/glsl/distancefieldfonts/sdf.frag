@@ -15,9 +15,16 @@ layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragColor;
 
+// The atlas stores a multi-channel distance field, the median of the channels gives the signed distance
+float median(float r, float g, float b)
+{
+	return max(min(r, g), min(max(r, g), b));
+}
+
 void main() 
 {
-    float distance = texture(samplerColor, inUV).a;
+    vec3 msd = texture(samplerColor, inUV).rgb;
+    float distance = median(msd.r, msd.g, msd.b);
     float smoothWidth = fwidth(distance);	
     float alpha = smoothstep(0.5 - smoothWidth, 0.5 + smoothWidth, distance);
 	vec3 rgb = vec3(alpha);
@@ -18,6 +18,14 @@ layout (set = 0, binding = 1) buffer LinkedListSBO
     Node nodes[];
 };
 
+layout (set = 0, binding = 5) buffer GeometrySBO
+{
+    uint count;
+    uint maxNodeCount;
+    uint overflow;
+    uint coveredPixels;
+} geometrySBO;
+
 void main()
 {
     Node fragments[MAX_FRAGMENT_COUNT];
@@ -32,6 +40,11 @@ void main()
         ++count;
     }
     
+    if (count > 0)
+    {
+        atomicAdd(geometrySBO.coveredPixels, 1);
+    }
+
     // Do the insertion sort
     for (uint i = 1; i < count; ++i)
     {
@@ -0,0 +1,56 @@
+#version 450
+
+#define KBUFFER_SIZE 8
+#define EMPTY 0xffffffff
+
+layout (location = 0) out vec4 outFragColor;
+
+layout (set = 0, binding = 2) uniform sampler2D samplerAccum;
+layout (set = 0, binding = 3) uniform sampler2D samplerRevealage;
+
+layout (set = 0, binding = 4, r32ui) uniform readonly uimage2DArray kBufferImage;
+
+layout (set = 0, binding = 5) buffer GeometrySBO
+{
+    uint count;
+    uint maxNodeCount;
+    uint overflow;
+    uint coveredPixels;
+};
+
+layout (set = 0, binding = 6) readonly buffer ObjectColorsSBO
+{
+    vec4 colors[];
+};
+
+void main()
+{
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(samplerAccum, coord, 0);
+    float revealage = texelFetch(samplerRevealage, coord, 0).r;
+    bool covered = revealage < 1.0;
+
+    // Fragments in the tail are behind all fragments in the k-buffer, so they're composited over the background first
+    vec3 background = vec3(0.025);
+    vec3 color = mix(accum.rgb / max(accum.a, 1e-5), background, revealage);
+
+    // Blend the nearest fragments back to front
+    for (int i = KBUFFER_SIZE - 1; i >= 0; i--)
+    {
+        uint key = imageLoad(kBufferImage, ivec3(coord, i)).r;
+        if (key == EMPTY)
+        {
+            continue;
+        }
+        covered = true;
+        vec4 fragment = colors[key & 0xff];
+        color = mix(color, fragment.rgb, fragment.a);
+    }
+
+    if (covered)
+    {
+        atomicAdd(coveredPixels, 1);
+    }
+
+    outFragColor = vec4(color, 1.0);
+}
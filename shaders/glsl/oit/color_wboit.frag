@@ -0,0 +1,31 @@
+#version 450
+
+layout (location = 0) out vec4 outFragColor;
+
+layout (set = 0, binding = 2) uniform sampler2D samplerAccum;
+layout (set = 0, binding = 3) uniform sampler2D samplerRevealage;
+
+layout (set = 0, binding = 5) buffer GeometrySBO
+{
+    uint count;
+    uint maxNodeCount;
+    uint overflow;
+    uint coveredPixels;
+};
+
+void main()
+{
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(samplerAccum, coord, 0);
+    float revealage = texelFetch(samplerRevealage, coord, 0).r;
+
+    if (revealage < 1.0)
+    {
+        atomicAdd(coveredPixels, 1);
+    }
+
+    // Weighted average of the transparent colors composited over the background
+    vec3 background = vec3(0.025);
+    vec3 average = accum.rgb / max(accum.a, 1e-5);
+    outFragColor = vec4(mix(average, background, revealage), 1.0);
+}
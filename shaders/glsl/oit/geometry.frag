@@ -13,6 +13,8 @@ layout (set = 0, binding = 1) buffer GeometrySBO
 {
     uint count;
     uint maxNodeCount;
+    uint overflow;
+    uint coveredPixels;
 };
 
 layout (set = 0, binding = 2, r32ui) uniform coherent uimage2D headIndexImage;
@@ -25,6 +27,7 @@ layout (set = 0, binding = 3) buffer LinkedListSBO
 layout(push_constant) uniform PushConsts {
 	mat4 model;
     vec4 color;
+    uint index;
 } pushConsts;
 
 void main()
@@ -43,4 +46,9 @@ void main()
         nodes[nodeIdx].depth = gl_FragCoord.z;
         nodes[nodeIdx].next = prevHeadIdx;
     }
+    else
+    {
+        // Fragment is dropped
+        atomicAdd(overflow, 1);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+#version 450
+
+layout (early_fragment_tests) in;
+
+#define KBUFFER_SIZE 8
+#define EMPTY 0xffffffff
+
+layout (set = 0, binding = 1) buffer GeometrySBO
+{
+    uint count;
+    uint maxNodeCount;
+    uint overflow;
+    uint coveredPixels;
+};
+
+layout (set = 0, binding = 4, r32ui) uniform coherent uimage2DArray kBufferImage;
+
+layout (set = 0, binding = 5) readonly buffer ObjectColorsSBO
+{
+    vec4 colors[];
+};
+
+layout(push_constant) uniform PushConsts {
+	mat4 model;
+    vec4 color;
+    uint index;
+} pushConsts;
+
+layout (location = 0) out vec4 outAccum;
+layout (location = 1) out float outRevealage;
+
+float weight(float z, float alpha)
+{
+    return clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - z * 0.9, 3.0), 1e-2, 3e3);
+}
+
+void main()
+{
+    // Keys sort by depth (upper 24 bits), the lower 8 bits store the object index to look up the color
+    uint key = (uint(gl_FragCoord.z * 16777215.0) << 8) | (pushConsts.index & 0xff);
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+
+    // Insert into the list of nearest fragments, which is kept sorted front to back without locks:
+    // Each slot keeps the smaller of its key and the incoming one, the larger key moves on to the next slot
+    for (int i = 0; i < KBUFFER_SIZE; i++)
+    {
+        uint prevKey = imageAtomicMin(kBufferImage, ivec3(coord, i), key);
+        if (prevKey == EMPTY)
+        {
+            // Stored in a free slot, nothing to blend
+            discard;
+        }
+        key = max(key, prevKey);
+    }
+
+    // The farthest fragment didn't fit and is blended into the tail with weighted blending
+    atomicAdd(overflow, 1);
+    vec4 color = colors[key & 0xff];
+    float z = float(key >> 8) / 16777215.0;
+    outAccum = vec4(color.rgb * color.a, color.a) * weight(z, color.a);
+    outRevealage = color.a;
+}
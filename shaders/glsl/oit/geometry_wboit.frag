@@ -0,0 +1,27 @@
+#version 450
+
+layout (early_fragment_tests) in;
+
+layout(push_constant) uniform PushConsts {
+	mat4 model;
+    vec4 color;
+    uint index;
+} pushConsts;
+
+layout (location = 0) out vec4 outAccum;
+layout (location = 1) out float outRevealage;
+
+// Depth based weight from "Weighted Blended Order-Independent Transparency" (McGuire and Bavoil), nearer and more opaque fragments get larger weights
+float weight(float z, float alpha)
+{
+    return clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - z * 0.9, 3.0), 1e-2, 3e3);
+}
+
+void main()
+{
+    vec4 color = pushConsts.color;
+    // Accumulated with additive blending
+    outAccum = vec4(color.rgb * color.a, color.a) * weight(gl_FragCoord.z, color.a);
+    // The render target is multiplied by (1 - alpha)
+    outRevealage = color.a;
+}
@@ -1,7 +1,8 @@
 #version 450
 
-layout (location = 0) in vec4 inPos;
-layout (location = 1) in vec4 inColor;
+layout (location = 0) in vec3 inPos;
+// Particles are tinted grey
+layout (location = 1) in float inColor;
 layout (location = 2) in float inAlpha;
 layout (location = 3) in float inSize;
 layout (location = 4) in float inRotation;
@@ -22,7 +23,7 @@ layout (binding = 0) uniform UBO
 
 void main () 
 {
-	outColor = inColor;
+	outColor = vec4(inColor);
 	outAlpha = inAlpha;
 	outType = inType;
 	outRotation = inRotation;
@@ -22,7 +22,7 @@ Triangle unpackTriangle(uint index, int vertexSize) {
 	Triangle tri;
 	const uint triIndex = index * 3;
 
-	GeometryNode geometryNode = geometryNodes.nodes[gl_GeometryIndexEXT];
+	GeometryNode geometryNode = geometryNodes.nodes[gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT];
 
 	Indices indices   = Indices(geometryNode.indexBufferDeviceAddress);
 	Vertices vertices = Vertices(geometryNode.vertexBufferDeviceAddress);
@@ -0,0 +1,51 @@
+#version 450
+
+#extension GL_ARB_shader_viewport_layer_array : enable
+
+layout (location = 0) in vec3 inPos;
+
+layout (location = 0) out vec4 outPos;
+layout (location = 1) out vec3 outLightPos;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view; 
+	mat4 model;
+	vec4 lightPos;
+	mat4 faceViews[6];
+} ubo;
+
+layout(push_constant) uniform PushConsts 
+{
+	mat4 view;
+	// Faces the current caster is visible in, one instance is drawn per face
+	uint faceMask;
+} pushConsts;
+ 
+out gl_PerVertex 
+{
+	vec4 gl_Position;
+};
+ 
+void main()
+{
+	// The face for this instance is the n-th set bit of the face mask
+	uint face = 0;
+	uint instance = gl_InstanceIndex;
+	for (uint i = 0; i < 6; i++) {
+		if ((pushConsts.faceMask & (1u << i)) != 0u) {
+			if (instance == 0) {
+				face = i;
+				break;
+			}
+			instance--;
+		}
+	}
+
+	gl_Layer = int(face);
+	gl_Position = ubo.projection * ubo.faceViews[face] * ubo.model * vec4(inPos, 1.0);
+
+	outPos = vec4(inPos, 1.0);	
+	outLightPos = ubo.lightPos.xyz; 
+}
@@ -0,0 +1,42 @@
+#version 450
+
+#extension GL_EXT_multiview : enable
+
+layout (location = 0) in vec3 inPos;
+
+layout (location = 0) out vec4 outPos;
+layout (location = 1) out vec3 outLightPos;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view; 
+	mat4 model;
+	vec4 lightPos;
+	mat4 faceViews[6];
+} ubo;
+
+layout(push_constant) uniform PushConsts 
+{
+	mat4 view;
+	// Faces the current caster is visible in
+	uint faceMask;
+} pushConsts;
+ 
+out gl_PerVertex 
+{
+	vec4 gl_Position;
+};
+ 
+void main()
+{
+	// Each draw is broadcast to all faces, so casters outside of the current face's frustum are moved outside of the clip volume
+	if ((pushConsts.faceMask & (1u << gl_ViewIndex)) == 0u) {
+		gl_Position = vec4(0.0, 0.0, -2.0, 1.0);
+	} else {
+		gl_Position = ubo.projection * ubo.faceViews[gl_ViewIndex] * ubo.model * vec4(inPos, 1.0);
+	}
+
+	outPos = vec4(inPos, 1.0);	
+	outLightPos = ubo.lightPos.xyz; 
+}
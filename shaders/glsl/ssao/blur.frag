@@ -1,6 +1,7 @@
 #version 450
 
 layout (binding = 0) uniform sampler2D samplerSSAO;
+layout (binding = 1) uniform sampler2D samplerPositionDepth;
 
 layout (location = 0) in vec2 inUV;
 
@@ -8,18 +9,27 @@ layout (location = 0) out float outFragColor;
 
 void main() 
 {
+	// Blurs the occlusion and upsamples it to the G-Buffer resolution
+	// Samples are weighted by the difference between their depth and the depth of this pixel, so occlusion doesn't bleed across edges
 	const int blurRange = 2;
-	int n = 0;
+	const float depthSharpness = 32.0;
 	vec2 texelSize = 1.0 / vec2(textureSize(samplerSSAO, 0));
+	// Center of the SSAO texel covering this pixel
+	vec2 baseUV = (floor(inUV / texelSize) + 0.5) * texelSize;
+	float depth = texture(samplerPositionDepth, inUV).w;
 	float result = 0.0;
+	float weightSum = 0.0;
 	for (int x = -blurRange; x <= blurRange; x++) 
 	{
 		for (int y = -blurRange; y <= blurRange; y++) 
 		{
-			vec2 offset = vec2(float(x), float(y)) * texelSize;
-			result += texture(samplerSSAO, inUV + offset).r;
-			n++;
+			vec2 uv = baseUV + vec2(float(x), float(y)) * texelSize;
+			// Depth at the position the occlusion of this texel was calculated for
+			float sampleDepth = texture(samplerPositionDepth, uv).w;
+			float weight = exp(-depthSharpness * abs(depth - sampleDepth) / max(depth, 1e-3)) + 1e-4;
+			result += texture(samplerSSAO, uv).r * weight;
+			weightSum += weight;
 		}
 	}
-	outFragColor = result / (float(n));
-}
\ No newline at end of file
+	outFragColor = result / weightSum;
+}
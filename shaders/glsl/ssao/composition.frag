@@ -7,7 +7,7 @@ layout (binding = 3) uniform sampler2D samplerSSAO;
 layout (binding = 4) uniform sampler2D samplerSSAOBlur;
 layout (binding = 5) uniform UBO 
 {
-	mat4 _dummy;
+	mat4 _dummy[2];
 	int ssao;
 	int ssaoOnly;
 	int ssaoBlur;
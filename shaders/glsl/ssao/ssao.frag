@@ -15,6 +15,14 @@ layout (binding = 3) uniform UBOSSAOKernel
 layout (binding = 4) uniform UBO 
 {
 	mat4 projection;
+	mat4 reprojection;
+	int ssao;
+	int ssaoOnly;
+	int ssaoBlur;
+	int kernelOffset;
+	int sampleCount;
+	float noiseRotation;
+	float temporalWeight;
 } ubo;
 
 layout (location = 0) in vec2 inUV;
@@ -28,10 +36,13 @@ void main()
 	vec3 normal = normalize(texture(samplerNormal, inUV).rgb * 2.0 - 1.0);
 
 	// Get a random vector using a noise lookup
-	ivec2 texDim = textureSize(samplerPositionDepth, 0); 
+	// The noise is tiled over the pixels of the SSAO target, which may be smaller than the G-Buffer
 	ivec2 noiseDim = textureSize(ssaoNoise, 0);
-	const vec2 noiseUV = vec2(float(texDim.x)/float(noiseDim.x), float(texDim.y)/(noiseDim.y)) * inUV;  
-	vec3 randomVec = texture(ssaoNoise, noiseUV).xyz * 2.0 - 1.0;
+	vec3 randomVec = texelFetch(ssaoNoise, ivec2(gl_FragCoord.xy) % noiseDim, 0).xyz * 2.0 - 1.0;
+	// Rotate the noise, changes with each frame with temporal accumulation
+	float s = sin(ubo.noiseRotation);
+	float c = cos(ubo.noiseRotation);
+	randomVec.xy = vec2(c * randomVec.x - s * randomVec.y, s * randomVec.x + c * randomVec.y);
 	
 	// Create TBN matrix
 	vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
@@ -42,9 +53,10 @@ void main()
 	float occlusion = 0.0f;
 	// remove banding
 	const float bias = 0.025f;
-	for(int i = 0; i < SSAO_KERNEL_SIZE; i++)
+	// Only a part of the kernel is evaluated with temporal accumulation
+	for(int i = 0; i < ubo.sampleCount; i++)
 	{		
-		vec3 samplePos = TBN * uboSSAOKernel.samples[i].xyz; 
+		vec3 samplePos = TBN * uboSSAOKernel.samples[ubo.kernelOffset + i].xyz; 
 		samplePos = fragPos + samplePos * SSAO_RADIUS; 
 		
 		// project
@@ -58,7 +70,7 @@ void main()
 		float rangeCheck = smoothstep(0.0f, 1.0f, SSAO_RADIUS / abs(fragPos.z - sampleDepth));
 		occlusion += (sampleDepth >= samplePos.z + bias ? 1.0f : 0.0f) * rangeCheck;           
 	}
-	occlusion = 1.0 - (occlusion / float(SSAO_KERNEL_SIZE));
+	occlusion = 1.0 - (occlusion / float(ubo.sampleCount));
 	
 	outFragColor = occlusion;
 }
@@ -0,0 +1,40 @@
+#version 450
+
+layout (binding = 0) uniform sampler2D samplerSSAO;
+layout (binding = 1) uniform sampler2D samplerHistory;
+layout (binding = 2) uniform sampler2D samplerPositionDepth;
+layout (binding = 3) uniform UBO 
+{
+	mat4 projection;
+	mat4 reprojection;
+	int ssao;
+	int ssaoOnly;
+	int ssaoBlur;
+	int kernelOffset;
+	int sampleCount;
+	float noiseRotation;
+	float temporalWeight;
+} ubo;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec2 outFragColor;
+
+void main() 
+{
+	float occlusion = texture(samplerSSAO, inUV).r;
+	vec4 positionDepth = texture(samplerPositionDepth, inUV);
+
+	// Find this pixel in the previous frame
+	vec4 prevPos = ubo.reprojection * vec4(positionDepth.xyz, 1.0);
+	vec2 prevUV = prevPos.xy / prevPos.w * 0.5 + 0.5;
+	// r = accumulated occlusion, g = linear depth
+	vec2 history = texture(samplerHistory, prevUV).rg;
+
+	// Discard the history if the pixel was off screen or covered by a different surface in the previous frame
+	bool onScreen = all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0)));
+	bool sameSurface = abs(history.g - prevPos.w) < 0.05 * prevPos.w;
+	float weight = (onScreen && sameSurface) ? ubo.temporalWeight : 1.0;
+
+	outFragColor = vec2(mix(history.r, occlusion, weight), positionDepth.w);
+}
@@ -1,6 +1,5 @@
 #version 450
 
-layout (set = 0, binding = 1) uniform sampler2D samplerHeight; 
 layout (set = 0, binding = 2) uniform sampler2DArray samplerLayers;
 
 layout (location = 0) in vec3 inNormal;
@@ -9,6 +8,7 @@ layout (location = 2) in vec3 inViewVec;
 layout (location = 3) in vec3 inLightVec;
 layout (location = 4) in vec3 inEyePos;
 layout (location = 5) in vec3 inWorldPos;
+layout (location = 6) in float inHeight;
 
 layout (location = 0) out vec4 outFragColor;
 
@@ -25,8 +25,8 @@ vec3 sampleTerrainLayer()
 
 	vec3 color = vec3(0.0);
 	
-	// Get height from displacement map
-	float height = textureLod(samplerHeight, inUV, 0.0).r * 255.0;
+	// Height is interpolated from the terrain tile the fragment belongs to
+	float height = inHeight * 255.0;
 	
 	for (int i = 0; i < 6; i++)
 	{
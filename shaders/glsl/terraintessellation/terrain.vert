@@ -1,15 +1,44 @@
 #version 450
 
-layout (location = 0) in vec3 inPos;
-layout (location = 1) in vec3 inNormal;
-layout (location = 2) in vec2 inUV;
+// Number of patches along each edge of a terrain chunk (must match TERRAIN_CHUNK_GRID in the example)
+#define CHUNK_GRID 16.0
 
-layout (location = 0) out vec3 outNormal;
-layout (location = 1) out vec2 outUV;
+layout(set = 0, binding = 0) uniform UBO
+{
+	mat4 projection;
+	mat4 modelview;
+	vec4 lightPos;
+	vec4 cameraPos;
+	vec4 frustumPlanes[6];
+	float displacementFactor;
+	float tessellationFactor;
+	vec2 viewportDim;
+	float tessellatedEdgeSize;
+	float terrainSize;
+} ubo;
+
+// Position within the chunk grid in [0..1]
+layout (location = 0) in vec2 inGridPos;
+// Per chunk instance data
+// xy = world space origin, z = size
+layout (location = 1) in vec4 inRect;
+// x = tile layer, y = parent tile layer, zw = offset of the chunk within the parent tile
+layout (location = 2) in vec4 inTile;
+// x = morph start distance, y = morph end distance
+layout (location = 3) in vec4 inMorph;
+
+layout (location = 0) out vec2 outLocal;
+layout (location = 1) out vec4 outTile;
+layout (location = 2) out vec4 outMorph;
 
 void main(void)
 {
-	gl_Position = vec4(inPos.xyz, 1.0);
-	outUV = inUV;
-	outNormal = inNormal;
-}
\ No newline at end of file
+	// Geomorphing: Odd grid vertices move onto the grid of the next coarser level towards the end of the chunk's distance range
+	vec2 worldPos = inRect.xy + inGridPos * inRect.z;
+	float morph = clamp((distance(ubo.cameraPos.xyz, vec3(worldPos.x, 0.0, worldPos.y)) - inMorph.x) / (inMorph.y - inMorph.x), 0.0, 1.0);
+	vec2 local = inGridPos - fract(inGridPos * CHUNK_GRID * 0.5) * 2.0 / CHUNK_GRID * morph;
+	gl_Position = vec4(inRect.x + local.x * inRect.z, 0.0, inRect.y + local.y * inRect.z, 1.0);
+	outLocal = local;
+	outTile = inTile;
+	outMorph = inMorph;
+}
@@ -1,9 +1,28 @@
 #version 450 core
 
+// Per-instance glyph data
 layout (location = 0) in vec2 inPos;
-layout (location = 1) in vec2 inUV;
+layout (location = 1) in uint inGlyph;
+layout (location = 2) in vec4 inColor;
+
+struct Glyph {
+	// Quad corners relative to the pen position in font pixels
+	vec4 rect;
+	// Texture coordinates of the quad corners in the font atlas
+	vec4 uv;
+};
+
+layout (binding = 1) readonly buffer GlyphMetrics {
+	Glyph glyphs[];
+};
+
+layout (push_constant) uniform PushConsts {
+	vec2 invViewportSize;
+	float scale;
+} pushConsts;
 
 layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 outColor;
 
 out gl_PerVertex 
 {
@@ -12,6 +31,11 @@ out gl_PerVertex
 
 void main(void)
 {
-	gl_Position = vec4(inPos, 0.0, 1.0);
-	outUV = inUV;
+	// One instance per glyph, the quad corner is derived from the vertex index of the triangle strip
+	vec2 corner = vec2(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1);
+	Glyph glyph = glyphs[inGlyph];
+	vec2 pos = inPos + mix(glyph.rect.xy, glyph.rect.zw, corner) * pushConsts.scale;
+	gl_Position = vec4(pos * pushConsts.invViewportSize * 2.0 - 1.0, 0.0, 1.0);
+	outUV = mix(glyph.uv.xy, glyph.uv.zw, corner);
+	outColor = inColor;
 }
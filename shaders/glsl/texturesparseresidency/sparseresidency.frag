@@ -5,27 +5,58 @@
 
 layout (binding = 1) uniform sampler2D samplerColor;
 
+// One flag per page outside the mip tail, set for the pages that are sampled
+layout (binding = 2) buffer Feedback
+{
+	uint requested[];
+} feedback;
+
+layout (binding = 3) uniform PageTable
+{
+	// x = page width, y = page height, z = first mip level in the mip tail, w = mip level count
+	uvec4 info;
+	// x = first page, y = pages per row, z = page rows
+	uvec4 mips[16];
+} pageTable;
+
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in float inLodBias;
 
 layout (location = 0) out vec4 outFragColor;
 
+void requestPage(float lod)
+{
+	// Only every 4th fragment in each direction writes feedback, pages are large enough to always cover some of them
+	if (((uint(gl_FragCoord.x) | uint(gl_FragCoord.y)) & 3u) != 0u) {
+		return;
+	}
+	uint mipLevel = uint(clamp(lod + 0.5, 0.0, float(pageTable.info.w - 1u)));
+	// The mip tail is always resident
+	if (mipLevel >= pageTable.info.z) {
+		return;
+	}
+	uvec2 texel = uvec2(clamp(inUV, 0.0, 1.0) * vec2(textureSize(samplerColor, int(mipLevel))));
+	uvec2 page = min(texel / pageTable.info.xy, pageTable.mips[mipLevel].yz - 1u);
+	feedback.requested[pageTable.mips[mipLevel].x + page.y * pageTable.mips[mipLevel].y + page.x] = 1u;
+}
+
 void main() 
 {
 	vec4 color = vec4(0.0);
 
+	float lod = textureQueryLod(samplerColor, inUV).y + inLodBias;
+	requestPage(lod);
+
 	// Get residency code for current texel
 	int residencyCode = sparseTextureARB(samplerColor, inUV, color, inLodBias);
 
-	// Fetch sparse until we get a valid texel
-	/*
-	float minLod = 1.0;
-	while (!sparseTexelsResidentARB(residencyCode)) 
+	// Fetch sparse from coarser mip levels until we get a valid texel, the mip tail is always resident
+	float minLod = floor(max(lod, 0.0)) + 1.0;
+	while (!sparseTexelsResidentARB(residencyCode) && (minLod < float(pageTable.info.w)))
 	{
-		residencyCode = sparseTextureClampARB(samplerColor, inUV, minLod, color);
-		minLod += 1.0f;
+		residencyCode = sparseTextureClampARB(samplerColor, inUV, minLod, color, inLodBias);
+		minLod += 1.0;
 	}
-	*/
 
 	// Check if texel is resident
 	bool texelResident = sparseTexelsResidentARB(residencyCode);
@@ -36,4 +67,4 @@ void main()
 	}
 
 	outFragColor = color;
-}
\ No newline at end of file
+}
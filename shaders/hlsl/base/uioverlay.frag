@@ -5,11 +5,17 @@ SamplerState fontSampler : register(s0);
 
 struct VSOutput
 {
+	float4 Pos : SV_POSITION;
 	[[vk::location(0)]]float2 UV : TEXCOORD0;
 	[[vk::location(1)]]float4 Color : COLOR0;
+	[[vk::location(2)]]nointerpolation float4 ClipRect : TEXCOORD1;
 };
 
 float4 main(VSOutput input) : SV_TARGET
 {
+	// Clip rectangle as min/max in framebuffer coordinates
+	if (any(input.Pos.xy < input.ClipRect.xy) || any(input.Pos.xy >= input.ClipRect.zw)) {
+		discard;
+	}
 	return input.Color * fontTexture.Sample(fontSampler, input.UV);
 }
\ No newline at end of file
@@ -5,6 +5,7 @@ struct VSInput
 	[[vk::location(0)]]float2 Pos : POSITION0;
 	[[vk::location(1)]]float2 UV : TEXCOORD0;
 	[[vk::location(2)]]float4 Color : COLOR0;
+	[[vk::location(3)]]float4 ClipRect : TEXCOORD1;
 };
 
 struct VSOutput
@@ -12,6 +13,7 @@ struct VSOutput
 	float4 Pos : SV_POSITION;
 	[[vk::location(0)]]float2 UV : TEXCOORD0;
 	[[vk::location(1)]]float4 Color : COLOR0;
+	[[vk::location(2)]]nointerpolation float4 ClipRect : TEXCOORD1;
 };
 
 struct PushConstants
@@ -29,5 +31,6 @@ VSOutput main(VSInput input)
 	output.Pos = float4(input.Pos * pushConstants.scale + pushConstants.translate, 0.0, 1.0);
 	output.UV = input.UV;
 	output.Color = input.Color;
+	output.ClipRect = input.ClipRect;
 	return output;
 }
\ No newline at end of file
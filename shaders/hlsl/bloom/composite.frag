@@ -0,0 +1,15 @@
+// Copyright 2024 Sascha Willems
+
+Texture2D textureBloom : register(t1);
+SamplerState samplerBloom : register(s1);
+
+cbuffer UBO : register(b0)
+{
+	float blurScale;
+	float blurStrength;
+};
+
+float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
+{
+	return float4(textureBloom.Sample(samplerBloom, inUV).rgb * blurStrength, 1.0);
+}
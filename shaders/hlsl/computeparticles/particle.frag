@@ -18,5 +18,7 @@ float4 main (VSOutput input) : SV_TARGET
 {
 	float3 color = textureGradientRamp.Sample(samplerGradientRamp, float2(input.GradientPos, 0.0)).rgb;
 	float2 PointCoord = (input.Pos.xy - input.CenterPos.xy) / input.PointSize + 0.5;
-	return float4(textureColorMap.Sample(samplerColorMap, PointCoord).rgb * color, 1.0);
+	float3 particle = textureColorMap.Sample(samplerColorMap, PointCoord).rgb;
+	// Opacity for alpha blending, ignored with additive blending
+	return float4(particle * color, dot(particle, float3(0.299, 0.587, 0.114)));
 }
@@ -16,12 +16,14 @@ struct VSOutput
 [[vk::location(3)]] float PointSize : TEXCOORD0;
 };
 
-struct PushConsts
+struct UBO
 {
+  float4x4 projection;
+  float4x4 view;
   float2 screendim;
 };
 
-[[vk::push_constant]] PushConsts pushConstants;
+cbuffer ubo : register(b2) { UBO ubo; }
 
 VSOutput main (VSInput input)
 {
@@ -29,7 +31,8 @@ VSOutput main (VSInput input)
   output.PSize = output.PointSize = 8.0;
   output.Color = float4(0.035, 0.035, 0.035, 0.035);
   output.GradientPos = input.GradientPos.x;
-  output.Pos = float4(input.Pos.xy, 1.0, 1.0);
-	output.CenterPos = ((output.Pos.xy / output.Pos.w) + 1.0) * 0.5 * pushConstants.screendim;
+  // The z position of the particle is stored in the gradient position
+  output.Pos = mul(ubo.projection, mul(ubo.view, float4(input.Pos.xy, input.GradientPos.y, 1.0)));
+	output.CenterPos = ((output.Pos.xy / output.Pos.w) + 1.0) * 0.5 * ubo.screendim;
   return output;
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 // Copyright 2020 Google LLC
 
+// Depth with the packed G-Buffer layout
 Texture2D textureposition : register(t1);
 SamplerState samplerposition : register(s1);
 Texture2D textureNormal : register(t2);
@@ -7,6 +8,12 @@ SamplerState samplerNormal : register(s2);
 Texture2D textureAlbedo : register(t3);
 SamplerState samplerAlbedo : register(s3);
 
+// Must match the defines in deferred.cpp
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define CLUSTER_MAX_LIGHTS 512
+
 struct Light {
 	float4 position;
 	float3 color;
@@ -15,21 +22,100 @@ struct Light {
 
 struct UBO
 {
-	Light lights[6];
+	float4x4 view;
+	float4x4 invViewProjection;
 	float4 viewPos;
+	// x = projection[0][0], y = projection[1][1], z = near plane, w = far plane
+	float4 clusterParams;
 	int displayDebugTarget;
+	uint lightCount;
+	uint clustered;
 };
 
 cbuffer ubo : register(b4) { UBO ubo; }
 
+StructuredBuffer<Light> lights : register(t5);
+StructuredBuffer<uint> clusterLightCounts : register(t6);
+StructuredBuffer<uint> clusterLightIndices : register(t7);
+
+// The packed G-Buffer layout reconstructs the position from depth and stores octahedral encoded normals
+[[vk::constant_id(0)]] const bool PACKED_GBUFFER = false;
+
+#define ambient 0.0
+
+float3 decodeNormal(float2 f)
+{
+	f = f * 2.0 - 1.0;
+	float3 n = float3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+float3 reconstructPosition(float2 uv, float depth)
+{
+	// Cleared to the far plane, matches the cleared position of the full layout
+	if (depth >= 1.0) {
+		return float3(0.0, 0.0, 0.0);
+	}
+	float4 pos = mul(ubo.invViewProjection, float4(uv * 2.0 - 1.0, depth, 1.0));
+	return pos.xyz / pos.w;
+}
+
+float3 shadeLight(Light light, float3 fragPos, float3 N, float3 V, float4 albedo)
+{
+	// Vector to light
+	float3 L = light.position.xyz - fragPos;
+	// Distance from light to fragment position
+	float dist = length(L);
+	if (dist > light.position.w) {
+		return float3(0.0, 0.0, 0.0);
+	}
+
+	// Light to fragment
+	L = normalize(L);
+
+	// Attenuation, faded out towards the range of the light so culling doesn't cause visible seams
+	float atten = light.radius / (pow(dist, 2.0) + 1.0);
+	float window = clamp(1.0 - pow(dist / light.position.w, 4.0), 0.0, 1.0);
+	atten *= window * window;
+
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	float3 diff = light.color * albedo.rgb * NdotL * atten;
+
+	// Specular part
+	// Specular map values are stored in alpha of albedo mrt
+	float3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	float3 spec = light.color * albedo.a * pow(NdotR, 16.0) * atten;
+
+	return diff + spec;
+}
 
 float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
 {
 	// Get G-Buffer values
-	float3 fragPos = textureposition.Sample(samplerposition, inUV).rgb;
-	float3 normal = textureNormal.Sample(samplerNormal, inUV).rgb;
+	float3 fragPos;
+	float3 normal;
+	if (PACKED_GBUFFER) {
+		fragPos = reconstructPosition(inUV, textureposition.Sample(samplerposition, inUV).r);
+		normal = decodeNormal(textureNormal.Sample(samplerNormal, inUV).rg);
+	} else {
+		fragPos = textureposition.Sample(samplerposition, inUV).rgb;
+		normal = textureNormal.Sample(samplerNormal, inUV).rgb;
+	}
 	float4 albedo = textureAlbedo.Sample(samplerAlbedo, inUV);
 
+	// Cluster of the fragment, the slices are distributed exponentially along the view depth
+	float depth = -mul(ubo.view, float4(fragPos, 1.0)).z;
+	float zNear = ubo.clusterParams.z;
+	float zFar = ubo.clusterParams.w;
+	uint slice = uint(clamp(log(max(depth, zNear) / zNear) / log(zFar / zNear) * float(CLUSTER_COUNT_Z), 0.0, float(CLUSTER_COUNT_Z - 1)));
+	uint2 tile = min(uint2(inUV * float2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y)), uint2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1));
+	uint clusterIndex = (slice * CLUSTER_COUNT_Y + tile.y) * CLUSTER_COUNT_X + tile.x;
+
 	float3 fragcolor;
 
 	// Debug display
@@ -47,49 +133,34 @@ float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
 			case 4: 
 				fragcolor.rgb = albedo.aaa;
 				break;
+			case 5: {
+				// Heat map of the number of lights in the fragment's cluster (red = full)
+				float load = (ubo.clustered == 1) ? float(clusterLightCounts[clusterIndex]) / float(CLUSTER_MAX_LIGHTS) : 0.0;
+				fragcolor.rgb = lerp(float3(0.0, 0.0, 1.0), float3(1.0, 0.0, 0.0), sqrt(load)) * step(0.0001, load);
+				break;
+			}
 		}		
 		return float4(fragcolor, 1.0);
 	}
 
-	#define lightCount 6
-	#define ambient 0.0
-
 	// Ambient part
 	fragcolor = albedo.rgb * ambient;
 
-	for(int i = 0; i < lightCount; ++i)
-	{
-		// Vector to light
-		float3 L = ubo.lights[i].position.xyz - fragPos;
-		// Distance from light to fragment position
-		float dist = length(L);
-
-		// Viewer to fragment
-		float3 V = ubo.viewPos.xyz - fragPos;
-		V = normalize(V);
-
-		//if(dist < ubo.lights[i].radius)
-		{
-			// Light to fragment
-			L = normalize(L);
-
-			// Attenuation
-			float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
-
-			// Diffuse part
-			float3 N = normalize(normal);
-			float NdotL = max(0.0, dot(N, L));
-			float3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
-
-			// Specular part
-			// Specular map values are stored in alpha of albedo mrt
-			float3 R = reflect(-L, N);
-			float NdotR = max(0.0, dot(R, V));
-			float3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 16.0) * atten;
-
-			fragcolor += diff + spec;
+	float3 N = normalize(normal);
+	// Viewer to fragment
+	float3 V = normalize(ubo.viewPos.xyz - fragPos);
+
+	if (ubo.clustered == 1) {
+		// Only the lights binned into the fragment's cluster
+		uint count = clusterLightCounts[clusterIndex];
+		for (uint i = 0; i < count; ++i) {
+			fragcolor += shadeLight(lights[clusterLightIndices[clusterIndex * CLUSTER_MAX_LIGHTS + i]], fragPos, N, V, albedo);
+		}
+	} else {
+		for (uint i = 0; i < ubo.lightCount; ++i) {
+			fragcolor += shadeLight(lights[i], fragPos, N, V, albedo);
 		}
 	}
 
   return float4(fragcolor, 1.0);
-}
\ No newline at end of file
+}
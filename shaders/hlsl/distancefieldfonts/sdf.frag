@@ -15,9 +15,16 @@ struct UBO
 
 cbuffer ubo : register(b0) { UBO ubo; }
 
+// The atlas stores a multi-channel distance field, the median of the channels gives the signed distance
+float median(float r, float g, float b)
+{
+	return max(min(r, g), min(max(r, g), b));
+}
+
 float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
 {
-    float dist = textureColor.Sample(samplerColor, inUV).a;
+    float3 msd = textureColor.Sample(samplerColor, inUV).rgb;
+    float dist = median(msd.r, msd.g, msd.b);
     float smoothWidth = fwidth(dist);
     float alpha = smoothstep(0.5 - smoothWidth, 0.5 + smoothWidth, dist);
 	float3 rgb = alpha.xxx;
@@ -26,6 +26,15 @@ struct Particle
 // Binding 0 : Position storage buffer
 RWStructuredBuffer<Node> nodes : register(u1);
 
+struct GeometrySBO
+{
+    uint count;
+    uint maxNodeCount;
+    uint overflow;
+    uint coveredPixels;
+};
+RWStructuredBuffer<GeometrySBO> geometrySBO : register(u5);
+
 float4 main(VSOutput input) : SV_TARGET
 {
     Node fragments[MAX_FRAGMENT_COUNT];
@@ -40,6 +49,11 @@ float4 main(VSOutput input) : SV_TARGET
         ++count;
     }
     
+    if (count > 0)
+    {
+        InterlockedAdd(geometrySBO[0].coveredPixels, 1);
+    }
+
     // Do the insertion sort
     for (uint i = 1; i < count; ++i)
     {
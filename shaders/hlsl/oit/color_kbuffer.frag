@@ -0,0 +1,59 @@
+// Copyright 2024 Sascha Willems
+
+#define KBUFFER_SIZE 8
+#define EMPTY 0xffffffff
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+};
+
+Texture2D textureAccum : register(t2);
+SamplerState samplerAccum : register(s2);
+Texture2D textureRevealage : register(t3);
+SamplerState samplerRevealage : register(s3);
+
+RWTexture2DArray<uint> kBufferImage : register(u4);
+
+struct GeometrySBO
+{
+	uint count;
+	uint maxNodeCount;
+	uint overflow;
+	uint coveredPixels;
+};
+RWStructuredBuffer<GeometrySBO> geometrySBO : register(u5);
+
+StructuredBuffer<float4> colors : register(t6);
+
+float4 main(VSOutput input) : SV_TARGET
+{
+	int3 coord = int3(input.Pos.xy, 0);
+	float4 accum = textureAccum.Load(coord);
+	float revealage = textureRevealage.Load(coord).r;
+	bool covered = revealage < 1.0;
+
+	// Fragments in the tail are behind all fragments in the k-buffer, so they're composited over the background first
+	float3 background = float3(0.025, 0.025, 0.025);
+	float3 color = lerp(accum.rgb / max(accum.a, 1e-5), background, revealage);
+
+	// Blend the nearest fragments back to front
+	for (int i = KBUFFER_SIZE - 1; i >= 0; i--)
+	{
+		uint key = kBufferImage[uint3(coord.xy, i)];
+		if (key == EMPTY)
+		{
+			continue;
+		}
+		covered = true;
+		float4 fragment = colors[key & 0xff];
+		color = lerp(color, fragment.rgb, fragment.a);
+	}
+
+	if (covered)
+	{
+		InterlockedAdd(geometrySBO[0].coveredPixels, 1);
+	}
+
+	return float4(color, 1.0);
+}
@@ -0,0 +1,37 @@
+// Copyright 2024 Sascha Willems
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+};
+
+Texture2D textureAccum : register(t2);
+SamplerState samplerAccum : register(s2);
+Texture2D textureRevealage : register(t3);
+SamplerState samplerRevealage : register(s3);
+
+struct GeometrySBO
+{
+	uint count;
+	uint maxNodeCount;
+	uint overflow;
+	uint coveredPixels;
+};
+RWStructuredBuffer<GeometrySBO> geometrySBO : register(u5);
+
+float4 main(VSOutput input) : SV_TARGET
+{
+	int3 coord = int3(input.Pos.xy, 0);
+	float4 accum = textureAccum.Load(coord);
+	float revealage = textureRevealage.Load(coord).r;
+
+	if (revealage < 1.0)
+	{
+		InterlockedAdd(geometrySBO[0].coveredPixels, 1);
+	}
+
+	// Weighted average of the transparent colors composited over the background
+	float3 background = float3(0.025, 0.025, 0.025);
+	float3 average = accum.rgb / max(accum.a, 1e-5);
+	return float4(lerp(average, background, revealage), 1.0);
+}
@@ -16,6 +16,8 @@ struct GeometrySBO
 {
     uint count;
     uint maxNodeCount;
+    uint overflow;
+    uint coveredPixels;
 };
 // Binding 0 : Position storage buffer
 RWStructuredBuffer<GeometrySBO> geometrySBO : register(u1);
@@ -27,6 +29,7 @@ RWStructuredBuffer<Node> nodes : register(u3);
 struct PushConsts {
 	float4x4 model;
 	float4 color;
+	uint index;
 };
 [[vk::push_constant]] PushConsts pushConsts;
 
@@ -49,4 +52,9 @@ void main(VSOutput input)
         nodes[nodeIdx].depth = input.Pos.z;
         nodes[nodeIdx].next = prevHeadIdx;
     }
+    else
+    {
+        // Fragment is dropped
+        InterlockedAdd(geometrySBO[0].overflow, 1);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,71 @@
+// Copyright 2024 Sascha Willems
+
+#define KBUFFER_SIZE 8
+#define EMPTY 0xffffffff
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+};
+
+struct GeometrySBO
+{
+	uint count;
+	uint maxNodeCount;
+	uint overflow;
+	uint coveredPixels;
+};
+RWStructuredBuffer<GeometrySBO> geometrySBO : register(u1);
+
+globallycoherent RWTexture2DArray<uint> kBufferImage : register(u4);
+
+StructuredBuffer<float4> colors : register(t5);
+
+struct PushConsts {
+	float4x4 model;
+	float4 color;
+	uint index;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+struct FSOutput
+{
+	float4 Accum : SV_TARGET0;
+	float Revealage : SV_TARGET1;
+};
+
+float weight(float z, float alpha)
+{
+	return clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - z * 0.9, 3.0), 1e-2, 3e3);
+}
+
+[earlydepthstencil]
+FSOutput main(VSOutput input)
+{
+	// Keys sort by depth (upper 24 bits), the lower 8 bits store the object index to look up the color
+	uint key = (uint(input.Pos.z * 16777215.0) << 8) | (pushConsts.index & 0xff);
+	uint2 coord = uint2(input.Pos.xy);
+
+	// Insert into the list of nearest fragments, which is kept sorted front to back without locks:
+	// Each slot keeps the smaller of its key and the incoming one, the larger key moves on to the next slot
+	for (uint i = 0; i < KBUFFER_SIZE; i++)
+	{
+		uint prevKey;
+		InterlockedMin(kBufferImage[uint3(coord, i)], key, prevKey);
+		if (prevKey == EMPTY)
+		{
+			// Stored in a free slot, nothing to blend
+			discard;
+		}
+		key = max(key, prevKey);
+	}
+
+	// The farthest fragment didn't fit and is blended into the tail with weighted blending
+	InterlockedAdd(geometrySBO[0].overflow, 1);
+	float4 color = colors[key & 0xff];
+	float z = float(key >> 8) / 16777215.0;
+	FSOutput output;
+	output.Accum = float4(color.rgb * color.a, color.a) * weight(z, color.a);
+	output.Revealage = color.a;
+	return output;
+}
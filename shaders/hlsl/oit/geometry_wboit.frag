@@ -0,0 +1,37 @@
+// Copyright 2024 Sascha Willems
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+};
+
+struct PushConsts {
+	float4x4 model;
+	float4 color;
+	uint index;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+struct FSOutput
+{
+	float4 Accum : SV_TARGET0;
+	float Revealage : SV_TARGET1;
+};
+
+// Depth based weight from "Weighted Blended Order-Independent Transparency" (McGuire and Bavoil), nearer and more opaque fragments get larger weights
+float weight(float z, float alpha)
+{
+	return clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - z * 0.9, 3.0), 1e-2, 3e3);
+}
+
+[earlydepthstencil]
+FSOutput main(VSOutput input)
+{
+	FSOutput output;
+	float4 color = pushConsts.color;
+	// Accumulated with additive blending
+	output.Accum = float4(color.rgb * color.a, color.a) * weight(input.Pos.z, color.a);
+	// The render target is multiplied by (1 - alpha)
+	output.Revealage = color.a;
+	return output;
+}
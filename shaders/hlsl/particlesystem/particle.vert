@@ -2,8 +2,9 @@
 
 struct VSInput
 {
-[[vk::location(0)]] float4 Pos : POSITION0;
-[[vk::location(1)]] float4 Color : COLOR0;
+[[vk::location(0)]] float3 Pos : POSITION0;
+// Particles are tinted grey
+[[vk::location(1)]] float Color : COLOR0;
 [[vk::location(2)]] float Alpha : TEXCOORD0;
 [[vk::location(3)]] float Size : TEXCOORD1;
 [[vk::location(4)]] float Rotation : TEXCOORD2;
@@ -35,7 +36,7 @@ cbuffer ubo : register(b0) { UBO ubo; }
 VSOutput main (VSInput input)
 {
 	VSOutput output = (VSOutput)0;
-	output.Color = input.Color;
+	output.Color = input.Color.xxxx;
 	output.Alpha = input.Alpha;
 	output.Type = input.Type;
 	output.Rotation = input.Rotation;
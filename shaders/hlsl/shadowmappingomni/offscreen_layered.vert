@@ -0,0 +1,52 @@
+// Copyright 2024 Sascha Willems
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+[[vk::location(0)]] float4 WorldPos : POSITION0;
+[[vk::location(1)]] float3 LightPos : POSITION1;
+	uint Layer : SV_RenderTargetArrayIndex;
+};
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float4x4 model;
+	float4 lightPos;
+	float4x4 faceViews[6];
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+struct PushConsts
+{
+	float4x4 view;
+	// Faces the current caster is visible in, one instance is drawn per face
+	uint faceMask;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+VSOutput main([[vk::location(0)]] float3 Pos : POSITION0, uint InstanceIndex : SV_InstanceID)
+{
+	VSOutput output = (VSOutput)0;
+	// The face for this instance is the n-th set bit of the face mask
+	uint face = 0;
+	uint instance = InstanceIndex;
+	for (uint i = 0; i < 6; i++) {
+		if ((pushConsts.faceMask & (1u << i)) != 0u) {
+			if (instance == 0) {
+				face = i;
+				break;
+			}
+			instance--;
+		}
+	}
+
+	output.Layer = face;
+	output.Pos = mul(ubo.projection, mul(ubo.faceViews[face], mul(ubo.model, float4(Pos, 1.0))));
+
+	output.WorldPos = float4(Pos, 1.0);
+	output.LightPos = ubo.lightPos.xyz;
+	return output;
+}
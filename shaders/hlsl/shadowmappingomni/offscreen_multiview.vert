@@ -0,0 +1,42 @@
+// Copyright 2024 Sascha Willems
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+[[vk::location(0)]] float4 WorldPos : POSITION0;
+[[vk::location(1)]] float3 LightPos : POSITION1;
+};
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float4x4 model;
+	float4 lightPos;
+	float4x4 faceViews[6];
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+struct PushConsts
+{
+	float4x4 view;
+	// Faces the current caster is visible in
+	uint faceMask;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+VSOutput main([[vk::location(0)]] float3 Pos : POSITION0, uint ViewIndex : SV_ViewID)
+{
+	VSOutput output = (VSOutput)0;
+	// Each draw is broadcast to all faces, so casters outside of the current face's frustum are moved outside of the clip volume
+	if ((pushConsts.faceMask & (1u << ViewIndex)) == 0u) {
+		output.Pos = float4(0.0, 0.0, -2.0, 1.0);
+	} else {
+		output.Pos = mul(ubo.projection, mul(ubo.faceViews[ViewIndex], mul(ubo.model, float4(Pos, 1.0))));
+	}
+
+	output.WorldPos = float4(Pos, 1.0);
+	output.LightPos = ubo.lightPos.xyz;
+	return output;
+}
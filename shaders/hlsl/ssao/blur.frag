@@ -2,23 +2,34 @@
 
 Texture2D textureSSAO : register(t0);
 SamplerState samplerSSAO : register(s0);
+Texture2D texturePositionDepth : register(t1);
+SamplerState samplerPositionDepth : register(s1);
 
 float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
 {
+	// Blurs the occlusion and upsamples it to the G-Buffer resolution
+	// Samples are weighted by the difference between their depth and the depth of this pixel, so occlusion doesn't bleed across edges
 	const int blurRange = 2;
-	int n = 0;
+	const float depthSharpness = 32.0;
 	int2 texDim;
 	textureSSAO.GetDimensions(texDim.x, texDim.y);
 	float2 texelSize = 1.0 / (float2)texDim;
+	// Center of the SSAO texel covering this pixel
+	float2 baseUV = (floor(inUV / texelSize) + 0.5) * texelSize;
+	float depth = texturePositionDepth.Sample(samplerPositionDepth, inUV).w;
 	float result = 0.0;
+	float weightSum = 0.0;
 	for (int x = -blurRange; x <= blurRange; x++)
 	{
 		for (int y = -blurRange; y <= blurRange; y++)
 		{
-			float2 offset = float2(float(x), float(y)) * texelSize;
-			result += textureSSAO.Sample(samplerSSAO, inUV + offset).r;
-			n++;
+			float2 uv = baseUV + float2(float(x), float(y)) * texelSize;
+			// Depth at the position the occlusion of this texel was calculated for
+			float sampleDepth = texturePositionDepth.Sample(samplerPositionDepth, uv).w;
+			float weight = exp(-depthSharpness * abs(depth - sampleDepth) / max(depth, 1e-3)) + 1e-4;
+			result += textureSSAO.Sample(samplerSSAO, uv).r * weight;
+			weightSum += weight;
 		}
 	}
-	return result / (float(n));
-}
\ No newline at end of file
+	return result / weightSum;
+}
@@ -12,7 +12,7 @@ Texture2D textureSSAOBlur : register(t4);
 SamplerState samplerSSAOBlur : register(s4);
 struct UBO
 {
-	float4x4 _dummy;
+	float4x4 _dummy[2];
 	int ssao;
 	int ssaoOnly;
 	int ssaoBlur;
@@ -20,22 +20,32 @@ cbuffer uboSSAOKernel : register(b3) { UBOSSAOKernel uboSSAOKernel; };
 struct UBO
 {
 	float4x4 projection;
+	float4x4 reprojection;
+	int ssao;
+	int ssaoOnly;
+	int ssaoBlur;
+	int kernelOffset;
+	int sampleCount;
+	float noiseRotation;
+	float temporalWeight;
 };
 cbuffer ubo : register(b4) { UBO ubo; };
 
-float main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
+float main(float4 fragCoord : SV_POSITION, [[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
 {
 	// Get G-Buffer values
 	float3 fragPos = texturePositionDepth.Sample(samplerPositionDepth, inUV).rgb;
 	float3 normal = normalize(textureNormal.Sample(samplerNormal, inUV).rgb * 2.0 - 1.0);
 
 	// Get a random vector using a noise lookup
-	int2 texDim;
-	texturePositionDepth.GetDimensions(texDim.x, texDim.y);
+	// The noise is tiled over the pixels of the SSAO target, which may be smaller than the G-Buffer
 	int2 noiseDim;
 	ssaoNoiseTexture.GetDimensions(noiseDim.x, noiseDim.y);
-	const float2 noiseUV = float2(float(texDim.x)/float(noiseDim.x), float(texDim.y)/(noiseDim.y)) * inUV;
-	float3 randomVec = ssaoNoiseTexture.Sample(ssaoNoiseSampler, noiseUV).xyz * 2.0 - 1.0;
+	float3 randomVec = ssaoNoiseTexture.Load(int3(int2(fragCoord.xy) % noiseDim, 0)).xyz * 2.0 - 1.0;
+	// Rotate the noise, changes with each frame with temporal accumulation
+	float s = sin(ubo.noiseRotation);
+	float c = cos(ubo.noiseRotation);
+	randomVec.xy = float2(c * randomVec.x - s * randomVec.y, s * randomVec.x + c * randomVec.y);
 
 	// Create TBN matrix
 	float3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
@@ -44,9 +54,10 @@ float main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
 
 	// Calculate occlusion value
 	float occlusion = 0.0f;
-	for(int i = 0; i < SSAO_KERNEL_SIZE; i++)
+	// Only a part of the kernel is evaluated with temporal accumulation
+	for(int i = 0; i < ubo.sampleCount; i++)
 	{
-		float3 samplePos = mul(TBN, uboSSAOKernel.samples[i].xyz);
+		float3 samplePos = mul(TBN, uboSSAOKernel.samples[ubo.kernelOffset + i].xyz);
 		samplePos = fragPos + samplePos * SSAO_RADIUS;
 
 		// project
@@ -60,7 +71,7 @@ float main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
 		float rangeCheck = smoothstep(0.0f, 1.0f, SSAO_RADIUS / abs(fragPos.z - sampleDepth));
 		occlusion += (sampleDepth >= samplePos.z ? 1.0f : 0.0f) * rangeCheck;
 	}
-	occlusion = 1.0 - (occlusion / float(SSAO_KERNEL_SIZE));
+	occlusion = 1.0 - (occlusion / float(ubo.sampleCount));
 
 	return occlusion;
 }
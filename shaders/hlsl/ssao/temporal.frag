@@ -0,0 +1,41 @@
+// Copyright 2024 Sascha Willems
+
+Texture2D textureSSAO : register(t0);
+SamplerState samplerSSAO : register(s0);
+Texture2D textureHistory : register(t1);
+SamplerState samplerHistory : register(s1);
+Texture2D texturePositionDepth : register(t2);
+SamplerState samplerPositionDepth : register(s2);
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 reprojection;
+	int ssao;
+	int ssaoOnly;
+	int ssaoBlur;
+	int kernelOffset;
+	int sampleCount;
+	float noiseRotation;
+	float temporalWeight;
+};
+cbuffer ubo : register(b3) { UBO ubo; };
+
+float2 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
+{
+	float occlusion = textureSSAO.Sample(samplerSSAO, inUV).r;
+	float4 positionDepth = texturePositionDepth.Sample(samplerPositionDepth, inUV);
+
+	// Find this pixel in the previous frame
+	float4 prevPos = mul(ubo.reprojection, float4(positionDepth.xyz, 1.0));
+	float2 prevUV = prevPos.xy / prevPos.w * 0.5 + 0.5;
+	// r = accumulated occlusion, g = linear depth
+	float2 history = textureHistory.Sample(samplerHistory, prevUV).rg;
+
+	// Discard the history if the pixel was off screen or covered by a different surface in the previous frame
+	bool onScreen = all(prevUV >= float2(0.0, 0.0)) && all(prevUV <= float2(1.0, 1.0));
+	bool sameSurface = abs(history.g - prevPos.w) < 0.05 * prevPos.w;
+	float weight = (onScreen && sameSurface) ? ubo.temporalWeight : 1.0;
+
+	return float2(lerp(history.r, occlusion, weight), positionDepth.w);
+}
@@ -1,7 +1,5 @@
 // Copyright 2020 Google LLC
 
-Texture2D textureHeight : register(t1);
-SamplerState samplerHeight : register(s1);
 Texture2DArray textureLayers : register(t2);
 SamplerState samplerLayers : register(s2);
 
@@ -14,9 +12,10 @@ struct DSOutput
 [[vk::location(3)]] float3 LightVec : TEXCOORD2;
 [[vk::location(4)]] float3 EyePos : POSITION1;
 [[vk::location(5)]] float3 WorldPos : POSITION0;
+[[vk::location(6)]] float Height : TEXCOORD3;
 };
 
-float3 sampleTerrainLayer(float2 inUV)
+float3 sampleTerrainLayer(float2 inUV, float inHeight)
 {
 	// Define some layer ranges for sampling depending on terrain height
 	float2 layers[6];
@@ -29,8 +28,8 @@ float3 sampleTerrainLayer(float2 inUV)
 
 	float3 color = float3(0.0, 0.0, 0.0);
 
-	// Get height from displacement map
-	float height = textureHeight.SampleLevel(samplerHeight, inUV, 0.0).r * 255.0;
+	// Height is interpolated from the terrain tile the fragment belongs to
+	float height = inHeight * 255.0;
 
 	for (int i = 0; i < 6; i++)
 	{
@@ -58,7 +57,7 @@ float4 main(DSOutput input) : SV_TARGET
 	float3 ambient = float3(0.5, 0.5, 0.5);
 	float3 diffuse = max(dot(N, L), 0.0) * float3(1.0, 1.0, 1.0);
 
-	float4 color = float4((ambient + diffuse) * sampleTerrainLayer(input.UV), 1.0);
+	float4 color = float4((ambient + diffuse) * sampleTerrainLayer(input.UV, input.Height), 1.0);
 
 	const float4 fogColor = float4(0.47, 0.5, 0.67, 0.0);
 	return lerp(color, fogColor, fog(0.25, input.Pos));
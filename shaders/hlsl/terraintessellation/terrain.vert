@@ -1,24 +1,54 @@
 // Copyright 2020 Google LLC
 
+// Number of patches along each edge of a terrain chunk (must match TERRAIN_CHUNK_GRID in the example)
+#define CHUNK_GRID 16.0
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 modelview;
+	float4 lightPos;
+	float4 cameraPos;
+	float4 frustumPlanes[6];
+	float displacementFactor;
+	float tessellationFactor;
+	float2 viewportDim;
+	float tessellatedEdgeSize;
+	float terrainSize;
+};
+cbuffer ubo : register(b0) { UBO ubo; };
+
 struct VSInput
 {
-[[vk::location(0)]] float3 Pos : POSITION0;
-[[vk::location(1)]] float3 Normal : NORMAL0;
-[[vk::location(2)]] float2 UV : TEXCOORD0;
+// Position within the chunk grid in [0..1]
+[[vk::location(0)]] float2 GridPos : POSITION0;
+// Per chunk instance data
+// xy = world space origin, z = size
+[[vk::location(1)]] float4 Rect : TEXCOORD0;
+// x = tile layer, y = parent tile layer, zw = offset of the chunk within the parent tile
+[[vk::location(2)]] float4 Tile : TEXCOORD1;
+// x = morph start distance, y = morph end distance
+[[vk::location(3)]] float4 Morph : TEXCOORD2;
 };
 
 struct VSOutput
 {
 	float4 Pos : SV_POSITION;
-[[vk::location(0)]] float3 Normal : NORMAL0;
-[[vk::location(1)]] float2 UV : TEXCOORD0;
+[[vk::location(0)]] float2 Local : TEXCOORD0;
+[[vk::location(1)]] float4 Tile : TEXCOORD1;
+[[vk::location(2)]] float4 Morph : TEXCOORD2;
 };
 
 VSOutput main(VSInput input)
 {
 	VSOutput output = (VSOutput)0;
-	output.Pos = float4(input.Pos.xyz, 1.0);
-	output.UV = input.UV;
-	output.Normal = input.Normal;
+	// Geomorphing: Odd grid vertices move onto the grid of the next coarser level towards the end of the chunk's distance range
+	float2 worldPos = input.Rect.xy + input.GridPos * input.Rect.z;
+	float morph = clamp((distance(ubo.cameraPos.xyz, float3(worldPos.x, 0.0, worldPos.y)) - input.Morph.x) / (input.Morph.y - input.Morph.x), 0.0, 1.0);
+	float2 local = input.GridPos - frac(input.GridPos * CHUNK_GRID * 0.5) * 2.0 / CHUNK_GRID * morph;
+	output.Pos = float4(input.Rect.x + local.x * input.Rect.z, 0.0, input.Rect.y + local.y * input.Rect.z, 1.0);
+	output.Local = local;
+	output.Tile = input.Tile;
+	output.Morph = input.Morph;
 	return output;
-}
\ No newline at end of file
+}
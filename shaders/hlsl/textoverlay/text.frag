@@ -3,8 +3,8 @@
 Texture2D textureFont : register(t0);
 SamplerState samplerFont : register(s0);
 
-float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
+float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0, [[vk::location(1)]] float4 inColor : COLOR0) : SV_TARGET
 {
 	float color = textureFont.Sample(samplerFont, inUV).r;
-	return color.xxxx;
+	return inColor * color;
 }
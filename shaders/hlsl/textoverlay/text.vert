@@ -1,21 +1,45 @@
 // Copyright 2020 Google LLC
 
+// Per-instance glyph data
 struct VSInput
 {
 [[vk::location(0)]] float2 Pos : POSITION0;
-[[vk::location(1)]] float2 UV : TEXCOORD0;
+[[vk::location(1)]] uint Glyph : TEXCOORD0;
+[[vk::location(2)]] float4 Color : COLOR0;
 };
 
+struct Glyph
+{
+	// Quad corners relative to the pen position in font pixels
+	float4 rect;
+	// Texture coordinates of the quad corners in the font atlas
+	float4 uv;
+};
+
+StructuredBuffer<Glyph> glyphs : register(t1);
+
+struct PushConsts {
+	float2 invViewportSize;
+	float scale;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
 struct VSOutput
 {
 	float4 Pos : SV_POSITION;
 [[vk::location(0)]] float2 UV : TEXCOORD0;
+[[vk::location(1)]] float4 Color : COLOR0;
 };
 
-VSOutput main(VSInput input)
+VSOutput main(VSInput input, uint VertexIndex : SV_VertexID)
 {
 	VSOutput output = (VSOutput)0;
-	output.Pos = float4(input.Pos, 0.0, 1.0);
-	output.UV = input.UV;
+	// One instance per glyph, the quad corner is derived from the vertex index of the triangle strip
+	float2 corner = float2(VertexIndex & 1, (VertexIndex >> 1) & 1);
+	Glyph glyph = glyphs[input.Glyph];
+	float2 pos = input.Pos + lerp(glyph.rect.xy, glyph.rect.zw, corner) * pushConsts.scale;
+	output.Pos = float4(pos * pushConsts.invViewportSize * 2.0 - 1.0, 0.0, 1.0);
+	output.UV = lerp(glyph.uv.xy, glyph.uv.zw, corner);
+	output.Color = input.Color;
 	return output;
 }
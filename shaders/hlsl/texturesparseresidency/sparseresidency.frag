@@ -3,6 +3,19 @@
 Texture2D textureColor : register(t1);
 SamplerState samplerColor : register(s1);
 
+// One flag per page outside the mip tail, set for the pages that are sampled
+RWStructuredBuffer<uint> feedback : register(u2);
+
+struct PageTable
+{
+	// x = page width, y = page height, z = first mip level in the mip tail, w = mip level count
+	uint4 info;
+	// x = first page, y = pages per row, z = page rows
+	uint4 mips[16];
+};
+
+cbuffer pageTable : register(b3) { PageTable pageTable; }
+
 struct VSOutput
 {
 [[vk::location(0)]] float2 UV : TEXCOORD0;
@@ -12,18 +25,39 @@ struct VSOutput
 [[vk::location(4)]] float3 LightVec : TEXCOORD2;
 };
 
-float4 main(VSOutput input) : SV_TARGET
+void requestPage(float2 uv, float lod, float4 fragCoord)
+{
+	// Only every 4th fragment in each direction writes feedback, pages are large enough to always cover some of them
+	if ((((uint)fragCoord.x | (uint)fragCoord.y) & 3) != 0) {
+		return;
+	}
+	uint mipLevel = (uint)clamp(lod + 0.5, 0.0, (float)(pageTable.info.w - 1));
+	// The mip tail is always resident
+	if (mipLevel >= pageTable.info.z) {
+		return;
+	}
+	uint width, height, levels;
+	textureColor.GetDimensions(mipLevel, width, height, levels);
+	uint2 texel = uint2(saturate(uv) * float2(width, height));
+	uint2 page = min(texel / pageTable.info.xy, pageTable.mips[mipLevel].yz - 1);
+	feedback[pageTable.mips[mipLevel].x + page.y * pageTable.mips[mipLevel].y + page.x] = 1;
+}
+
+float4 main(VSOutput input, float4 fragCoord : SV_Position) : SV_TARGET
 {
 	float4 color = float4(0.0, 0.0, 0.0, 0.0);
 
-	// Fetch sparse until we get a valid texel
+	float lod = textureColor.CalculateLevelOfDetailUnclamped(samplerColor, input.UV) + input.LodBias;
+	requestPage(input.UV, lod, fragCoord);
+
+	// Fetch sparse until we get a valid texel, the mip tail is always resident
 	uint status;
-	float minLod = input.LodBias;
+	float minLod = max(lod, 0.0);
 	do
 	{
 		color = textureColor.SampleLevel(samplerColor, input.UV, minLod, 0, status);
 		minLod += 1.0f;
-	} while(!CheckAccessFullyMapped(status));
+	} while(!CheckAccessFullyMapped(status) && (minLod < (float)pageTable.info.w));
 
 	float3 N = normalize(input.Normal);
 